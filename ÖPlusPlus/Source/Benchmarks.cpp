@@ -0,0 +1,551 @@
+#include "Benchmarks.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "json.hpp"
+
+#include "Lexer.h"
+#include "Parser.h"
+#include "LanguageServer.h"
+#include "ParallelFrontEnd.h"
+
+#include "Interpreter/Functions.h"
+#include "Interpreter/Bytecode/BytecodeInterpreter.h"
+
+namespace Benchmarks {
+
+// A program with the things that take most of the time to lex: comments, indentation, long names and strings
+std::string GenerateLexerBenchmarkSource(int size)
+{
+	std::string source;
+	source.reserve(size + 1024);
+
+	for (int i = 0; source.length() < size; i++)
+	{
+		std::string n = std::to_string(i);
+
+		source += "// Calculates the squared distance between two points, the comment is long like the ones that document a real function\n";
+		source += "/* The points are given as separate coordinates\n   since there are no structs yet */\n";
+		source += "float squared_distance_" + n + "(float first_x, float first_y, float second_x, float second_y)\n{\n";
+		source += "\tfloat delta_x = second_x - first_x\n";
+		source += "\tfloat delta_y = second_y - first_y\n";
+		source += "\tstring message = \"Calculating the distance between the two points, function number " + n + "\"\n";
+		source += "\tint l\xC3\xA4ngd_" + n + " = 1234 + " + n + "\n";
+		source += "\treturn delta_x * delta_x + delta_y * delta_y\n}\n\n";
+	}
+
+	return source;
+}
+
+// Lexes the source over and over, first one character at a time and then with the vectorized scanning
+void RunLexerBenchmark(const std::string& source)
+{
+	for (bool vectorized : { false, true })
+	{
+		int runs = 0;
+		int tokens = 0;
+		double seconds = 0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		while (seconds < 1.0)
+		{
+			Lexer lexer;
+			lexer.m_UseVectorScanning = vectorized;
+
+			std::string error = lexer.CreateTokens(source);
+			if (error != "")
+			{
+				std::cout << "Lexer error: " << error << "\n";
+				return;
+			}
+
+			tokens = (int)lexer.m_Tokens.size();
+			runs++;
+			seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+
+		double megabytes = (double)source.length() * runs / (1024.0 * 1024.0);
+		std::cout << (vectorized ? "Vectorized: " : "Scalar:     ") << megabytes / seconds << " MB/s (" << source.length() << " bytes, " << tokens << " tokens, " << runs << " runs)\n";
+	}
+}
+
+// Half of the lines are in the body of one function and the other half are in the global scope,
+// since long scopes are where the parser used to copy and rescan the most
+static std::string GenerateParserBenchmarkSource(int lines)
+{
+	std::string source = "int work(int n) => {\n";
+
+	for (int i = 0; i * 16 < lines; i++)
+	{
+		std::string n = std::to_string(i);
+
+		source += "\tint a" + n + " = n * 3 + " + n + " - (n / 2);\n";
+		source += "\tif (a" + n + " > " + n + " && n != 0) {\n\t\tn = n + 1;\n\t}\n";
+		source += "\twhile (n > 1000) {\n\t\tn -= 7;\n\t}\n";
+		source += "\tprintf(\"%i\", a" + n + " * 2 + f(n, (a" + n + " + 1)));\n";
+	}
+
+	source += "\treturn n;\n};\n";
+
+	for (int i = 0; i * 14 < lines; i++)
+	{
+		std::string n = std::to_string(i);
+
+		source += "int b" + n + " = work(" + n + ") * 2 - (" + n + " / 3);\n";
+		source += "if (b" + n + " > " + n + ") {\n\tb" + n + " = 1;\n} else {\n\tb" + n + " += 2;\n};\n";
+		source += "printf(\"%i\", b" + n + ");\n";
+	}
+
+	return source;
+}
+
+// A single call with a long argument list, every argument has operators that have to be checked for being inside the brackets
+static std::string GenerateLongCallBenchmarkSource(int arguments)
+{
+	std::string source = "int a = 1;\nprintf(\"%i\"";
+
+	for (int i = 0; i < arguments; i++)
+		source += ", a * " + std::to_string(i) + " + 1";
+
+	source += ");\n";
+
+	return source;
+}
+
+// Prints the time it takes to lex and parse the source, and the time per unit of count
+bool TimeParsing(const std::string& source, int count, const std::string& unit)
+{
+	auto lexStart = std::chrono::high_resolution_clock::now();
+
+	Lexer lexer;
+	std::string error = lexer.CreateTokens(source);
+	if (error != "")
+	{
+		std::cout << "Lexer error: " << error << "\n";
+		return false;
+	}
+
+	auto parseStart = std::chrono::high_resolution_clock::now();
+
+	Parser parser;
+	parser.CreateProgram(lexer.m_Tokens, lexer.m_Source);
+	if (parser.m_Error != "")
+	{
+		std::cout << "AST Error: " << parser.m_Error << "\n";
+		return false;
+	}
+
+	auto parseEnd = std::chrono::high_resolution_clock::now();
+
+	double lexMs = std::chrono::duration<double, std::milli>(parseStart - lexStart).count();
+	double parseMs = std::chrono::duration<double, std::milli>(parseEnd - parseStart).count();
+
+	std::cout << count << " " << unit << "s, " << lexer.m_Tokens.size() << " tokens, " << parser.m_Arena.GetNodeCount() << " nodes: lexing " << lexMs << " ms, parsing " << parseMs << " ms (" << parseMs * 1000000.0 / count << " ns per " << unit << ")\n";
+	return true;
+}
+
+// Lexes and parses inputs of growing size, the time per line or argument should stay about the same
+void RunParserBenchmark()
+{
+	for (int lines : { 1000, 10000, 100000, 1000000 })
+	{
+		if (!TimeParsing(GenerateParserBenchmarkSource(lines), lines, "line"))
+			return;
+	}
+
+	for (int arguments : { 1000, 10000, 100000 })
+	{
+		if (!TimeParsing(GenerateLongCallBenchmarkSource(arguments), arguments, "argument"))
+			return;
+	}
+}
+
+// Functions with a global statement or two after each, like in a real program, so that an edit in one of them only changes a small part of the file
+std::string GenerateEditBenchmarkSource(int lines)
+{
+	std::string source;
+
+	for (int i = 0; i * 11 < lines; i++)
+	{
+		std::string n = std::to_string(i);
+
+		source += "// Adds up the multiples of " + n + " below the limit\n";
+		source += "int sum" + n + "(int limit) => {\n";
+		source += "\tint total = 0\n";
+		source += "\tfor (int i = 0, i < limit, i++) {\n\t\ttotal += i * " + n + "\n\t};\n";
+		source += "\treturn total\n";
+		source += "};\n";
+		source += "int value" + n + " = sum" + n + "(10)\n";
+		source += "printf(\"%i\", value" + n + ")\n\n";
+	}
+
+	return source;
+}
+
+static std::string FrameMessage(const nlohmann::json& message)
+{
+	std::string body = message.dump();
+	return "Content-Length: " + std::to_string(body.length()) + "\r\n\r\n" + body;
+}
+
+// Runs a language server on the messages and returns the time it took in milliseconds
+static double TimeLanguageServer(const std::string& messages, bool isIncremental)
+{
+	std::istringstream input(messages);
+	std::ostringstream output;
+
+	LanguageServer server;
+	server.m_IsIncremental = isIncremental;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	server.Run(input, output);
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Opens a long file in the language server and types into functions all over it, one character at a time like in the editor.
+// The time from a change to its diagnostics is measured with only the changed part lexed and parsed again, and with everything
+void RunEditBenchmark(int lines)
+{
+	std::string source = GenerateEditBenchmarkSource(lines);
+	if (!TimeParsing(source, lines, "line"))
+		return;
+
+	std::string uri = "file:///edit_benchmark.txt";
+	std::string open = FrameMessage({ { "jsonrpc", "2.0" }, { "method", "textDocument/didOpen" },
+		{ "params", { { "textDocument", { { "uri", uri }, { "version", 0 }, { "text", source } } } } } });
+	std::string close = FrameMessage({ { "jsonrpc", "2.0" }, { "id", 1 }, { "method", "shutdown" } }) + FrameMessage({ { "jsonrpc", "2.0" }, { "method", "exit" } });
+
+	// A digit is typed at the end of the line in the loop of a function and then removed again
+	auto makeEdits = [&](int count) {
+		std::string edits;
+		int functions = (lines + 10) / 11;
+
+		for (int i = 0; i < count; i++)
+		{
+			int function = (int)((i / 2) * 7919LL % functions);
+			int line = function * 11 + 4;
+			int character = 15 + (int)std::to_string(function).length();
+
+			nlohmann::json start = { { "line", line }, { "character", character } };
+			nlohmann::json end = { { "line", line }, { "character", character + (i % 2) } };
+			nlohmann::json change = { { "range", { { "start", start }, { "end", end } } }, { "text", i % 2 == 0 ? "7" : "" } };
+
+			edits += FrameMessage({ { "jsonrpc", "2.0" }, { "method", "textDocument/didChange" },
+				{ "params", { { "textDocument", { { "uri", uri }, { "version", i + 1 } } }, { "contentChanges", { change } } } } });
+		}
+
+		return edits;
+	};
+
+	for (bool isIncremental : { false, true })
+	{
+		int count = isIncremental ? 1000 : 20;
+
+		double openMs = TimeLanguageServer(open + close, isIncremental);
+		double totalMs = TimeLanguageServer(open + makeEdits(count) + close, isIncremental);
+
+		std::cout << (isIncremental ? "Incremental: " : "Everything:  ") << (totalMs - openMs) / count << " ms from an edit to the diagnostics (" << count << " edits, opening took " << openMs << " ms)\n";
+	}
+}
+
+// Lexes and parses a long program on one thread, and then in chunks on more and more threads up to the number of cores
+void RunFrontEndBenchmark(int lines)
+{
+	std::string source = GenerateEditBenchmarkSource(lines);
+
+	auto timeBest = [](const std::function<bool()>& run) {
+		double best = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!run())
+				return -1.0;
+
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			best = i == 0 ? ms : std::min(best, ms);
+		}
+
+		return best;
+	};
+
+	double serialMs = timeBest([&] {
+		Lexer lexer;
+		Parser parser;
+		if (lexer.CreateTokens(source) != "")
+			return false;
+
+		parser.CreateProgram(lexer.m_Tokens, lexer.m_Source);
+		return parser.m_Error == "";
+	});
+
+	if (serialMs < 0)
+	{
+		std::cout << "The benchmark program has an error\n";
+		return;
+	}
+
+	std::cout << lines << " lines, " << source.length() << " bytes: " << serialMs << " ms on one thread without chunks\n";
+
+	int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads <= cores; threads *= 2)
+		threadCounts.push_back(threads);
+	if (threadCounts.back() != cores)
+		threadCounts.push_back(cores);
+
+	for (int threads : threadCounts)
+	{
+		ThreadPool pool(threads);
+		ParallelFrontEnd frontEnd(pool);
+
+		double ms = timeBest([&] {
+			Lexer lexer;
+			Parser parser;
+			return frontEnd.CreateProgram(source, lexer, parser) == "" && parser.m_Error == "";
+		});
+
+		std::cout << threads << (threads == 1 ? " thread:  " : " threads: ") << ms << " ms, " << serialMs / ms << "x (" << frontEnd.m_UsedChunkCount << " of " << frontEnd.m_ChunkCount << " chunks used)\n";
+	}
+}
+
+// Functions with loops and branches that call the one before, and a global that calls each of them
+static std::string GenerateCompileBenchmarkSource(int functions)
+{
+	std::string source;
+
+	for (int i = 0; i < functions; i++)
+	{
+		std::string n = std::to_string(i);
+		std::string call = i == 0 ? "a" : "f" + std::to_string(i - 1) + "(j, a)";
+
+		source += "int f" + n + "(int a, int b) => {\n";
+		source += "\tint c = a * " + n + " + b;\n";
+		source += "\tfor (int j = 0, j < b, j++) {\n";
+		source += "\t\tif (c > 100) {\n\t\t\tc = c - a;\n\t\t};\n";
+		source += "\t\tif (c <= 100) {\n\t\t\tc = c + " + call + ";\n\t\t};\n";
+		source += "\t};\n";
+		source += "\twhile (c > 10) {\n\t\tc = c / 2;\n\t};\n";
+		source += "\treturn c;\n";
+		source += "};\n";
+		source += "int r" + n + " = f" + n + "(" + n + ", 3);\n";
+	}
+
+	return source;
+}
+
+// Compiles a program with many functions to bytecode, with the function bodies compiled on their own on more and more threads
+// up to the number of cores, and with them left to be compiled when they are called. The program has too many variables to run it
+void RunCompileBenchmark(int functions)
+{
+	std::string source = GenerateCompileBenchmarkSource(functions);
+
+	Lexer lexer;
+	Parser parser;
+	ASTNode* program = nullptr;
+	if (lexer.CreateTokens(source) == "")
+		program = parser.CreateProgram(lexer.m_Tokens, lexer.m_Source);
+
+	if (program == nullptr || parser.m_Error != "")
+	{
+		std::cout << "The benchmark program has an error\n";
+		return;
+	}
+
+	auto timeBest = [&](ThreadPool* pool, bool lazily) {
+		double best = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			Bytecode::BytecodeCompiler compiler;
+			compiler.m_CompileFunctionsLazily = lazily;
+			std::vector<Bytecode::Instruction> instructions;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			compiler.CompileProgram(program, instructions, pool);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			if (compiler.m_Error != "")
+			{
+				std::cout << "Bytecode compilation error: " << compiler.m_Error << "\n";
+				return -1.0;
+			}
+
+			best = i == 0 ? ms : std::min(best, ms);
+		}
+
+		return best;
+	};
+
+	int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads <= cores; threads *= 2)
+		threadCounts.push_back(threads);
+	if (threadCounts.back() != cores)
+		threadCounts.push_back(cores);
+
+	std::cout << functions << " functions, " << source.length() << " bytes\n";
+
+	double oneThreadMs = 0;
+	for (int threads : threadCounts)
+	{
+		ThreadPool pool(threads);
+
+		double ms = timeBest(&pool, false);
+		if (ms < 0)
+			return;
+
+		if (threads == 1)
+			oneThreadMs = ms;
+
+		std::cout << threads << (threads == 1 ? " thread:  " : " threads: ") << ms << " ms, " << oneThreadMs / ms << "x\n";
+	}
+
+	double lazyMs = timeBest(nullptr, true);
+	std::cout << "Lazily: " << lazyMs << " ms until the first instruction, " << oneThreadMs / lazyMs << "x\n";
+}
+
+// Creates, reads and deletes short strings on the bytecode heap with a few thousand of them alive at a time, like a program that
+// formats strings in a loop. Compared to the map of entries and the strings from new[] that the heap used to have
+void RunHeapBenchmark(int operations)
+{
+	const int liveCount = 4096;
+
+	std::vector<std::string> strings;
+	for (int i = 0; i < 64; i++)
+		strings.push_back(std::string(i % 48, 'a' + i % 26));
+
+	// The lengths of the strings that are read, so that the reads aren't optimized away
+	volatile size_t checksum = 0;
+
+	auto timeBest = [&](auto run) {
+		double best = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			checksum = checksum + run();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			best = i == 0 ? ms : std::min(best, ms);
+		}
+
+		return best;
+	};
+
+	double mapMs = timeBest([&]() {
+		std::unordered_map<int, HeapEntry> entries;
+		std::vector<int> live(liveCount, -1);
+		int nextFreeId = 0;
+		size_t checksum = 0;
+
+		for (int i = 0; i < operations; i++)
+		{
+			int& slot = live[i % liveCount];
+			if (slot != -1)
+			{
+				checksum += strlen((char*)entries[slot].m_Data);
+				delete[] (char*)entries[slot].m_Data;
+				entries.erase(slot);
+			}
+
+			slot = nextFreeId++;
+			entries[slot] = HeapEntry(0, slot, CopyString(strings[i % strings.size()].c_str()));
+		}
+
+		for (auto& [id, entry] : entries)
+			delete[] (char*)entry.m_Data;
+
+		return checksum;
+	});
+
+	double slabMs = timeBest([&]() {
+		Heap heap;
+		Heap::AllocationBuffer buffer;
+		Heap::BufferScope scope(heap, buffer);
+
+		std::vector<HeapHandle> live(liveCount);
+		size_t checksum = 0;
+
+		for (int i = 0; i < operations; i++)
+		{
+			HeapHandle& slot = live[i % liveCount];
+			if (!slot.IsNull())
+			{
+				checksum += strlen((char*)heap.Get(slot)->m_Data);
+				heap.DeleteObject(slot);
+			}
+
+			slot = heap.CreateString(strings[i % strings.size()]);
+		}
+
+		return checksum;
+	});
+
+	std::cout << operations << " strings, " << liveCount << " alive at a time\n";
+	std::cout << "Map and new[]:     " << mapMs << " ms, " << operations / mapMs / 1000.0 << " M/s\n";
+	std::cout << "Slabs and handles: " << slabMs << " ms, " << operations / slabMs / 1000.0 << " M/s, " << mapMs / slabMs << "x\n";
+}
+
+// Strings created on more and more threads at once, each one with its own allocation buffer, and then all of them with the shared
+// buffer behind a lock. Between the rounds nothing is reachable and the whole heap is collected, like the interpreter would
+void RunHeapThreadBenchmark(int stringsPerThread)
+{
+	const int rounds = 4;
+	const std::string str(23, 'a');
+	int maxThreads = std::max(4, (int)std::thread::hardware_concurrency());
+
+	auto run = [&](int threadCount, bool ownBuffers) {
+		Heap heap;
+		double ms = 0;
+
+		for (int round = 0; round < rounds; round++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+
+			std::vector<std::thread> threads;
+			for (int t = 0; t < threadCount; t++)
+			{
+				threads.emplace_back([&]() {
+					Heap::AllocationBuffer buffer;
+					Heap::BufferScope scope(heap, buffer);
+
+					if (!ownBuffers)
+						heap.SetThreadBuffer(nullptr);
+
+					for (int i = 0; i < stringsPerThread; i++)
+						heap.CreateString(str);
+				});
+			}
+
+			for (std::thread& thread : threads)
+				thread.join();
+
+			ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			heap.BeginMarking();
+			heap.MarkStep(Heap::NoDeadline());
+			heap.BeginSweeping();
+			heap.SweepStep(Heap::NoDeadline());
+		}
+
+		return ms;
+	};
+
+	std::cout << "\n" << stringsPerThread << " strings on each thread, " << std::thread::hardware_concurrency() << " cores\n";
+	for (int threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+	{
+		double ownMs = run(threadCount, true);
+		double sharedMs = run(threadCount, false);
+		double strings = (double)stringsPerThread * threadCount * rounds;
+
+		std::cout << threadCount << " threads: own buffers " << strings / ownMs / 1000.0 << " M/s, shared buffer " << strings / sharedMs / 1000.0
+			<< " M/s, " << sharedMs / ownMs << "x\n";
+	}
+}
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+// The benchmarks that main runs for the -*bench arguments, what each one measures is described with it in Benchmarks.cpp
+namespace Benchmarks
+{
+	// -lexbench, the source is generated when there is no file
+	std::string GenerateLexerBenchmarkSource(int size);
+	void RunLexerBenchmark(const std::string& source);
+
+	// -parsebench, -editbench times the parsing of its source with TimeParsing too
+	bool TimeParsing(const std::string& source, int count, const std::string& unit);
+	void RunParserBenchmark();
+
+	// -editbench, -frontendbench lexes and parses the same source
+	std::string GenerateEditBenchmarkSource(int lines);
+	void RunEditBenchmark(int lines);
+
+	// -frontendbench
+	void RunFrontEndBenchmark(int lines);
+
+	// -compilebench
+	void RunCompileBenchmark(int functions);
+
+	// -heapbench
+	void RunHeapBenchmark(int operations);
+	void RunHeapThreadBenchmark(int stringsPerThread);
+}
@@ -1,11 +1,17 @@
 #include "AssemblyCompiler.h"
+#include "RegisterAllocator.h"
+#include "LoopVectorizer.h"
 
 #include <iostream>
+#include <algorithm>
 
 std::string FloatToString(float value)
 {
+	// to_string() uses the decimal separator of the locale
 	std::string str = std::to_string(value);
-	str.replace(str.find(","), 1, ".");
+	size_t comma = str.find(",");
+	if (comma != std::string::npos)
+		str.replace(comma, 1, ".");
 
 	return str;
 }
@@ -121,9 +127,9 @@ bool HasPriorityCompilation(ASTNode* n)
 
 namespace ASM {
 
-std::vector<std::pair<ValueTypes, std::string>> AssemblyCompiler::ReverseFunctionArguments(ASTNode* node)
+std::vector<std::pair<ValueTypes, Symbol>> AssemblyCompiler::ReverseFunctionArguments(ASTNode* node)
 {
-	std::vector<std::pair<ValueTypes, std::string>> argsSortedByType;
+	std::vector<std::pair<ValueTypes, Symbol>> argsSortedByType;
 
 	// 1, 2, x, 3
 	// 3, x, 2, 1
@@ -139,7 +145,7 @@ std::vector<std::pair<ValueTypes, std::string>> AssemblyCompiler::ReverseFunctio
 
 	for (int i = node->arguments.size() - 1; i >= 0; i--)
 	{
-		std::string name = "arg" + std::to_string(i);
+		Symbol name = StringInterner::Get().Intern("arg" + std::to_string(i));
 
 		// Float variable, because the intermediate value is not stored in a variable
 		if (!m_Context.HasVariable(name))
@@ -154,7 +160,7 @@ std::vector<std::pair<ValueTypes, std::string>> AssemblyCompiler::ReverseFunctio
 	}
 
 	// Now find the floats in the array and reverse them
-	std::vector<std::pair<ValueTypes, std::string>> floatArguments;
+	std::vector<std::pair<ValueTypes, Symbol>> floatArguments;
 
 	// Collect floats
 	for (int i = 0; i < argsSortedByType.size(); i++)
@@ -343,7 +349,7 @@ AssemblyCompiler::AssemblyCompiler()
 
 	auto printfFunc = printFunc;
 	printfFunc.m_Name = "printf";
-	m_Context.m_Functions["printf"] = printfFunc;
+	m_Context.m_Functions[StringInterner::Get().Intern("printf")] = printfFunc;
 
 
 	// rand
@@ -484,8 +490,8 @@ void AssemblyCompiler::Compile(ASTNode* node)
 	case ASTTypes::VariableDeclaration:
 	case ASTTypes::GlobalVariableDeclaration:
 	{
-		const std::string& name = node->right->stringValue;
-		if (m_Context.HasVariable(name))
+		std::string name(node->right->stringValue);
+		if (m_Context.HasVariable(node->right->symbol))
 			return MakeError("Variable '" + name + "' has already been declared in this scope");
 
 		ValueTypes type = GetValueTypeOfNode(node->left);
@@ -506,7 +512,7 @@ void AssemblyCompiler::Compile(ASTNode* node)
 			publicity = Publicity::Global;
 		}
 
-		AssemblyCompilerContext::Variable variable = m_Context.CreateVariable(name, type, size, publicity);
+		AssemblyCompilerContext::Variable variable = m_Context.CreateVariable(node->right->symbol, type, size, publicity);
 
 		if (publicity == Publicity::Global)
 		{
@@ -534,8 +540,8 @@ void AssemblyCompiler::Compile(ASTNode* node)
 	{
 		if (node->left->type == ASTTypes::VariableDeclaration || node->left->type == ASTTypes::GlobalVariableDeclaration)
 		{
-			const std::string& name = node->left->right->stringValue;
-			if (m_Context.HasVariable(name))
+			std::string name(node->left->right->stringValue);
+			if (m_Context.HasVariable(node->left->right->symbol))
 				return MakeError("Variable '" + name + "' has already been declared in this scope");
 
 			// Evaluate the assignment on the rhs
@@ -569,7 +575,7 @@ void AssemblyCompiler::Compile(ASTNode* node)
 				publicity = Publicity::Global;
 			}
 
-			AssemblyCompilerContext::Variable variable = m_Context.CreateVariable(name, variableType, size, publicity);
+			AssemblyCompilerContext::Variable variable = m_Context.CreateVariable(node->left->right->symbol, variableType, size, publicity);
 
 			if (variable.m_Publicity == Publicity::Global)
 			{
@@ -603,12 +609,12 @@ void AssemblyCompiler::Compile(ASTNode* node)
 			return;
 		}
 
-		const std::string& variableName = node->left->stringValue;
+		std::string variableName(node->left->stringValue);
 
-		if (!m_Context.HasVariable(variableName))
+		if (!m_Context.HasVariable(node->left->symbol))
 			return MakeError("Variable '" + variableName + "' has not been declared in this scope");
 
-		AssemblyCompilerContext::Variable variable = m_Context.GetVariable(variableName);
+		AssemblyCompilerContext::Variable variable = m_Context.GetVariable(node->left->symbol);
 
 		// Evaluate the assignment on the rhs
 		Compile(node->right);
@@ -629,16 +635,11 @@ void AssemblyCompiler::Compile(ASTNode* node)
 		}
 		else
 		{
+			// The declaration already moved esp past the variable, doing it again would grow the stack every time a loop assigns it
 			if (variable.m_Type == ValueTypes::Integer || variable.m_Type == ValueTypes::String)
-			{
 				m_TextSection.AddInstruction("mov", variable.GetASMLocation("dword"), "eax");
-				m_TextSection.AddInstruction("sub", "esp", "4");
-			}
 			else if (variable.m_Type == ValueTypes::Float)
-			{
 				m_TextSection.AddInstruction("fstp", variable.GetASMLocation("qword"));
-				m_TextSection.AddInstruction("sub", "esp", "8");
-			}
 		}
 
 
@@ -731,7 +732,7 @@ void AssemblyCompiler::Compile(ASTNode* node)
 		// TODO: Store string in global variable
 		// 
 		// Allocate space for string
-		const std::string& str = node->stringValue;
+		std::string str(node->stringValue);
 
 		int strSize = str.size() + 1;
 
@@ -762,11 +763,11 @@ void AssemblyCompiler::Compile(ASTNode* node)
 		break;
 	case ASTTypes::Variable:
 	{
-		const std::string& variableName = node->stringValue;
-		if (!m_Context.HasVariable(variableName))
+		std::string variableName(node->stringValue);
+		if (!m_Context.HasVariable(node->symbol))
 			return MakeError("Variable '" + variableName + "' has not been declared in this scope");
 
-		AssemblyCompilerContext::Variable variable = m_Context.GetVariable(variableName);
+		AssemblyCompilerContext::Variable variable = m_Context.GetVariable(node->symbol);
 
 		if (variable.m_Type == ValueTypes::Integer || variable.m_Type == ValueTypes::String)
 		{
@@ -846,11 +847,11 @@ void AssemblyCompiler::Compile(ASTNode* node)
 		else
 			assert(node->parent->type == ASTTypes::Scope);
 
-		const std::string& variableName = node->left->stringValue;
-		if (!m_Context.HasVariable(variableName))
+		std::string variableName(node->left->stringValue);
+		if (!m_Context.HasVariable(node->left->symbol))
 			return MakeError("Variable '" + variableName + "' has not been declared in this scope");
 
-		AssemblyCompilerContext::Variable variable = m_Context.GetVariable(variableName);
+		AssemblyCompilerContext::Variable variable = m_Context.GetVariable(node->left->symbol);
 
 		std::string opcode = node->type == ASTTypes::PostIncrement ? "inc" : "dec";
 
@@ -876,13 +877,13 @@ void AssemblyCompiler::Compile(ASTNode* node)
 		if (node->arguments.size() > maxArgumentCount)
 			return MakeError("Too many arguments for function. A maximum of 4 is supported");
 
-		std::string functionName = node->stringValue;
+		std::string functionName(node->stringValue);
 
 		// Check if the function has been defined
-		if (!m_Context.HasFunction(functionName))
+		if (!m_Context.HasFunction(node->symbol))
 			return MakeError("Function '" + functionName + "' has not been defined");
 
-		auto& function = m_Context.GetFunction(functionName);
+		auto& function = m_Context.GetFunction(node->symbol);
 
 		int argumentsSize = 0;
 
@@ -932,7 +933,7 @@ void AssemblyCompiler::Compile(ASTNode* node)
 		// The value of the evaluated arguments are stored in registers
 		for (int i = 0; i < argsSortedByType.size(); i++)
 		{
-			const std::string& name = argsSortedByType[i].second;
+			Symbol name = argsSortedByType[i].second;
 
 			if (!m_Context.HasVariable(name))
 				continue;
@@ -957,7 +958,7 @@ void AssemblyCompiler::Compile(ASTNode* node)
 		// The registers are pushed on to the new call stack
 		for (int i = 0; i < argsSortedByType.size(); i++)
 		{
-			const std::string& name = argsSortedByType[i].second;
+			Symbol name = argsSortedByType[i].second;
 
 			// No variable means that it is a float
 			if (!m_Context.HasVariable(name))
@@ -1017,12 +1018,10 @@ void AssemblyCompiler::Compile(ASTNode* node)
 		if (rhsType == ValueTypes::Integer || rhsType == ValueTypes::String)
 			m_TextSection.AddInstruction("pop", "eax");
 
-		const std::string& functionName = m_Context.m_CurrentParsingFunctionName;
-
-		if (functionName == "")
+		if (m_Context.m_CurrentParsingFunction == NoSymbol)
 			return MakeError("Return has to be inside a function body");
 
-		auto& function = m_Context.GetFunction(functionName);
+		auto& function = m_Context.GetFunction(m_Context.m_CurrentParsingFunction);
 		if (function.m_ReturnType == ValueTypes::Void)
 		{
 			// Ensure that void functions cannot return a value
@@ -1128,6 +1127,11 @@ void AssemblyCompiler::Compile(ASTNode* node)
 		// 1. Variable
 		Compile(node->arguments[0]);
 
+		// Run as many iterations as possible with SIMD instructions first. The normal loop below does the rest
+		LoopVectorizer vectorizer(*this);
+		if (vectorizer.CanVectorize(node))
+			vectorizer.Compile();
+
 		// 2. Condition
 		m_Context.m_LoopInfo.labelIndex++;
 
@@ -1165,9 +1169,9 @@ void AssemblyCompiler::Compile(ASTNode* node)
 	{
 		ASTNode* functionPrototype = node->left;
 		ValueTypes returnType = functionPrototype->arguments[0]->VariableTypeToValueType();
-		const std::string& name = functionPrototype->arguments[1]->stringValue;
+		std::string name(functionPrototype->arguments[1]->stringValue);
 
-		if (m_Context.HasFunction(name))
+		if (m_Context.HasFunction(functionPrototype->arguments[1]->symbol))
 			return MakeError("Function '" + name + "' has already been defined");
 		
 		// Create arguments for the function definition
@@ -1178,7 +1182,7 @@ void AssemblyCompiler::Compile(ASTNode* node)
 			functionArguments.push_back(GetValueTypeOfNode(functionPrototype->arguments[i]));
 		}
 
-		AssemblyCompilerContext::Function& function = m_Context.CreateFunction(name, returnType, functionArguments);
+		AssemblyCompilerContext::Function& function = m_Context.CreateFunction(functionPrototype->arguments[1]->symbol, returnType, functionArguments);
 
 		m_TextSection.AddLabel(name + ":");
 
@@ -1195,7 +1199,7 @@ void AssemblyCompiler::Compile(ASTNode* node)
 		// New context for function
 		AssemblyCompilerContext prevContext = m_Context;
 
-		m_Context.m_CurrentParsingFunctionName = name;
+		m_Context.m_CurrentParsingFunction = functionPrototype->arguments[1]->symbol;
 
 		m_TextSection.AddComment("Get arguments");
 		// Compile arguments
@@ -1224,11 +1228,11 @@ void AssemblyCompiler::Compile(ASTNode* node)
 			else if (typeOfArgument == ValueTypes::Float)
 			{
 				// Create the variable
-				const std::string& name = variableDeclaration->right->stringValue;
-				if (m_Context.HasVariable(name))
+				std::string name(variableDeclaration->right->stringValue);
+				if (m_Context.HasVariable(variableDeclaration->right->symbol))
 					return MakeError("Variable '" + name + "' has already been declared in this scope");
 
-				AssemblyCompilerContext::Variable& variable = m_Context.CreateVariable(name, typeOfArgument, 8, Publicity::Local);
+				AssemblyCompilerContext::Variable& variable = m_Context.CreateVariable(variableDeclaration->right->symbol, typeOfArgument, 8, Publicity::Local);
 
 				m_TextSection.AddComment(name);
 				m_TextSection.AddInstruction("mov", "eax", "[ebp + " + std::to_string(byteOffsetThisArgument) + "]");
@@ -1268,6 +1272,23 @@ void AssemblyCompiler::Compile(ASTNode* node)
 	}
 }
 
+void AssemblyCompiler::AllocateRegisters(bool quiet)
+{
+	// Every user defined function and the main program has its own call frame
+	std::vector<std::string> routines = { "CMAIN" };
+	for (auto& [name, function] : m_Context.m_Functions)
+	{
+		if (!function.m_IsStdLib)
+			routines.push_back(function.m_ActualName);
+	}
+
+	RegisterAllocator allocator(m_TextSection, routines);
+	allocator.Allocate();
+
+	if (!quiet)
+		std::cout << "Register allocation: " << allocator.GetAllocatedCount() << " of " << allocator.GetCandidateCount() << " local variables in registers\n";
+}
+
 void AssemblyCompiler::Optimize()
 {
 	auto& lines = m_TextSection.GetLines();
@@ -1303,6 +1324,43 @@ void AssemblyCompiler::Optimize()
 				linesToRemove.push_back(prevInstIndex);
 				linesToRemove.push_back(i);
 			}
+			// A temporary that is pushed and popped into another register can stay in a register
+			else if (inst.m_Src == "" && prevInst.m_Src == "" && (inst.m_Dest.find('[') == std::string::npos || prevInst.m_Dest.find('[') == std::string::npos))
+			{
+				linesToRemove.push_back(prevInstIndex);
+				inst = Instruction("mov", inst.m_Dest, prevInst.m_Dest, inst.m_Comment);
+			}
+		}
+
+		// The same when the pushed register gets the other operand in between, like "push eax, mov eax, [ebp - 8], pop ebx" for a math operation.
+		// The pop is replaced by a mov before the other operand is loaded, unless loading it reads the register or the stack pointer.
+		// Lines that are already going to be removed are skipped, the lhs is usually a "push eax, pop eax" pair by now
+		if (inst.m_Op == "pop")
+		{
+			auto getPrevious = [&](int index)
+			{
+				index--;
+				while (index >= 0 && (lines[index].m_Op == "" || std::find(linesToRemove.begin(), linesToRemove.end(), index) != linesToRemove.end()))
+					index--;
+				return index;
+			};
+
+			int movIndex = getPrevious(i);
+			int pushIndex = movIndex >= 0 ? getPrevious(movIndex) : -1;
+
+			if (pushIndex >= 0)
+			{
+				Instruction& mov = lines[movIndex];
+				Instruction& push = lines[pushIndex];
+				bool isRegister = push.m_Dest.find('[') == std::string::npos && inst.m_Dest.find('[') == std::string::npos;
+
+				if (push.m_Op == "push" && mov.m_Op == "mov" && push.m_Src == "" && isRegister && push.m_Dest == mov.m_Dest && inst.m_Dest != push.m_Dest &&
+					mov.m_Src.find(inst.m_Dest) == std::string::npos && mov.m_Src.find("esp") == std::string::npos)
+				{
+					push = Instruction("mov", inst.m_Dest, push.m_Dest, push.m_Comment);
+					linesToRemove.push_back(i);
+				}
+			}
 		}
 
 		// Remove push op that segfaults when returning
@@ -1400,14 +1458,14 @@ ValueTypes AssemblyCompiler::GetValueTypeOfNode(ASTNode* node)
 	}
 	case ASTTypes::Variable:
 	{
-		const std::string& variableName = node->stringValue;
-		if (!m_Context.HasVariable(variableName))
+		std::string variableName(node->stringValue);
+		if (!m_Context.HasVariable(node->symbol))
 		{
 			MakeError("Variable '" + variableName + "' has not been declared in this scope");
 			return ValueTypes::Void;
 		}
 
-		AssemblyCompilerContext::Variable variable = m_Context.GetVariable(variableName);
+		AssemblyCompilerContext::Variable variable = m_Context.GetVariable(node->symbol);
 
 		return variable.m_Type;
 	}
@@ -1466,14 +1524,14 @@ ValueTypes AssemblyCompiler::GetValueTypeOfNode(ASTNode* node)
 		else
 			assert(node->parent->type == ASTTypes::Scope);
 
-		const std::string& variableName = node->left->stringValue;
-		if (!m_Context.HasVariable(variableName))
+		std::string variableName(node->left->stringValue);
+		if (!m_Context.HasVariable(node->left->symbol))
 		{
 			MakeError("Variable '" + variableName + "' has not been declared in this scope");
 			return ValueTypes::Void;
 		}
 
-		AssemblyCompilerContext::Variable variable = m_Context.GetVariable(variableName);
+		AssemblyCompilerContext::Variable variable = m_Context.GetVariable(node->left->symbol);
 		return variable.m_Type;
 	}
 	case ASTTypes::PreIncrement:
@@ -1481,16 +1539,16 @@ ValueTypes AssemblyCompiler::GetValueTypeOfNode(ASTNode* node)
 		abort();
 	case ASTTypes::FunctionCall:
 	{
-		const std::string& functionName = node->stringValue;
+		std::string functionName(node->stringValue);
 
 		// Check user defined functions
-		if (!m_Context.HasFunction(functionName))
+		if (!m_Context.HasFunction(node->symbol))
 		{
 			MakeError("Function '" + functionName + "' has not been defined");
 			return ValueTypes::Void;
 		}
 
-		auto& function = m_Context.GetFunction(functionName);
+		auto& function = m_Context.GetFunction(node->symbol);
 		return function.m_ReturnType;
 	}
 
@@ -1505,26 +1563,27 @@ ValueTypes AssemblyCompiler::GetValueTypeOfNode(ASTNode* node)
 	}
 }
 
-bool AssemblyCompilerContext::HasVariable(const std::string& variableName)
+bool AssemblyCompilerContext::HasVariable(Symbol variableName)
 {
 	return m_Variables.count(variableName) == 1;
 }
 
-AssemblyCompilerContext::Variable& AssemblyCompilerContext::GetVariable(const std::string& variableName)
+AssemblyCompilerContext::Variable& AssemblyCompilerContext::GetVariable(Symbol variableName)
 {
-	assert(HasVariable(variableName));
-	return m_Variables[variableName];
+	auto it = m_Variables.find(variableName);
+	assert(it != m_Variables.end());
+	return it->second;
 }
 
-AssemblyCompilerContext::Variable& AssemblyCompilerContext::CreateVariable(const std::string& variableName, ValueTypes type, int size, Publicity publicity)
+AssemblyCompilerContext::Variable& AssemblyCompilerContext::CreateVariable(Symbol variableName, ValueTypes type, int size, Publicity publicity)
 {
 	//std::string editedVariableName = variableName;
 	//editedVariableName += std::to_string(rand() % 100);
 	assert(!HasVariable(variableName));
 
 	Variable var;
-	var.m_Name = variableName;
-	var.m_MangledName = MangleName(variableName);
+	var.m_Name = StringInterner::Get().GetString(variableName);
+	var.m_MangledName = MangleName(var.m_Name);
 
 	if (publicity == Publicity::Local)
 		var.m_Index = Allocate(size);
@@ -1532,42 +1591,51 @@ AssemblyCompilerContext::Variable& AssemblyCompilerContext::CreateVariable(const
 	var.m_Type = type;
 	var.m_Publicity = publicity;
 
-	m_Variables[variableName] = var;
-	return m_Variables[variableName];
+	return m_Variables[variableName] = var;
 }
 
-bool AssemblyCompilerContext::DeleteVariable(const std::string& variableName)
+bool AssemblyCompilerContext::DeleteVariable(Symbol variableName)
 {
 	assert(HasVariable(variableName));
 	m_Variables.erase(variableName);
 	return true;
 }
 
-bool AssemblyCompilerContext::HasFunction(const std::string& functionName)
+AssemblyCompilerContext::Variable& AssemblyCompilerContext::CreateVariable(const std::string& variableName, ValueTypes type, int size, Publicity publicity)
+{
+	return CreateVariable(StringInterner::Get().Intern(variableName), type, size, publicity);
+}
+
+bool AssemblyCompilerContext::HasFunction(Symbol functionName)
 {
 	return m_Functions.count(functionName) == 1;
 }
 
-AssemblyCompilerContext::Function& AssemblyCompilerContext::GetFunction(const std::string& functionName)
+AssemblyCompilerContext::Function& AssemblyCompilerContext::GetFunction(Symbol functionName)
 {
-assert(HasFunction(functionName));
-return m_Functions[functionName];
+	auto it = m_Functions.find(functionName);
+	assert(it != m_Functions.end());
+	return it->second;
 }
 
-AssemblyCompilerContext::Function& AssemblyCompilerContext::CreateFunction(const std::string& functionName, ValueTypes returnType, std::vector<ValueTypes> arguments)
+AssemblyCompilerContext::Function& AssemblyCompilerContext::CreateFunction(Symbol functionName, ValueTypes returnType, std::vector<ValueTypes> arguments)
 {
 	assert(!HasFunction(functionName));
 
 	Function func;
-	func.m_Name = functionName;
-	func.m_MangledName = MangleName(functionName);
+	func.m_Name = StringInterner::Get().GetString(functionName);
+	func.m_MangledName = MangleName(func.m_Name);
 	func.m_ReturnType = returnType;
 	func.m_Arguments = arguments;
 
 	func.m_ActualName = func.m_Name;
 
-	m_Functions[functionName] = func;
-	return m_Functions[functionName];
+	return m_Functions[functionName] = func;
+}
+
+AssemblyCompilerContext::Function& AssemblyCompilerContext::CreateFunction(const std::string& functionName, ValueTypes returnType, std::vector<ValueTypes> arguments)
+{
+	return CreateFunction(StringInterner::Get().Intern(functionName), returnType, arguments);
 }
 
 int AssemblyCompilerContext::Allocate(int size)
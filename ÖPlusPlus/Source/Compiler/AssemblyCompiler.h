@@ -103,24 +103,27 @@ namespace ASM {
 		};
 
 	public:
-		bool HasVariable(const std::string& variableName);
-		Variable& GetVariable(const std::string& variableName);
+		// Variables and functions are keyed by the symbols from the lexer. Names the compiler makes up itself are interned when they are created
+		bool HasVariable(Symbol variableName);
+		Variable& GetVariable(Symbol variableName);
+		Variable& CreateVariable(Symbol variableName, ValueTypes type, int size = 4, Publicity publicity = Publicity::Local);
 		Variable& CreateVariable(const std::string& variableName, ValueTypes type, int size = 4, Publicity publicity = Publicity::Local);
-		bool DeleteVariable(const std::string& variableName);
+		bool DeleteVariable(Symbol variableName);
 
-		bool HasFunction(const std::string& functionName);
-		Function& GetFunction(const std::string& functionName);
+		bool HasFunction(Symbol functionName);
+		Function& GetFunction(Symbol functionName);
+		Function& CreateFunction(Symbol functionName, ValueTypes returnType, std::vector<ValueTypes> args = {});
 		Function& CreateFunction(const std::string& functionName, ValueTypes returnType, std::vector<ValueTypes> args = {});
 
 		int Allocate(int size);
 
 	public:
-		std::unordered_map<std::string, Variable> m_Variables;
-		std::unordered_map<std::string, Function> m_Functions;
+		std::unordered_map<Symbol, Variable> m_Variables;
+		std::unordered_map<Symbol, Function> m_Functions;
 
 		uint32_t m_CurrentVariableIndex = 0;
 
-		std::string m_CurrentParsingFunctionName = "";
+		Symbol m_CurrentParsingFunction = NoSymbol;
 
 		LoopInfo m_LoopInfo;
 
@@ -133,6 +136,7 @@ namespace ASM {
 		AssemblyCompiler();
 
 		void Compile(ASTNode* node);
+		void AllocateRegisters(bool quiet = false);
 		void Optimize();
 
 		void MakeError(std::string error) { m_Error = error; }
@@ -140,7 +144,7 @@ namespace ASM {
 	private:
 		ValueTypes GetValueTypeOfNode(ASTNode* node);
 
-		std::vector<std::pair<ValueTypes, std::string>> ReverseFunctionArguments(ASTNode* node);
+		std::vector<std::pair<ValueTypes, Symbol>> ReverseFunctionArguments(ASTNode* node);
 		std::vector<std::pair<ValueTypes, int>> ReverseFunctionArgumentIndicies(ASTNode* node);
 
 	public:
@@ -152,6 +156,8 @@ namespace ASM {
 
 		ConstantsPool m_Constants;
 
+		int m_VectorizedLoops = 0;
+
 		std::string m_Error;
 	};
 }
\ No newline at end of file
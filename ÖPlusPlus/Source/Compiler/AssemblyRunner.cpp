@@ -2,6 +2,7 @@
 
 #include "../Lexer.h"
 #include "../Parser.h"
+#include "../Inliner.h"
 
 #include <iostream>
 #include <fstream>
@@ -34,25 +35,34 @@ namespace ASM {
 		if (!quiet)
 		{
 			for (int i = 0; i < lexer.m_Tokens.size(); i++)
-				std::cout << lexer.m_Tokens[i].ToString() << ": " << lexer.m_Tokens[i].m_Value << " [" << lexer.m_Tokens[i].m_Depth << "]\n";
+				std::cout << lexer.m_Tokens[i].ToString() << ": " << lexer.m_Tokens[i].GetValue(lexer.m_Source) << " [" << lexer.m_Tokens[i].m_Depth << "]\n";
 			std::cout << "\n";
 		}
 
 		Parser parser;
 
-		ASTNode tree;
-		tree.parent = new ASTNode(ASTTypes::ProgramBody);
-		tree.parent->left = &tree;
-
-		parser.CreateAST(lexer.m_Tokens, &tree, tree.parent);
+		ASTNode* program = parser.CreateProgram(lexer.m_Tokens, lexer.m_Source);
 
 		if (parser.m_Error != "")
 			return "AST Error: " + parser.m_Error;
 
+		Inliner inliner(parser.m_Arena);
+		inliner.Run(program);
+
+		if (!quiet)
+		{
+			parser.PrintASTTree(program, 0);
+			inliner.PrintReport();
+		}
+
+		m_Compiler.Compile(program);
+
 		if (!quiet)
-			parser.PrintASTTree(tree.parent, 0);
+			std::cout << "Vectorized loops: " << m_Compiler.m_VectorizedLoops << "\n";
+
+		if (m_Compiler.m_Error == "")
+			m_Compiler.AllocateRegisters(quiet);
 
-		m_Compiler.Compile(tree.parent);
 		m_Compiler.Optimize();
 
 		if (m_Compiler.m_Error != "")
@@ -0,0 +1,531 @@
+#include "LoopVectorizer.h"
+
+#include <algorithm>
+
+// Vector register usage:
+// 0-3 temporaries for evaluating expressions
+// 4-5 accumulators
+// 6   loop variable, one lane per iteration
+// 7   step for the loop variable
+constexpr int TemporaryRegisterCount = 4;
+constexpr int FirstAccumulatorRegister = 4;
+constexpr int MaxReductions = 2;
+constexpr int LoopVariableRegister = 6;
+constexpr int StepRegister = 7;
+
+namespace ASM {
+	LoopVectorizer::LoopVectorizer(AssemblyCompiler& compiler)
+		: m_Compiler(compiler)
+	{
+	}
+
+	bool LoopVectorizer::CanVectorize(ASTNode* node)
+	{
+		assert(node->type == ASTTypes::ForStatement);
+
+		ASTNode* initializer = node->arguments[0];
+		ASTNode* condition = node->arguments[1];
+		ASTNode* action = node->arguments[2];
+		ASTNode* body = node->right;
+
+		// int i = ...
+		if (initializer->type != ASTTypes::Assign || initializer->left->type != ASTTypes::VariableDeclaration)
+			return false;
+		if (initializer->left->left->VariableTypeToValueType() != ValueTypes::Integer)
+			return false;
+
+		m_LoopVariable = initializer->left->right->symbol;
+
+		// i < bound
+		if (condition->type != ASTTypes::CompareLessThan || condition->left->type != ASTTypes::Variable || condition->left->symbol != m_LoopVariable)
+			return false;
+
+		m_Bound = condition->right;
+		if (m_Bound->type != ASTTypes::IntLiteral && m_Bound->type != ASTTypes::Variable)
+			return false;
+
+		// i++
+		if (action->type != ASTTypes::PostIncrement || action->left->symbol != m_LoopVariable)
+			return false;
+
+		if (body == nullptr || body->type != ASTTypes::Scope || body->arguments.size() == 0)
+			return false;
+
+		// Every statement has to be a reduction, sum += x or sum = sum + x
+		m_Reductions.clear();
+		for (ASTNode* statement : body->arguments)
+		{
+			if (statement->type != ASTTypes::Assign || statement->left->type != ASTTypes::Variable)
+				return false;
+
+			ASTNode* rhs = statement->right;
+			if (rhs->type != ASTTypes::Add && rhs->type != ASTTypes::Subtract)
+				return false;
+
+			Symbol accumulator = statement->left->symbol;
+			if (rhs->left->type != ASTTypes::Variable || rhs->left->symbol != accumulator || accumulator == m_LoopVariable)
+				return false;
+
+			if (!m_Compiler.m_Context.HasVariable(accumulator))
+				return false;
+
+			for (auto& reduction : m_Reductions)
+			{
+				if (reduction.m_Accumulator == accumulator)
+					return false;
+			}
+
+			Reduction reduction;
+			reduction.m_Accumulator = accumulator;
+			reduction.m_Expression = rhs->right;
+			reduction.m_IsSubtraction = rhs->type == ASTTypes::Subtract;
+			m_Reductions.push_back(reduction);
+		}
+
+		if (m_Reductions.size() > MaxReductions)
+			return false;
+
+		// All the accumulators have to be the same type, so that they use the same amount of lanes
+		m_Type = m_Compiler.m_Context.GetVariable(m_Reductions[0].m_Accumulator).m_Type;
+		if (m_Type != ValueTypes::Integer && m_Type != ValueTypes::Float)
+			return false;
+
+		for (auto& reduction : m_Reductions)
+		{
+			if (m_Compiler.m_Context.GetVariable(reduction.m_Accumulator).m_Type != m_Type)
+				return false;
+
+			if (!IsValidExpression(reduction.m_Expression))
+				return false;
+		}
+
+		if (m_Bound->type == ASTTypes::Variable)
+		{
+			if (!m_Compiler.m_Context.HasVariable(m_Bound->symbol) || m_Compiler.m_Context.GetVariable(m_Bound->symbol).m_Type != ValueTypes::Integer)
+				return false;
+
+			for (auto& reduction : m_Reductions)
+			{
+				if (reduction.m_Accumulator == m_Bound->symbol)
+					return false;
+			}
+		}
+
+		// Compile everything once to make sure that the expressions fit in the registers
+		Section scratch;
+		m_IsDryRun = true;
+
+		bool fitsInRegisters = true;
+		for (auto& reduction : m_Reductions)
+		{
+			if (!CompileExpression(scratch, reduction.m_Expression, 0, false) || !CompileExpression(scratch, reduction.m_Expression, 0, true))
+				fitsInRegisters = false;
+		}
+
+		m_IsDryRun = false;
+
+		return fitsInRegisters;
+	}
+
+	bool LoopVectorizer::IsValidExpression(ASTNode* node)
+	{
+		switch (node->type)
+		{
+		case ASTTypes::IntLiteral:
+			return m_Type == ValueTypes::Integer;
+		case ASTTypes::DoubleLiteral:
+			return m_Type == ValueTypes::Float;
+		case ASTTypes::Variable:
+		{
+			Symbol name = node->symbol;
+			if (!m_Compiler.m_Context.HasVariable(name) || m_Compiler.m_Context.GetVariable(name).m_Type != m_Type)
+				return false;
+
+			// Reading an accumulator would be a loop-carried dependency
+			for (auto& reduction : m_Reductions)
+			{
+				if (reduction.m_Accumulator == name)
+					return false;
+			}
+
+			return true;
+		}
+		case ASTTypes::Add:
+		case ASTTypes::Subtract:
+		case ASTTypes::Multiply:
+			return IsValidExpression(node->left) && IsValidExpression(node->right);
+		case ASTTypes::Divide:
+			// There is no packed integer division
+			return m_Type == ValueTypes::Float && IsValidExpression(node->left) && IsValidExpression(node->right);
+		default:
+			return false;
+		}
+	}
+
+	void LoopVectorizer::Compile()
+	{
+		Section& text = m_Compiler.m_TextSection;
+
+		if (m_Compiler.m_VectorizedLoops == 0)
+		{
+			// -1 means that CPUID hasn't been checked yet
+			m_Compiler.m_DataSection.AddLine("cpu_has_avx2 DD -1");
+			m_Compiler.m_DataSection.AddLine("vec_lane_offsets DD 0, 1, 2, 3, 4, 5, 6, 7");
+		}
+
+		m_Compiler.m_VectorizedLoops++;
+
+		m_Compiler.m_Context.m_LoopInfo.labelIndex++;
+		int labelIndex = m_Compiler.m_Context.m_LoopInfo.labelIndex;
+		std::string index = std::to_string(labelIndex);
+
+		text.AddComment("Vectorized loop");
+		text.AddInstruction("cmp", "dword [cpu_has_avx2]", "-1");
+		text.AddInstruction("jne", "vec_dispatch" + index);
+		text.AddInstruction("call", "detect_avx2");
+		text.AddInstruction("mov", "dword [cpu_has_avx2]", "eax");
+		text.AddLabel("vec_dispatch" + index + ":");
+		text.AddInstruction("cmp", "dword [cpu_has_avx2]", "1");
+		text.AddInstruction("jne", "vec_sse2_start" + index);
+
+		CompileVersion(text, true, labelIndex);
+		text.AddInstruction("jmp", "vec_done" + index);
+
+		text.AddLabel("vec_sse2_start" + index + ":");
+		CompileVersion(text, false, labelIndex);
+
+		text.AddLabel("vec_done" + index + ":");
+		text.AddComment("Scalar remainder");
+	}
+
+	void LoopVectorizer::CompileVersion(Section& section, bool avx2, int labelIndex)
+	{
+		auto& loopVariable = m_Compiler.m_Context.GetVariable(m_LoopVariable);
+
+		const std::string prefix = avx2 ? "vec_avx2_" : "vec_sse2_";
+		const std::string index = std::to_string(labelIndex);
+		const std::string lanes = std::to_string(GetLaneCount(avx2));
+
+		std::string bound;
+		if (m_Bound->type == ASTTypes::IntLiteral)
+			bound = std::to_string((int)m_Bound->numberValue);
+		else
+			bound = m_Compiler.m_Context.GetVariable(m_Bound->symbol).GetASMLocation("dword");
+
+		// Lane n of the loop variable register is i + n
+		if (m_Type == ValueTypes::Integer)
+		{
+			std::string loopRegister = Register(LoopVariableRegister, avx2);
+			std::string stepRegister = Register(StepRegister, avx2);
+
+			section.AddInstruction("mov", "eax", loopVariable.GetASMLocation("dword"));
+			CompileBroadcast(section, loopRegister, "eax", avx2);
+
+			if (avx2)
+			{
+				section.AddInstruction("vmovdqu", stepRegister, "[vec_lane_offsets]");
+				section.AddInstruction("vpaddd", loopRegister, loopRegister + ", " + stepRegister);
+			}
+			else
+			{
+				section.AddInstruction("movdqu", stepRegister, "[vec_lane_offsets]");
+				section.AddInstruction("paddd", loopRegister, stepRegister);
+			}
+
+			section.AddInstruction("mov", "eax", lanes);
+			CompileBroadcast(section, stepRegister, "eax", avx2);
+		}
+
+		for (int i = 0; i < m_Reductions.size(); i++)
+		{
+			std::string accumulator = Register(FirstAccumulatorRegister + i, avx2);
+
+			if (!avx2)
+				section.AddInstruction("pxor", accumulator, accumulator);
+			else if (m_Type == ValueTypes::Float)
+				section.AddInstruction("vxorpd", accumulator, accumulator + ", " + accumulator);
+			else
+				section.AddInstruction("vpxor", accumulator, accumulator + ", " + accumulator);
+		}
+
+		// Run while all the lanes are inside the bounds, i + lanes <= bound
+		section.AddLabel(prefix + "loop" + index + ":");
+		section.AddInstruction("mov", "eax", loopVariable.GetASMLocation("dword"));
+		section.AddInstruction("add", "eax", lanes);
+		section.AddInstruction("cmp", "eax", bound);
+		section.AddInstruction("jg", prefix + "end" + index);
+
+		for (int i = 0; i < m_Reductions.size(); i++)
+		{
+			const Reduction& reduction = m_Reductions[i];
+
+			CompileExpression(section, reduction.m_Expression, 0, avx2);
+
+			std::string accumulator = Register(FirstAccumulatorRegister + i, avx2);
+			std::string value = Register(0, avx2);
+
+			std::string op;
+			if (m_Type == ValueTypes::Integer)
+				op = reduction.m_IsSubtraction ? "psubd" : "paddd";
+			else
+				op = reduction.m_IsSubtraction ? "subpd" : "addpd";
+
+			if (avx2)
+				section.AddInstruction("v" + op, accumulator, accumulator + ", " + value);
+			else
+				section.AddInstruction(op, accumulator, value);
+		}
+
+		if (m_Type == ValueTypes::Integer)
+		{
+			std::string loopRegister = Register(LoopVariableRegister, avx2);
+			std::string stepRegister = Register(StepRegister, avx2);
+
+			if (avx2)
+				section.AddInstruction("vpaddd", loopRegister, loopRegister + ", " + stepRegister);
+			else
+				section.AddInstruction("paddd", loopRegister, stepRegister);
+		}
+
+		section.AddInstruction("add", loopVariable.GetASMLocation("dword"), lanes);
+		section.AddInstruction("jmp", prefix + "loop" + index);
+		section.AddLabel(prefix + "end" + index + ":");
+
+		// Add the lanes together into the scalar accumulators
+		for (int i = 0; i < m_Reductions.size(); i++)
+			CompileHorizontalSum(section, m_Reductions[i], FirstAccumulatorRegister + i, avx2);
+
+		// Avoid the penalty for mixing AVX and SSE code afterwards
+		if (avx2)
+			section.AddInstruction("vzeroupper");
+	}
+
+	bool LoopVectorizer::CompileExpression(Section& section, ASTNode* node, int reg, bool avx2)
+	{
+		if (reg >= TemporaryRegisterCount)
+			return false;
+
+		std::string dest = Register(reg, avx2);
+
+		switch (node->type)
+		{
+		case ASTTypes::IntLiteral:
+		{
+			section.AddInstruction("mov", "eax", std::to_string((int)node->numberValue));
+			CompileBroadcast(section, dest, "eax", avx2);
+			return true;
+		}
+		case ASTTypes::DoubleLiteral:
+		{
+			CompileBroadcast(section, dest, "qword [" + GetFloatConstant(node->numberValue) + "]", avx2);
+			return true;
+		}
+		case ASTTypes::Variable:
+		{
+			if (node->symbol == m_LoopVariable)
+			{
+				std::string loopRegister = Register(LoopVariableRegister, avx2);
+				section.AddInstruction(avx2 ? "vmovdqa" : "movdqa", dest, loopRegister);
+				return true;
+			}
+
+			auto& variable = m_Compiler.m_Context.GetVariable(node->symbol);
+
+			if (m_Type == ValueTypes::Integer)
+			{
+				section.AddInstruction("mov", "eax", variable.GetASMLocation("dword"));
+				CompileBroadcast(section, dest, "eax", avx2);
+			}
+			else
+			{
+				CompileBroadcast(section, dest, variable.GetASMLocation("qword"), avx2);
+			}
+
+			return true;
+		}
+		case ASTTypes::Add:
+		case ASTTypes::Subtract:
+		case ASTTypes::Multiply:
+		case ASTTypes::Divide:
+		{
+			if (!CompileExpression(section, node->left, reg, avx2))
+				return false;
+			if (!CompileExpression(section, node->right, reg + 1, avx2))
+				return false;
+
+			std::string src = Register(reg + 1, avx2);
+
+			if (m_Type == ValueTypes::Float)
+			{
+				std::string op;
+				if (node->type == ASTTypes::Add) op = "addpd";
+				else if (node->type == ASTTypes::Subtract) op = "subpd";
+				else if (node->type == ASTTypes::Multiply) op = "mulpd";
+				else op = "divpd";
+
+				if (avx2)
+					section.AddInstruction("v" + op, dest, dest + ", " + src);
+				else
+					section.AddInstruction(op, dest, src);
+
+				return true;
+			}
+
+			if (node->type == ASTTypes::Add || node->type == ASTTypes::Subtract)
+			{
+				std::string op = node->type == ASTTypes::Add ? "paddd" : "psubd";
+
+				if (avx2)
+					section.AddInstruction("v" + op, dest, dest + ", " + src);
+				else
+					section.AddInstruction(op, dest, src);
+
+				return true;
+			}
+
+			if (avx2)
+			{
+				section.AddInstruction("vpmulld", dest, dest + ", " + src);
+				return true;
+			}
+
+			// SSE2 only has pmuludq, which multiplies lane 0 and 2. Do the odd lanes separately and shuffle the results back together
+			if (reg + 3 >= TemporaryRegisterCount)
+				return false;
+
+			std::string oddLhs = Register(reg + 2, avx2);
+			std::string oddRhs = Register(reg + 3, avx2);
+
+			section.AddInstruction("movdqa", oddLhs, dest);
+			section.AddInstruction("movdqa", oddRhs, src);
+			section.AddInstruction("psrlq", oddLhs, "32");
+			section.AddInstruction("psrlq", oddRhs, "32");
+			section.AddInstruction("pmuludq", dest, src);
+			section.AddInstruction("pmuludq", oddLhs, oddRhs);
+			section.AddInstruction("pshufd", dest, dest + ", 0x08");
+			section.AddInstruction("pshufd", oddLhs, oddLhs + ", 0x08");
+			section.AddInstruction("punpckldq", dest, oddLhs);
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+
+	void LoopVectorizer::CompileBroadcast(Section& section, const std::string& reg, const std::string& source, bool avx2)
+	{
+		if (m_Type == ValueTypes::Integer)
+		{
+			std::string xmm = "xmm" + reg.substr(3);
+
+			if (avx2)
+			{
+				section.AddInstruction("vmovd", xmm, source);
+				section.AddInstruction("vpbroadcastd", reg, xmm);
+			}
+			else
+			{
+				section.AddInstruction("movd", reg, source);
+				section.AddInstruction("pshufd", reg, reg + ", 0");
+			}
+		}
+		else
+		{
+			if (avx2)
+			{
+				section.AddInstruction("vbroadcastsd", reg, source);
+			}
+			else
+			{
+				section.AddInstruction("movsd", reg, source);
+				section.AddInstruction("unpcklpd", reg, reg);
+			}
+		}
+	}
+
+	void LoopVectorizer::CompileHorizontalSum(Section& section, const Reduction& reduction, int reg, bool avx2)
+	{
+		auto& accumulator = m_Compiler.m_Context.GetVariable(reduction.m_Accumulator);
+
+		std::string sum = Register(reg, avx2, true);
+		std::string temp = Register(0, avx2, true);
+
+		// Subtractions have been accumulated as negative values, so the lanes are always added to the accumulator
+		if (m_Type == ValueTypes::Integer)
+		{
+			if (avx2)
+			{
+				section.AddInstruction("vextracti128", temp, Register(reg, avx2) + ", 1");
+				section.AddInstruction("vpaddd", sum, sum + ", " + temp);
+				section.AddInstruction("vpshufd", temp, sum + ", 0x4E");
+				section.AddInstruction("vpaddd", sum, sum + ", " + temp);
+				section.AddInstruction("vpshufd", temp, sum + ", 0xB1");
+				section.AddInstruction("vpaddd", sum, sum + ", " + temp);
+				section.AddInstruction("vmovd", "eax", sum);
+			}
+			else
+			{
+				section.AddInstruction("pshufd", temp, sum + ", 0x4E");
+				section.AddInstruction("paddd", sum, temp);
+				section.AddInstruction("pshufd", temp, sum + ", 0xB1");
+				section.AddInstruction("paddd", sum, temp);
+				section.AddInstruction("movd", "eax", sum);
+			}
+
+			section.AddInstruction("add", accumulator.GetASMLocation("dword"), "eax");
+		}
+		else
+		{
+			std::string location = accumulator.GetASMLocation("qword");
+
+			if (avx2)
+			{
+				section.AddInstruction("vextractf128", temp, Register(reg, avx2) + ", 1");
+				section.AddInstruction("vaddpd", sum, sum + ", " + temp);
+				section.AddInstruction("vunpckhpd", temp, sum + ", " + sum);
+				section.AddInstruction("vaddsd", sum, sum + ", " + temp);
+				section.AddInstruction("vaddsd", sum, sum + ", " + location);
+				section.AddInstruction("vmovsd", location, sum);
+			}
+			else
+			{
+				section.AddInstruction("movapd", temp, sum);
+				section.AddInstruction("unpckhpd", temp, temp);
+				section.AddInstruction("addsd", sum, temp);
+				section.AddInstruction("addsd", sum, location);
+				section.AddInstruction("movsd", location, sum);
+			}
+		}
+	}
+
+	std::string LoopVectorizer::GetFloatConstant(float value)
+	{
+		if (m_IsDryRun)
+			return "float_0";
+
+		ConstantsPool& constants = m_Compiler.m_Constants;
+
+		// Same as for float literals in the scalar code
+		if (constants.HasFloat(value))
+			return "float_" + std::to_string(constants.GetFloatIndex(value));
+
+		std::string name = "float_" + std::to_string(constants.StoreFloat(value));
+		std::string str = std::to_string(value);
+		std::replace(str.begin(), str.end(), ',', '.');
+
+		m_Compiler.m_DataSection.AddLine(name + " " + "DQ " + str);
+		return name;
+	}
+
+	std::string LoopVectorizer::Register(int index, bool avx2, bool forceXmm)
+	{
+		return ((avx2 && !forceXmm) ? "ymm" : "xmm") + std::to_string(index);
+	}
+
+	int LoopVectorizer::GetLaneCount(bool avx2)
+	{
+		// 32-bit integers and 64-bit floats
+		int bytes = avx2 ? 32 : 16;
+		return bytes / (m_Type == ValueTypes::Integer ? 4 : 8);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "AssemblyCompiler.h"
+
+#include <string>
+#include <vector>
+
+namespace ASM {
+	// Vectorizes simple counted for-loops:
+	//		for (int i = start, i < bound, i++) { sum += <expression>; ... }
+	// Every statement in the body has to be a reduction into an accumulator, and the expressions may only read literals,
+	// the loop variable and variables that are not written to in the loop, so that there are no loop-carried dependencies other than the reductions.
+	// The loop is compiled to both an SSE2 and an AVX2 version. The one to use is picked at runtime with CPUID,
+	// and the normal scalar loop runs afterwards to take care of the remaining iterations
+	class LoopVectorizer
+	{
+	public:
+		struct Reduction
+		{
+			Symbol m_Accumulator = NoSymbol;
+			ASTNode* m_Expression = nullptr;
+			bool m_IsSubtraction = false;
+		};
+
+		LoopVectorizer(AssemblyCompiler& compiler);
+
+		bool CanVectorize(ASTNode* node);
+
+		// Compiles the loop that CanVectorize() accepted. Should be called after the loop variable has been declared, but before the scalar loop is compiled
+		void Compile();
+
+	private:
+		bool IsValidExpression(ASTNode* node);
+
+		void CompileVersion(Section& section, bool avx2, int labelIndex);
+		bool CompileExpression(Section& section, ASTNode* node, int reg, bool avx2);
+		void CompileBroadcast(Section& section, const std::string& reg, const std::string& source, bool avx2);
+		void CompileHorizontalSum(Section& section, const Reduction& reduction, int reg, bool avx2);
+
+		std::string GetFloatConstant(float value);
+		std::string Register(int index, bool avx2, bool forceXmm = false);
+
+		int GetLaneCount(bool avx2);
+
+	private:
+		AssemblyCompiler& m_Compiler;
+
+		Symbol m_LoopVariable = NoSymbol;
+		ASTNode* m_Bound = nullptr;
+		ValueTypes m_Type = ValueTypes::Void;
+
+		std::vector<Reduction> m_Reductions;
+
+		// Don't add constants to the data section while checking if the loop can be vectorized
+		bool m_IsDryRun = false;
+	};
+}
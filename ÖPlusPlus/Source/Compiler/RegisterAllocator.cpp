@@ -0,0 +1,445 @@
+#include "RegisterAllocator.h"
+
+#include <algorithm>
+#include <map>
+#include <cassert>
+
+// The code generator only uses eax, ebx, ecx and edx. esi and edi are callee-saved in cdecl, so calls into the C library keep them intact
+static const char* AllocatableRegisters[] = { "esi", "edi" };
+constexpr int AllocatableRegistersCount = 2;
+
+struct StackReference
+{
+	int m_Slot = 0;
+	int m_Size = 0; // 0 means that the size is unknown or that the address is taken
+};
+
+// Parses operands like "dword [ebp - 8]" or "[ebp - 8]"
+static bool ParseStackReference(const std::string& operand, StackReference& ref)
+{
+	const std::string base = "[ebp - ";
+
+	size_t bracket = operand.find(base);
+	if (bracket == std::string::npos)
+		return false;
+
+	size_t close = operand.find("]", bracket);
+	if (close == std::string::npos)
+		return false;
+
+	ref.m_Slot = std::stoi(operand.substr(bracket + base.size(), close - bracket - base.size()));
+
+	std::string prefix = operand.substr(0, bracket);
+	if (close != operand.size() - 1)
+		ref.m_Size = 0;
+	else if (prefix == "" || prefix == "dword ")
+		ref.m_Size = 4;
+	else if (prefix == "byte ")
+		ref.m_Size = 1;
+	else if (prefix == "word ")
+		ref.m_Size = 2;
+	else if (prefix == "qword ")
+		ref.m_Size = 8;
+	else
+		ref.m_Size = 0;
+
+	return true;
+}
+
+// The bytes of a reference, as distances below ebp
+static std::pair<int, int> GetReferenceRange(const StackReference& ref)
+{
+	// Unknown accesses are treated as the largest possible one
+	int size = ref.m_Size == 0 ? 8 : ref.m_Size;
+	return std::make_pair(ref.m_Slot - size + 1, ref.m_Slot);
+}
+
+static bool RangesOverlap(std::pair<int, int> a, std::pair<int, int> b)
+{
+	return a.first <= b.second && b.first <= a.second;
+}
+
+namespace ASM {
+	RegisterAllocator::RegisterAllocator(Section& section, const std::vector<std::string>& routines)
+		: m_Section(section)
+	{
+		for (const std::string& routine : routines)
+			m_Routines.insert(routine);
+	}
+
+	void RegisterAllocator::Allocate()
+	{
+		auto& lines = m_Section.GetLines();
+
+		// Every routine has its own call frame, so the same [ebp - n] means different things in different routines
+		std::vector<std::pair<int, int>> routineRanges;
+		int routineStart = -1;
+
+		for (int i = 0; i < lines.size(); i++)
+		{
+			if (!IsRoutineLabel(lines[i]))
+				continue;
+
+			if (routineStart != -1)
+				routineRanges.push_back(std::make_pair(routineStart, i));
+
+			routineStart = i;
+		}
+
+		if (routineStart != -1)
+			routineRanges.push_back(std::make_pair(routineStart, (int)lines.size()));
+
+		for (auto& range : routineRanges)
+			AllocateRoutine(range.first, range.second);
+
+		if (m_Insertions.empty())
+			return;
+
+		std::stable_sort(m_Insertions.begin(), m_Insertions.end(), [](auto& a, auto& b) { return a.first < b.first; });
+
+		std::vector<Instruction> newInstructions;
+		newInstructions.reserve(lines.size() + m_Insertions.size());
+
+		int insertionIndex = 0;
+		for (int i = 0; i <= lines.size(); i++)
+		{
+			while (insertionIndex < m_Insertions.size() && m_Insertions[insertionIndex].first == i)
+				newInstructions.push_back(m_Insertions[insertionIndex++].second);
+
+			if (i < lines.size())
+				newInstructions.push_back(lines[i]);
+		}
+
+		lines = newInstructions;
+		m_Insertions.clear();
+	}
+
+	void RegisterAllocator::AllocateRoutine(int start, int end)
+	{
+		auto& lines = m_Section.GetLines();
+
+		std::vector<LiveInterval> intervals = ComputeLiveIntervals(start, end);
+		if (intervals.empty())
+			return;
+
+		ExtendIntervalsOverLoops(intervals, start, end);
+		LinearScan(intervals);
+
+		std::vector<std::string> usedRegisters;
+		for (auto& interval : intervals)
+		{
+			if (interval.m_Register == "")
+				continue;
+
+			m_AllocatedCount++;
+
+			if (std::find(usedRegisters.begin(), usedRegisters.end(), interval.m_Register) == usedRegisters.end())
+				usedRegisters.push_back(interval.m_Register);
+
+			Instruction comment("", "", "", "[ebp - " + std::to_string(interval.m_Slot) + "] in " + interval.m_Register);
+			comment.m_IsOnlyComment = true;
+			m_Insertions.push_back(std::make_pair(start + 1, comment));
+		}
+
+		if (usedRegisters.empty())
+			return;
+
+		RewriteOperands(intervals, start, end);
+		SaveRegistersAroundCalls(intervals, start, end);
+
+		// CMAIN is called from the C runtime, which expects esi and edi to be preserved
+		if (lines[start].m_Op == "CMAIN:")
+		{
+			for (int i = 0; i < usedRegisters.size(); i++)
+				m_Insertions.push_back(std::make_pair(start + 1, Instruction("push", usedRegisters[i], "", "callee-saved")));
+
+			for (int i = end - 1; i > start; i--)
+			{
+				if (lines[i].m_Op != "ret")
+					continue;
+
+				for (int j = usedRegisters.size() - 1; j >= 0; j--)
+					m_Insertions.push_back(std::make_pair(i, Instruction("pop", usedRegisters[j], "", "callee-saved")));
+				break;
+			}
+		}
+	}
+
+	std::vector<RegisterAllocator::LiveInterval> RegisterAllocator::ComputeLiveIntervals(int start, int end)
+	{
+		auto& lines = m_Section.GetLines();
+
+		std::map<int, LiveInterval> candidates;
+		std::vector<StackReference> otherReferences;
+
+		for (int i = start; i < end; i++)
+		{
+			Instruction& inst = lines[i];
+			if (inst.m_IsLabel || inst.m_IsOnlyComment)
+				continue;
+
+			for (const std::string* operand : { &inst.m_Dest, &inst.m_Src })
+			{
+				StackReference ref;
+				if (!ParseStackReference(*operand, ref))
+					continue;
+
+				// The address of the slot escapes, so it has to stay in memory
+				if (inst.m_Op == "lea")
+					ref.m_Size = 0;
+
+				if (ref.m_Size != 4)
+				{
+					otherReferences.push_back(ref);
+					continue;
+				}
+
+				LiveInterval& interval = candidates[ref.m_Slot];
+				if (interval.m_Start == -1)
+				{
+					interval.m_Slot = ref.m_Slot;
+					interval.m_Start = i;
+				}
+				interval.m_End = i;
+			}
+		}
+
+		std::vector<LiveInterval> intervals;
+
+		for (auto& [slot, interval] : candidates)
+		{
+			auto range = GetReferenceRange({ slot, 4 });
+			bool isAliased = false;
+
+			// Floats are also accessed as two dwords, and scopes reuse the same stack space for different types
+			for (auto& other : otherReferences)
+			{
+				if (RangesOverlap(range, GetReferenceRange(other)))
+				{
+					isAliased = true;
+					break;
+				}
+			}
+
+			for (auto& [otherSlot, otherInterval] : candidates)
+			{
+				if (otherSlot != slot && RangesOverlap(range, GetReferenceRange({ otherSlot, 4 })))
+				{
+					isAliased = true;
+					break;
+				}
+			}
+
+			if (!isAliased)
+				intervals.push_back(interval);
+		}
+
+		m_CandidateCount += intervals.size();
+
+		return intervals;
+	}
+
+	void RegisterAllocator::ExtendIntervalsOverLoops(std::vector<LiveInterval>& intervals, int start, int end)
+	{
+		auto& lines = m_Section.GetLines();
+
+		std::unordered_map<std::string, int> labels;
+		for (int i = start; i < end; i++)
+		{
+			const std::string& op = lines[i].m_Op;
+			if (lines[i].m_IsLabel && op.back() == ':')
+				labels[op.substr(0, op.size() - 1)] = i;
+		}
+
+		// A jump backwards is a loop. A value that is used anywhere in the loop has to survive the whole loop
+		std::vector<std::pair<int, int>> loops;
+		std::vector<std::pair<int, int>> forwardJumps;
+		for (int i = start; i < end; i++)
+		{
+			const Instruction& inst = lines[i];
+			if (inst.m_IsLabel || inst.m_Op == "" || inst.m_Op[0] != 'j')
+				continue;
+
+			if (labels.count(inst.m_Dest) == 0)
+				continue;
+
+			if (labels[inst.m_Dest] <= i)
+				loops.push_back(std::make_pair(labels[inst.m_Dest], i));
+			else
+				forwardJumps.push_back(std::make_pair(i, labels[inst.m_Dest]));
+		}
+
+		// Except for a value that is only used inside the loop and is written before it's read in every iteration, like the
+		// argument temporaries of calls in the loop body. Nothing is kept from one iteration to the next
+		auto isWrittenFirst = [&](const LiveInterval& interval, const std::pair<int, int>& loop) {
+			if (interval.m_Start <= loop.first || interval.m_End >= loop.second)
+				return false;
+
+			const Instruction& first = lines[interval.m_Start];
+			StackReference ref;
+			if (first.m_Op != "mov" || !ParseStackReference(first.m_Dest, ref) || ref.m_Slot != interval.m_Slot)
+				return false;
+
+			// A jump over the write, like an if statement or a continue, could get to a read without it
+			for (auto& jump : forwardJumps)
+			{
+				if (jump.first >= loop.first && jump.first < interval.m_Start && jump.second > interval.m_Start && jump.second <= loop.second)
+					return false;
+			}
+
+			return true;
+		};
+
+		// Nested loops can extend an interval into an outer loop, so repeat until nothing changes
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+
+			for (auto& interval : intervals)
+			{
+				for (auto& loop : loops)
+				{
+					if (!RangesOverlap({ interval.m_Start, interval.m_End }, loop) || isWrittenFirst(interval, loop))
+						continue;
+
+					if (interval.m_Start > loop.first || interval.m_End < loop.second)
+					{
+						interval.m_Start = std::min(interval.m_Start, loop.first);
+						interval.m_End = std::max(interval.m_End, loop.second);
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+
+	void RegisterAllocator::LinearScan(std::vector<LiveInterval>& intervals)
+	{
+		std::sort(intervals.begin(), intervals.end(), [](const LiveInterval& a, const LiveInterval& b) { return a.m_Start < b.m_Start; });
+
+		// Sorted by increasing end point
+		std::vector<LiveInterval*> active;
+
+		std::vector<std::string> freeRegisters;
+		for (int i = AllocatableRegistersCount - 1; i >= 0; i--)
+			freeRegisters.push_back(AllocatableRegisters[i]);
+
+		auto addToActive = [&](LiveInterval* interval) {
+			auto it = std::upper_bound(active.begin(), active.end(), interval, [](LiveInterval* a, LiveInterval* b) { return a->m_End < b->m_End; });
+			active.insert(it, interval);
+		};
+
+		for (auto& current : intervals)
+		{
+			// Expire old intervals
+			for (int i = 0; i < active.size();)
+			{
+				if (active[i]->m_End < current.m_Start)
+				{
+					freeRegisters.push_back(active[i]->m_Register);
+					active.erase(active.begin() + i);
+				}
+				else
+				{
+					i++;
+				}
+			}
+
+			if (!freeRegisters.empty())
+			{
+				current.m_Register = freeRegisters.back();
+				freeRegisters.pop_back();
+				addToActive(&current);
+				continue;
+			}
+
+			// Out of registers. Spill the interval that ends last
+			LiveInterval* spill = active.back();
+			if (spill->m_End > current.m_End)
+			{
+				current.m_Register = spill->m_Register;
+				spill->m_Register = "";
+
+				active.pop_back();
+				addToActive(&current);
+			}
+		}
+	}
+
+	void RegisterAllocator::RewriteOperands(const std::vector<LiveInterval>& intervals, int start, int end)
+	{
+		auto& lines = m_Section.GetLines();
+
+		std::unordered_map<int, std::string> slotToRegister;
+		for (auto& interval : intervals)
+		{
+			if (interval.m_Register != "")
+				slotToRegister[interval.m_Slot] = interval.m_Register;
+		}
+
+		for (int i = start; i < end; i++)
+		{
+			Instruction& inst = lines[i];
+			if (inst.m_IsLabel || inst.m_IsOnlyComment || inst.m_Op == "lea")
+				continue;
+
+			for (std::string* operand : { &inst.m_Dest, &inst.m_Src })
+			{
+				StackReference ref;
+				if (!ParseStackReference(*operand, ref) || ref.m_Size != 4)
+					continue;
+
+				if (slotToRegister.count(ref.m_Slot) == 1)
+					*operand = slotToRegister[ref.m_Slot];
+			}
+		}
+	}
+
+	void RegisterAllocator::SaveRegistersAroundCalls(const std::vector<LiveInterval>& intervals, int start, int end)
+	{
+		auto& lines = m_Section.GetLines();
+
+		// Functions compiled by us don't preserve esi and edi, so the caller saves the ones that are live across the call.
+		// They are pushed before the caller-saved edx, so that the arguments are still right above the return address
+		for (int i = start; i < end; i++)
+		{
+			if (lines[i].m_Op != "call" || m_Routines.count(lines[i].m_Dest) == 0)
+				continue;
+
+			std::vector<std::string> liveRegisters;
+			for (auto& interval : intervals)
+			{
+				if (interval.m_Register != "" && interval.m_Start < i && interval.m_End > i)
+					liveRegisters.push_back(interval.m_Register);
+			}
+
+			if (liveRegisters.empty())
+				continue;
+
+			int pushIndex = i;
+			while (pushIndex > start && !(lines[pushIndex].m_Op == "push" && lines[pushIndex].m_Dest == "edx"))
+				pushIndex--;
+
+			int popIndex = i;
+			while (popIndex < end && !(lines[popIndex].m_Op == "pop" && lines[popIndex].m_Dest == "edx"))
+				popIndex++;
+
+			assert(pushIndex > start && popIndex < end);
+
+			for (int j = 0; j < liveRegisters.size(); j++)
+				m_Insertions.push_back(std::make_pair(pushIndex, Instruction("push", liveRegisters[j], "", "caller-saved")));
+
+			for (int j = liveRegisters.size() - 1; j >= 0; j--)
+				m_Insertions.push_back(std::make_pair(popIndex + 1, Instruction("pop", liveRegisters[j], "", "caller-saved")));
+		}
+	}
+
+	bool RegisterAllocator::IsRoutineLabel(const Instruction& inst)
+	{
+		if (!inst.m_IsLabel || inst.m_Op.size() < 2 || inst.m_Op.back() != ':')
+			return false;
+
+		return m_Routines.count(inst.m_Op.substr(0, inst.m_Op.size() - 1)) == 1;
+	}
+}
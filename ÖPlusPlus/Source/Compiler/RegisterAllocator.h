@@ -0,0 +1,56 @@
+#pragma once
+
+#include "AssemblyCompiler.h"
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+namespace ASM {
+	// Linear scan register allocator (Poletto & Sarkar) that runs on the generated text section.
+	// The compiler places every local variable on the stack at [ebp - n]. This pass finds the 32-bit slots that are only
+	// accessed as a whole, computes their live intervals and moves them into the registers the compiler never uses (esi, edi).
+	// Slots that don't fit are spilled, which here means that they simply stay on the stack
+	class RegisterAllocator
+	{
+	public:
+		struct LiveInterval
+		{
+			int m_Slot = 0; // Offset below ebp
+			int m_Start = -1;
+			int m_End = -1;
+
+			std::string m_Register = ""; // Empty when spilled
+		};
+
+		RegisterAllocator(Section& section, const std::vector<std::string>& routines);
+
+		void Allocate();
+
+		int GetCandidateCount() { return m_CandidateCount; }
+		int GetAllocatedCount() { return m_AllocatedCount; }
+
+	private:
+		void AllocateRoutine(int start, int end);
+
+		std::vector<LiveInterval> ComputeLiveIntervals(int start, int end);
+		void ExtendIntervalsOverLoops(std::vector<LiveInterval>& intervals, int start, int end);
+		void LinearScan(std::vector<LiveInterval>& intervals);
+
+		void RewriteOperands(const std::vector<LiveInterval>& intervals, int start, int end);
+		void SaveRegistersAroundCalls(const std::vector<LiveInterval>& intervals, int start, int end);
+
+		bool IsRoutineLabel(const Instruction& inst);
+
+	private:
+		Section& m_Section;
+
+		std::unordered_set<std::string> m_Routines;
+
+		// Instructions that are inserted before the line with the same index when the allocation is done
+		std::vector<std::pair<int, Instruction>> m_Insertions;
+
+		int m_CandidateCount = 0;
+		int m_AllocatedCount = 0;
+	};
+}
@@ -0,0 +1,595 @@
+#include "Inliner.h"
+
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
+// Sizes are counted in AST nodes. Calls inside loops may be larger, since that's where the call overhead adds up
+constexpr int MaxInlineSize = 12;
+constexpr int MaxInlineSizeInLoop = 24;
+
+static ASTNode* CloneTree(ASTArena& arena, ASTNode* node, ASTNode* parent)
+{
+	if (node == nullptr)
+		return nullptr;
+
+	ASTNode* copy = arena.Create(node->type);
+	copy->parent = parent;
+	copy->numberValue = node->numberValue;
+	copy->stringValue = node->stringValue;
+	copy->symbol = node->symbol;
+
+	copy->left = CloneTree(arena, node->left, copy);
+	copy->right = CloneTree(arena, node->right, copy);
+
+	for (ASTNode* argument : node->arguments)
+		copy->arguments.push_back(CloneTree(arena, argument, copy));
+
+	return copy;
+}
+
+// Moves the contents of the replacement into the node, so that the parent doesn't have to be changed.
+// The replacement is left empty, the arena frees it with the rest of the tree
+static void ReplaceNode(ASTNode* node, ASTNode* replacement)
+{
+	ASTNode* parent = node->parent;
+	uint32_t index = node->index;
+
+	*node = *replacement;
+	node->parent = parent;
+	node->index = index;
+
+	if (node->left != nullptr) node->left->parent = node;
+	if (node->right != nullptr) node->right->parent = node;
+	for (ASTNode* argument : node->arguments)
+		argument->parent = node;
+
+	replacement->left = nullptr;
+	replacement->right = nullptr;
+	replacement->arguments.clear();
+}
+
+static int CountNodes(ASTNode* node)
+{
+	if (node == nullptr)
+		return 0;
+
+	int count = 1 + CountNodes(node->left) + CountNodes(node->right);
+	for (ASTNode* argument : node->arguments)
+		count += CountNodes(argument);
+
+	return count;
+}
+
+static int CountUses(ASTNode* node, Symbol variableName)
+{
+	if (node == nullptr)
+		return 0;
+
+	int count = (node->type == ASTTypes::Variable && node->symbol == variableName) ? 1 : 0;
+	count += CountUses(node->left, variableName) + CountUses(node->right, variableName);
+	for (ASTNode* argument : node->arguments)
+		count += CountUses(argument, variableName);
+
+	return count;
+}
+
+static bool ContainsCall(ASTNode* node)
+{
+	if (node == nullptr)
+		return false;
+
+	if (node->type == ASTTypes::FunctionCall)
+		return true;
+
+	if (ContainsCall(node->left) || ContainsCall(node->right))
+		return true;
+
+	for (ASTNode* argument : node->arguments)
+	{
+		if (ContainsCall(argument))
+			return true;
+	}
+
+	return false;
+}
+
+static bool IsWrite(ASTNode* node)
+{
+	switch (node->type)
+	{
+	case ASTTypes::Assign:
+	case ASTTypes::PropertyAssign:
+	case ASTTypes::PlusEquals:
+	case ASTTypes::MinusEquals:
+	case ASTTypes::PostIncrement:
+	case ASTTypes::PreIncrement:
+	case ASTTypes::PostDecrement:
+	case ASTTypes::PreDecrement:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Calls, and everything that changes a variable
+static bool HasSideEffects(ASTNode* node)
+{
+	if (node == nullptr)
+		return false;
+
+	if (node->type == ASTTypes::FunctionCall || IsWrite(node))
+		return true;
+
+	if (HasSideEffects(node->left) || HasSideEffects(node->right))
+		return true;
+
+	for (ASTNode* argument : node->arguments)
+	{
+		if (HasSideEffects(argument))
+			return true;
+	}
+
+	return false;
+}
+
+static void CollectCalls(ASTNode* node, std::vector<Symbol>& calls)
+{
+	if (node == nullptr)
+		return;
+
+	if (node->type == ASTTypes::FunctionCall)
+		calls.push_back(node->symbol);
+
+	CollectCalls(node->left, calls);
+	CollectCalls(node->right, calls);
+	for (ASTNode* argument : node->arguments)
+		CollectCalls(argument, calls);
+}
+
+static void CollectVariables(ASTNode* node, std::unordered_set<Symbol>& variables)
+{
+	if (node == nullptr)
+		return;
+
+	if (node->type == ASTTypes::Variable)
+		variables.insert(node->symbol);
+
+	CollectVariables(node->left, variables);
+	CollectVariables(node->right, variables);
+	for (ASTNode* argument : node->arguments)
+		CollectVariables(argument, variables);
+}
+
+// The variables that are assigned, incremented or decremented
+static void CollectWrittenVariables(ASTNode* node, std::unordered_set<Symbol>& variables)
+{
+	if (node == nullptr)
+		return;
+
+	if (IsWrite(node))
+	{
+		CollectVariables(node, variables);
+		return;
+	}
+
+	CollectWrittenVariables(node->left, variables);
+	CollectWrittenVariables(node->right, variables);
+	for (ASTNode* argument : node->arguments)
+		CollectWrittenVariables(argument, variables);
+}
+
+static bool IsInlinableExpression(ASTNode* node)
+{
+	switch (node->type)
+	{
+	case ASTTypes::IntLiteral:
+	case ASTTypes::DoubleLiteral:
+	case ASTTypes::Variable:
+		return true;
+	case ASTTypes::Add:
+	case ASTTypes::Subtract:
+	case ASTTypes::Multiply:
+	case ASTTypes::Divide:
+	case ASTTypes::Modulus:
+		return IsInlinableExpression(node->left) && IsInlinableExpression(node->right);
+	case ASTTypes::FunctionCall:
+	{
+		for (ASTNode* argument : node->arguments)
+		{
+			if (!IsInlinableExpression(argument))
+				return false;
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+// Replaces all the variables at once, so that a value that contains a variable with the same name as a parameter isn't replaced again
+static void SubstituteVariables(ASTArena& arena, ASTNode* node, const std::unordered_map<Symbol, ASTNode*>& values)
+{
+	if (node == nullptr)
+		return;
+
+	if (node->type == ASTTypes::Variable && values.count(node->symbol) == 1)
+	{
+		ReplaceNode(node, CloneTree(arena, values.at(node->symbol), node->parent));
+		return;
+	}
+
+	SubstituteVariables(arena, node->left, values);
+	SubstituteVariables(arena, node->right, values);
+	for (ASTNode* argument : node->arguments)
+		SubstituteVariables(arena, argument, values);
+}
+
+void Inliner::Run(ASTNode* program)
+{
+	assert(program->type == ASTTypes::ProgramBody);
+
+	CollectFunctions(program->left);
+	FindRecursiveFunctions();
+
+	// Inline into the candidates first, so that every call site gets the fully inlined expression
+	std::unordered_set<Symbol> visited;
+	std::function<void(Symbol)> prepareCandidate = [&](Symbol name) {
+		if (visited.count(name) == 1)
+			return;
+		visited.insert(name);
+
+		InlineCandidate& candidate = m_Candidates[name];
+		if (candidate.m_IsRecursive)
+			return;
+
+		std::vector<Symbol> calls;
+		CollectCalls(candidate.m_Expression, calls);
+		for (Symbol call : calls)
+		{
+			if (m_Candidates.count(call) == 1)
+				prepareCandidate(call);
+		}
+
+		InlineCalls(candidate.m_Expression, 0);
+		candidate.m_Size = CountNodes(candidate.m_Expression);
+		m_Report[StringInterner::Get().GetString(name)].m_Size = candidate.m_Size;
+	};
+
+	for (auto& [name, candidate] : m_Candidates)
+		prepareCandidate(name);
+
+	InlineCalls(program, 0);
+}
+
+void Inliner::PrintReport()
+{
+	std::cout << "Inlining decisions:\n";
+
+	for (auto& [name, report] : m_Report)
+	{
+		Symbol symbol = StringInterner::Get().Find(name);
+
+		std::cout << "\t" << name;
+		if (m_Candidates.count(symbol) == 1)
+			std::cout << " (size " << report.m_Size << ")";
+		std::cout << ": " << report.m_InlinedCalls << " inlined";
+
+		for (auto& [reason, count] : report.m_RejectedCalls)
+			std::cout << ", " << count << " kept (" << reason << ")";
+
+		if (m_NotInlinable.count(symbol) == 1 && report.m_RejectedCalls.empty())
+			std::cout << " (" << m_NotInlinable[symbol] << ")";
+
+		std::cout << "\n";
+	}
+
+	std::cout << "\n";
+}
+
+void Inliner::CollectFunctions(ASTNode* scope)
+{
+	std::unordered_set<Symbol> defined;
+
+	for (ASTNode* node : scope->arguments)
+	{
+		// Exported functions can be inlined in the module
+		if (node->type == ASTTypes::Export && node->left != nullptr)
+			node = node->left;
+
+		if (node->type != ASTTypes::FunctionDefinition)
+			continue;
+
+		Symbol name = node->left->arguments[1]->symbol;
+		m_Report[std::string(node->left->arguments[1]->stringValue)];
+
+		if (defined.count(name) == 1)
+		{
+			m_Candidates.erase(name);
+			m_NotInlinable[name] = "defined more than once";
+			continue;
+		}
+
+		defined.insert(name);
+		AnalyzeFunction(node);
+	}
+}
+
+void Inliner::AnalyzeFunction(ASTNode* definition)
+{
+	ASTNode* prototype = definition->left;
+	ASTNode* body = definition->right;
+
+	Symbol name = prototype->arguments[1]->symbol;
+
+	if (prototype->arguments[0]->VariableTypeToValueType() == ValueTypes::Void)
+	{
+		m_NotInlinable[name] = "no return value";
+		return;
+	}
+
+	InlineCandidate candidate;
+	candidate.m_Definition = definition;
+
+	std::unordered_set<Symbol> names;
+
+	for (int i = 2; i < prototype->arguments.size(); i++)
+	{
+		ASTNode* parameter = prototype->arguments[i];
+		candidate.m_Parameters.push_back(parameter->right->symbol);
+		candidate.m_ParameterTypes.push_back(parameter->left->VariableTypeToValueType());
+		names.insert(parameter->right->symbol);
+	}
+
+	if (body == nullptr || body->type != ASTTypes::Scope || body->arguments.empty())
+	{
+		m_NotInlinable[name] = "empty body";
+		return;
+	}
+
+	// Local variables, like "float pi = 3.14;" are replaced with their values
+	std::vector<std::pair<Symbol, ASTNode*>> locals;
+
+	for (int i = 0; i < body->arguments.size() - 1; i++)
+	{
+		ASTNode* statement = body->arguments[i];
+
+		if (statement->type != ASTTypes::Assign || statement->left->type != ASTTypes::VariableDeclaration ||
+			!IsInlinableExpression(statement->right) || ContainsCall(statement->right))
+		{
+			m_NotInlinable[name] = "body is not a single return statement";
+			return;
+		}
+
+		Symbol localName = statement->left->right->symbol;
+		if (names.count(localName) == 1)
+		{
+			m_NotInlinable[name] = "shadowed variable";
+			return;
+		}
+
+		names.insert(localName);
+		locals.push_back(std::make_pair(localName, statement->right));
+	}
+
+	ASTNode* returnStatement = body->arguments.back();
+	if (returnStatement->type != ASTTypes::Return || returnStatement->left == nullptr || !IsInlinableExpression(returnStatement->left))
+	{
+		m_NotInlinable[name] = "body is not a single return statement";
+		return;
+	}
+
+	candidate.m_Expression = CloneTree(m_Arena, returnStatement->left, nullptr);
+
+	// The last local can depend on the ones before it, so replace them backwards
+	for (int i = locals.size() - 1; i >= 0; i--)
+		SubstituteVariables(m_Arena, candidate.m_Expression, { { locals[i].first, locals[i].second } });
+
+	// Globals could be shadowed by local variables at the call site
+	std::unordered_set<Symbol> variables;
+	CollectVariables(candidate.m_Expression, variables);
+	for (Symbol variable : variables)
+	{
+		if (std::find(candidate.m_Parameters.begin(), candidate.m_Parameters.end(), variable) == candidate.m_Parameters.end())
+		{
+			m_NotInlinable[name] = "uses global variables";
+			return;
+		}
+	}
+
+	candidate.m_Size = CountNodes(candidate.m_Expression);
+	m_Report[std::string(prototype->arguments[1]->stringValue)].m_Size = candidate.m_Size;
+
+	m_Candidates[name] = candidate;
+}
+
+void Inliner::FindRecursiveFunctions()
+{
+	for (auto& [name, candidate] : m_Candidates)
+	{
+		// Search for a path from the function back to itself
+		std::vector<Symbol> stack;
+		std::unordered_set<Symbol> visited;
+
+		CollectCalls(candidate.m_Expression, stack);
+
+		while (!stack.empty())
+		{
+			Symbol current = stack.back();
+			stack.pop_back();
+
+			if (current == name)
+			{
+				candidate.m_IsRecursive = true;
+				break;
+			}
+
+			if (visited.count(current) == 1 || m_Candidates.count(current) == 0)
+				continue;
+
+			visited.insert(current);
+			CollectCalls(m_Candidates[current].m_Expression, stack);
+		}
+	}
+}
+
+void Inliner::InlineCalls(ASTNode* node, int loopDepth)
+{
+	if (node == nullptr)
+		return;
+
+	// The prototype only has declarations
+	if (node->type == ASTTypes::FunctionDefinition)
+	{
+		InlineCalls(node->right, 0);
+		return;
+	}
+
+	int childLoopDepth = loopDepth;
+	if (node->type == ASTTypes::ForStatement || node->type == ASTTypes::WhileStatement)
+		childLoopDepth++;
+
+	// Arguments first, so that calls in the arguments are inlined before the call itself
+	InlineCalls(node->left, childLoopDepth);
+	InlineCalls(node->right, childLoopDepth);
+	for (ASTNode* argument : node->arguments)
+		InlineCalls(argument, childLoopDepth);
+
+	if (node->type != ASTTypes::FunctionCall)
+		return;
+
+	std::string name(node->stringValue);
+	std::string reason = "";
+
+	if (TryInlineCall(node, loopDepth, reason))
+		m_Report[name].m_InlinedCalls++;
+	else if (reason != "")
+		Reject(name, reason);
+}
+
+bool Inliner::TryInlineCall(ASTNode* call, int loopDepth, std::string& reason)
+{
+	Symbol name = call->symbol;
+
+	if (m_NotInlinable.count(name) == 1)
+	{
+		reason = m_NotInlinable[name];
+		return false;
+	}
+
+	// Native functions
+	if (m_Candidates.count(name) == 0)
+		return false;
+
+	InlineCandidate& candidate = m_Candidates[name];
+
+	if (candidate.m_IsRecursive)
+	{
+		reason = "recursive";
+		return false;
+	}
+
+	if (call->arguments.size() != candidate.m_Parameters.size())
+	{
+		reason = "wrong number of arguments";
+		return false;
+	}
+
+	// The backends don't expect a lone expression as a statement. The return expression of a candidate has no parent
+	ASTTypes parentType = call->parent == nullptr ? ASTTypes::Return : call->parent->type;
+	if (parentType == ASTTypes::Scope || parentType == ASTTypes::ProgramBody || parentType == ASTTypes::ForStatement)
+	{
+		reason = "result is unused";
+		return false;
+	}
+
+	int size = candidate.m_Size;
+	int argumentsWithSideEffects = 0;
+
+	std::unordered_map<Symbol, ASTNode*> values;
+	std::unordered_set<Symbol> written;
+
+	for (int i = 0; i < call->arguments.size(); i++)
+	{
+		ASTNode* argument = call->arguments[i];
+		Symbol parameter = candidate.m_Parameters[i];
+		int uses = CountUses(candidate.m_Expression, parameter);
+
+		// The parameter is replaced by the argument everywhere it is used
+		size += uses * (CountNodes(argument) - 1);
+
+		if ((argument->type == ASTTypes::IntLiteral && candidate.m_ParameterTypes[i] != ValueTypes::Integer) ||
+			(argument->type == ASTTypes::DoubleLiteral && candidate.m_ParameterTypes[i] != ValueTypes::Float))
+		{
+			reason = "argument type doesn't match";
+			return false;
+		}
+
+		// Calls and i++ have to be evaluated exactly once, like they would be for a normal call
+		if (HasSideEffects(argument))
+		{
+			argumentsWithSideEffects++;
+
+			if (uses != 1)
+			{
+				reason = "argument with side effects is not used exactly once";
+				return false;
+			}
+
+			CollectWrittenVariables(argument, written);
+		}
+
+		values[parameter] = argument;
+	}
+
+	// The order of the side effects would change
+	if (argumentsWithSideEffects > 1 || (argumentsWithSideEffects == 1 && HasSideEffects(candidate.m_Expression)))
+	{
+		reason = "evaluation order would change";
+		return false;
+	}
+
+	// The other arguments and the function would read the changed variable where the body uses them, not after the argument
+	if (!written.empty())
+	{
+		std::unordered_set<Symbol> read;
+		CollectVariables(candidate.m_Expression, read);
+
+		for (Symbol parameter : candidate.m_Parameters)
+			read.erase(parameter);
+
+		for (ASTNode* argument : call->arguments)
+		{
+			if (!HasSideEffects(argument))
+				CollectVariables(argument, read);
+		}
+
+		for (Symbol variable : written)
+		{
+			if (read.count(variable) == 1)
+			{
+				reason = "evaluation order would change";
+				return false;
+			}
+		}
+	}
+
+	int maxSize = loopDepth > 0 ? MaxInlineSizeInLoop : MaxInlineSize;
+	if (size > maxSize)
+	{
+		reason = "too large";
+		return false;
+	}
+
+	ASTNode* expression = CloneTree(m_Arena, candidate.m_Expression, call->parent);
+	SubstituteVariables(m_Arena, expression, values);
+	ReplaceNode(call, expression);
+
+	return true;
+}
+
+void Inliner::Reject(const std::string& function, const std::string& reason)
+{
+	m_Report[function].m_RejectedCalls[reason]++;
+}
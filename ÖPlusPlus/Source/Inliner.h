@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Parser.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Replaces calls to small functions with the body of the function, before any of the backends see the tree.
+// Only functions that consist of local variable declarations followed by a single return statement are inlined, like:
+//		float dot(float ax, float ay, float bx, float by) => { return ax * bx + ay * by; };
+// The function definitions are kept, so calls that aren't inlined still work
+class Inliner
+{
+public:
+	struct InlineCandidate
+	{
+		ASTNode* m_Definition = nullptr;
+		std::vector<Symbol> m_Parameters;
+		std::vector<ValueTypes> m_ParameterTypes;
+
+		// The return expression, with the local variables replaced by their values
+		ASTNode* m_Expression = nullptr;
+		int m_Size = 0;
+
+		bool m_IsRecursive = false;
+	};
+
+	struct FunctionReport
+	{
+		int m_Size = 0;
+		int m_InlinedCalls = 0;
+		std::map<std::string, int> m_RejectedCalls; // Reason -> count
+	};
+
+	// Copies of function bodies are created in the arena of the tree
+	Inliner(ASTArena& arena) : m_Arena(arena) {};
+
+	void Run(ASTNode* program);
+
+	void PrintReport();
+
+private:
+	void CollectFunctions(ASTNode* scope);
+	void AnalyzeFunction(ASTNode* definition);
+	void FindRecursiveFunctions();
+
+	void InlineCalls(ASTNode* node, int loopDepth);
+	bool TryInlineCall(ASTNode* call, int loopDepth, std::string& reason);
+
+	void Reject(const std::string& function, const std::string& reason);
+
+private:
+	ASTArena& m_Arena;
+
+	std::unordered_map<Symbol, InlineCandidate> m_Candidates;
+
+	// Functions that can't be inlined at all and why
+	std::unordered_map<Symbol, std::string> m_NotInlinable;
+
+	// Keyed by the name so that it's printed in order
+	std::map<std::string, FunctionReport> m_Report;
+};
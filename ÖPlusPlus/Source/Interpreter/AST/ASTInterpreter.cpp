@@ -24,40 +24,16 @@ ValueTypes NodeVariableTypeToValueType(ASTNode* n)
 // Scope frame
 namespace AST
 {
-	bool ScopeFrame::HasVariable(const std::string& name)
-	{
-		return m_Variables.count(name) == 1;
-	}
-
-	Value& ScopeFrame::GetVariable(const std::string& name)
-	{
-		assert(HasVariable(name));
-		return m_Variables[name];
-	}
-
-	void ScopeFrame::SetVariable(const std::string& name, Value value)
-	{
-		assert(HasVariable(name));
-		m_Variables[name] = value;
-	}
-
-	Value& ScopeFrame::CreateVariable(const std::string& name, Value value)
-	{
-		assert(!HasVariable(name));
-
-		m_Variables[name] = value;
-		return m_Variables[name];
-	}
-	bool ScopeFrame::HasFunction(const std::string& name)
+	bool ScopeFrame::HasFunction(Symbol name)
 	{
 		return m_Functions.count(name) == 1;
 	}
-	ASTNode* ScopeFrame::GetFunction(const std::string& name)
+	ASTNode* ScopeFrame::GetFunction(Symbol name)
 	{
 		assert(HasFunction(name));
 		return m_Functions[name];
 	}
-	void ScopeFrame::CreateFunction(const std::string& name, ASTNode* start)
+	void ScopeFrame::CreateFunction(Symbol name, ASTNode* start)
 	{
 		assert(!HasFunction(name));
 
@@ -75,26 +51,51 @@ namespace AST
 	void ASTInterpreter::Initialize(ASTNode* tree)
 	{
 		m_ASTTree = tree;
-		m_ScopeFrames.resize(ScopeFramesCount);
-		for (int i = 0; i < ScopeFramesCount; i++)
-		{
-			m_ScopeFrames[i] = ScopeFrame();
-		}
+		m_Error = "";
+
+		m_Resolver.Resolve(tree);
+		if (m_Resolver.m_Error != "")
+			MakeError(m_Resolver.m_Error);
+
+		// Frame 0 is never used, the program body pushes the first one
+		m_ScopeFrames.clear();
+		m_ScopeFrames.emplace_back();
+		m_ScopeFrameTop = 0;
+		m_ShouldReturn = false;
+
+		// The recursive interpreter uses the C++ stack for every call, so it can't go as deep as the stack evaluator
+		m_FrameLimit = m_UseStackEvaluator ? StackEvaluatorFramesCount : ScopeFramesCount;
+
+		m_SpecializationStats = SpecializationStats();
 	}
 
 	Value ASTInterpreter::Execute(ASTNode* tree)
 	{
 		Initialize(tree);
+
+		if (m_Error != "")
+			return Value(ValueTypes::Void);
+
+		if (m_UseStackEvaluator)
+		{
+			m_StackEvaluator.Start(m_ASTTree);
+			m_StackEvaluator.Run();
+
+			return m_StackEvaluator.m_Result;
+		}
+
 		return InterpretTree(m_ASTTree);
 	}
 
 	void ASTInterpreter::MakeError(std::string error)
 	{
-		m_Error = error;
+		// Keep the first error, the ones after it are usually caused by it
+		if (m_Error == "")
+			m_Error = error;
 	}
 	Value ASTInterpreter::MakeErrorValueReturn(std::string error)
 	{
-		m_Error = error;
+		MakeError(error);
 		return Value(ValueTypes::Void);
 	}
 
@@ -107,7 +108,7 @@ namespace AST
 			return Value();
 
 		if (node->type == ASTTypes::ProgramBody)
-			PushFrame();
+			PushFrame(node->slotCount, nullptr);
 
 		ScopeFrame& currentFrame = GetTopFrame();
 
@@ -119,11 +120,8 @@ namespace AST
 			return InterpretTree(node->left);
 		case ASTTypes::Scope:
 		{
-			ScopeFrame& previousFrame = GetTopFrame();
-			ScopeFrame& frame = PushFrame();
-
-			// Copy variables from previous frame to the current frame
-			InheritVariables(previousFrame, frame);
+			// The new frame only holds the variables declared in this scope, the rest are found through the parent
+			PushFrame(node->slotCount, &currentFrame);
 
 			Value valueOfLastLine;
 
@@ -133,23 +131,23 @@ namespace AST
 				valueOfLastLine = InterpretTree(nodes[i]);
 
 				if (m_ShouldReturn)
+				{
+					PopFrame();
 					return valueOfLastLine;
+				}
 			}
 
 			// Return the value of the last line
 			valueOfLastLine = InterpretTree(nodes[nodes.size() - 1]);
 
-			PropagateVariables(previousFrame, frame);
-
 			// Pop the scope
 			PopFrame();
 			
 			return valueOfLastLine;
 		}
 		case ASTTypes::VariableDeclaration:
+		case ASTTypes::GlobalVariableDeclaration:
 		{
-			const std::string& variableName = node->right->stringValue;
-			
 			ValueTypes variableType = NodeVariableTypeToValueType(node->left);
 
 			Value value;
@@ -161,79 +159,46 @@ namespace AST
 			else if (variableType == ValueTypes::String)
 				value = Value("", ValueTypes::String);
 
-			return currentFrame.CreateVariable(variableName, value);
+			Value& variable = GetVariable(node->right);
+			variable = value;
+
+			return variable;
 		}
 		case ASTTypes::VariableType:
 			break;
 		case ASTTypes::Assign:
 		{
-			std::string variableName = node->left->stringValue;
+			std::string variableName(node->left->stringValue);
 
 			// Create the variable first if it is a declaration
-			if (node->left->type == ASTTypes::VariableDeclaration)
+			if (node->left->type == ASTTypes::VariableDeclaration || node->left->type == ASTTypes::GlobalVariableDeclaration)
 			{
 				variableName = node->left->right->stringValue;
 				InterpretTree(node->left);
 			}
 
+			if (node->depth == -1)
+				return MakeErrorValueReturn("Variable '" + variableName + "' has not been defined in this scope");
+
 			// Evaluate value at rhs
 			Value rhs = InterpretTree(node->right);
-			currentFrame.SetVariable(variableName, rhs);
-
-			// If this variable exists at scopes above, copy set them to 'rhs'
-			for (int i = m_ScopeFrameTop; i >= 0; i--)
-			{
-				if (m_ScopeFrames[i].HasVariable(variableName))
-					m_ScopeFrames[i].SetVariable(variableName, rhs);
-				else
-					break; // If this frame doesn't have the variable, then the ones furhter above won't either
-			}
+			GetVariable(node) = rhs;
 
 			return Value(variableName, ValueTypes::String);
 		}
 		case ASTTypes::PropertyAssign:
 			break;
 		case ASTTypes::CompareEquals:
-		{
-			Value lhs = InterpretTree(node->left);
-			Value rhs = InterpretTree(node->right);
-
-			return Value(Value::CompareEquals(lhs, rhs), ValueTypes::Integer);
-		}
 		case ASTTypes::CompareNotEquals:
-		{
-			Value lhs = InterpretTree(node->left);
-			Value rhs = InterpretTree(node->right);
-
-			return Value(Value::CompareNotEquals(lhs, rhs), ValueTypes::Integer);
-		}
 		case ASTTypes::CompareLessThan:
-		{
-			Value lhs = InterpretTree(node->left);
-			Value rhs = InterpretTree(node->right);
-
-			return Value(Value::CompareLessThan(lhs, rhs), ValueTypes::Integer);
-		}
 		case ASTTypes::CompareGreaterThan:
-		{
-			Value lhs = InterpretTree(node->left);
-			Value rhs = InterpretTree(node->right);
-
-			return Value(Value::CompareGreaterThan(lhs, rhs), ValueTypes::Integer);
-		}
 		case ASTTypes::CompareLessThanEqual:
-		{
-			Value lhs = InterpretTree(node->left);
-			Value rhs = InterpretTree(node->right);
-
-			return Value(Value::CompareLessThanEqual(lhs, rhs), ValueTypes::Integer);
-		}
 		case ASTTypes::CompareGreaterThanEqual:
 		{
 			Value lhs = InterpretTree(node->left);
 			Value rhs = InterpretTree(node->right);
 
-			return Value(Value::CompareGreaterThanEqual(lhs, rhs), ValueTypes::Integer);
+			return ApplyComparison(node, lhs, rhs);
 		}
 		case ASTTypes::And:
 		{
@@ -263,7 +228,7 @@ namespace AST
 		case ASTTypes::DoubleLiteral:
 			return Value(node->numberValue, ValueTypes::Float);
 		case ASTTypes::StringLiteral:
-			return Value(node->stringValue, ValueTypes::StringConstant);
+			return Value(std::string(node->stringValue), ValueTypes::StringConstant);
 		case ASTTypes::Bool:
 			break;
 		case ASTTypes::ArrayType:
@@ -274,40 +239,20 @@ namespace AST
 			break;
 		case ASTTypes::Variable:
 		{
-			const std::string& variableName = node->stringValue;
-			
-			if (!currentFrame.HasVariable(variableName))
-				return MakeErrorValueReturn("Variable '" + variableName + "' has not been defined in this scope");
+			if (node->depth == -1)
+				return MakeErrorValueReturn("Variable '" + std::string(node->stringValue) + "' has not been defined in this scope");
 			
-			return currentFrame.GetVariable(variableName);
+			return GetVariable(node);
 		}		
-		case ASTTypes::Add: 
-		{
-			Value lhs = InterpretTree(node->left);
-			Value rhs = InterpretTree(node->right);
-
-			return Value::Add(lhs, rhs);
-		}
+		case ASTTypes::Add:
 		case ASTTypes::Subtract:
-		{
-			Value lhs = InterpretTree(node->left);
-			Value rhs = InterpretTree(node->right);
-
-			return Value::Subtract(lhs, rhs);
-		}
 		case ASTTypes::Multiply:
-		{
-			Value lhs = InterpretTree(node->left);
-			Value rhs = InterpretTree(node->right);
-
-			return Value::Multiply(lhs, rhs);
-		}
 		case ASTTypes::Divide:
 		{
 			Value lhs = InterpretTree(node->left);
 			Value rhs = InterpretTree(node->right);
 
-			return Value::Divide(lhs, rhs);
+			return ApplyMath(node, lhs, rhs);
 		}
 		case ASTTypes::Xor:
 			break;
@@ -317,63 +262,57 @@ namespace AST
 			break;
 		case ASTTypes::PostIncrement:
 		{
-			const std::string& variableName = node->left->stringValue;
+			if (node->left->depth == -1)
+				return MakeErrorValueReturn("Variable '" + std::string(node->left->stringValue) + "' has not been defined in this scope");
 
-			if (!currentFrame.HasVariable(variableName))
-				return MakeErrorValueReturn("Variable '" + variableName + "' has not been defined in this scope");
-
-			Value variable = currentFrame.GetVariable(variableName);
+			Value& variable = GetVariable(node->left);
+			Value previousValue = variable;
 			
-			currentFrame.SetVariable(variableName, Value::Increment(variable));
+			variable = Value::Increment(variable);
 
 			// Return the variable as it was before the increment
-			return variable; 
+			return previousValue;
 		}
 		case ASTTypes::PreIncrement:
 		{
-			const std::string& variableName = node->left->stringValue;
-
-			if (!currentFrame.HasVariable(variableName))
-				return MakeErrorValueReturn("Variable '" + variableName + "' has not been defined in this scope");
+			if (node->left->depth == -1)
+				return MakeErrorValueReturn("Variable '" + std::string(node->left->stringValue) + "' has not been defined in this scope");
 
-			Value variable = currentFrame.GetVariable(variableName);
+			Value& variable = GetVariable(node->left);
 
-			currentFrame.SetVariable(variableName, Value::Increment(variable));
+			variable = Value::Increment(variable);
 
 			// Return the variable as it is after the increment
-			return currentFrame.GetVariable(variableName);
+			return variable;
 		}
 		case ASTTypes::PostDecrement:
 		{
-			const std::string& variableName = node->left->stringValue;
-
-			if (!currentFrame.HasVariable(variableName))
-				return MakeErrorValueReturn("Variable '" + variableName + "' has not been defined in this scope");
+			if (node->left->depth == -1)
+				return MakeErrorValueReturn("Variable '" + std::string(node->left->stringValue) + "' has not been defined in this scope");
 
-			Value variable = currentFrame.GetVariable(variableName);
+			Value& variable = GetVariable(node->left);
+			Value previousValue = variable;
 
-			currentFrame.SetVariable(variableName, Value::Decrement(variable));
+			variable = Value::Decrement(variable);
 
 			// Return the variable as it was before the decrement
-			return variable;
+			return previousValue;
 		}
 		case ASTTypes::PreDecrement:
 		{
-			const std::string& variableName = node->left->stringValue;
-
-			if (!currentFrame.HasVariable(variableName))
-				return MakeErrorValueReturn("Variable '" + variableName + "' has not been defined in this scope");
+			if (node->left->depth == -1)
+				return MakeErrorValueReturn("Variable '" + std::string(node->left->stringValue) + "' has not been defined in this scope");
 
-			Value variable = currentFrame.GetVariable(variableName);
+			Value& variable = GetVariable(node->left);
 
-			currentFrame.SetVariable(variableName, Value::Decrement(variable));
+			variable = Value::Decrement(variable);
 
 			// Return the variable as it is after the decrement
-			return currentFrame.GetVariable(variableName);
+			return variable;
 		}
 		case ASTTypes::FunctionCall:
 		{
-			const std::string& functionName = node->stringValue;
+			std::string_view functionName = node->stringValue;
 
 			std::vector<Value> args;
 
@@ -383,15 +322,14 @@ namespace AST
 			}
 
 			// User defined function
-			if (currentFrame.HasFunction(functionName))
+			ScopeFrame* definitionFrame = FindFunction(currentFrame, node->symbol);
+			if (definitionFrame)
 			{
-				ASTNode* functionDefinition = currentFrame.m_Functions[functionName];
+				ASTNode* functionDefinition = definitionFrame->GetFunction(node->symbol);
 				ASTNode* functionPrototype = functionDefinition->left;
 
-				ScopeFrame previousFrame = GetTopFrame();
-				ScopeFrame& frame = PushFrame();
-
-				InheritGlobalVariables(previousFrame, frame);
+				// The function sees the functions from where it was defined, not the variables
+				PushFrame(functionDefinition->slotCount, definitionFrame);
 
 				// Args
 				for (int i = 2; i < functionPrototype->arguments.size(); i++)
@@ -400,12 +338,8 @@ namespace AST
 					InterpretTree(functionPrototype->arguments[i]);
 
 					// Set the value of them (if there are any arguments passed)
-					if (!args.empty())
-					{
-						const std::string& variableName = ResolveVariableName(functionPrototype->arguments[i]);
-
-						frame.SetVariable(variableName, args[i - 2]);
-					}
+					if (i - 2 < args.size())
+						GetVariable(functionPrototype->arguments[i]->right) = args[i - 2];
 				}
 				
 				// Jump to the function
@@ -419,18 +353,11 @@ namespace AST
 			}
 
 			// Internal function
-			CallableFunction function = Functions::GetFunctionByName(functionName);
+			CallableFunction function = Functions::GetFunctionBySymbol(node->symbol);
 			if (function)
 				return function(args);
-
-			if (currentFrame.HasFunction(functionName))
-			{
-				return InterpretTree(currentFrame.GetFunction(functionName));
-			}
-
-			//if (function == nullptr && !currentFrame.HasFunction(functionName));
 			
-			return MakeErrorValueReturn("Function '" + functionName + "' doesn't exist");
+			return MakeErrorValueReturn("Function '" + std::string(functionName) + "' doesn't exist");
 
 		}
 		case ASTTypes::Return:
@@ -475,7 +402,6 @@ namespace AST
 		{
 			// 1. Variable
 			InterpretTree(node->arguments[0]); // Create or set the variable
-			std::string variableName = ResolveVariableName(node->arguments[0]);
 
 			Value lastResult;
 
@@ -499,22 +425,17 @@ namespace AST
 		{
 			InterpretTree(node->left);
 
-			const std::string& functionName = node->left->arguments[1]->stringValue;
-			currentFrame.m_Functions[functionName] = node;
+			ASTNode* name = node->left->arguments[1];
+			currentFrame.m_Functions[name->symbol] = node;
 
-			return Value(functionName, ValueTypes::String);
+			return Value(std::string(name->stringValue), ValueTypes::String);
 		}
 		case ASTTypes::FunctionPrototype:
 		{
 			Value returnValue = NodeVariableTypeToValueType(node->arguments[0]);
-			const std::string& functionName = node->arguments[1]->stringValue;
-			// variables
 			
-			// Create a variable that corresponds to the function
-			if (currentFrame.HasVariable(functionName) || Functions::GetFunctionByName(functionName))
-				return MakeErrorValueReturn("Function '" + functionName + "' has already been defined");
-
-			currentFrame.CreateVariable(functionName, Value("{ function body }", ValueTypes::String));
+			// Create a variable that corresponds to the function, the resolver has already checked that the name isn't taken
+			GetVariable(node->arguments[1]) = Value("{ function body }", ValueTypes::String);
 			
 			return Value();
 		}
@@ -530,104 +451,224 @@ namespace AST
 		return Value(ValueTypes::Void);
 	}
 
-	ScopeFrame& ASTInterpreter::PushFrame()
+	Value ASTInterpreter::ApplyMath(ASTNode* node, Value& lhs, Value& rhs)
 	{
-		assert(m_ScopeFrameTop >= 0 && m_ScopeFrameTop < ScopeFramesCount - 1);
+		TypeFeedback& feedback = node->feedback;
 
-		m_ScopeFrameTop++;
-		m_ScopeFrames[m_ScopeFrameTop] = ScopeFrame();
-		return m_ScopeFrames[m_ScopeFrameTop];
-	}
-
-	ScopeFrame ASTInterpreter::PopFrame()
-	{
-		assert(m_ScopeFrameTop > 0 && m_ScopeFrameTop < ScopeFramesCount);
+		if (feedback.m_Specialization == Specialization::Integer)
+		{
+			if (lhs.GetType() == ValueTypes::Integer && rhs.GetType() == ValueTypes::Integer)
+			{
+				int a = lhs.GetInt();
+				int b = rhs.GetInt();
 
-		ScopeFrame top = m_ScopeFrames[m_ScopeFrameTop];
+				switch (node->type)
+				{
+				case ASTTypes::Add: return Value(a + b, ValueTypes::Integer);
+				case ASTTypes::Subtract: return Value(a - b, ValueTypes::Integer);
+				case ASTTypes::Multiply: return Value(a * b, ValueTypes::Integer);
+				case ASTTypes::Divide:
+					// Ints perform float division, dividing by 0 is left to Value::Divide to give the error
+					if (b != 0)
+						return Value((float)a / (float)b, ValueTypes::Float);
+					break;
+				default: break;
+				}
+			}
+			else
+			{
+				Despecialize(node);
+			}
+		}
+		else if (feedback.m_Specialization == Specialization::Float)
+		{
+			if (lhs.GetType() == ValueTypes::Float && rhs.GetType() == ValueTypes::Float)
+			{
+				double a = lhs.GetFloat();
+				double b = rhs.GetFloat();
 
-		m_ScopeFrames[m_ScopeFrameTop] = ScopeFrame();
+				switch (node->type)
+				{
+				case ASTTypes::Add: return Value(a + b, ValueTypes::Float);
+				case ASTTypes::Subtract: return Value(a - b, ValueTypes::Float);
+				case ASTTypes::Multiply: return Value(a * b, ValueTypes::Float);
+				case ASTTypes::Divide:
+					if (b != 0)
+						return Value(a / b, ValueTypes::Float);
+					break;
+				default: break;
+				}
+			}
+			else
+			{
+				Despecialize(node);
+			}
+		}
+		else if (feedback.m_Specialization == Specialization::Uninitialized)
+		{
+			RecordTypeFeedback(node, lhs, rhs);
+		}
 
-		m_ScopeFrameTop--;
+		switch (node->type)
+		{
+		case ASTTypes::Add: return Value::Add(lhs, rhs);
+		case ASTTypes::Subtract: return Value::Subtract(lhs, rhs);
+		case ASTTypes::Multiply: return Value::Multiply(lhs, rhs);
+		case ASTTypes::Divide: return Value::Divide(lhs, rhs);
+		default: break;
+		}
 
-		return top;
+		return Value(ValueTypes::Void);
 	}
 
-	ScopeFrame& ASTInterpreter::GetTopFrame()
+	Value ASTInterpreter::ApplyComparison(ASTNode* node, Value& lhs, Value& rhs)
 	{
-		assert(m_ScopeFrameTop >= 0 && m_ScopeFrameTop < ScopeFramesCount);
+		TypeFeedback& feedback = node->feedback;
 
-		return m_ScopeFrames[m_ScopeFrameTop];
-	}
-	std::string ASTInterpreter::ResolveVariableName(ASTNode* node)
-	{
-		switch (node->type)
-		{
-		case ASTTypes::VariableDeclaration:
+		if (feedback.m_Specialization == Specialization::Integer)
 		{
-			std::string variableName = "";
-			if (node->left->right == nullptr)
-				variableName = node->right->stringValue;
-			else
-				variableName = node->left->right->stringValue;
+			if (lhs.GetType() == ValueTypes::Integer && rhs.GetType() == ValueTypes::Integer)
+			{
+				int a = lhs.GetInt();
+				int b = rhs.GetInt();
 
-			return variableName;
+				switch (node->type)
+				{
+				case ASTTypes::CompareEquals: return Value(a == b, ValueTypes::Integer);
+				case ASTTypes::CompareNotEquals: return Value(a != b, ValueTypes::Integer);
+				case ASTTypes::CompareLessThan: return Value(a < b, ValueTypes::Integer);
+				case ASTTypes::CompareGreaterThan: return Value(a > b, ValueTypes::Integer);
+				case ASTTypes::CompareLessThanEqual: return Value(a <= b, ValueTypes::Integer);
+				case ASTTypes::CompareGreaterThanEqual: return Value(a >= b, ValueTypes::Integer);
+				default: break;
+				}
+			}
+			else
+			{
+				Despecialize(node);
+			}
 		}
-		case ASTTypes::Assign:
+		else if (feedback.m_Specialization == Specialization::Float)
 		{
-			std::string variableName = node->left->stringValue;
-
-			if (node->left->type == ASTTypes::VariableDeclaration)
-				variableName = node->left->right->stringValue;
+			if (lhs.GetType() == ValueTypes::Float && rhs.GetType() == ValueTypes::Float)
+			{
+				double a = lhs.GetFloat();
+				double b = rhs.GetFloat();
 
-			return variableName;
+				switch (node->type)
+				{
+				case ASTTypes::CompareEquals: return Value(a == b, ValueTypes::Integer);
+				case ASTTypes::CompareNotEquals: return Value(a != b, ValueTypes::Integer);
+				case ASTTypes::CompareLessThan: return Value(a < b, ValueTypes::Integer);
+				case ASTTypes::CompareGreaterThan: return Value(a > b, ValueTypes::Integer);
+				case ASTTypes::CompareLessThanEqual: return Value(a <= b, ValueTypes::Integer);
+				case ASTTypes::CompareGreaterThanEqual: return Value(a >= b, ValueTypes::Integer);
+				default: break;
+				}
+			}
+			else
+			{
+				Despecialize(node);
+			}
 		}
-		case ASTTypes::Variable:
+		else if (feedback.m_Specialization == Specialization::Uninitialized)
 		{
-			std::string variableName = node->stringValue;
-
-			return variableName;
-		}
-		default:
-			abort();
+			RecordTypeFeedback(node, lhs, rhs);
 		}
 
-		return "";
+		return Value(Value::Compare(lhs, rhs, node->type), ValueTypes::Integer);
 	}
-	void ASTInterpreter::InheritVariables(ScopeFrame& previous, ScopeFrame& current)
+
+	void ASTInterpreter::RecordTypeFeedback(ASTNode* node, Value& lhs, Value& rhs)
 	{
-		// Copy variables from previous frame to the current fram
-		for (auto& map : previous.m_Variables)
-		{
-			current.m_Variables[map.first] = map.second;
-		}
+		TypeFeedback& feedback = node->feedback;
+
+		ValueTypes type = lhs.GetType();
 
-		// Copy functions from previous frame to the current fram
-		for (auto& map : previous.m_Functions)
+		// Only nodes that always get two ints or two floats are worth specializing
+		bool isNumeric = type == ValueTypes::Integer || type == ValueTypes::Float;
+		if (!isNumeric || rhs.GetType() != type || (feedback.m_Samples > 0 && feedback.m_SeenType != type))
 		{
-			current.m_Functions[map.first] = map.second;
+			feedback.m_Specialization = Specialization::Generic;
+			m_SpecializationStats.m_Generic++;
+			return;
 		}
+
+		feedback.m_SeenType = type;
+		feedback.m_Samples++;
+
+		if (feedback.m_Samples < SpecializationSamples)
+			return;
+
+		feedback.m_Specialization = type == ValueTypes::Integer ? Specialization::Integer : Specialization::Float;
+		m_SpecializationStats.m_Specialized++;
 	}
 
-	void ASTInterpreter::InheritGlobalVariables(ScopeFrame& previous, ScopeFrame& current)
+	void ASTInterpreter::Despecialize(ASTNode* node)
 	{
-		// Copy functions from previous frame to the current fram
-		for (auto& map : previous.m_Functions)
-		{
-			current.m_Functions[map.first] = map.second;
-		}
+		// Don't try again, a node that has seen different types will probably see them again
+		node->feedback.m_Specialization = Specialization::Generic;
+		m_SpecializationStats.m_Fallbacks++;
 	}
 
-	void ASTInterpreter::PropagateVariables(ScopeFrame& topFrame, ScopeFrame& localFrame)
+	ScopeFrame& ASTInterpreter::PushFrame(int slotCount, ScopeFrame* parent)
 	{
-		// TODO: NEEDS TO BE IMPLEMENTED
-		// 
-		// Copy variables from previous frame to the current fram
-		for (auto& map : topFrame.m_Variables)
-		{
-			//if (topFrame.m_Variables[map.first].GetType() != ValueTypes::Void)
-				//topFrame.m_Variables[map.first] = localFrame.m_Variables[map.first];
-		}		
+		assert(m_ScopeFrameTop >= 0);
+
+		// The frame is still pushed so that the caller has something to use, the error stops the program right after
+		if (m_ScopeFrameTop + 1 >= m_FrameLimit)
+			MakeError("Stack overflow, too many nested function calls or scopes");
+
+		m_ScopeFrameTop++;
+
+		if (m_ScopeFrameTop == m_ScopeFrames.size())
+			m_ScopeFrames.emplace_back();
+
+		// Reuse the storage of the frame that was here before
+		ScopeFrame& frame = m_ScopeFrames[m_ScopeFrameTop];
+		frame.m_Slots.assign(slotCount, Value());
+		frame.m_Functions.clear();
+		frame.m_ArgumentsForFunction.clear();
+		frame.m_Parent = parent;
+
+		return frame;
+	}
+
+	void ASTInterpreter::PopFrame()
+	{
+		assert(m_ScopeFrameTop > 0);
+
+		m_ScopeFrameTop--;
+	}
+
+	ScopeFrame& ASTInterpreter::GetTopFrame()
+	{
+		assert(m_ScopeFrameTop >= 0 && m_ScopeFrameTop < m_ScopeFrames.size());
+
+		return m_ScopeFrames[m_ScopeFrameTop];
+	}
+	Value& ASTInterpreter::GetVariable(ASTNode* node)
+	{
+		assert(node->depth != -1);
+
+		if (node->depth == GlobalDepth)
+			return m_ScopeFrames[GlobalFrameIndex].m_Slots[node->slot];
+
+		ScopeFrame* frame = &GetTopFrame();
+		for (int i = 0; i < node->depth; i++)
+			frame = frame->m_Parent;
+
+		return frame->m_Slots[node->slot];
 	}
 
-	//topFrame.m_VariablesList[i] = localFrame.m_VariablesList[i];
+	ScopeFrame* ASTInterpreter::FindFunction(ScopeFrame& frame, Symbol name)
+	{
+		for (ScopeFrame* current = &frame; current != nullptr; current = current->m_Parent)
+		{
+			if (current->HasFunction(name))
+				return current;
+		}
+
+		return nullptr;
+	}
 }
@@ -4,33 +4,41 @@
 #include "../ValueTypes.h"
 #include <string>
 #include "../Value.h"
+#include "Resolver.h"
+#include "Specialization.h"
+#include "StackEvaluator.h"
 
 #include <vector>
 
 #include <map>
+#include <unordered_map>
+#include <deque>
 #include <stack>
 
 namespace AST 
 {
 
+// The most frames there can be at once. They are only created when they are needed
 constexpr int ScopeFramesCount = 5000;
+constexpr int StackEvaluatorFramesCount = 1000000;
+
+// Global variables live in the frame of the program body
+constexpr int GlobalFrameIndex = 1;
 
 class ScopeFrame 
 {
 public:
-	bool HasVariable(const std::string& name);
-	Value& GetVariable(const std::string& name);
-	void SetVariable(const std::string& name, Value value);
-	Value& CreateVariable(const std::string& name, Value value);
-
-	bool HasFunction(const std::string& name);
-	ASTNode* GetFunction(const std::string& name);
-	void CreateFunction(const std::string& name, ASTNode* start);
+	bool HasFunction(Symbol name);
+	ASTNode* GetFunction(Symbol name);
+	void CreateFunction(Symbol name, ASTNode* start);
 
 public:
-	std::map<std::string, Value> m_Variables;
-	std::map<std::string, Value> m_InitialVariables;
-	std::map<std::string, ASTNode*> m_Functions;
+	// Indexed by the slots that the resolver gave the variables
+	std::vector<Value> m_Slots;
+
+	// The frame of the enclosing scope, or where the function was defined for function frames
+	ScopeFrame* m_Parent = nullptr;
+	std::unordered_map<Symbol, ASTNode*> m_Functions;
 
 	std::vector<Value> m_ArgumentsForFunction;
 };
@@ -50,24 +58,42 @@ public:
 private:
 	ASTInterpreter() {};
 
-	ScopeFrame& PushFrame();
-	ScopeFrame PopFrame();
+	ScopeFrame& PushFrame(int slotCount, ScopeFrame* parent);
+	void PopFrame();
 	ScopeFrame& GetTopFrame();
 
-	std::string ResolveVariableName(ASTNode* node);
-	void InheritVariables(ScopeFrame& previous, ScopeFrame& current);
-	void InheritGlobalVariables(ScopeFrame& previous, ScopeFrame& current);
-	void PropagateVariables(ScopeFrame& previous, ScopeFrame& current);
+	Value& GetVariable(ASTNode* node);
+	ScopeFrame* FindFunction(ScopeFrame& frame, Symbol name); // Returns the frame the function was defined in
+
+	// Math and compare nodes, these specialize themselves for the types they see
+	Value ApplyMath(ASTNode* node, Value& lhs, Value& rhs);
+	Value ApplyComparison(ASTNode* node, Value& lhs, Value& rhs);
+	void RecordTypeFeedback(ASTNode* node, Value& lhs, Value& rhs);
+	void Despecialize(ASTNode* node);
 
 private:
-	std::vector<ScopeFrame> m_ScopeFrames;
+	// A deque so that the frames don't move when it grows, since frames point to their parents.
+	// Popped frames are kept and reused by the next push
+	std::deque<ScopeFrame> m_ScopeFrames;
 	int m_ScopeFrameTop = 0;
 
+	int m_FrameLimit = ScopeFramesCount;
+
 	bool m_ShouldReturn = false;
 
+	Resolver m_Resolver;
+	StackEvaluator m_StackEvaluator;
+
+	friend class StackEvaluator;
+
 public:
 	ASTNode* m_ASTTree = nullptr;
 
+	SpecializationStats m_SpecializationStats;
+
+	// Run the program with the stack evaluator instead of InterpretTree
+	bool m_UseStackEvaluator = false;
+
 	std::string m_Error = "";
 };
 
@@ -0,0 +1,163 @@
+#include "Resolver.h"
+
+#include "../Functions.h"
+
+namespace AST
+{
+	void Resolver::Resolve(ASTNode* program)
+	{
+		m_Scopes.clear();
+		m_Globals = Scope();
+		m_FunctionStart = 0;
+		m_Error = "";
+
+		ResolveNode(program);
+	}
+
+	bool Resolver::MakeError(const std::string& error)
+	{
+		if (m_Error == "")
+			m_Error = error;
+
+		return false;
+	}
+
+	void Resolver::ResolveNode(ASTNode* node)
+	{
+		if (node == nullptr || m_Error != "")
+			return;
+
+		switch (node->type)
+		{
+		case ASTTypes::ProgramBody:
+		{
+			ResolveNode(node->left);
+
+			node->slotCount = m_Globals.m_SlotCount;
+			return;
+		}
+		case ASTTypes::Scope:
+		{
+			PushScope();
+
+			for (ASTNode* line : node->arguments)
+				ResolveNode(line);
+
+			PopScope(node);
+			return;
+		}
+		case ASTTypes::VariableDeclaration:
+			Declare(m_Scopes.back(), node->right, 0);
+			return;
+		case ASTTypes::GlobalVariableDeclaration:
+			Declare(m_Globals, node->right, GlobalDepth);
+			return;
+		case ASTTypes::Assign:
+		{
+			// The variable is created before the value is evaluated
+			ResolveNode(node->left);
+			ResolveNode(node->right);
+
+			ASTNode* variable = node->left;
+			if (variable->type == ASTTypes::VariableDeclaration || variable->type == ASTTypes::GlobalVariableDeclaration)
+				variable = variable->right;
+
+			node->depth = variable->depth;
+			node->slot = variable->slot;
+			return;
+		}
+		case ASTTypes::Variable:
+			ResolveVariable(node);
+			return;
+		case ASTTypes::FunctionDefinition:
+			ResolveFunction(node);
+			return;
+		case ASTTypes::Import:
+		case ASTTypes::Export:
+			MakeError("Modules are only supported by the bytecode interpreter");
+			return;
+		default:
+			break;
+		}
+
+		// The for-loop keeps the variable, condition and action in the arguments, so they have to be resolved before the body
+		for (ASTNode* argument : node->arguments)
+			ResolveNode(argument);
+
+		ResolveNode(node->left);
+		ResolveNode(node->right);
+	}
+
+	void Resolver::ResolveFunction(ASTNode* node)
+	{
+		ASTNode* prototype = node->left;
+		ASTNode* name = prototype->arguments[1];
+
+		// The function name is a variable in the scope it's defined in
+		if (m_Scopes.back().m_Slots.count(name->symbol) == 1 || Functions::GetFunctionBySymbol(name->symbol))
+		{
+			MakeError("Function '" + std::string(name->stringValue) + "' has already been defined");
+			return;
+		}
+
+		Declare(m_Scopes.back(), name, 0);
+
+		// The parameters get a frame of their own, below the one of the body
+		int previousFunctionStart = m_FunctionStart;
+		m_FunctionStart = (int)m_Scopes.size();
+
+		PushScope();
+
+		for (int i = 2; i < prototype->arguments.size(); i++)
+			ResolveNode(prototype->arguments[i]);
+
+		ResolveNode(node->right);
+
+		PopScope(node);
+
+		m_FunctionStart = previousFunctionStart;
+	}
+
+	void Resolver::ResolveVariable(ASTNode* node)
+	{
+		Symbol name = node->symbol;
+
+		for (int i = (int)m_Scopes.size() - 1; i >= m_FunctionStart; i--)
+		{
+			auto it = m_Scopes[i].m_Slots.find(name);
+			if (it != m_Scopes[i].m_Slots.end())
+			{
+				node->depth = (int)m_Scopes.size() - 1 - i;
+				node->slot = it->second;
+				return;
+			}
+		}
+
+		auto it = m_Globals.m_Slots.find(name);
+		if (it != m_Globals.m_Slots.end())
+		{
+			node->depth = GlobalDepth;
+			node->slot = it->second;
+		}
+	}
+
+	void Resolver::PushScope()
+	{
+		m_Scopes.emplace_back();
+	}
+
+	void Resolver::PopScope(ASTNode* node)
+	{
+		node->slotCount = m_Scopes.back().m_SlotCount;
+		m_Scopes.pop_back();
+	}
+
+	void Resolver::Declare(Scope& scope, ASTNode* variable, int depth)
+	{
+		// Declaring a variable again gives it a new slot, which shadows the old one from here on
+		variable->depth = depth;
+		variable->slot = scope.m_SlotCount++;
+
+		scope.m_Slots[variable->symbol] = variable->slot;
+	}
+}
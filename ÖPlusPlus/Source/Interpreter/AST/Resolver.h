@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../../Parser.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace AST
+{
+
+// Depth used for global variables, they are stored in the frame of the program body
+constexpr int GlobalDepth = -2;
+
+// Runs before the AST interpreter and works out where every variable lives, so that it doesn't have to look them up by name.
+// Variable and Assign nodes get a (depth, slot) pair, where depth is how many frames up the variable was declared and slot is the index in that frame.
+// Scope and function definition nodes get the number of slots their frame needs.
+// Variables that can't be resolved keep a depth of -1 and are reported by the interpreter if they are used
+class Resolver
+{
+public:
+	void Resolve(ASTNode* program);
+
+	bool MakeError(const std::string& error);
+
+private:
+	struct Scope
+	{
+		std::unordered_map<Symbol, int> m_Slots;
+		int m_SlotCount = 0;
+	};
+
+	void ResolveNode(ASTNode* node);
+	void ResolveFunction(ASTNode* node);
+	void ResolveVariable(ASTNode* node);
+
+	void PushScope();
+	void PopScope(ASTNode* node);
+
+	void Declare(Scope& scope, ASTNode* variable, int depth);
+
+private:
+	std::vector<Scope> m_Scopes;
+	Scope m_Globals;
+
+	// Variables outside of the current function can't be seen, other than globals
+	int m_FunctionStart = 0;
+
+public:
+	std::string m_Error = "";
+};
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../ValueTypes.h"
+
+namespace AST
+{
+
+// How many times a math or compare node has to see the same operand types before it specializes
+constexpr int SpecializationSamples = 4;
+
+enum class Specialization
+{
+	Uninitialized, // Still collecting type feedback
+	Integer,
+	Float,
+	Generic // Goes through Value::Add etc. like before
+};
+
+// Stored in every AST node, only used by the math and compare nodes
+struct TypeFeedback
+{
+	Specialization m_Specialization = Specialization::Uninitialized;
+
+	ValueTypes m_SeenType = ValueTypes::Void;
+	int m_Samples = 0;
+};
+
+struct SpecializationStats
+{
+	int m_Specialized = 0; // Nodes that got an int or float version
+	int m_Generic = 0; // Nodes that saw mixed or non-numeric types while collecting feedback
+	int m_Fallbacks = 0; // Specialized nodes that got other types later and went back to the generic version
+};
+
+}
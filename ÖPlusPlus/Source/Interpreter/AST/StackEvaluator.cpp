@@ -0,0 +1,408 @@
+#include "StackEvaluator.h"
+
+#include "ASTInterpreter.h"
+#include "../Functions.h"
+
+#include <assert.h>
+
+namespace AST
+{
+	void StackEvaluator::Start(ASTNode* program)
+	{
+		m_Tasks.clear();
+		m_Values.clear();
+		m_Result = Value(ValueTypes::Void);
+
+		Evaluate(program);
+	}
+
+	bool StackEvaluator::Run(int maxSteps)
+	{
+		for (int i = 0; i != maxSteps && !m_Tasks.empty(); i++)
+			Step();
+
+		if (IsFinished() && !m_Values.empty())
+			m_Result = m_Values.back();
+
+		return IsFinished();
+	}
+
+	bool StackEvaluator::IsFinished()
+	{
+		return m_Tasks.empty();
+	}
+
+	void StackEvaluator::Step()
+	{
+		auto& interpreter = ASTInterpreter::Get();
+
+		// Only used before Evaluate() is called, since that can push a new task and move this one
+		Task& task = m_Tasks.back();
+		ASTNode* node = task.m_Node;
+
+		switch (node->type)
+		{
+		case ASTTypes::ProgramBody:
+		{
+			if (task.m_Step == 0)
+			{
+				task.m_Step++;
+				interpreter.PushFrame(node->slotCount, nullptr);
+				return Evaluate(node->left);
+			}
+
+			return Complete(m_Values.back());
+		}
+		case ASTTypes::Scope:
+		{
+			auto& lines = node->arguments;
+
+			if (task.m_Step == 0)
+			{
+				interpreter.PushFrame(node->slotCount, &interpreter.GetTopFrame());
+
+				if (lines.empty())
+				{
+					interpreter.PopFrame();
+					return Complete(Value(ValueTypes::Void));
+				}
+			}
+			else if (task.m_Step == lines.size())
+			{
+				// Return the value of the last line
+				interpreter.PopFrame();
+				return Complete(m_Values.back());
+			}
+			else
+			{
+				m_Values.pop_back();
+			}
+
+			task.m_Step++;
+			return Evaluate(lines[task.m_Step - 1]);
+		}
+		case ASTTypes::Assign:
+		{
+			ASTNode* variable = node->left;
+
+			if (task.m_Step == 0)
+			{
+				// Create the variable first if it is a declaration
+				if (variable->type == ASTTypes::VariableDeclaration || variable->type == ASTTypes::GlobalVariableDeclaration)
+				{
+					variable = variable->right;
+					interpreter.InterpretTree(node->left);
+				}
+
+				if (node->depth == -1)
+					return Complete(interpreter.MakeErrorValueReturn("Variable '" + std::string(variable->stringValue) + "' has not been defined in this scope"));
+
+				task.m_Step++;
+				return Evaluate(node->right);
+			}
+
+			if (variable->type == ASTTypes::VariableDeclaration || variable->type == ASTTypes::GlobalVariableDeclaration)
+				variable = variable->right;
+
+			interpreter.GetVariable(node) = m_Values.back();
+
+			return Complete(Value(std::string(variable->stringValue), ValueTypes::String));
+		}
+		case ASTTypes::CompareEquals:
+		case ASTTypes::CompareNotEquals:
+		case ASTTypes::CompareLessThan:
+		case ASTTypes::CompareGreaterThan:
+		case ASTTypes::CompareLessThanEqual:
+		case ASTTypes::CompareGreaterThanEqual:
+		case ASTTypes::And:
+		case ASTTypes::Or:
+		case ASTTypes::Add:
+		case ASTTypes::Subtract:
+		case ASTTypes::Multiply:
+		case ASTTypes::Divide:
+		{
+			if (task.m_Step == 0)
+			{
+				task.m_Step++;
+				return Evaluate(node->left);
+			}
+			if (task.m_Step == 1)
+			{
+				task.m_Step++;
+				return Evaluate(node->right);
+			}
+
+			// Complete() removes them from the stack
+			Value& lhs = m_Values[task.m_ValueBase];
+			Value& rhs = m_Values[task.m_ValueBase + 1];
+
+			if (node->type == ASTTypes::And)
+				return Complete(Value(lhs.IsTruthy() && rhs.IsTruthy(), ValueTypes::Integer));
+			if (node->type == ASTTypes::Or)
+				return Complete(Value(lhs.IsTruthy() || rhs.IsTruthy(), ValueTypes::Integer));
+			if (node->IsMathOperator())
+				return Complete(interpreter.ApplyMath(node, lhs, rhs));
+
+			return Complete(interpreter.ApplyComparison(node, lhs, rhs));
+		}
+		case ASTTypes::Not:
+		{
+			if (task.m_Step == 0)
+			{
+				task.m_Step++;
+				return Evaluate(node->left);
+			}
+
+			return Complete(Value(!m_Values.back().IsTruthy(), ValueTypes::Integer));
+		}
+		case ASTTypes::FunctionCall:
+		{
+			int argumentCount = (int)node->arguments.size();
+
+			// Evaluate the arguments one by one
+			if (task.m_Step < argumentCount)
+			{
+				task.m_Step++;
+				return Evaluate(node->arguments[task.m_Step - 1]);
+			}
+
+			// The function has returned
+			if (task.m_Step > argumentCount)
+			{
+				interpreter.PopFrame();
+				return Complete(m_Values.back());
+			}
+
+			std::vector<Value> args(m_Values.begin() + task.m_ValueBase, m_Values.end());
+
+			std::string_view functionName = node->stringValue;
+
+			// User defined function
+			ScopeFrame* definitionFrame = interpreter.FindFunction(interpreter.GetTopFrame(), node->symbol);
+			if (definitionFrame)
+			{
+				ASTNode* functionDefinition = definitionFrame->GetFunction(node->symbol);
+				ASTNode* functionPrototype = functionDefinition->left;
+
+				// The function sees the functions from where it was defined, not the variables
+				interpreter.PushFrame(functionDefinition->slotCount, definitionFrame);
+
+				for (int i = 2; i < functionPrototype->arguments.size(); i++)
+				{
+					interpreter.InterpretTree(functionPrototype->arguments[i]);
+
+					if (i - 2 < args.size())
+						interpreter.GetVariable(functionPrototype->arguments[i]->right) = args[i - 2];
+				}
+
+				task.m_Step++;
+				return Evaluate(functionDefinition->right);
+			}
+
+			// Internal function
+			CallableFunction function = Functions::GetFunctionBySymbol(node->symbol);
+			if (function)
+				return Complete(function(args));
+
+			return Complete(interpreter.MakeErrorValueReturn("Function '" + std::string(functionName) + "' doesn't exist"));
+		}
+		case ASTTypes::Return:
+		{
+			if (task.m_Step == 0)
+			{
+				task.m_Step++;
+				return Evaluate(node->left);
+			}
+
+			return Return(m_Values.back());
+		}
+		case ASTTypes::IfStatement:
+		{
+			if (task.m_Step == 0)
+			{
+				task.m_Step++;
+				return Evaluate(node->left);
+			}
+			if (task.m_Step == 1)
+			{
+				if (!PopCondition())
+					return Complete(Value());
+
+				task.m_Step++;
+				return Evaluate(node->right);
+			}
+
+			return Complete(m_Values.back());
+		}
+		case ASTTypes::WhileStatement:
+		{
+			// The value of the last run of the body is kept at the bottom of the task's values
+			if (task.m_Step == 0)
+			{
+				m_Values.emplace_back();
+			}
+			else if (task.m_Step == 1)
+			{
+				if (!PopCondition())
+					return Complete(m_Values[task.m_ValueBase]);
+
+				task.m_Step = 2;
+				return Evaluate(node->right);
+			}
+			else
+			{
+				m_Values[task.m_ValueBase] = m_Values.back();
+				m_Values.pop_back();
+			}
+
+			task.m_Step = 1;
+			return Evaluate(node->left);
+		}
+		case ASTTypes::ForStatement:
+		{
+			// The step is what was evaluated last. 1: variable, 2: condition, 3: body, 4: action
+			switch (task.m_Step)
+			{
+			case 0:
+				m_Values.emplace_back();
+
+				task.m_Step = 1;
+				return Evaluate(node->arguments[0]);
+			case 2:
+				if (!PopCondition())
+					return Complete(m_Values[task.m_ValueBase]);
+
+				task.m_Step = 3;
+				return Evaluate(node->right);
+			case 3:
+				m_Values[task.m_ValueBase] = m_Values.back();
+				m_Values.pop_back();
+
+				task.m_Step = 4;
+				return Evaluate(node->arguments[2]);
+			default:
+				// The variable or the action is done, check the condition
+				m_Values.pop_back();
+
+				if (interpreter.m_Error != "")
+					return Complete(m_Values[task.m_ValueBase]);
+
+				task.m_Step = 2;
+				return Evaluate(node->arguments[1]);
+			}
+		}
+		default:
+			break;
+		}
+
+		// Only nodes that aren't leaves get a task
+		assert(false);
+		Complete(Value(ValueTypes::Void));
+	}
+
+	void StackEvaluator::Evaluate(ASTNode* node)
+	{
+		auto& interpreter = ASTInterpreter::Get();
+
+		// Like InterpretTree, nothing more is evaluated after an error, the nodes that are already running finish with empty values
+		if (interpreter.m_Error != "")
+		{
+			m_Values.emplace_back(ValueTypes::Void);
+			return;
+		}
+
+		if (IsLeaf(node))
+		{
+			m_Values.push_back(interpreter.InterpretTree(node));
+			return;
+		}
+
+		Task task;
+		task.m_Node = node;
+		task.m_ValueBase = (int)m_Values.size();
+
+		m_Tasks.push_back(task);
+	}
+
+	void StackEvaluator::Complete(const Value& value)
+	{
+		// The value can be one of the task's own values, so it's put in the first one instead of being pushed after the rest are removed
+		int base = m_Tasks.back().m_ValueBase;
+
+		if (base == m_Values.size())
+			m_Values.push_back(value);
+		else if (&m_Values[base] != &value)
+			m_Values[base] = value;
+
+		m_Values.resize(base + 1);
+		m_Tasks.pop_back();
+	}
+
+	void StackEvaluator::Return(Value value)
+	{
+		auto& interpreter = ASTInterpreter::Get();
+
+		// Pop everything up to the function call, including the frames of the scopes in between
+		int valueBase = m_Tasks.back().m_ValueBase;
+
+		while (!m_Tasks.empty())
+		{
+			Task& task = m_Tasks.back();
+
+			bool isRunningFunction = task.m_Node->type == ASTTypes::FunctionCall && task.m_Step > task.m_Node->arguments.size();
+			if (isRunningFunction)
+				break;
+
+			if (task.m_Node->type == ASTTypes::Scope && task.m_Step > 0)
+				interpreter.PopFrame();
+
+			valueBase = task.m_ValueBase;
+			m_Tasks.pop_back();
+		}
+
+		// The function call gets the value like it was the value of its body. Without a function call it is the value of the program
+		m_Values.resize(valueBase);
+		m_Values.push_back(value);
+	}
+
+	bool StackEvaluator::PopCondition()
+	{
+		assert(!m_Values.empty());
+
+		bool isTruthy = m_Values.back().IsTruthy();
+		m_Values.pop_back();
+
+		return isTruthy;
+	}
+
+	bool StackEvaluator::IsLeaf(ASTNode* node)
+	{
+		switch (node->type)
+		{
+		case ASTTypes::ProgramBody:
+		case ASTTypes::Scope:
+		case ASTTypes::Assign:
+		case ASTTypes::CompareEquals:
+		case ASTTypes::CompareNotEquals:
+		case ASTTypes::CompareLessThan:
+		case ASTTypes::CompareGreaterThan:
+		case ASTTypes::CompareLessThanEqual:
+		case ASTTypes::CompareGreaterThanEqual:
+		case ASTTypes::And:
+		case ASTTypes::Or:
+		case ASTTypes::Not:
+		case ASTTypes::Add:
+		case ASTTypes::Subtract:
+		case ASTTypes::Multiply:
+		case ASTTypes::Divide:
+		case ASTTypes::FunctionCall:
+		case ASTTypes::Return:
+		case ASTTypes::IfStatement:
+		case ASTTypes::WhileStatement:
+		case ASTTypes::ForStatement:
+			return false;
+		default:
+			return true;
+		}
+	}
+}
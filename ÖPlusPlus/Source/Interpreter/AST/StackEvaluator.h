@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../../Parser.h"
+#include "../Value.h"
+
+#include <vector>
+
+namespace AST
+{
+
+// Runs the AST like ASTInterpreter::InterpretTree, but keeps the nodes that are being evaluated on its own stack instead of the C++ stack.
+// Deep recursion in a program then only grows that stack, and the program can be paused after any number of steps and continued later.
+// Nodes that don't have children to evaluate (literals, variables, declarations...) are still given to InterpretTree
+class StackEvaluator
+{
+public:
+	void Start(ASTNode* program);
+
+	// Runs at most maxSteps steps, or until the program is done if it's -1. Returns true when the program is done
+	bool Run(int maxSteps = -1);
+	bool IsFinished();
+
+private:
+	struct Task
+	{
+		ASTNode* m_Node = nullptr;
+
+		// How far the node has come, what it means depends on the node
+		int m_Step = 0;
+
+		// Size of the value stack when the task was started. The task's own values are above it and are removed when it's done
+		int m_ValueBase = 0;
+	};
+
+	void Step();
+
+	// Evaluates a child node, its value ends up on the top of the value stack when the task runs next time
+	void Evaluate(ASTNode* node);
+
+	// Finishes the current task and gives its value to the task below
+	void Complete(const Value& value);
+
+	// Goes back to the function call that the return statement is in
+	void Return(Value value);
+
+	// Removes the value of a condition from the stack
+	bool PopCondition();
+
+	bool IsLeaf(ASTNode* node);
+
+private:
+	std::vector<Task> m_Tasks;
+	std::vector<Value> m_Values;
+
+public:
+	// The value of the program when it's done
+	Value m_Result;
+};
+
+}
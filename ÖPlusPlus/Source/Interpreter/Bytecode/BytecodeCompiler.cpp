@@ -1,6 +1,7 @@
 #pragma once
 
 #include <fstream>
+#include <algorithm>
 #include <iostream>
 
 #include "BytecodeCompiler.h"
@@ -9,6 +10,7 @@
 #include "../../Utils.hpp"
 
 #include "Heap.h"
+#include "ModuleCache.h"
 
 //
 //ValueTypes NodeTypeToValueType(ASTNode* n)
@@ -43,13 +45,14 @@ Bytecode::Opcodes ASTComparisonTypeToOpcode(ASTTypes type)
 
 namespace Bytecode {
 
-uint32_t BytecodeConverterContext::AddStringConstant(ConstantsPool& constants, std::string string)
+uint32_t BytecodeConverterContext::AddStringConstant(ConstantsPool& constants, Symbol string)
 {
-	char* stringConstant = CopyString(string.c_str());
-
 	// If an index already exists for this string
-	if (m_IndiciesForStringConstants.count(string) == 1)
-		return m_IndiciesForStringConstants[string];
+	auto it = m_IndiciesForStringConstants.find(string);
+	if (it != m_IndiciesForStringConstants.end())
+		return it->second;
+
+	char* stringConstant = CopyString(StringInterner::Get().GetString(string).c_str());
 
 	// Otherwise, create the string and use the next free slot
 	uint32_t index = constants.m_FreeStringSlot++;
@@ -60,21 +63,39 @@ uint32_t BytecodeConverterContext::AddStringConstant(ConstantsPool& constants, s
 	return index;
 }
 
-BytecodeConverterContext::Variable BytecodeConverterContext::GetVariable(std::string& variableName)
+const BytecodeConverterContext::Variable* BytecodeConverterContext::FindVariable(Symbol variableName)
+{
+	auto it = m_Variables.find(variableName);
+	if (it != m_Variables.end())
+		return &it->second;
+
+	if (m_Globals != nullptr)
+	{
+		auto global = m_Globals->find(variableName);
+		if (global != m_Globals->end() && global->second.m_Index <= m_LastVisibleGlobal)
+			return &global->second;
+	}
+
+	return nullptr;
+}
+
+BytecodeConverterContext::Variable BytecodeConverterContext::GetVariable(Symbol variableName)
 {
 	// If an index already exists for this variable
-	if (m_Variables.count(variableName) == 1)
-		return m_Variables[variableName];
+	const Variable* variable = FindVariable(variableName);
+	if (variable != nullptr)
+		return *variable;
 
 	return Variable();
 }
 
-bool BytecodeConverterContext::CreateVariableIndex(std::string& variableName, ValueTypes type, int& index)
+bool BytecodeConverterContext::CreateVariableIndex(Symbol variableName, ValueTypes type, int& index)
 {
 	// If an index already exists for this variable
-	if (m_Variables.count(variableName) == 1)
+	const Variable* existing = FindVariable(variableName);
+	if (existing != nullptr)
 	{
-		index = m_Variables[variableName].m_Index;
+		index = existing->m_Index;
 		return false;
 	}
 
@@ -87,19 +108,20 @@ bool BytecodeConverterContext::CreateVariableIndex(std::string& variableName, Va
 bool BytecodeConverterContext::CreateVariableIndex(Variable& variable)
 {
 	// If an index already exists for this variable
-	if (m_Variables.count(variable.m_Name) == 1)
+	const Variable* existing = FindVariable(variable.m_Symbol);
+	if (existing != nullptr)
 	{
-		variable.m_Index = m_Variables[variable.m_Name].m_Index;
+		variable.m_Index = existing->m_Index;
 		return false;
 	}
 
 	// Use the next free slot
 	variable.m_Index = m_NextFreeVariableIndex++;
-	m_Variables[variable.m_Name] = Variable(variable.m_Index, variable.m_Name, variable.m_Type, variable.m_IsGlobal);
+	m_Variables[variable.m_Symbol] = Variable(variable.m_Index, variable.m_Symbol, variable.m_Type, variable.m_IsGlobal);
 	return true;
 }
 
-int BytecodeConverterContext::CreateVariableIndex(std::string& variableName, ValueTypes type)
+int BytecodeConverterContext::CreateVariableIndex(Symbol variableName, ValueTypes type)
 {
 	int index = 0;
 	CreateVariableIndex(variableName, type, index);
@@ -109,36 +131,85 @@ int BytecodeConverterContext::CreateVariableIndex(std::string& variableName, Val
 
 void BytecodeCompiler::PreCompileFunction(ASTNode* node)
 {
-	BytecodeConverterContext::Variable variable(-1, node->left->arguments[1]->stringValue, ValueTypes::Integer/*ValueTypes::FunctionPointer*/);
+	BytecodeConverterContext::Variable variable(-1, node->left->arguments[1]->symbol, ValueTypes::Integer/*ValueTypes::FunctionPointer*/);
 
-	m_Context.CreateVariableIndex(variable.m_Name, variable.m_Type, variable.m_Index);
+	m_Context.CreateVariableIndex(variable.m_Symbol, variable.m_Type, variable.m_Index);
 }
 
 int BytecodeCompiler::CompileFunction(ASTNode* node, std::vector<Instruction>& instructions)
 {
 	PreCompileFunction(node);
-	BytecodeConverterContext::Variable variable = m_Context.GetVariable(node->left->arguments[1]->stringValue);
+	BytecodeConverterContext::Variable variable = m_Context.GetVariable(node->left->arguments[1]->symbol);
 	if (variable.m_Index == -1)
 	{
-		Throw("Function " + variable.m_Name + " has not been declared somehow");
+		Throw("Function " + variable.GetName() + " has not been declared somehow");
 		return -1;
 	}
 
 	// A function declaration has to be global
 	if (m_CurrentScope != 0)
 	{
-		Throw("Function " + variable.m_Name + " is not in the global scope");
+		Throw("Function " + variable.GetName() + " is not in the global scope");
 		return -1;
 	}
 	variable.m_IsGlobal = true;
 
-	m_CurrentScope++;
+	int functionStart = -1;
 
-	int functionStart = instructions.size() + 1;
+	m_FunctionCount++;
 
-	//std::vector<Instruction> function;
+	if (!m_DeferFunctions)
+	{
+		m_CompiledFunctionCount++;
+
+		functionStart = instructions.size() + 1;
+
+		instructions.emplace_back(Opcodes::skip_function);
+
+		BytecodeConverterContext initialContext = m_Context;
+
+		CompileFunctionBody(node, instructions);
+
+		m_Context.m_Variables = initialContext.m_Variables;
+
+		// Function before
+		instructions[functionStart - 1].m_Arguments[0] = InstructionArgument(int(instructions.size()), ValueTypes::Integer);
+	}
+
+	if (m_Context.m_ShouldExportVariable)
+		instructions.push_back(Instruction(Opcodes::load).Arg(m_Context.m_ModuleIndex));
+
+	// The start of a deferred function is set when it's linked
+	if (m_DeferFunctions)
+	{
+		m_DeferredFunctions.emplace_back();
+		m_DeferredFunctions.back().m_Node = node;
+		m_DeferredFunctions.back().m_Index = variable.m_Index;
+		m_DeferredFunctions.back().m_PointerAt = instructions.size();
+	}
+
+	// The variable for the function stores the adress of the function
+	instructions.push_back(Instruction(Opcodes::push_functionpointer).Arg(functionStart));
+
+	instructions.push_back(Instruction(Opcodes::store)
+		.Arg(variable.m_Index)
+		.Arg((int)variable.m_Type)
+		.Arg(variable.GetName())
+		.Arg(variable.m_IsGlobal));
+
+	if (m_Context.m_ShouldExportVariable)
+	{
+		instructions.push_back(Instruction(Opcodes::load).Arg(variable.m_Index));
+		instructions.push_back(Instruction(Opcodes::store_property).Arg(variable.GetName()));
+	}
+
+	return functionStart;
+}
+
+void BytecodeCompiler::CompileFunctionBody(ASTNode* node, std::vector<Instruction>& instructions)
+{
+	m_CurrentScope++;
 
-	instructions.emplace_back(Opcodes::skip_function);
 	instructions.push_back(Instruction(Opcodes::create_function_frame).Arg((int)m_CurrentScope));
 
 	// Reset export variable so the local function variables don't get exported
@@ -147,10 +218,6 @@ int BytecodeCompiler::CompileFunction(ASTNode* node, std::vector<Instruction>& i
 
 	if (node->right)
 	{
-		//Instructions body;
-
-		BytecodeConverterContext initialContext = m_Context;
-
 		// Compile arguments
 		if (node->left->arguments.size() >= 3)
 		{
@@ -167,15 +234,6 @@ int BytecodeCompiler::CompileFunction(ASTNode* node, std::vector<Instruction>& i
 		}
 
 		Compile(node->right, instructions, false);
-
-		m_Context.m_Variables = initialContext.m_Variables;
-
-		// Make the function global in case of it being marked as threaded
-		//if (m_Context.m_IsThreadedFunction)
-		//	m_Constants.m_GlobalFunctions[variable.m_Name] = body;
-
-		//function = ConcatVectors(function, body);
-
 	}
 
 	m_Context.m_ShouldExportVariable = shouldExport;
@@ -189,33 +247,319 @@ int BytecodeCompiler::CompileFunction(ASTNode* node, std::vector<Instruction>& i
 		instructions.emplace_back(Opcodes::ret_void);
 	}
 
-	// Function before
-	instructions[functionStart - 1].m_Arguments[0] = InstructionArgument(int(instructions.size()), ValueTypes::Integer);
+	m_CurrentScope--;
+}
 
-	// Insert the function instructions at the start of the bytecode
-	//instructions = ConcatVectors(instructions, function);
+void BytecodeCompiler::CompileProgram(ASTNode* program, std::vector<Instruction>& instructions, ThreadPool* pool)
+{
+	m_LinkedModules.clear();
 
-	if (m_Context.m_ShouldExportVariable)
-		instructions.push_back(Instruction(Opcodes::load).Arg(m_Context.m_ModuleIndex));
+	if (pool == nullptr && !m_CompileFunctionsLazily)
+		return Compile(program, instructions);
 
-	// The variable for the function stores the adress of the function
-	instructions.push_back(Instruction(Opcodes::push_functionpointer).Arg(functionStart));
+	m_DeferredFunctions.clear();
+	m_DeferFunctions = true;
 
-	instructions.push_back(Instruction(Opcodes::store)
-		.Arg(variable.m_Index)
-		.Arg((int)variable.m_Type)
-		.Arg(variable.m_Name)
-		.Arg(variable.m_IsGlobal));
+	// The top level variables are kept after the program body, since the functions need them
+	if (program->type == ASTTypes::ProgramBody || program->type == ASTTypes::ModuleBody)
+		Compile(program->left, instructions, false, false);
+	else
+		Compile(program, instructions);
 
-	if (m_Context.m_ShouldExportVariable)
+	m_DeferFunctions = false;
+
+	instructions.emplace_back(Opcodes::stop);
+
+	// Every function starts out as a stub that compiles it when it's called
+	if (m_CompileFunctionsLazily)
 	{
-		instructions.push_back(Instruction(Opcodes::load).Arg(variable.m_Index));
-		instructions.push_back(Instruction(Opcodes::store_property).Arg(variable.m_Name));
+		for (int i = 0; i < m_DeferredFunctions.size(); i++)
+		{
+			instructions[m_DeferredFunctions[i].m_PointerAt].m_Arguments[0] = InstructionArgument(int(instructions.size()), ValueTypes::Integer);
+			instructions.push_back(Instruction(Opcodes::compile_function).Arg(i));
+		}
+
+		return;
 	}
 
-	m_CurrentScope--;
+	// The function bodies only read the top level variables, so they can be compiled on any thread
+	pool->ForEach((int)m_DeferredFunctions.size(), [&](int i) {
+		CompileDeferredFunction(m_DeferredFunctions[i]);
+	});
 
-	return functionStart;
+	// Every function was found before the first error in the program body, so an error in one of them comes first
+	for (DeferredFunction& function : m_DeferredFunctions)
+	{
+		if (function.m_Error != "")
+		{
+			m_Error = function.m_Error;
+			break;
+		}
+	}
+
+	size_t size = instructions.size();
+	for (DeferredFunction& function : m_DeferredFunctions)
+		size += function.m_Instructions.size();
+
+	instructions.reserve(size);
+
+	for (DeferredFunction& function : m_DeferredFunctions)
+	{
+		instructions[function.m_PointerAt].m_Arguments[0] = InstructionArgument(LinkFunction(function, instructions, m_Constants), ValueTypes::Integer);
+		m_CompiledFunctionCount++;
+	}
+
+	m_DeferredFunctions.clear();
+}
+
+int BytecodeCompiler::CompileLazyFunction(int function, std::vector<Instruction>& instructions, ConstantsPool& constants)
+{
+	DeferredFunction& deferred = m_DeferredFunctions[function];
+
+	CompileDeferredFunction(deferred);
+	if (deferred.m_Error != "")
+	{
+		Throw(deferred.m_Error);
+		return -1;
+	}
+
+	m_CompiledFunctionCount++;
+
+	int start = LinkFunction(deferred, instructions, constants);
+	deferred.m_Instructions = Instructions();
+
+	return start;
+}
+
+void BytecodeCompiler::CompileDeferredFunction(DeferredFunction& function)
+{
+	// The body gets a compiler of its own that only reads this one
+	BytecodeCompiler compiler;
+	compiler.m_Context.m_Globals = &m_Context.m_Variables;
+	compiler.m_Context.m_LastVisibleGlobal = function.m_Index;
+	compiler.m_Context.m_NextFreeVariableIndex = m_Context.m_NextFreeVariableIndex;
+	compiler.m_Context.m_IsModule = m_Context.m_IsModule;
+	compiler.m_Context.m_ModuleIndex = m_Context.m_ModuleIndex;
+
+	compiler.CompileFunctionBody(function.m_Node, function.m_Instructions);
+
+	function.m_Error = compiler.m_Error;
+
+	// The strings are added to the program's constants when the function is linked
+	function.m_StringConstants = std::move(compiler.m_Context.m_IndiciesForStringConstants);
+	for (uint32_t s = 0; s < compiler.m_Constants.m_FreeStringSlot; s++)
+		delete[] (char*)compiler.m_Constants.m_StringConstants[s].m_Data;
+}
+
+int BytecodeCompiler::LinkFunction(DeferredFunction& function, std::vector<Instruction>& instructions, ConstantsPool& constants)
+{
+	int start = instructions.size();
+
+	std::vector<Symbol> strings(function.m_StringConstants.size());
+	for (auto& [string, index] : function.m_StringConstants)
+		strings[index] = string;
+
+	for (Instruction& instruction : function.m_Instructions)
+	{
+		// The jumps were compiled for a function that starts at 0
+		if (instruction.m_Type == Opcodes::jmp || instruction.m_Type == Opcodes::jmp_if_true || instruction.m_Type == Opcodes::jmp_if_false)
+			instruction.m_Arguments[0] = InstructionArgument(instruction.m_Arguments[0].GetInt() + start, ValueTypes::Integer);
+
+		if (instruction.m_Type == Opcodes::push_stringconst)
+			instruction.m_Arguments[0] = InstructionArgument((int)m_Context.AddStringConstant(constants, strings[instruction.m_Arguments[0].GetInt()]), ValueTypes::Integer);
+
+		instructions.push_back(std::move(instruction));
+	}
+
+	return start;
+}
+
+void BytecodeCompiler::CompileModule(ASTNode* program, BytecodeModule& module)
+{
+	m_Context.m_IsModule = true;
+
+	// The top level variables are kept, they are the exports
+	if (program->left != nullptr)
+		Compile(program->left, module.m_Instructions, false, false);
+
+	if (m_Error != "")
+		return;
+
+	module.m_VariableCount = m_Context.m_NextFreeVariableIndex;
+
+	for (Symbol name : m_Exports)
+	{
+		BytecodeConverterContext::Variable variable = m_Context.GetVariable(name);
+		module.m_Exports.push_back({ variable.GetName(), variable.m_Index, variable.m_Type });
+	}
+
+	module.m_Imports = m_Imports;
+	module.m_Dependencies = m_Dependencies;
+
+	// The strings are added to the program's constants when the module is linked
+	module.m_Strings.resize(m_Constants.m_FreeStringSlot);
+	for (auto& [string, index] : m_Context.m_IndiciesForStringConstants)
+		module.m_Strings[index] = StringInterner::Get().GetString(string);
+
+	for (uint32_t s = 0; s < m_Constants.m_FreeStringSlot; s++)
+		delete[] (char*)m_Constants.m_StringConstants[s].m_Data;
+	m_Constants.m_FreeStringSlot = 0;
+}
+
+void BytecodeCompiler::CompileImport(ASTNode* node, std::vector<Instruction>& instructions)
+{
+	if (m_CurrentScope != 0)
+		return Throw("Can only import " + std::string(node->stringValue) + " at the top level");
+
+	if (m_Modules == nullptr)
+		return Throw("Can't import " + std::string(node->stringValue) + " here");
+
+	std::string path = ModuleCache::ResolvePath(m_Directory, std::string(node->stringValue));
+
+	std::string error;
+	const BytecodeModule* module = m_Modules->Get(path, error);
+	if (module == nullptr)
+		return Throw(error);
+
+	// A module only gets variables for the exports, they are the exporter's variables once the program is linked
+	if (m_Context.m_IsModule)
+	{
+		if (std::find(m_Dependencies.begin(), m_Dependencies.end(), path) != m_Dependencies.end())
+			return;
+
+		m_Dependencies.push_back(path);
+
+		for (const BytecodeModule::Export& exported : module->m_Exports)
+		{
+			BytecodeConverterContext::Variable variable(-1, StringInterner::Get().Intern(exported.m_Name), exported.m_Type, true);
+			if (!m_Context.CreateVariableIndex(variable))
+				return Throw("Variable " + exported.m_Name + " from " + std::string(node->stringValue) + " has already been declared");
+
+			m_Imports.push_back({ path, exported.m_Name, variable.m_Index, exported.m_Type });
+		}
+
+		return;
+	}
+
+	if (!LinkModule(*module, instructions))
+		return;
+
+	const auto& exports = m_LinkedModules[path];
+	for (const BytecodeModule::Export& exported : module->m_Exports)
+	{
+		const BytecodeConverterContext::Variable& variable = exports.at(exported.m_Name);
+
+		// Importing the same module twice is fine
+		BytecodeConverterContext::Variable existing = m_Context.GetVariable(variable.m_Symbol);
+		if (existing.m_Index == variable.m_Index)
+			continue;
+
+		if (existing.m_Index != -1)
+			return Throw("Variable " + exported.m_Name + " from " + std::string(node->stringValue) + " has already been declared");
+
+		m_Context.m_Variables[variable.m_Symbol] = variable;
+	}
+}
+
+void BytecodeCompiler::CompileExport(ASTNode* node, std::vector<Instruction>& instructions)
+{
+	if (!m_Context.m_IsModule)
+		return Throw("Can only export from a file that is imported");
+
+	if (m_CurrentScope != 0)
+		return Throw("Can only export at the top level");
+
+	// The name that is declared
+	Symbol name = NoSymbol;
+	if (node->left->type == ASTTypes::FunctionDefinition)
+		name = node->left->left->arguments[1]->symbol;
+	else if (node->left->type == ASTTypes::VariableDeclaration)
+		name = node->left->right->symbol;
+	else if (node->left->type == ASTTypes::Assign && node->left->left->type == ASTTypes::VariableDeclaration)
+		name = node->left->left->right->symbol;
+	else
+		return Throw("Can only export variable and function declarations");
+
+	Compile(node->left, instructions);
+
+	if (std::find(m_Exports.begin(), m_Exports.end(), name) == m_Exports.end())
+		m_Exports.push_back(name);
+}
+
+bool BytecodeCompiler::LinkModule(const BytecodeModule& module, std::vector<Instruction>& instructions)
+{
+	if (m_LinkedModules.count(module.m_Path) == 1)
+		return true;
+
+	// The modules it imports run first
+	for (const std::string& path : module.m_Dependencies)
+	{
+		const BytecodeModule* dependency = m_Modules->Find(path);
+		assert(dependency != nullptr);
+
+		if (!LinkModule(*dependency, instructions))
+			return false;
+	}
+
+	std::vector<int> indices(module.m_VariableCount, -1);
+	for (const BytecodeModule::Import& import : module.m_Imports)
+	{
+		const auto& exports = m_LinkedModules[import.m_Path];
+
+		auto it = exports.find(import.m_Name);
+		if (it == exports.end() || it->second.m_Type != import.m_Type)
+		{
+			Throw(module.m_Path + ": " + import.m_Path + " doesn't export " + import.m_Name);
+			return false;
+		}
+
+		indices[import.m_Index] = it->second.m_Index;
+	}
+
+	for (int& index : indices)
+	{
+		if (index == -1)
+			index = m_Context.m_NextFreeVariableIndex++;
+	}
+
+	int start = instructions.size();
+	instructions.reserve(start + module.m_Instructions.size());
+
+	for (Instruction instruction : module.m_Instructions)
+	{
+		switch (instruction.m_Type)
+		{
+		// The jumps were compiled for a module that starts at 0
+		case Opcodes::jmp:
+		case Opcodes::jmp_if_true:
+		case Opcodes::jmp_if_false:
+		case Opcodes::skip_function:
+		case Opcodes::push_functionpointer:
+			instruction.m_Arguments[0] = InstructionArgument(instruction.m_Arguments[0].GetInt() + start, ValueTypes::Integer);
+			break;
+		case Opcodes::load:
+		case Opcodes::store:
+		case Opcodes::post_inc:
+		case Opcodes::pre_inc:
+		case Opcodes::post_dec:
+		case Opcodes::pre_dec:
+			instruction.m_Arguments[0] = InstructionArgument(indices[instruction.m_Arguments[0].GetInt()], ValueTypes::Integer);
+			break;
+		case Opcodes::push_stringconst:
+			instruction.m_Arguments[0] = InstructionArgument((int)m_Context.AddStringConstant(m_Constants, StringInterner::Get().Intern(module.m_Strings[instruction.m_Arguments[0].GetInt()])), ValueTypes::Integer);
+			break;
+		default:
+			break;
+		}
+
+		instructions.push_back(std::move(instruction));
+	}
+
+	auto& exports = m_LinkedModules[module.m_Path];
+	for (const BytecodeModule::Export& exported : module.m_Exports)
+		exports[exported.m_Name] = BytecodeConverterContext::Variable(indices[exported.m_Index], StringInterner::Get().Intern(exported.m_Name), exported.m_Type, true);
+
+	return true;
 }
 
 void BytecodeCompiler::PreCompileAnonymousFunction(ASTNode* node)
@@ -257,14 +601,14 @@ void BytecodeCompiler::CompileAssignment(ASTNode* node, std::vector<Instruction>
 {
 	std::string propertyName = "";
 
-	BytecodeConverterContext::Variable variable(-1, node->left->stringValue/*, NodeTypeToValueType(node->right)*/);
+	BytecodeConverterContext::Variable variable(-1, node->left->symbol/*, NodeTypeToValueType(node->right)*/);
 
 	bool assigningToProperty = false;
 
 	// Resolve if variable decleration on the left. Should create a new variable
 	if (node->left->type == ASTTypes::VariableDeclaration)
 	{
-		variable.m_Name = node->left->right->stringValue;
+		variable.m_Symbol = node->left->right->symbol;
 		variable.m_Type = node->left->left->VariableTypeToValueType();
 		if (variable.m_Type == ValueTypes::String)
 			variable.m_Type == ValueTypes::StringConstant;
@@ -278,11 +622,11 @@ void BytecodeCompiler::CompileAssignment(ASTNode* node, std::vector<Instruction>
 		else
 		{
 			if (!m_Context.CreateVariableIndex(variable))
-				return Throw("Variable " + variable.m_Name + " has already been declared");
+				return Throw("Variable " + variable.GetName() + " has already been declared");
 
 			// Error if the type of the value on the right couldn't be evaluated, because it's not a constant
 			if (variable.m_Type == ValueTypes::Void && node->right->type != ASTTypes::Null)
-				return Throw("Variable " + variable.m_Name + " doesn't have a type");
+				return Throw("Variable " + variable.GetName() + " doesn't have a type");
 		}
 	}
 	// Assigning to a property
@@ -296,7 +640,7 @@ void BytecodeCompiler::CompileAssignment(ASTNode* node, std::vector<Instruction>
 		{
 			if (n->left == nullptr)
 			{
-				variable.m_Name = n->stringValue;
+				variable.m_Symbol = n->symbol;
 				break;
 			}
 
@@ -304,8 +648,8 @@ void BytecodeCompiler::CompileAssignment(ASTNode* node, std::vector<Instruction>
 		}
 
 		// Assigning to an existing variable
-		std::string name = variable.m_Name;
-		variable = m_Context.GetVariable(variable.m_Name);
+		std::string name = variable.GetName();
+		variable = m_Context.GetVariable(variable.m_Symbol);
 		if (variable.m_Index == -1)
 			return Throw("Variable " + name + " cannot be assigned to, because it hasn't been declared");
 
@@ -315,8 +659,8 @@ void BytecodeCompiler::CompileAssignment(ASTNode* node, std::vector<Instruction>
 	else
 	{
 		// Assigning to an existing variable
-		std::string name = variable.m_Name;
-		variable = m_Context.GetVariable(variable.m_Name);
+		std::string name = variable.GetName();
+		variable = m_Context.GetVariable(variable.m_Symbol);
 		if (variable.m_Index == -1)
 		{
 			//if (node->right->type == ASTTypes::FunctionDefinition)
@@ -343,19 +687,19 @@ void BytecodeCompiler::CompileAssignment(ASTNode* node, std::vector<Instruction>
 		instructions.push_back(Instruction(Opcodes::store)
 			.Arg(variable.m_Index)
 			.Arg((int)variable.m_Type)
-			.Arg(variable.m_Name)
+			.Arg(variable.GetName())
 			.Arg(variable.m_IsGlobal));
 	}
 	else
 	{
-		instructions.push_back(Instruction(Opcodes::store_property).Arg(node->left->right->stringValue));
+		instructions.push_back(Instruction(Opcodes::store_property).Arg(std::string(node->left->right->stringValue)));
 	}
 
 	// Store the variable to the module, but also as a normal variable
 	if (m_Context.m_ShouldExportVariable)
 	{
 		instructions.push_back(Instruction(Opcodes::load).Arg(variable.m_Index));
-		instructions.push_back(Instruction(Opcodes::store_property).Arg(variable.m_Name));
+		instructions.push_back(Instruction(Opcodes::store_property).Arg(variable.GetName()));
 	}
 }
 
@@ -366,7 +710,7 @@ void BytecodeCompiler::ExportVariable(ASTNode* node, BytecodeConverterContext::V
 	if (node->type == ASTTypes::Assign)
 	{
 		if (node->left->type != ASTTypes::VariableDeclaration)
-			return Throw("Cannot export an assignment to existing variable '" + variable.m_Name + "', only declarations");
+			return Throw("Cannot export an assignment to existing variable '" + variable.GetName() + "', only declarations");
 
 	}
 	else if (node->type == ASTTypes::VariableDeclaration)
@@ -377,8 +721,8 @@ void BytecodeCompiler::ExportVariable(ASTNode* node, BytecodeConverterContext::V
 		return Throw("Can only export variables");
 	}
 
-	if (!m_Context.CreateVariableIndex(variable.m_Name, variable.m_Type, variable.m_Index))
-		return Throw("Variable " + variable.m_Name + " has already been exported or declared");
+	if (!m_Context.CreateVariableIndex(variable.m_Symbol, variable.m_Type, variable.m_Index))
+		return Throw("Variable " + variable.GetName() + " has already been exported or declared");
 
 	instructions.push_back(Instruction(Opcodes::load).Arg(m_Context.m_ModuleIndex));
 }
@@ -717,10 +1061,22 @@ void BytecodeCompiler::Compile(ASTNode* node, std::vector<Instruction>& instruct
 		break;
 	}
 
+	case ASTTypes::Import:
+	{
+		CompileImport(node, instructions);
+		break;
+	}
+
+	case ASTTypes::Export:
+	{
+		CompileExport(node, instructions);
+		break;
+	}
+
 	case ASTTypes::VariableDeclaration:
 	{
 		bool isGlobalVariable = m_CurrentScope == 0;
-		BytecodeConverterContext::Variable variable(-1, right->stringValue, left->VariableTypeToValueType(), isGlobalVariable);
+		BytecodeConverterContext::Variable variable(-1, right->symbol, left->VariableTypeToValueType(), isGlobalVariable);
 		if (variable.m_Type == ValueTypes::String)
 			variable.m_Type = ValueTypes::StringConstant;
 
@@ -735,7 +1091,7 @@ void BytecodeCompiler::Compile(ASTNode* node, std::vector<Instruction>& instruct
 		if (variable.m_Type == ValueTypes::Float) // 0
 			instructions.push_back(Instruction(Opcodes::push_number).Arg(double(0.0), ValueTypes::Float));
 		else if (variable.m_Type == ValueTypes::String) // ""
-			instructions.push_back(Instruction(Opcodes::push_stringconst).Arg(m_Context.AddStringConstant(m_Constants, "")));
+			instructions.push_back(Instruction(Opcodes::push_stringconst).Arg(m_Context.AddStringConstant(m_Constants, NoSymbol)));
 		//else if (variable.m_Type == ValueTypes::Array) // []
 		//	instructions.emplace_back(Opcodes::array_create_empty);
 		//else if (variable.m_Type == ValueTypes::Object) // {}
@@ -744,14 +1100,14 @@ void BytecodeCompiler::Compile(ASTNode* node, std::vector<Instruction>& instruct
 		instructions.push_back(Instruction(Opcodes::store).
 			Arg(variable.m_Index)
 			.Arg((int)variable.m_Type)
-			.Arg(variable.m_Name)
+			.Arg(variable.GetName())
 			.Arg(variable.m_IsGlobal));
 
 		// Store the variable value to the module property, but also as a variable
 		if (m_Context.m_ShouldExportVariable)
 		{
 			instructions.push_back(Instruction(Opcodes::load).Arg(variable.m_Index));
-			instructions.push_back(Instruction(Opcodes::store_property).Arg(variable.m_Name));
+			instructions.push_back(Instruction(Opcodes::store_property).Arg(variable.GetName()));
 		}
 
 		break;
@@ -768,10 +1124,10 @@ void BytecodeCompiler::Compile(ASTNode* node, std::vector<Instruction>& instruct
 	case ASTTypes::PostIncrement:
 	{
 		// Load the variable
-		int index = m_Context.GetVariable(node->left->stringValue).m_Index;
+		int index = m_Context.GetVariable(node->left->symbol).m_Index;
 
 		if (index == -1)
-			return Throw("Variable " + node->stringValue + " doesn't exist");
+			return Throw("Variable " + std::string(node->stringValue) + " doesn't exist");
 
 		if (node->type == ASTTypes::PostIncrement)
 			instructions.push_back(Instruction(Opcodes::post_inc, ResultCanBeDiscarded(node)).Arg(index));
@@ -823,21 +1179,21 @@ void BytecodeCompiler::Compile(ASTNode* node, std::vector<Instruction>& instruct
 		if (right->type == ASTTypes::FunctionCall)
 		{
 			// Compile the function call
-			// Push all the arguments onto the stack backwards
-			for (int i = right->arguments.size() - 1; i >= 0; i--)
+			// Push all the arguments onto the stack in order, so that they are evaluated from left to right
+			for (int i = 0; i < right->arguments.size(); i++)
 			{
 				Compile(right->arguments[i], instructions);
 			}
 
 			Compile(left, instructions); // Source object
-			instructions.push_back(Instruction(Opcodes::load_property).Arg(right->stringValue));
+			instructions.push_back(Instruction(Opcodes::load_property).Arg(std::string(right->stringValue)));
 
-			instructions.push_back(Instruction(Opcodes::call).Arg(right->arguments.size()).Arg(right->stringValue));
+			instructions.push_back(Instruction(Opcodes::call).Arg(right->arguments.size()).Arg(std::string(right->stringValue)));
 		}
 		else
 		{
 			Compile(left, instructions); // Source object
-			instructions.push_back(Instruction(Opcodes::load_property).Arg(right->stringValue));
+			instructions.push_back(Instruction(Opcodes::load_property).Arg(std::string(right->stringValue)));
 		}
 
 		break;
@@ -856,25 +1212,25 @@ void BytecodeCompiler::Compile(ASTNode* node, std::vector<Instruction>& instruct
 	{
 		// Push all the arguments onto the stack
 
-		// Push the arguments backwards
-		for (int i = node->arguments.size() - 1; i >= 0; i--)
+		// Push the arguments in order, so that they are evaluated from left to right
+		for (int i = 0; i < node->arguments.size(); i++)
 		{
 			Compile(node->arguments[i], instructions);
 		}
 
 		// Calling native functions
-		if (Functions::GetFunctionByName(node->stringValue))
+		if (Functions::GetFunctionBySymbol(node->symbol))
 		{
-			instructions.push_back(Instruction(Opcodes::call_native, ResultCanBeDiscarded(node)).Arg(node->stringValue).Arg(node->arguments.size()));
+			instructions.push_back(Instruction(Opcodes::call_native, ResultCanBeDiscarded(node)).Arg(std::string(node->stringValue)).Arg(node->arguments.size()));
 			break;
 		}
 
-		BytecodeConverterContext::Variable variable = m_Context.GetVariable(node->stringValue);
+		BytecodeConverterContext::Variable variable = m_Context.GetVariable(node->symbol);
 		if (variable.m_Index == -1)
-			return Throw("Function " + node->stringValue + " not defined");
+			return Throw("Function " + std::string(node->stringValue) + " not defined");
 
 		instructions.push_back(Instruction(Opcodes::load).Arg(variable.m_Index));
-		instructions.push_back(Instruction(Opcodes::call, ResultCanBeDiscarded(node)).Arg(node->arguments.size()).Arg(node->stringValue));
+		instructions.push_back(Instruction(Opcodes::call, ResultCanBeDiscarded(node)).Arg(node->arguments.size()).Arg(std::string(node->stringValue)));
 
 		break;
 	}
@@ -956,10 +1312,10 @@ void BytecodeCompiler::Compile(ASTNode* node, std::vector<Instruction>& instruct
 
 	case ASTTypes::Variable:
 	{
-		int index = m_Context.GetVariable(node->stringValue).m_Index;
+		int index = m_Context.GetVariable(node->symbol).m_Index;
 
 		if (index == -1)
-			return Throw("Variable " + node->stringValue + " doesn't exist");
+			return Throw("Variable " + std::string(node->stringValue) + " doesn't exist");
 
 		instructions.push_back(Instruction(Opcodes::load).Arg(index));
 
@@ -995,7 +1351,7 @@ void BytecodeCompiler::Compile(ASTNode* node, std::vector<Instruction>& instruct
 	{
 		bool discardValue = node->parent->type == ASTTypes::Scope;
 
-		uint32_t constantsIndex = m_Context.AddStringConstant(m_Constants, node->stringValue);
+		uint32_t constantsIndex = m_Context.AddStringConstant(m_Constants, node->symbol);
 		instructions.push_back(Instruction(Opcodes::push_stringconst, discardValue).Arg(constantsIndex));
 
 		break;
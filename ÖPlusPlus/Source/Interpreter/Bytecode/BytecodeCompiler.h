@@ -5,6 +5,7 @@
 
 #include "../../Lexer.h"
 #include "../../Parser.h"
+#include "../../ThreadPool.h"
 #include "../Value.h"
 
 // https://dzone.com/articles/introduction-to-java-bytecode
@@ -76,6 +77,7 @@ namespace Bytecode {
 		call, // Calls a function from a reference. Tha arguments must have been pushed to the stack
 		call_native, // {name}, {arg count}
 		skip_function, // Skips the function that is below. Used to skip functions that have not been called. x = end of function
+		compile_function, // Compiles a function the first time it's called, and becomes a jump to it. arg = function
 
 		no_op, // Does nothing
 		stop
@@ -145,6 +147,7 @@ namespace Bytecode {
 			"call",
 			"call_native",
 			"skip_function",
+			"compile_function",
 
 			"no_op",
 			"stop"
@@ -202,14 +205,17 @@ namespace Bytecode {
 	public:
 		struct Variable
 		{
-			std::string m_Name = "";
+			Symbol m_Symbol = NoSymbol;
 			int m_Index = -1;
 
 			bool m_IsGlobal = false;
 
 			ValueTypes m_Type = ValueTypes::Void;
 
-			Variable(int index = -1, std::string name = "", ValueTypes type = ValueTypes::Void, bool isGlobal = false) : m_Name(name), m_Index(index), m_Type(type), m_IsGlobal(isGlobal) {};
+			Variable(int index = -1, Symbol symbol = NoSymbol, ValueTypes type = ValueTypes::Void, bool isGlobal = false) : m_Symbol(symbol), m_Index(index), m_Type(type), m_IsGlobal(isGlobal) {};
+
+			// The name is only needed for the instructions and errors
+			const std::string& GetName() const { return StringInterner::Get().GetString(m_Symbol); }
 		};
 
 		struct LoopInfo
@@ -221,16 +227,21 @@ namespace Bytecode {
 		};
 
 	public:
-		uint32_t AddStringConstant(ConstantsPool& constants, std::string string);
+		uint32_t AddStringConstant(ConstantsPool& constants, Symbol string);
 
-		Variable GetVariable(std::string& variableName);
-		bool CreateVariableIndex(std::string& variableName, ValueTypes type, int& index); // Returns false if the variable exists, true if it was created
+		Variable GetVariable(Symbol variableName);
+		bool CreateVariableIndex(Symbol variableName, ValueTypes type, int& index); // Returns false if the variable exists, true if it was created
 		bool CreateVariableIndex(Variable& variable); // Returns false if the variable exists, true if it was created. Sets the index on the variable object
-		int CreateVariableIndex(std::string& variableName, ValueTypes type);
+		int CreateVariableIndex(Symbol variableName, ValueTypes type);
 
 	public:
-		std::unordered_map<std::string, Variable> m_Variables;
-		std::unordered_map<std::string, uint32_t> m_IndiciesForStringConstants;
+		std::unordered_map<Symbol, Variable> m_Variables;
+
+		// The top level variables of the whole program, for a function body that is compiled on its own. The ones declared
+		// before the function have an index up to the function's own, and are the only ones it can see
+		const std::unordered_map<Symbol, Variable>* m_Globals = nullptr;
+		int m_LastVisibleGlobal = -1;
+		std::unordered_map<Symbol, uint32_t> m_IndiciesForStringConstants;
 
 		uint32_t m_NextFreeVariableIndex = 0;
 		uint32_t m_NextFreeStringConstantIndex = 0;
@@ -241,6 +252,43 @@ namespace Bytecode {
 		bool m_IsThreadedFunction = false;
 
 		LoopInfo m_LoopInfo;
+
+	private:
+		const Variable* FindVariable(Symbol variableName);
+	};
+
+	class ModuleCache;
+
+	// A file that is imported, compiled on its own so that it can be linked into every program that imports it. The jumps start at 0,
+	// and the variable indices and strings are the module's own, they are moved to the program's when it's linked
+	struct BytecodeModule
+	{
+		struct Export
+		{
+			std::string m_Name;
+			int m_Index = -1;
+			ValueTypes m_Type = ValueTypes::Void;
+		};
+
+		// A variable in the module that is an export of a module it imports
+		struct Import
+		{
+			std::string m_Path;
+			std::string m_Name;
+			int m_Index = -1;
+			ValueTypes m_Type = ValueTypes::Void;
+		};
+
+		std::string m_Path;
+		uint64_t m_SourceHash = 0;
+
+		Instructions m_Instructions;
+		uint32_t m_VariableCount = 0;
+		std::vector<std::string> m_Strings; // The string constants, by their index
+
+		std::vector<Export> m_Exports;
+		std::vector<Import> m_Imports;
+		std::vector<std::string> m_Dependencies; // The paths of the imported modules, in the order they are imported
 	};
 
 	class BytecodeCompiler
@@ -250,10 +298,26 @@ namespace Bytecode {
 
 		void Compile(ASTNode* node, std::vector<Instruction>& instructions, bool canCreateScope = true, bool canMakeVariablesLocal = true);
 
+		// Compiles the rest of the program first, and then the function bodies on the threads of the pool, each into its own instructions.
+		// The functions are linked in after the program, which ends with a stop. Without a pool it's the same as Compile,
+		// unless the functions are compiled lazily
+		void CompileProgram(ASTNode* program, std::vector<Instruction>& instructions, ThreadPool* pool = nullptr);
+
+		// Compiles a function that was left as a stub and adds it to the end of the instructions, with its strings in the constants.
+		// Returns where it starts, or -1 if it has an error
+		int CompileLazyFunction(int function, std::vector<Instruction>& instructions, ConstantsPool& constants);
+
+		// Compiles an imported file into a module, with the top level variables kept so that the exports can be found
+		void CompileModule(ASTNode* program, BytecodeModule& module);
+
+		void CompileImport(ASTNode* node, std::vector<Instruction>& instructions);
+		void CompileExport(ASTNode* node, std::vector<Instruction>& instructions);
+
 		void ExportVariable(ASTNode* node, BytecodeConverterContext::Variable& variable, std::vector<Instruction>& instructions);
 
 		void PreCompileFunction(ASTNode* node);
 		int CompileFunction(ASTNode* node, std::vector<Instruction>& instructions);
+		void CompileFunctionBody(ASTNode* node, std::vector<Instruction>& instructions);
 		void PreCompileAnonymousFunction(ASTNode* node);
 		int CompileAnonymousFunction(ASTNode* node, std::vector<Instruction>& instructions);
 
@@ -272,5 +336,46 @@ namespace Bytecode {
 		BytecodeConverterContext m_Context;
 
 		uint32_t m_CurrentScope = 0;
+
+		// The functions are left as stubs by CompileProgram, and compiled the first time they are called
+		bool m_CompileFunctionsLazily = false;
+
+		int m_FunctionCount = 0;
+		int m_CompiledFunctionCount = 0;
+
+		// Where the imported files are compiled and kept, and the directory that their paths are relative to
+		ModuleCache* m_Modules = nullptr;
+		std::string m_Directory;
+
+	private:
+		// A function whose body is compiled after the rest of the program
+		struct DeferredFunction
+		{
+			ASTNode* m_Node = nullptr;
+			int m_Index = -1; // The function's variable
+			int m_PointerAt = -1; // The push_functionpointer that gets the start of the function
+
+			Instructions m_Instructions;
+			std::unordered_map<Symbol, uint32_t> m_StringConstants;
+			std::string m_Error;
+		};
+
+		void CompileDeferredFunction(DeferredFunction& function);
+		int LinkFunction(DeferredFunction& function, std::vector<Instruction>& instructions, ConstantsPool& constants);
+
+		bool m_DeferFunctions = false;
+		std::vector<DeferredFunction> m_DeferredFunctions;
+
+		// Adds the code of a module after the instructions, after the modules it imports if they aren't in the program yet. Its variables
+		// get indices after the program's, and the variables it imports get the indices of the exports. Returns false if it has an error
+		bool LinkModule(const BytecodeModule& module, std::vector<Instruction>& instructions);
+
+		// The exports of the modules that are in the program, by their paths
+		std::unordered_map<std::string, std::unordered_map<std::string, BytecodeConverterContext::Variable>> m_LinkedModules;
+
+		// For a module, the top level declarations that are exported and the imported variables
+		std::vector<Symbol> m_Exports;
+		std::vector<BytecodeModule::Import> m_Imports;
+		std::vector<std::string> m_Dependencies;
 	};
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "BytecodeInterpreter.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -12,6 +13,8 @@
 #include "../../Utils.hpp"
 #include "../Functions.h"
 #include "../../Parser.h"
+#include "../../Inliner.h"
+#include "../../ParallelFrontEnd.h"
 
 namespace Bytecode {
 BytecodeInterpreter& BytecodeInterpreter::Get()
@@ -20,36 +23,71 @@ BytecodeInterpreter& BytecodeInterpreter::Get()
 	return instance;
 }
 
-Value BytecodeInterpreter::CreateAndRunProgram(std::string fileContent, std::string& error, bool verbose)
+Value BytecodeInterpreter::CreateAndRunProgram(std::string fileContent, std::string& error, bool verbose, bool parallel)
 {
+	// The time until the program starts running, without the printing
+	std::chrono::duration<double, std::milli> setupTime(0);
+	auto setupStart = std::chrono::high_resolution_clock::now();
+
+	// A pool with one thread doesn't start any
+	ThreadPool pool(parallel ? 0 : 1);
+
 	Lexer lexer;
-	error = lexer.CreateTokens(fileContent);
+	Parser parser;
+	ASTNode* program = nullptr;
+
+	if (parallel)
+	{
+		ParallelFrontEnd frontEnd(pool);
+
+		error = frontEnd.CreateProgram(fileContent, lexer, parser);
+		program = parser.m_Program;
+	}
+	else
+	{
+		error = lexer.CreateTokens(fileContent);
+	}
+
+	setupTime += std::chrono::high_resolution_clock::now() - setupStart;
+
 	if (error != "")
 		std::cout << error << "\n\n";
 
 	if (verbose)
 	{
 		for (int i = 0; i < lexer.m_Tokens.size(); i++)
-			std::cout << lexer.m_Tokens[i].ToString() << ": " << lexer.m_Tokens[i].m_Value << " [" << lexer.m_Tokens[i].m_Depth << "]\n";
+			std::cout << lexer.m_Tokens[i].ToString() << ": " << lexer.m_Tokens[i].GetValue(lexer.m_Source) << " [" << lexer.m_Tokens[i].m_Depth << "]\n";
 		std::cout << "\n";
 	}
 
-	Parser parser;
+	setupStart = std::chrono::high_resolution_clock::now();
 
-	ASTNode tree;
-	tree.parent = new ASTNode(ASTTypes::ProgramBody);
-	tree.parent->left = &tree;
-
-	parser.CreateAST(lexer.m_Tokens, &tree, tree.parent);
+	if (!parallel)
+		program = parser.CreateProgram(lexer.m_Tokens, lexer.m_Source);
 
 	if (parser.m_Error != "")
 		std::cout << "AST Error: " << parser.m_Error << "\n";
 
+	Inliner inliner(parser.m_Arena);
+	inliner.Run(program);
+
+	setupTime += std::chrono::high_resolution_clock::now() - setupStart;
+
 	if (verbose)
-		parser.PrintASTTree(tree.parent, 0);
+	{
+		parser.PrintASTTree(program, 0);
+		inliner.PrintReport();
+	}
+
+	setupStart = std::chrono::high_resolution_clock::now();
+
+	m_Modules.CheckForChanges();
+	m_Compiler.m_Modules = &m_Modules;
 
 	std::vector<Bytecode::Instruction> instructions;
-	m_Compiler.Compile(tree.parent, instructions);
+	m_Compiler.CompileProgram(program, instructions, parallel ? &pool : nullptr);
+
+	setupTime += std::chrono::high_resolution_clock::now() - setupStart;
 
 	//m_ProgramCounter = m_Compiler.m_StartExecutionAt;
 	m_ConstantsPool = m_Compiler.m_Constants;
@@ -89,7 +127,11 @@ Value BytecodeInterpreter::CreateAndRunProgram(std::string fileContent, std::str
 
 	auto start = std::chrono::high_resolution_clock::now();
 
-	if (verbose) std::cout << "Console output:\n";
+	if (verbose)
+	{
+		std::cout << "Time to the first instruction: " << setupTime.count() << "ms" << "\n";
+		std::cout << "Console output:\n";
+	}
 
 	m_Instructions = instructions;
 	InterpretBytecode();
@@ -101,10 +143,85 @@ Value BytecodeInterpreter::CreateAndRunProgram(std::string fileContent, std::str
 	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
 
 	if (verbose) std::cout << "\nExecution took: " << (duration.count()) << "ms" << "\n";
+	if (verbose) std::cout << "Functions compiled: " << m_Compiler.m_CompiledFunctionCount << " of " << m_Compiler.m_FunctionCount << "\n";
+	if (verbose)
+	{
+		const Heap::Statistics& gc = m_Heap.m_Statistics;
+		std::cout << "Garbage collections: " << gc.m_Collections << ", " << gc.m_ObjectsFreed << " objects and " << gc.m_BytesFreed << " bytes freed, "
+			<< gc.m_TotalPauseMs << "ms paused, longest " << gc.m_LongestPauseMs << "ms, " << gc.m_Remarks << " root remarks, "
+			<< gc.m_UnboundedSteps << " steps past the budget\n";
+
+		std::cout << "Pauses: " << gc.m_Pauses;
+		for (int i = 0; i < Heap::PauseBucketCount; i++)
+		{
+			if (i == Heap::PauseBucketCount - 1)
+				std::cout << ", over " << Heap::PauseBuckets[i - 1] << "ms: " << gc.m_PauseHistogram[i];
+			else
+				std::cout << ", up to " << Heap::PauseBuckets[i] << "ms: " << gc.m_PauseHistogram[i];
+		}
+		std::cout << "\n";
+	}
+	if (verbose) std::cout << "Modules compiled: " << m_Modules.m_CompiledCount << ", loaded: " << m_Modules.m_LoadedCount << "\n";
 
 	return Value();
 }
 
+void BytecodeInterpreter::MarkRoots()
+{
+	// The globals are in the first frame. The string constants aren't on the heap
+	for (auto& [id, context] : m_Contexts)
+	{
+		for (uint32_t f = 0; f <= context->m_StackFrameTop && f < context->m_StackFrames.size(); f++)
+		{
+			StackFrame& frame = context->m_StackFrames[f];
+
+			for (int i = 0; i < STACK_SIZE; i++)
+			{
+				m_Heap.Shade(frame.m_VariablesList[i].m_Handle);
+				m_Heap.Shade(frame.m_InitialVariablesList[i].m_Handle);
+			}
+
+			// The popped operands are still in the slots above the top, they would keep dead objects alive
+			for (uint32_t i = 0; i < frame.m_OperandStackTop && i < STACK_SIZE; i++)
+				m_Heap.Shade(frame.m_OperandStack[i].m_Handle);
+		}
+	}
+}
+
+void BytecodeInterpreter::CollectGarbage()
+{
+	auto start = std::chrono::steady_clock::now();
+	m_Heap.m_CollectionRequested = false;
+
+	Heap::Deadline deadline = Heap::NoDeadline();
+	if (m_Heap.m_Incremental && !m_Heap.IsFallingBehind())
+		deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(m_Heap.m_StepBudgetMs));
+	else if (m_Heap.m_Incremental)
+		m_Heap.m_Statistics.m_UnboundedSteps++;
+
+	if (m_Heap.GetPhase() == Heap::Phase::Idle)
+	{
+		m_Heap.BeginMarking();
+		MarkRoots();
+	}
+
+	// The frames have no write barrier for the operands, so they are marked again when there are no gray objects left. The marking
+	// is done when that finds nothing new, otherwise the new gray objects are scanned within the same budget, here or in the next steps
+	while (m_Heap.GetPhase() == Heap::Phase::Marking && m_Heap.MarkStep(deadline))
+	{
+		MarkRoots();
+		m_Heap.m_Statistics.m_Remarks++;
+
+		if (!m_Heap.HasGrayObjects())
+			m_Heap.BeginSweeping();
+	}
+
+	if (m_Heap.GetPhase() == Heap::Phase::Sweeping)
+		m_Heap.SweepStep(deadline);
+
+	m_Heap.RecordPause(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
 std::string BytecodeInterpreter::InterpretBytecode()
 {
 	// Main thread
@@ -301,6 +418,7 @@ void ExecutionContext::Execute()
 	Instructions& instructions = m_Instructions;
 	ConstantsPool& constants = BytecodeInterpreter::Get().m_ConstantsPool;
 	Heap& heap = BytecodeInterpreter::Get().m_Heap;
+	Heap::BufferScope bufferScope(heap, m_AllocationBuffer);
 
 	//StackFrame& rootFrame = m_StackFrames[0];
 	//rootFrame.m_OperandStackTop = m_StackFrames[0].m_OperandStackTop;
@@ -313,6 +431,9 @@ void ExecutionContext::Execute()
 	{
 		BytecodeInterpreter::Get().m_Debugger.Render();
 
+		if (heap.m_CollectionRequested)
+			BytecodeInterpreter::Get().CollectGarbage();
+
 		StackFrame& stackFrame = m_StackFrames[m_StackFrameTop];
 
 		if (m_ProgramCounter >= instructions.size()) break;
@@ -380,6 +501,7 @@ void ExecutionContext::Execute()
 		//	for (int i = 0; i < itemCount; i++)
 		//	{
 		//		arrayItems.push_back(stackFrame.PopOperand());
+		//		heap.WriteBarrier(arrayItems.back().m_Handle);
 		//	}
 
 		//	Functions::array_push(&arrayItems);
@@ -409,6 +531,7 @@ void ExecutionContext::Execute()
 		//		Value value = stackFrame.PopOperand();
 		//		std::string key = stackFrame.PopOperand().GetString();
 		//		object[key] = value;
+		//		heap.WriteBarrier(value.m_Handle);
 		//	}
 
 		//	if (!instruction.m_DiscardValue)
@@ -425,6 +548,7 @@ void ExecutionContext::Execute()
 		case Opcodes::store:
 		{
 			Value operand = stackFrame.PopOperand();
+			heap.WriteBarrier(operand.m_Handle);
 
 			ValueTypes variableType = (ValueTypes)(instruction.m_Arguments[1].GetInt());
 
@@ -485,6 +609,7 @@ void ExecutionContext::Execute()
 			std::string key = instruction.m_Arguments[0].StringData;
 
 			object[key] = value;
+			heap.WriteBarrier(value.m_Handle);
 
 			break;
 		}*/
@@ -771,15 +896,20 @@ void ExecutionContext::Execute()
 
 			m_ProgramCounter = stackFrame.m_ReturnAdress;
 
-			StackFrame functionStack = PopFrame();
-
 			// If to actually return anything
-			if (functionStack.m_OperandStackTop != 0)
-			{
-				Value returnValue = functionStack.PopOperand();
+			bool hasReturnValue = stackFrame.m_OperandStackTop != 0;
+			Value returnValue;
+			if (hasReturnValue)
+				returnValue = stackFrame.PopOperand();
+
+			// Returning from inside a loop or an if leaves their frames too
+			if (!PopScopeFrames())
+				return;
 
+			StackFrame functionStack = PopFrame();
+
+			if (hasReturnValue)
 				GetTopFrame().PushOperand(returnValue);
-			}
 
 			//DeleteLocalVariables(GetTopFrame(), functionStack);
 			DeleteLocalVariables(m_StackFrames[0], functionStack);
@@ -791,6 +921,9 @@ void ExecutionContext::Execute()
 		{
 			m_ProgramCounter = stackFrame.m_ReturnAdress;
 
+			if (!PopScopeFrames())
+				return;
+
 			StackFrame functionStack = PopFrame();
 
 			GetTopFrame().PushOperand(Value(0, ValueTypes::Void));
@@ -807,6 +940,27 @@ void ExecutionContext::Execute()
 			break;
 		}
 
+		case Opcodes::compile_function:
+		{
+			int stub = m_ProgramCounter - 1;
+			int function = instruction.m_Arguments[0].GetInt();
+
+			// Adding the function can move the instructions
+			BytecodeCompiler& compiler = BytecodeInterpreter::Get().m_Compiler;
+			int start = compiler.CompileLazyFunction(function, instructions, constants);
+			if (start == -1)
+			{
+				BytecodeInterpreter::Get().ThrowExceptionValue("Bytecode compilation error: " + compiler.m_Error);
+				return;
+			}
+
+			// The next calls jump straight to it
+			instructions[stub] = Instruction(Opcodes::jmp).Arg(start);
+			m_ProgramCounter = start;
+
+			break;
+		}
+
 		case Opcodes::create_scope_frame:
 		{
 			PushFrame(this);
@@ -829,6 +983,7 @@ void ExecutionContext::Execute()
 		{
 			PushFrame(this);
 			StackFrame& newFrame = GetTopFrame();
+			newFrame.m_IsFunctionFrame = true;
 
 			// Copy the variables from the global scope into this frame
 			for (int i = 0; i < STACK_SIZE; i++)
@@ -844,7 +999,7 @@ void ExecutionContext::Execute()
 
 			uint32_t argCount = stackFrame.PopOperand().GetInt();
 
-			// Pull the arguments
+			// Pull the arguments, this reverses them so that the first one ends up on top and is stored first
 			for (int i = 0; i < argCount; i++)
 			{
 				newFrame.PushOperand(stackFrame.PopOperand());
@@ -908,18 +1063,21 @@ void ExecutionContext::Execute()
 			std::string functionName = instruction.m_Arguments[0].GetString();
 			uint32_t argCount = instruction.m_Arguments[1].GetInt();
 
-			// Get the args
-			ValueArray args;
-			for (int i = 0; i < argCount; i++)
+			// Get the args, the last one is on top of the stack
+			ValueArray args(argCount);
+			for (int i = argCount - 1; i >= 0; i--)
 			{
-				args.push_back(stackFrame.PopOperand());
+				args[i] = stackFrame.PopOperand();
 			}
 
 			CallableFunction function = Functions::GetFunctionByName(functionName);
 			Value returnValue = function(args);
 
 			if (Exception())
+			{
 				ThrowExceptionVoid(functionName + "(): " + m_Exception);
+				break;
+			}
 
 			if (!instruction.m_DiscardValue) 
 			{
@@ -970,6 +1128,22 @@ void ExecutionContext::ClearOperands(StackFrame& frame)
 	}
 }
 
+bool ExecutionContext::PopScopeFrames()
+{
+	while (!GetTopFrame().m_IsFunctionFrame)
+	{
+		if (m_StackFrameTop == 0)
+			return false;
+
+		StackFrame scopeStack = PopFrame();
+
+		DeleteLocalVariables(GetTopFrame(), scopeStack);
+		ClearOperands(scopeStack);
+	}
+
+	return true;
+}
+
 Value ExecutionContext::ThrowExceptionValue(std::string error)
 {
 	m_Exception = error;
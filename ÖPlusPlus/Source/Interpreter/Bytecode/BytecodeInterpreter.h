@@ -3,6 +3,7 @@
 #include "../Value.h"
 #include "BytecodeCompiler.h"
 #include "Debugger.h"
+#include "ModuleCache.h"
 
 #include <tuple>
 
@@ -39,6 +40,9 @@ namespace Bytecode {
 
 		int m_ReturnAdress = 0;
 
+		// Created by a call, and not by a loop or an if inside the function
+		bool m_IsFunctionFrame = false;
+
 		uint32_t m_OperandStackTop = 0;
 
 		ExecutionContext* m_Context = nullptr;
@@ -59,6 +63,9 @@ namespace Bytecode {
 		void DeleteLocalVariables(StackFrame& topFrame, StackFrame& localFrame);
 		void ClearOperands(StackFrame& frame);
 
+		// Pops the scope frames that are still open above the frame of the function that returns, false if there is no such frame
+		bool PopScopeFrames();
+
 		Value ThrowExceptionValue(std::string error);
 		void ThrowExceptionVoid(std::string error);
 		bool Exception();
@@ -77,6 +84,9 @@ namespace Bytecode {
 		int m_Id = -1;
 
 		std::string m_Exception;
+
+		// The objects this context creates, so that contexts on different threads don't wait for each other
+		Heap::AllocationBuffer m_AllocationBuffer;
 	};
 
 	class BytecodeInterpreter
@@ -84,10 +94,15 @@ namespace Bytecode {
 	public:
 		static BytecodeInterpreter& Get();
 
-		Value CreateAndRunProgram(std::string fileContent, std::string& error, bool verbose = false);
+		// Parallel lexes and parses the program in chunks, and compiles the functions, on all the cores
+		Value CreateAndRunProgram(std::string fileContent, std::string& error, bool verbose = false, bool parallel = false);
 
 		std::string InterpretBytecode();
 
+		// Marks the values in the frames of every context, and deletes the objects on the heap that none of them reach.
+		// In incremental mode it's one step of the collection
+		void CollectGarbage();
+
 		ExecutionContext* CreateContext();
 		void AddContext(ExecutionContext* context);
 		void RemoveContext(int id);
@@ -98,6 +113,8 @@ namespace Bytecode {
 	private:
 		BytecodeInterpreter() {};
 
+		void MarkRoots();
+
 		int m_NextFreeContextId = 0;
 
 	public:
@@ -111,6 +128,9 @@ namespace Bytecode {
 
 		BytecodeCompiler m_Compiler;
 
+		// The imported files, kept for the next programs that import them
+		ModuleCache m_Modules;
+
 		/*Console m_Console;*/
 		Debugger m_Debugger;
 	};
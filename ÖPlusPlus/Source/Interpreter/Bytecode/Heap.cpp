@@ -1,77 +1,541 @@
 #include "Heap.h"
 
-#include <map>
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+#include <new>
 
 #include "../../Utils.hpp"
 
 #include "../Value.h"
 
-HeapEntry& Heap::CreateObject(int type, char* data)
+// The buffer of the thread, it's only used by the heap it belongs to
+static thread_local Heap::AllocationBuffer* t_Buffer = nullptr;
+
+Heap::~Heap()
+{
+	// The arrays and objects own values that have to be destroyed, the strings are only bytes in the slabs
+	for (uint32_t i = 0; i < m_EntryCount; i++)
+	{
+		if (GetEntry(i).m_IsLive)
+			DeleteEntry(i);
+	}
+}
+
+HeapHandle Heap::CreateString(const std::string& str)
+{
+	if (AllocationBuffer* buffer = GetThreadBuffer())
+		return CreateString(*buffer, str);
+
+	std::lock_guard<std::mutex> lock(m_SharedBufferMutex);
+	return CreateString(m_SharedBuffer, str);
+}
+
+HeapHandle Heap::CreateArray()
+{
+	if (AllocationBuffer* buffer = GetThreadBuffer())
+		return CreateArray(*buffer);
+
+	std::lock_guard<std::mutex> lock(m_SharedBufferMutex);
+	return CreateArray(m_SharedBuffer);
+}
+
+HeapHandle Heap::CreateObject()
+{
+	if (AllocationBuffer* buffer = GetThreadBuffer())
+		return CreateObject(*buffer);
+
+	std::lock_guard<std::mutex> lock(m_SharedBufferMutex);
+	return CreateObject(m_SharedBuffer);
+}
+
+HeapHandle Heap::CreateString(AllocationBuffer& buffer, const std::string& str)
+{
+	uint32_t size = 0;
+	char* strData = (char*)Allocate(buffer, (uint32_t)str.length() + 1, size);
+	memcpy(strData, str.c_str(), str.length() + 1);
+
+	HeapHandle handle = CreateEntry(buffer, 0, strData, size);
+	GetEntry(handle.GetIndex()).m_Length = (uint32_t)str.length();
+	return handle;
+}
+
+HeapHandle Heap::CreateArray(AllocationBuffer& buffer)
+{
+	uint32_t size = 0;
+	ValueArray* arrayData = new (Allocate(buffer, sizeof(ValueArray), size)) ValueArray();
+
+	return CreateEntry(buffer, 1, arrayData, size);
+}
+
+HeapHandle Heap::CreateObject(AllocationBuffer& buffer)
+{
+	uint32_t size = 0;
+	ObjectInstance* objectData = new (Allocate(buffer, sizeof(ObjectInstance), size)) ObjectInstance();
+
+	return CreateEntry(buffer, 2, objectData, size);
+}
+
+HeapHandle Heap::AppendString(HeapHandle handle, uint32_t length, std::string_view appended)
+{
+	if (AllocationBuffer* buffer = GetThreadBuffer())
+		return AppendString(*buffer, handle, length, appended);
+
+	std::lock_guard<std::mutex> lock(m_SharedBufferMutex);
+	return AppendString(m_SharedBuffer, handle, length, appended);
+}
+
+HeapHandle Heap::AppendString(AllocationBuffer& buffer, HeapHandle handle, uint32_t length, std::string_view appended)
+{
+	HeapEntry* entry = Get(handle);
+	assert(entry != nullptr && entry->m_Type == 0 && length <= entry->m_Length);
+
+	// Something else has been appended to this string already, the values that have it see the data after the length
+	if (entry->m_Length != length)
+	{
+		std::string copied((char*)entry->m_Data, length);
+		copied += appended;
+		return CreateString(buffer, copied);
+	}
+
+	uint32_t newLength = length + (uint32_t)appended.size();
+	char* data = (char*)entry->m_Data;
+
+	// The appended string can be in the old data, so it's copied before that is freed
+	if (newLength + 1 > entry->m_Size)
+	{
+		uint32_t size = 0;
+		char* grown = (char*)Allocate(buffer, std::max(newLength + 1, entry->m_Size * 2), size);
+		memcpy(grown, data, length);
+		memcpy(grown + length, appended.data(), appended.size());
+
+		Free(buffer, data, entry->m_Size);
+		buffer.m_Bytes += (int64_t)size - entry->m_Size;
+
+		entry->m_Data = data = grown;
+		entry->m_Size = size;
+	}
+	else
+	{
+		memcpy(data + length, appended.data(), appended.size());
+	}
+
+	data[newLength] = '\0';
+	entry->m_Length = newLength;
+	return handle;
+}
+
+HeapEntry* Heap::Get(HeapHandle handle)
+{
+	uint32_t index = handle.GetIndex();
+	if (index >= m_EntryCount.load(std::memory_order_acquire))
+		return nullptr;
+
+	HeapEntry& entry = GetEntry(index);
+	if (!entry.m_IsLive || entry.m_Generation != handle.GetGeneration())
+		return nullptr;
+
+	return &entry;
+}
+
+void Heap::DeleteObject(HeapHandle handle)
+{
+	// A thread with a buffer keeps what it deletes for its next objects, without locking
+	if (AllocationBuffer* buffer = GetThreadBuffer())
+	{
+		if (Get(handle) != nullptr)
+			DeleteEntry(handle.GetIndex(), *buffer);
+
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	if (Get(handle) != nullptr)
+		DeleteEntry(handle.GetIndex());
+}
+
+void Heap::DestroyObject(HeapEntry& entry)
+{
+	if (entry.m_Type == 1)
+		((ValueArray*)entry.m_Data)->~ValueArray();
+	else if (entry.m_Type == 2)
+		((ObjectInstance*)entry.m_Data)->~ObjectInstance();
+}
+
+bool Heap::RetireEntry(HeapEntry& entry)
+{
+	entry.m_Data = nullptr;
+	entry.m_IsLive = false;
+	entry.m_IsMarked = false;
+
+	// An entry that has been through every generation isn't used again, since an old handle could find it
+	entry.m_Generation++;
+	return entry.m_Generation != 0;
+}
+
+void Heap::DeleteEntry(uint32_t index)
+{
+	HeapEntry& entry = GetEntry(index);
+
+	// Freeing the block writes the free list over the start of it, so the object is destroyed first
+	DestroyObject(entry);
+	Free(entry.m_Data, entry.m_Size);
+	m_ObjectCount--;
+	m_AllocatedBytes -= entry.m_Size;
+
+	if (!RetireEntry(entry))
+		return;
+
+	entry.m_NextFree = m_FirstFreeEntry;
+	m_FirstFreeEntry = index;
+}
+
+void Heap::DeleteEntry(uint32_t index, AllocationBuffer& buffer)
+{
+	HeapEntry& entry = GetEntry(index);
+
+	DestroyObject(entry);
+	Free(buffer, entry.m_Data, entry.m_Size);
+	buffer.m_Objects--;
+	buffer.m_Bytes -= entry.m_Size;
+
+	if (!RetireEntry(entry))
+		return;
+
+	entry.m_NextFree = buffer.m_FirstFreeEntry;
+	buffer.m_FirstFreeEntry = index;
+}
+
+Heap::AllocationBuffer* Heap::SetThreadBuffer(AllocationBuffer* buffer)
 {
-	int id = m_NextFreeId;
-	m_Entries[id] = HeapEntry(0, id, data);
+	AllocationBuffer* previous = t_Buffer;
 
-	m_NextFreeId++; // Increment to use a different slot for the next object
+	if (buffer != nullptr)
+		buffer->m_Heap = this;
 
-	return m_Entries[id];
+	t_Buffer = buffer;
+	return previous;
 }
 
-HeapEntry& Heap::CreateString(const std::string& str)
+Heap::AllocationBuffer* Heap::GetThreadBuffer()
 {
-	int id = m_NextFreeId;
-	m_Entries[id] = HeapEntry(0, id, (const char*)nullptr);
+	if (t_Buffer == nullptr || t_Buffer->m_Heap != this)
+		return nullptr;
 
-	char* strData = CopyString(str.c_str());
+	return t_Buffer;
+}
+
+void Heap::ReleaseBuffer(AllocationBuffer& buffer)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Count(buffer);
+
+	while (buffer.m_FirstFreeEntry != NoEntry)
+	{
+		uint32_t index = buffer.m_FirstFreeEntry;
+		buffer.m_FirstFreeEntry = GetEntry(index).m_NextFree;
+
+		GetEntry(index).m_NextFree = m_FirstFreeEntry;
+		m_FirstFreeEntry = index;
+	}
+
+	for (int sizeClass = 0; sizeClass < SizeClassCount; sizeClass++)
+	{
+		AllocationBuffer::SizeClass& blocks = buffer.m_SizeClasses[sizeClass];
+		uint32_t blockSize = 1u << (sizeClass + MinSizeClassBits);
+
+		// The rest of the span is cut into blocks, the sizes all divide the span
+		for (; blocks.m_Cursor != blocks.m_End; blocks.m_Cursor += blockSize)
+			Free(blocks.m_Cursor, blockSize);
+
+		while (blocks.m_FreeList != nullptr)
+		{
+			void* block = blocks.m_FreeList;
+			blocks.m_FreeList = *(void**)block;
+			Free(block, blockSize);
+		}
+
+		blocks = AllocationBuffer::SizeClass();
+	}
+}
+
+void Heap::Count(AllocationBuffer& buffer)
+{
+	m_ObjectCount += buffer.m_Objects;
+	m_AllocatedBytes += buffer.m_Bytes;
+	m_AllocatedSinceStep += (size_t)buffer.m_Bytes;
+
+	buffer.m_Objects = 0;
+	buffer.m_Bytes = 0;
+
+	if (m_Phase == Phase::Idle ? m_AllocatedBytes >= (int64_t)m_NextCollection : m_AllocatedSinceStep >= m_StepBytes)
+	{
+		m_CollectionRequested = true;
+		m_AllocatedSinceStep = 0;
+	}
+}
+
+void Heap::RefillEntries(AllocationBuffer& buffer)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Count(buffer);
+
+	// Taken in order and linked from the end, so that the buffer hands them out in order too
+	uint32_t taken[EntryBatch];
+	for (int i = 0; i < EntryBatch; i++)
+	{
+		uint32_t index = m_FirstFreeEntry;
 
-	m_Entries[id].m_Data = (void*)strData;
+		if (index != NoEntry)
+		{
+			m_FirstFreeEntry = GetEntry(index).m_NextFree;
+		}
+		else
+		{
+			index = m_EntryCount.load(std::memory_order_relaxed);
+			assert(index <= HeapHandle::IndexMask);
 
-	m_NextFreeId++; // Increment to use a different slot for the next object
+			if (index % EntriesPerPage == 0)
+				m_Pages[index / EntriesPerPage] = std::make_unique<HeapEntry[]>(EntriesPerPage);
 
-	return m_Entries[id];
+			// The page is there before another thread can see the entry
+			m_EntryCount.store(index + 1, std::memory_order_release);
+		}
+
+		taken[i] = index;
+	}
+
+	for (int i = EntryBatch - 1; i >= 0; i--)
+	{
+		GetEntry(taken[i]).m_NextFree = buffer.m_FirstFreeEntry;
+		buffer.m_FirstFreeEntry = taken[i];
+	}
 }
 
-HeapEntry& Heap::CreateArray()
+void Heap::RefillBlocks(AllocationBuffer& buffer, int sizeClass)
 {
-	int id = m_NextFreeId;
-	m_Entries[id] = HeapEntry(1, id, (const char*)nullptr);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Count(buffer);
+
+	AllocationBuffer::SizeClass& blocks = buffer.m_SizeClasses[sizeClass];
+
+	// The freed blocks are used first
+	for (int i = 0; i < BlockBatch && m_FreeBlocks[sizeClass] != nullptr; i++)
+	{
+		void* block = m_FreeBlocks[sizeClass];
+		m_FreeBlocks[sizeClass] = *(void**)block;
+
+		*(void**)block = blocks.m_FreeList;
+		blocks.m_FreeList = block;
+	}
 
-	ValueArray* arrayData = new ValueArray();
-	m_Entries[id].m_Data = (void*)arrayData;
+	if (blocks.m_FreeList != nullptr)
+		return;
 
-	m_NextFreeId++; // Increment to use a different slot for the next object
+	if (m_SlabUsed + SpanSize > SlabSize)
+	{
+		m_Slabs.push_back(std::unique_ptr<char[]>(new char[SlabSize]));
+		m_SlabUsed = 0;
+	}
 
-	return m_Entries[id];
+	blocks.m_Cursor = m_Slabs.back().get() + m_SlabUsed;
+	blocks.m_End = blocks.m_Cursor + SpanSize;
+	m_SlabUsed += SpanSize;
 }
 
-HeapEntry& Heap::CreateObject()
+HeapHandle Heap::CreateEntry(AllocationBuffer& buffer, int type, void* data, uint32_t size)
 {
-	int id = m_NextFreeId;
-	m_Entries[id] = HeapEntry(2, id, (const char*)nullptr);
+	if (buffer.m_FirstFreeEntry == NoEntry)
+		RefillEntries(buffer);
+
+	uint32_t index = buffer.m_FirstFreeEntry;
+	HeapEntry& entry = GetEntry(index);
+	buffer.m_FirstFreeEntry = entry.m_NextFree;
+
+	// Generation 0 is only for entries that have never been used, so that no handle is zero
+	if (entry.m_Generation == 0)
+		entry.m_Generation = 1;
+
+	entry.m_Type = type;
+	entry.m_Id = (int)HeapHandle(index, entry.m_Generation).m_Value;
+	entry.m_Data = data;
+	entry.m_Size = size;
+	entry.m_IsLive = true;
+
+	// The new objects are black while marking, and they can't be swept before the marks are cleared by the sweep
+	entry.m_IsMarked = m_Phase == Phase::Marking || (m_Phase == Phase::Sweeping && index >= m_SweepCursor);
 
-	ObjectInstance* objectData = new ObjectInstance();
-	m_Entries[id].m_Data = (void*)objectData;
+	// Counted by the heap when the buffer refills
+	buffer.m_Objects++;
+	buffer.m_Bytes += size;
 
-	m_NextFreeId++; // Increment to use a different slot for the next object
+	return HeapHandle(index, entry.m_Generation);
+}
 
-	return m_Entries[id];
+void Heap::BeginMarking()
+{
+	assert(m_Phase == Phase::Idle && m_MarkStack.empty());
+	m_Phase = Phase::Marking;
 }
 
-void Heap::DeleteObject(HeapEntry* obj)
+void Heap::Shade(HeapHandle handle)
 {
-	m_Entries.erase(obj->m_Id);
+	HeapEntry* entry = Get(handle);
+	if (entry == nullptr || entry->m_IsMarked)
+		return;
+
+	entry->m_IsMarked = true;
+	m_MarkStack.push_back(handle);
+}
+
+bool Heap::MarkStep(Deadline deadline)
+{
+	// A stack instead of recursion, since arrays can be nested deeply
+	for (int scanned = 0; !m_MarkStack.empty(); scanned++)
+	{
+		// Looking at the clock takes longer than scanning an object
+		if (scanned % 64 == 63 && std::chrono::steady_clock::now() >= deadline)
+			return false;
+
+		HeapEntry* entry = Get(m_MarkStack.back());
+		m_MarkStack.pop_back();
+
+		if (entry == nullptr)
+			continue;
+
+		if (entry->m_Type == 1)
+		{
+			for (Value& value : *(ValueArray*)entry->m_Data)
+				Shade(value.m_Handle);
+		}
+		else if (entry->m_Type == 2)
+		{
+			for (auto& [name, value] : *(ObjectInstance*)entry->m_Data)
+				Shade(value.m_Handle);
+		}
+	}
 
-	obj->m_Data = nullptr;
+	return true;
 }
 
-void Heap::DeleteObject(int id)
+void Heap::BeginSweeping()
 {
-	delete m_Entries[id].m_Data;
-	m_Entries[id].m_Data = nullptr;
+	assert(m_Phase == Phase::Marking && m_MarkStack.empty());
 
-	m_Entries.erase(id);
+	m_Phase = Phase::Sweeping;
+	m_SweepCursor = 0;
+}
+
+bool Heap::SweepStep(Deadline deadline)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	for (; m_SweepCursor < m_EntryCount; m_SweepCursor++)
+	{
+		if (m_SweepCursor % 256 == 255 && std::chrono::steady_clock::now() >= deadline)
+			return false;
+
+		HeapEntry& entry = GetEntry(m_SweepCursor);
+		if (!entry.m_IsLive)
+			continue;
+
+		if (entry.m_IsMarked)
+		{
+			entry.m_IsMarked = false;
+			continue;
+		}
+
+		m_Statistics.m_ObjectsFreed++;
+		m_Statistics.m_BytesFreed += entry.m_Size;
+
+		DeleteEntry(m_SweepCursor);
+	}
+
+	m_Statistics.m_Collections++;
+
+	m_Phase = Phase::Idle;
+	m_NextCollection = std::max(m_MinCollectionBytes, GetAllocatedBytes() * 2);
+	return true;
+}
+
+void Heap::RecordPause(double ms)
+{
+	m_Statistics.m_Pauses++;
+	m_Statistics.m_TotalPauseMs += ms;
+	m_Statistics.m_LongestPauseMs = std::max(m_Statistics.m_LongestPauseMs, ms);
+
+	int bucket = 0;
+	while (ms > PauseBuckets[bucket])
+		bucket++;
+
+	m_Statistics.m_PauseHistogram[bucket]++;
+}
+
+int Heap::GetSizeClass(uint32_t size)
+{
+	int sizeClass = 0;
+	while (sizeClass < SizeClassCount && (1u << (sizeClass + MinSizeClassBits)) < size)
+		sizeClass++;
+
+	return sizeClass;
+}
+
+void* Heap::Allocate(AllocationBuffer& buffer, uint32_t size, uint32_t& allocatedSize)
+{
+	int sizeClass = GetSizeClass(size);
+	if (sizeClass == SizeClassCount)
+	{
+		allocatedSize = size;
+		return new char[size];
+	}
+
+	AllocationBuffer::SizeClass& blocks = buffer.m_SizeClasses[sizeClass];
+	allocatedSize = 1u << (sizeClass + MinSizeClassBits);
+
+	if (blocks.m_FreeList == nullptr && (size_t)(blocks.m_End - blocks.m_Cursor) < allocatedSize)
+		RefillBlocks(buffer, sizeClass);
+
+	if (blocks.m_FreeList != nullptr)
+	{
+		void* block = blocks.m_FreeList;
+		blocks.m_FreeList = *(void**)block;
+		return block;
+	}
+
+	void* block = blocks.m_Cursor;
+	blocks.m_Cursor += allocatedSize;
+	return block;
+}
+
+void Heap::Free(void* data, uint32_t allocatedSize)
+{
+	int sizeClass = GetSizeClass(allocatedSize);
+	if (sizeClass == SizeClassCount)
+	{
+		delete[] (char*)data;
+		return;
+	}
+
+	*(void**)data = m_FreeBlocks[sizeClass];
+	m_FreeBlocks[sizeClass] = data;
+}
+
+void Heap::Free(AllocationBuffer& buffer, void* data, uint32_t allocatedSize)
+{
+	int sizeClass = GetSizeClass(allocatedSize);
+	if (sizeClass == SizeClassCount)
+	{
+		delete[] (char*)data;
+		return;
+	}
+
+	AllocationBuffer::SizeClass& blocks = buffer.m_SizeClasses[sizeClass];
+	*(void**)data = blocks.m_FreeList;
+	blocks.m_FreeList = data;
 }
 
 std::string HeapEntry::ToString()
 {
-	return Value(*this).ToFormattedString(true);
-}
\ No newline at end of file
+	return Value(*this, ValueTypes::StringConstant).ToFormattedString(true);
+}
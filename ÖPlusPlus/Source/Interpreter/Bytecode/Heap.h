@@ -1,11 +1,37 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
 
 constexpr int STACK_SIZE = 16;
 constexpr int STACKFRAME_SIZE = 16;
 
+// A reference to an object on the heap, the index of its entry and the generation of the entry when the object was created.
+// Deleting an object moves its entry to the next generation, so the old handles to it don't find anything anymore
+struct HeapHandle
+{
+	static constexpr int IndexBits = 24;
+	static constexpr uint32_t IndexMask = (1u << IndexBits) - 1;
+
+	HeapHandle() {};
+	HeapHandle(uint32_t index, uint32_t generation) : m_Value(index | (generation << IndexBits)) {};
+
+	uint32_t GetIndex() const { return m_Value & IndexMask; }
+	uint32_t GetGeneration() const { return m_Value >> IndexBits; }
+
+	// The generations start at 1, so the zero handle is never an object
+	bool IsNull() const { return m_Value == 0; }
+
+	uint32_t m_Value = 0;
+};
+
 class HeapEntry
 {
 public:
@@ -20,20 +46,268 @@ public:
 	int m_Id = 0;
 
 	void* m_Data = nullptr;
+
+	// The bytes the data has on the heap, the size of its size class
+	uint32_t m_Size = 0;
+
+	// For strings, the length of the longest one in the data. The shorter ones are the start of it, and they are the values that were appended to
+	uint32_t m_Length = 0;
+
+	// Bumped when the object is deleted, the entry is live while the handles to it have the same generation
+	uint8_t m_Generation = 0;
+	bool m_IsLive = false;
+
+	// Reached from the roots in the current collection
+	bool m_IsMarked = false;
+
+	// The next free entry, while this one is free
+	uint32_t m_NextFree = 0;
 };
 
-struct Heap
+// The objects of the bytecode interpreter. The entries are in pages that don't move when the heap grows, and the data of the objects
+// is in slabs of blocks that are all the same size, one size class for each power of two. Freed entries and blocks are reused first.
+// Creating, finding and deleting an object are all constant time.
+// The objects are garbage collected by marking the ones that the interpreter can reach and sweeping the rest. The marking is tri-color:
+// the unmarked objects are white, the marked ones that are still on the mark stack are gray, and the rest of the marked ones are black.
+// In incremental mode the marking and the sweeping are done in steps between the instructions, each one within a time budget.
+// Several threads can create objects at once, each one in its own allocation buffer. The collection steps need the other threads to be stopped
+class Heap
 {
-	std::unordered_map<int, HeapEntry> m_Entries;
+public:
+	struct AllocationBuffer;
+
+	Heap() {};
+	~Heap();
+
+	Heap(const Heap&) = delete;
+	Heap& operator=(const Heap&) = delete;
+
+	// In the buffer of the thread, or in a shared one behind a lock if the thread doesn't have one for this heap
+	HeapHandle CreateString(const std::string& str = "");
+	HeapHandle CreateArray();
+	HeapHandle CreateObject();
+
+	// Only the thread that owns the buffer can use it
+	HeapHandle CreateString(AllocationBuffer& buffer, const std::string& str);
+	HeapHandle CreateArray(AllocationBuffer& buffer);
+	HeapHandle CreateObject(AllocationBuffer& buffer);
+
+	// Appends to the string that is the first length bytes of the string object. If nothing has been appended to that string yet, it's
+	// appended in place and the object is returned, otherwise the string is copied into a new object. The data grows to twice the size
+	// when it's full, so that appending in a loop is amortized constant time
+	HeapHandle AppendString(HeapHandle handle, uint32_t length, std::string_view appended);
+
+	// The entry of a live object, or null if the object has been deleted
+	HeapEntry* Get(HeapHandle handle);
 
-	int m_NextFreeId = 0;
+	// Does nothing if the object has already been deleted
+	void DeleteObject(HeapHandle handle);
+
+	// The objects that are still in the buffers of the threads aren't counted yet
+	int GetObjectCount() const { return m_ObjectCount; }
+	size_t GetAllocatedBytes() const { return (size_t)std::max<int64_t>(m_AllocatedBytes, 0); }
+
+	// The buffer the objects of this thread are created in, the previous one is returned
+	AllocationBuffer* SetThreadBuffer(AllocationBuffer* buffer);
+
+	// Gives the entries and blocks the buffer hasn't used back to the heap, and counts its objects
+	void ReleaseBuffer(AllocationBuffer& buffer);
+
+	// Uses the buffer on this thread until the end of the scope, and then releases it
+	class BufferScope
+	{
+	public:
+		BufferScope(Heap& heap, AllocationBuffer& buffer) : m_Heap(heap), m_Buffer(buffer), m_Previous(heap.SetThreadBuffer(&buffer)) {};
+		~BufferScope() { m_Heap.SetThreadBuffer(m_Previous); m_Heap.ReleaseBuffer(m_Buffer); }
+
+	private:
+		Heap& m_Heap;
+		AllocationBuffer& m_Buffer;
+		AllocationBuffer* m_Previous;
+	};
+
+	enum class Phase
+	{
+		Idle,
+		Marking,
+		Sweeping
+	};
+
+	typedef std::chrono::steady_clock::time_point Deadline;
+	static Deadline NoDeadline() { return Deadline::max(); }
+
+	Phase GetPhase() const { return m_Phase; }
+
+	void BeginMarking();
+
+	// Makes an unmarked object gray
+	void Shade(HeapHandle handle);
+
+	// Scans the gray objects until there are none left, or until the deadline. Returns true if there are none left
+	bool MarkStep(Deadline deadline);
+
+	void BeginSweeping();
+
+	// Deletes the objects that weren't marked and clears the marks, until the deadline. Returns true when the whole heap is swept and the
+	// collection is done. The next collection is when the heap has grown to twice what's left
+	bool SweepStep(Deadline deadline);
+
+	bool HasGrayObjects() const { return !m_MarkStack.empty(); }
+
+	// Called when a value is stored where the interpreter keeps it, and has to be called by everything that stores a value in an
+	// array or an object. While marking, the value is made gray so that the objects that are already black never point to white ones
+	inline void WriteBarrier(HeapHandle stored)
+	{
+		if (m_Phase == Phase::Marking && !stored.IsNull())
+			Shade(stored);
+	}
+
+	// When the heap has grown a lot during a collection, the steps can't keep up and the rest should be done at once
+	bool IsFallingBehind() const { return m_AllocatedBytes > 2 * (int64_t)m_NextCollection; }
+
+	void RecordPause(double ms);
+
+public:
+	static constexpr int PauseBucketCount = 8;
+	static constexpr double PauseBuckets[PauseBucketCount] = { 0.1, 0.25, 0.5, 1, 2, 5, 10, 1e300 };
 
-	HeapEntry& CreateObject(int type, char* data = nullptr);
+	struct Statistics
+	{
+		int m_Collections = 0;
+		uint64_t m_ObjectsFreed = 0;
+		uint64_t m_BytesFreed = 0;
 
-	HeapEntry& CreateString(const std::string& str = "");
-	HeapEntry& CreateArray();
-	HeapEntry& CreateObject();
+		int m_Pauses = 0;
+		double m_TotalPauseMs = 0;
+		double m_LongestPauseMs = 0;
 
-	void DeleteObject(HeapEntry* obj);
-	void DeleteObject(int id);
-};
\ No newline at end of file
+		// The number of pauses up to each of the PauseBuckets milliseconds, and longer than the one before
+		int m_PauseHistogram[PauseBucketCount] = {};
+
+		// The times the frames were marked again at the end of the marking, and the incremental steps that ran without a deadline
+		// because the heap was falling behind
+		int m_Remarks = 0;
+		int m_UnboundedSteps = 0;
+	};
+
+	Statistics m_Statistics;
+
+	// Set by an allocation that takes the heap past the threshold, or in incremental mode after some allocations while collecting.
+	// The interpreter collects before its next instruction, when every value it uses is in a frame
+	std::atomic<bool> m_CollectionRequested = false;
+
+	// The smallest threshold, so that small heaps aren't collected all the time
+	size_t m_MinCollectionBytes = 1024 * 1024;
+
+	bool m_Incremental = false;
+	double m_StepBudgetMs = 0.5;
+
+	// How much is allocated between the steps of an incremental collection
+	size_t m_StepBytes = 64 * 1024;
+
+private:
+	static constexpr int EntriesPerPage = 4096;
+	static constexpr int PageCount = (HeapHandle::IndexMask + 1) / EntriesPerPage;
+	static constexpr uint32_t NoEntry = UINT32_MAX;
+
+	// 16 bytes and up
+	static constexpr int MinSizeClassBits = 4;
+	static constexpr int SizeClassCount = 8;
+	static constexpr uint32_t SlabSize = 64 * 1024;
+
+	// A buffer takes this many entries or freed blocks at a time, or a span of a slab to bump through
+	static constexpr int EntryBatch = 64;
+	static constexpr int BlockBatch = 32;
+	static constexpr uint32_t SpanSize = 4096;
+
+public:
+	struct AllocationBuffer
+	{
+		Heap* m_Heap = nullptr;
+
+		// The entries it has taken, linked like the free ones of the heap
+		uint32_t m_FirstFreeEntry = NoEntry;
+
+		struct SizeClass
+		{
+			void* m_FreeList = nullptr;
+
+			// The part of the span that hasn't been handed out
+			char* m_Cursor = nullptr;
+			char* m_End = nullptr;
+		};
+
+		SizeClass m_SizeClasses[SizeClassCount];
+
+		// Created since the heap last counted them
+		int m_Objects = 0;
+		int64_t m_Bytes = 0;
+	};
+
+private:
+	HeapEntry& GetEntry(uint32_t index) { return m_Pages[index / EntriesPerPage][index % EntriesPerPage]; }
+
+	HeapHandle CreateEntry(AllocationBuffer& buffer, int type, void* data, uint32_t size);
+
+	// Blocks of a size class, or from new[] if it's larger than the largest class
+	void* Allocate(AllocationBuffer& buffer, uint32_t size, uint32_t& allocatedSize);
+
+	// Runs the destructor of an array or an object, before its data is freed
+	void DestroyObject(HeapEntry& entry);
+
+	// Marks the entry as deleted, and returns false if it has been through every generation and can't be used again
+	bool RetireEntry(HeapEntry& entry);
+
+	// The heap has to be locked, unless it's deleted into the buffer of the thread
+	void DeleteEntry(uint32_t index);
+	void DeleteEntry(uint32_t index, AllocationBuffer& buffer);
+	void Free(void* data, uint32_t allocatedSize);
+	void Free(AllocationBuffer& buffer, void* data, uint32_t allocatedSize);
+
+	HeapHandle AppendString(AllocationBuffer& buffer, HeapHandle handle, uint32_t length, std::string_view appended);
+
+	static int GetSizeClass(uint32_t size);
+
+	// These lock the heap
+	void RefillEntries(AllocationBuffer& buffer);
+	void RefillBlocks(AllocationBuffer& buffer, int sizeClass);
+
+	// Adds the objects of the buffer to the heap's, and requests a collection when there are enough. The heap has to be locked
+	void Count(AllocationBuffer& buffer);
+
+	AllocationBuffer* GetThreadBuffer();
+
+private:
+	// Taken to change the entries, the slabs and the counts. The buffers only take it to refill
+	std::mutex m_Mutex;
+
+	// For the threads that don't have a buffer of their own
+	AllocationBuffer m_SharedBuffer;
+	std::mutex m_SharedBufferMutex;
+
+	// A table that never moves, so that finding an entry doesn't race with adding pages
+	std::unique_ptr<HeapEntry[]> m_Pages[PageCount];
+	std::atomic<uint32_t> m_EntryCount = 0;
+	uint32_t m_FirstFreeEntry = NoEntry;
+
+	// Signed, since an object can be deleted before the buffer it was created in is counted
+	int m_ObjectCount = 0;
+	int64_t m_AllocatedBytes = 0;
+	size_t m_NextCollection = 1024 * 1024;
+	size_t m_AllocatedSinceStep = 0;
+
+	Phase m_Phase = Phase::Idle;
+
+	// The gray objects
+	std::vector<HeapHandle> m_MarkStack;
+
+	// The entries before it have been swept
+	uint32_t m_SweepCursor = 0;
+
+	// The buffers take spans of the slabs for any size class
+	std::vector<std::unique_ptr<char[]>> m_Slabs;
+	uint32_t m_SlabUsed = SlabSize; // The bytes of the last slab that have been handed out
+
+	// The freed blocks of each size class, each one starts with a pointer to the next
+	void* m_FreeBlocks[SizeClassCount] = {};
+};
@@ -0,0 +1,363 @@
+#include "ModuleCache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "../../Lexer.h"
+#include "../../Parser.h"
+#include "../../Inliner.h"
+
+namespace Bytecode {
+
+// Written at the start of a saved module, a module with a different one is compiled again
+static const uint32_t ModuleFileVersion = 0x4F4D0002;
+
+static void WriteInt(std::ostream& file, int64_t value)
+{
+	file.write((const char*)&value, sizeof(value));
+}
+static void WriteString(std::ostream& file, const std::string& string)
+{
+	WriteInt(file, string.size());
+	file.write(string.data(), string.size());
+}
+
+static int64_t ReadInt(std::istream& file)
+{
+	int64_t value = 0;
+	file.read((char*)&value, sizeof(value));
+	return value;
+}
+static std::string ReadString(std::istream& file)
+{
+	int64_t size = ReadInt(file);
+	if (!file || size < 0 || size > (1 << 24))
+	{
+		file.setstate(std::ios::failbit);
+		return "";
+	}
+
+	std::string string(size, '\0');
+	file.read(string.data(), size);
+	return string;
+}
+
+const BytecodeModule* ModuleCache::Get(const std::string& path, std::string& error)
+{
+	if (m_Checked.count(path) == 1)
+		return Find(path);
+
+	if (std::find(m_Loading.begin(), m_Loading.end(), path) != m_Loading.end())
+	{
+		error = "The imports of " + path + " go in a circle";
+		return nullptr;
+	}
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file.good())
+	{
+		error = "Couldn't open the module " + path;
+		return nullptr;
+	}
+
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	std::string source = buffer.str();
+	uint64_t hash = std::hash<std::string>()(source);
+
+	m_Loading.push_back(path);
+
+	// The node stays where it is when other modules are added
+	std::unique_ptr<BytecodeModule>& module = m_Modules[path];
+
+	bool loaded = false;
+	if (module == nullptr && m_Directory != "")
+	{
+		module = Load(path);
+		loaded = module != nullptr;
+	}
+
+	if (module != nullptr && (module->m_SourceHash != hash || !IsUpToDate(*module)))
+	{
+		module = nullptr;
+		loaded = false;
+	}
+
+	if (module == nullptr)
+	{
+		module = Compile(path, source, hash, error);
+
+		if (module != nullptr)
+		{
+			m_CompiledCount++;
+
+			if (m_Directory != "")
+				Save(*module);
+		}
+	}
+	else if (loaded)
+	{
+		m_LoadedCount++;
+	}
+
+	m_Loading.pop_back();
+
+	if (module == nullptr)
+		return nullptr;
+
+	m_Checked.insert(path);
+	return module.get();
+}
+
+const BytecodeModule* ModuleCache::Find(const std::string& path)
+{
+	auto it = m_Modules.find(path);
+	if (it == m_Modules.end())
+		return nullptr;
+
+	return it->second.get();
+}
+
+void ModuleCache::CheckForChanges()
+{
+	m_Checked.clear();
+}
+
+std::string ModuleCache::ResolvePath(const std::string& directory, const std::string& path)
+{
+	std::filesystem::path full = std::filesystem::u8path(directory) / std::filesystem::u8path(path);
+	return std::filesystem::weakly_canonical(std::filesystem::absolute(full)).u8string();
+}
+
+bool ModuleCache::IsUpToDate(const BytecodeModule& module)
+{
+	// The modules it imports have to still export the variables it uses, with the same types
+	for (const BytecodeModule::Import& import : module.m_Imports)
+	{
+		std::string error;
+		const BytecodeModule* dependency = Get(import.m_Path, error);
+		if (dependency == nullptr)
+			return false;
+
+		auto it = std::find_if(dependency->m_Exports.begin(), dependency->m_Exports.end(), [&](const BytecodeModule::Export& exported) {
+			return exported.m_Name == import.m_Name;
+		});
+
+		if (it == dependency->m_Exports.end() || it->m_Type != import.m_Type)
+			return false;
+	}
+
+	// A dependency that lost all of its exports has no imports left to check
+	for (const std::string& path : module.m_Dependencies)
+	{
+		std::string error;
+		if (Get(path, error) == nullptr)
+			return false;
+	}
+
+	return true;
+}
+
+std::unique_ptr<BytecodeModule> ModuleCache::Compile(const std::string& path, const std::string& source, uint64_t hash, std::string& error)
+{
+	Lexer lexer;
+	error = lexer.CreateTokens(source);
+	if (error != "")
+	{
+		error = path + ": " + error;
+		return nullptr;
+	}
+
+	Parser parser;
+	ASTNode* program = parser.CreateProgram(lexer.m_Tokens, lexer.m_Source);
+	if (parser.m_Error != "")
+	{
+		error = path + ": " + parser.m_Error;
+		return nullptr;
+	}
+
+	Inliner inliner(parser.m_Arena);
+	inliner.Run(program);
+
+	auto module = std::make_unique<BytecodeModule>();
+	module->m_Path = path;
+	module->m_SourceHash = hash;
+
+	BytecodeCompiler compiler;
+	compiler.m_Modules = this;
+	compiler.m_Directory = std::filesystem::u8path(path).parent_path().u8string();
+	compiler.CompileModule(program, *module);
+
+	if (compiler.m_Error != "")
+	{
+		error = path + ": " + compiler.m_Error;
+		return nullptr;
+	}
+
+	return module;
+}
+
+std::string ModuleCache::GetCachePath(const std::string& path)
+{
+	std::stringstream name;
+	name << std::hex << std::hash<std::string>()(path) << ".obc";
+
+	return (std::filesystem::u8path(m_Directory) / name.str()).u8string();
+}
+
+void ModuleCache::Save(const BytecodeModule& module)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::u8path(m_Directory), ec);
+
+	std::stringstream file;
+
+	WriteInt(file, ModuleFileVersion);
+	WriteString(file, module.m_Path);
+	WriteInt(file, (int64_t)module.m_SourceHash);
+	WriteInt(file, module.m_VariableCount);
+
+	WriteInt(file, module.m_Strings.size());
+	for (const std::string& string : module.m_Strings)
+		WriteString(file, string);
+
+	WriteInt(file, module.m_Exports.size());
+	for (const BytecodeModule::Export& exported : module.m_Exports)
+	{
+		WriteString(file, exported.m_Name);
+		WriteInt(file, exported.m_Index);
+		WriteInt(file, exported.m_Type);
+	}
+
+	WriteInt(file, module.m_Imports.size());
+	for (const BytecodeModule::Import& import : module.m_Imports)
+	{
+		WriteString(file, import.m_Path);
+		WriteString(file, import.m_Name);
+		WriteInt(file, import.m_Index);
+		WriteInt(file, import.m_Type);
+	}
+
+	WriteInt(file, module.m_Dependencies.size());
+	for (const std::string& path : module.m_Dependencies)
+		WriteString(file, path);
+
+	WriteInt(file, module.m_Instructions.size());
+	for (const Instruction& instruction : module.m_Instructions)
+	{
+		WriteInt(file, (int)instruction.m_Type);
+		WriteInt(file, instruction.m_DiscardValue);
+		WriteInt(file, instruction.m_ArgsCount);
+
+		for (int a = 0; a < InstructionArgSize; a++)
+		{
+			// The arguments are copies, so the getters can be used
+			InstructionArgument argument = instruction.m_Arguments[a];
+			WriteInt(file, argument.GetType());
+
+			if (argument.GetType() == ValueTypes::Integer)
+				WriteInt(file, argument.GetInt());
+			else if (argument.GetType() == ValueTypes::Float)
+				file.write((const char*)&argument.GetFloat(), sizeof(double));
+			else if (argument.GetType() == ValueTypes::String)
+				WriteString(file, argument.GetString());
+			else if (argument.GetType() != ValueTypes::Void)
+				return; // Can't be saved, it's compiled every run
+		}
+	}
+
+	std::ofstream out(GetCachePath(module.m_Path), std::ios::binary);
+	out << file.rdbuf();
+}
+
+std::unique_ptr<BytecodeModule> ModuleCache::Load(const std::string& path)
+{
+	std::ifstream file(GetCachePath(path), std::ios::binary);
+	if (!file.good())
+		return nullptr;
+
+	if (ReadInt(file) != ModuleFileVersion)
+		return nullptr;
+
+	auto module = std::make_unique<BytecodeModule>();
+	module->m_Path = ReadString(file);
+	module->m_SourceHash = (uint64_t)ReadInt(file);
+	module->m_VariableCount = (uint32_t)ReadInt(file);
+
+	// A different file whose path has the same hash
+	if (!file || module->m_Path != path)
+		return nullptr;
+
+	module->m_Strings.resize(std::clamp<int64_t>(ReadInt(file), 0, STACK_SIZE));
+	for (std::string& string : module->m_Strings)
+		string = ReadString(file);
+
+	int64_t exportCount = ReadInt(file);
+	for (int64_t i = 0; file && i < exportCount; i++)
+	{
+		BytecodeModule::Export exported;
+		exported.m_Name = ReadString(file);
+		exported.m_Index = (int)ReadInt(file);
+		exported.m_Type = (ValueTypes)ReadInt(file);
+		module->m_Exports.push_back(exported);
+	}
+
+	int64_t importCount = ReadInt(file);
+	for (int64_t i = 0; file && i < importCount; i++)
+	{
+		BytecodeModule::Import import;
+		import.m_Path = ReadString(file);
+		import.m_Name = ReadString(file);
+		import.m_Index = (int)ReadInt(file);
+		import.m_Type = (ValueTypes)ReadInt(file);
+		module->m_Imports.push_back(import);
+	}
+
+	int64_t dependencyCount = ReadInt(file);
+	for (int64_t i = 0; file && i < dependencyCount; i++)
+		module->m_Dependencies.push_back(ReadString(file));
+
+	int64_t instructionCount = ReadInt(file);
+	for (int64_t i = 0; file && i < instructionCount; i++)
+	{
+		Instruction instruction((Opcodes)ReadInt(file));
+		instruction.m_DiscardValue = ReadInt(file) != 0;
+		int argsCount = (int)ReadInt(file);
+
+		for (int a = 0; a < InstructionArgSize; a++)
+		{
+			ValueTypes type = (ValueTypes)ReadInt(file);
+
+			if (type == ValueTypes::Integer)
+			{
+				instruction.m_Arguments[a] = InstructionArgument((int)ReadInt(file), ValueTypes::Integer);
+			}
+			else if (type == ValueTypes::Float)
+			{
+				double value = 0;
+				file.read((char*)&value, sizeof(double));
+				instruction.m_Arguments[a] = InstructionArgument(value, ValueTypes::Float);
+			}
+			else if (type == ValueTypes::String)
+			{
+				instruction.m_Arguments[a] = InstructionArgument(ReadString(file), ValueTypes::String);
+			}
+			else if (type != ValueTypes::Void)
+			{
+				return nullptr;
+			}
+		}
+
+		instruction.m_ArgsCount = (uint8_t)argsCount;
+		module->m_Instructions.push_back(instruction);
+	}
+
+	if (!file)
+		return nullptr;
+
+	return module;
+}
+
+}
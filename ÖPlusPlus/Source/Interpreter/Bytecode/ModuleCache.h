@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "BytecodeCompiler.h"
+
+namespace Bytecode {
+	// Compiles the imported files into modules and keeps them, so that a file that is imported by several others is only compiled once.
+	// A module is compiled again when its file changes, or when a module it imports no longer exports what it uses.
+	// With a directory the modules are also saved there, so that the next run only compiles the files that changed
+	class ModuleCache
+	{
+	public:
+		// The module of the file, compiled if it changed. Every file is only checked once until CheckForChanges(). Null if it has an error
+		const BytecodeModule* Get(const std::string& path, std::string& error);
+
+		// A module that Get() has returned
+		const BytecodeModule* Find(const std::string& path);
+
+		// The next program checks the files again
+		void CheckForChanges();
+
+		// The full path of a file that is imported by a file in the directory
+		static std::string ResolvePath(const std::string& directory, const std::string& path);
+
+	public:
+		std::string m_Directory;
+
+		// How many modules were compiled, and how many were read from the directory
+		int m_CompiledCount = 0;
+		int m_LoadedCount = 0;
+
+	private:
+		bool IsUpToDate(const BytecodeModule& module);
+		std::unique_ptr<BytecodeModule> Compile(const std::string& path, const std::string& source, uint64_t hash, std::string& error);
+
+		std::string GetCachePath(const std::string& path);
+		void Save(const BytecodeModule& module);
+		std::unique_ptr<BytecodeModule> Load(const std::string& path);
+
+	private:
+		std::unordered_map<std::string, std::unique_ptr<BytecodeModule>> m_Modules;
+		std::unordered_set<std::string> m_Checked;
+
+		// The modules that are being compiled or checked, to find imports that go in a circle
+		std::vector<std::string> m_Loading;
+	};
+}
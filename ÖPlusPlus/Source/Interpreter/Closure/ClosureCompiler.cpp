@@ -0,0 +1,1124 @@
+#include "ClosureCompiler.h"
+
+#include "../Functions.h"
+
+#include <assert.h>
+
+static bool IsNumericType(ValueTypes type)
+{
+	return type == ValueTypes::Integer || type == ValueTypes::Float;
+}
+
+static bool IsStringType(ValueTypes type)
+{
+	return type == ValueTypes::String || type == ValueTypes::StringReference || type == ValueTypes::StringConstant;
+}
+
+static Value DefaultValue(ValueTypes type)
+{
+	if (type == ValueTypes::Integer)
+		return Value(0, ValueTypes::Integer);
+	if (type == ValueTypes::Float)
+		return Value(0.0, ValueTypes::Float);
+	if (IsStringType(type))
+		return Value("", ValueTypes::String);
+
+	return Value(ValueTypes::Void);
+}
+
+// The native functions that always return the same type, so that their results don't have to go through the generic Value path
+static ValueTypes GetNativeReturnType(const std::string& name)
+{
+	static const std::unordered_map<std::string, ValueTypes> types = {
+		{ "rand", ValueTypes::Integer },
+		{ "time", ValueTypes::Integer },
+		{ "rand_range", ValueTypes::Integer },
+		{ "to_int", ValueTypes::Integer },
+		{ "length", ValueTypes::Integer },
+		{ "clock", ValueTypes::Float },
+		{ "sin", ValueTypes::Float },
+		{ "cos", ValueTypes::Float },
+		{ "tan", ValueTypes::Float },
+		{ "sqrt", ValueTypes::Float },
+		{ "pow", ValueTypes::Float },
+		{ "abs_float", ValueTypes::Float },
+		{ "to_float", ValueTypes::Float },
+	};
+
+	auto it = types.find(name);
+	if (it == types.end())
+		return ValueTypes::Any;
+
+	return it->second;
+}
+
+namespace Closure
+{
+	template <typename T>
+	static ClosureCompiler::IntExpression MakeComparison(ASTTypes type, const std::function<T()>& lhs, const std::function<T()>& rhs)
+	{
+		switch (type)
+		{
+		case ASTTypes::CompareEquals:
+			return [lhs, rhs]() { T a = lhs(); return (int)(a == rhs()); };
+		case ASTTypes::CompareNotEquals:
+			return [lhs, rhs]() { T a = lhs(); return (int)(a != rhs()); };
+		case ASTTypes::CompareLessThan:
+			return [lhs, rhs]() { T a = lhs(); return (int)(a < rhs()); };
+		case ASTTypes::CompareGreaterThan:
+			return [lhs, rhs]() { T a = lhs(); return (int)(a > rhs()); };
+		case ASTTypes::CompareLessThanEqual:
+			return [lhs, rhs]() { T a = lhs(); return (int)(a <= rhs()); };
+		case ASTTypes::CompareGreaterThanEqual:
+			return [lhs, rhs]() { T a = lhs(); return (int)(a >= rhs()); };
+		default:
+			abort();
+		}
+
+		return nullptr;
+	}
+
+	ClosureCompiler& ClosureCompiler::Get()
+	{
+		static ClosureCompiler instance;
+		return instance;
+	}
+
+	bool ClosureCompiler::Compile(ASTNode* program)
+	{
+		m_Error = "";
+		m_HasError = false;
+		m_Unwind = false;
+
+		m_Contexts.clear();
+		m_FunctionScopes.clear();
+		m_Functions.clear();
+
+		m_Resolver.Resolve(program);
+		if (m_Resolver.m_Error != "")
+		{
+			MakeError(m_Resolver.m_Error);
+			return false;
+		}
+
+		m_GlobalTypes.assign(program->slotCount, ValueTypes::Any);
+
+		m_Contexts.emplace_back();
+		m_Program = CompileStatement(program->left);
+		m_ProgramFrameSize = m_Contexts.back().m_FrameSize;
+		m_Contexts.pop_back();
+
+		m_Globals.assign(program->slotCount, Value());
+
+		return !m_HasError;
+	}
+
+	Value ClosureCompiler::Run()
+	{
+		m_Unwind = false;
+		m_CallDepth = 0;
+
+		m_Stack.assign(std::max(m_ProgramFrameSize, 64), Value());
+		m_FrameBase = 0;
+		m_StackTop = m_ProgramFrameSize;
+
+		m_ReturnValue = Value();
+
+		m_Program();
+
+		return m_ReturnValue;
+	}
+
+	void ClosureCompiler::MakeError(const std::string& error)
+	{
+		if (m_Error == "")
+			m_Error = error;
+
+		m_HasError = true;
+		m_Unwind = true;
+	}
+
+	Value ClosureCompiler::MakeErrorValueReturn(const std::string& error)
+	{
+		MakeError(error);
+		return Value(ValueTypes::Void);
+	}
+
+	ClosureCompiler::Statement ClosureCompiler::CompileStatement(ASTNode* node)
+	{
+		switch (node->type)
+		{
+		case ASTTypes::Empty:
+			return []() {};
+		case ASTTypes::Scope:
+			return CompileScope(node);
+		case ASTTypes::VariableDeclaration:
+		case ASTTypes::GlobalVariableDeclaration:
+			return CompileDeclaration(node);
+		case ASTTypes::Assign:
+			return CompileAssign(node);
+		case ASTTypes::FunctionDefinition:
+			return CompileFunctionDefinition(node);
+		case ASTTypes::IfStatement:
+		{
+			BoolExpression condition = ToBool(CompileExpression(node->left));
+			Statement body = CompileStatement(node->right);
+
+			return [this, condition, body]()
+			{
+				if (condition() && !m_HasError)
+					body();
+			};
+		}
+		case ASTTypes::Else:
+		{
+			ASTNode* ifStatement = node->left;
+
+			BoolExpression condition = ToBool(CompileExpression(ifStatement->left));
+			Statement body = CompileStatement(ifStatement->right);
+			Statement elseBody = CompileStatement(node->right);
+
+			return [this, condition, body, elseBody]()
+			{
+				bool value = condition();
+				if (m_HasError)
+					return;
+
+				if (value)
+					body();
+				else
+					elseBody();
+			};
+		}
+		case ASTTypes::WhileStatement:
+		{
+			BoolExpression condition = ToBool(CompileExpression(node->left));
+			Statement body = CompileStatement(node->right);
+
+			return [this, condition, body]()
+			{
+				while (condition() && !m_Unwind)
+				{
+					body();
+
+					if (m_Unwind)
+						return;
+				}
+			};
+		}
+		case ASTTypes::ForStatement:
+		{
+			Statement initialization = CompileStatement(node->arguments[0]);
+			BoolExpression condition = ToBool(CompileExpression(node->arguments[1]));
+			Statement action = CompileStatement(node->arguments[2]);
+			Statement body = CompileStatement(node->right);
+
+			return [this, initialization, condition, action, body]()
+			{
+				for (initialization(); condition() && !m_Unwind; action())
+				{
+					body();
+
+					if (m_Unwind)
+						return;
+				}
+			};
+		}
+		case ASTTypes::Return:
+		{
+			Function* function = m_Contexts.back().m_Function;
+
+			Expression value;
+			if (node->left)
+				value = CompileExpression(node->left);
+			else
+				value.m_Value = []() { return Value(ValueTypes::Void); };
+
+			// Return the type that the function says it does
+			if (function && function->m_ReturnType != ValueTypes::Void)
+				value = Convert(value, function->m_ReturnType);
+
+			ValueExpression result = ToValue(value);
+
+			return [this, result]()
+			{
+				m_ReturnValue = result();
+				m_Unwind = true;
+			};
+		}
+		case ASTTypes::Break:
+		case ASTTypes::Continue:
+			MakeError("'" + node->ToString(false) + "' isn't supported by the closure compiler");
+			return []() {};
+		default:
+			break;
+		}
+
+		// Expressions where the result isn't used
+		Expression expression = CompileExpression(node);
+
+		if (expression.m_Type == ValueTypes::Integer)
+		{
+			IntExpression value = expression.m_Int;
+			return [value]() { value(); };
+		}
+		if (expression.m_Type == ValueTypes::Float)
+		{
+			FloatExpression value = expression.m_Float;
+			return [value]() { value(); };
+		}
+
+		ValueExpression value = expression.m_Value;
+		return [value]() { value(); };
+	}
+
+	ClosureCompiler::Statement ClosureCompiler::CompileScope(ASTNode* node)
+	{
+		PushScope(node->slotCount);
+		m_FunctionScopes.emplace_back();
+
+		// Functions can be called before their definition in the scope
+		DeclareFunctions(node);
+
+		std::vector<Statement> statements;
+		for (ASTNode* line : node->arguments)
+			statements.push_back(CompileStatement(line));
+
+		m_FunctionScopes.pop_back();
+		PopScope();
+
+		return [this, statements]()
+		{
+			for (const Statement& statement : statements)
+			{
+				statement();
+
+				if (m_Unwind)
+					return;
+			}
+		};
+	}
+
+	ClosureCompiler::Statement ClosureCompiler::CompileDeclaration(ASTNode* declaration)
+	{
+		ValueTypes type = declaration->left->VariableTypeToValueType();
+
+		DeclareVariable(declaration->right, type);
+
+		VariableReference reference = GetReference(declaration->right);
+		Value initialValue = DefaultValue(type);
+
+		return [this, reference, initialValue]() { GetVariable(reference) = initialValue; };
+	}
+
+	ClosureCompiler::Statement ClosureCompiler::CompileAssign(ASTNode* node)
+	{
+		bool isDeclaration = node->left->type == ASTTypes::VariableDeclaration || node->left->type == ASTTypes::GlobalVariableDeclaration;
+		ASTNode* variable = isDeclaration ? node->left->right : node->left;
+
+		if (variable->depth == -1)
+		{
+			MakeError("Variable '" + std::string(variable->stringValue) + "' has not been defined in this scope");
+			return []() {};
+		}
+
+		if (isDeclaration)
+			DeclareVariable(variable, node->left->left->VariableTypeToValueType());
+
+		VariableReference reference = GetReference(variable);
+		ValueTypes type = GetVariableType(reference);
+
+		Expression value = Convert(CompileExpression(node->right), type);
+
+		// The value has to be evaluated before the variable is looked up, since a function call can move the stack
+		if (type == ValueTypes::Integer)
+		{
+			IntExpression rhs = value.m_Int;
+
+			if (isDeclaration)
+				return [this, reference, rhs]() { int result = rhs(); if (!m_HasError) GetVariable(reference) = Value(result, ValueTypes::Integer); };
+
+			return [this, reference, rhs]() { int result = rhs(); if (!m_HasError) GetVariable(reference).GetInt() = result; };
+		}
+		if (type == ValueTypes::Float)
+		{
+			FloatExpression rhs = value.m_Float;
+
+			if (isDeclaration)
+				return [this, reference, rhs]() { double result = rhs(); if (!m_HasError) GetVariable(reference) = Value(result, ValueTypes::Float); };
+
+			return [this, reference, rhs]() { double result = rhs(); if (!m_HasError) GetVariable(reference).GetFloat() = result; };
+		}
+
+		ValueExpression rhs = value.m_Value;
+		return [this, reference, rhs]() { Value result = rhs(); if (!m_HasError) GetVariable(reference) = result; };
+	}
+
+	ClosureCompiler::Statement ClosureCompiler::CompileFunctionDefinition(ASTNode* node)
+	{
+		Function* function = m_FunctionScopes.back()[node->left->arguments[1]->symbol];
+		assert(function && function->m_Definition == node);
+
+		FunctionContext context;
+		context.m_Function = function;
+		m_Contexts.push_back(context);
+
+		// The parameters are first in the frame
+		PushScope(node->slotCount);
+
+		ASTNode* prototype = node->left;
+		for (int i = 2; i < prototype->arguments.size(); i++)
+			DeclareVariable(prototype->arguments[i]->right, function->m_ParameterTypes[i - 2]);
+
+		function->m_Body = CompileStatement(node->right);
+
+		PopScope();
+
+		function->m_FrameSize = m_Contexts.back().m_FrameSize;
+		m_Contexts.pop_back();
+
+		// The function is compiled once here, so there is nothing to do when the definition is reached
+		return []() {};
+	}
+
+	ClosureCompiler::Expression ClosureCompiler::CompileExpression(ASTNode* node)
+	{
+		Expression expression;
+
+		switch (node->type)
+		{
+		case ASTTypes::IntLiteral:
+		{
+			int value = (int)node->numberValue;
+
+			expression.m_Type = ValueTypes::Integer;
+			expression.m_Int = [value]() { return value; };
+			return expression;
+		}
+		case ASTTypes::DoubleLiteral:
+		{
+			double value = node->numberValue;
+
+			expression.m_Type = ValueTypes::Float;
+			expression.m_Float = [value]() { return value; };
+			return expression;
+		}
+		case ASTTypes::StringLiteral:
+		{
+			Value value(std::string(node->stringValue), ValueTypes::StringConstant);
+
+			expression.m_Type = ValueTypes::StringConstant;
+			expression.m_Value = [value]() { return value; };
+			return expression;
+		}
+		case ASTTypes::Variable:
+			return CompileVariable(node);
+		case ASTTypes::Add:
+		case ASTTypes::Subtract:
+		case ASTTypes::Multiply:
+		case ASTTypes::Divide:
+			return CompileMath(node);
+		case ASTTypes::CompareEquals:
+		case ASTTypes::CompareNotEquals:
+		case ASTTypes::CompareLessThan:
+		case ASTTypes::CompareGreaterThan:
+		case ASTTypes::CompareLessThanEqual:
+		case ASTTypes::CompareGreaterThanEqual:
+			return CompileComparison(node);
+		case ASTTypes::And:
+		case ASTTypes::Or:
+		{
+			// Both sides are always evaluated, like in the AST interpreter
+			BoolExpression lhs = ToBool(CompileExpression(node->left));
+			BoolExpression rhs = ToBool(CompileExpression(node->right));
+
+			expression.m_Type = ValueTypes::Integer;
+
+			if (node->type == ASTTypes::And)
+				expression.m_Int = [lhs, rhs]() { bool a = lhs(); bool b = rhs(); return (int)(a && b); };
+			else
+				expression.m_Int = [lhs, rhs]() { bool a = lhs(); bool b = rhs(); return (int)(a || b); };
+
+			return expression;
+		}
+		case ASTTypes::Not:
+		{
+			BoolExpression value = ToBool(CompileExpression(node->left));
+
+			expression.m_Type = ValueTypes::Integer;
+			expression.m_Int = [value]() { return (int)!value(); };
+			return expression;
+		}
+		case ASTTypes::PostIncrement:
+		case ASTTypes::PreIncrement:
+		case ASTTypes::PostDecrement:
+		case ASTTypes::PreDecrement:
+			return CompileIncrement(node);
+		case ASTTypes::FunctionCall:
+			return CompileFunctionCall(node);
+
+		// Statements used as expressions
+		case ASTTypes::Scope:
+		case ASTTypes::VariableDeclaration:
+		case ASTTypes::GlobalVariableDeclaration:
+		case ASTTypes::Assign:
+		case ASTTypes::IfStatement:
+		case ASTTypes::Else:
+		case ASTTypes::WhileStatement:
+		case ASTTypes::ForStatement:
+		case ASTTypes::Return:
+		case ASTTypes::FunctionDefinition:
+		{
+			Statement statement = CompileStatement(node);
+
+			expression.m_Value = [statement]() { statement(); return Value(ValueTypes::Void); };
+			return expression;
+		}
+		default:
+			break;
+		}
+
+		MakeError("'" + node->ToString(false) + "' isn't supported by the closure compiler");
+		expression.m_Value = []() { return Value(ValueTypes::Void); };
+		return expression;
+	}
+
+	ClosureCompiler::Expression ClosureCompiler::CompileVariable(ASTNode* node)
+	{
+		Expression expression;
+
+		if (node->depth == -1)
+		{
+			MakeError("Variable '" + std::string(node->stringValue) + "' has not been defined in this scope");
+			return expression;
+		}
+
+		VariableReference reference = GetReference(node);
+		expression.m_Type = GetVariableType(reference);
+
+		if (expression.m_Type == ValueTypes::Integer)
+			expression.m_Int = [this, reference]() { return GetVariable(reference).GetInt(); };
+		else if (expression.m_Type == ValueTypes::Float)
+			expression.m_Float = [this, reference]() { return GetVariable(reference).GetFloat(); };
+		else
+			expression.m_Value = [this, reference]() { return GetVariable(reference); };
+
+		return expression;
+	}
+
+	ClosureCompiler::Expression ClosureCompiler::CompileMath(ASTNode* node)
+	{
+		Expression lhs = CompileExpression(node->left);
+		Expression rhs = CompileExpression(node->right);
+
+		Expression expression;
+
+		bool sameType = lhs.m_Type == rhs.m_Type;
+		bool bothInts = sameType && lhs.m_Type == ValueTypes::Integer;
+		bool bothNumeric = IsNumericType(lhs.m_Type) && IsNumericType(rhs.m_Type);
+
+		switch (node->type)
+		{
+		case ASTTypes::Add:
+		case ASTTypes::Subtract:
+		{
+			// Ints and floats can't be mixed, those go through Value to get the same error as in the other backends
+			if (!bothNumeric || !sameType)
+				break;
+
+			bool add = node->type == ASTTypes::Add;
+
+			expression.m_Type = lhs.m_Type;
+
+			if (bothInts)
+			{
+				IntExpression a = lhs.m_Int, b = rhs.m_Int;
+				if (add)
+					expression.m_Int = [a, b]() { int l = a(); return l + b(); };
+				else
+					expression.m_Int = [a, b]() { int l = a(); return l - b(); };
+			}
+			else
+			{
+				FloatExpression a = lhs.m_Float, b = rhs.m_Float;
+				if (add)
+					expression.m_Float = [a, b]() { double l = a(); return l + b(); };
+				else
+					expression.m_Float = [a, b]() { double l = a(); return l - b(); };
+			}
+
+			return expression;
+		}
+		case ASTTypes::Multiply:
+		{
+			if (!bothNumeric)
+				break;
+
+			if (bothInts)
+			{
+				IntExpression a = lhs.m_Int, b = rhs.m_Int;
+
+				expression.m_Type = ValueTypes::Integer;
+				expression.m_Int = [a, b]() { int l = a(); return l * b(); };
+				return expression;
+			}
+
+			// int * float -> float
+			FloatExpression a = Convert(lhs, ValueTypes::Float).m_Float;
+			FloatExpression b = Convert(rhs, ValueTypes::Float).m_Float;
+
+			expression.m_Type = ValueTypes::Float;
+			expression.m_Float = [a, b]() { double l = a(); return l * b(); };
+			return expression;
+		}
+		case ASTTypes::Divide:
+		{
+			if (!bothNumeric)
+				break;
+
+			expression.m_Type = ValueTypes::Float;
+
+			if (bothInts)
+			{
+				// Ints perform float division
+				IntExpression a = lhs.m_Int, b = rhs.m_Int;
+				expression.m_Float = [this, a, b]()
+				{
+					int l = a();
+					int r = b();
+					if (r == 0)
+					{
+						MakeError("Division by 0");
+						return 0.0;
+					}
+
+					return (double)((float)l / (float)r);
+				};
+
+				return expression;
+			}
+
+			FloatExpression a = Convert(lhs, ValueTypes::Float).m_Float;
+			FloatExpression b = Convert(rhs, ValueTypes::Float).m_Float;
+			expression.m_Float = [this, a, b]()
+			{
+				double l = a();
+				double r = b();
+				if (r == 0)
+				{
+					MakeError("Division by 0");
+					return 0.0;
+				}
+
+				return l / r;
+			};
+
+			return expression;
+		}
+		default:
+			abort();
+		}
+
+		// Strings or values from native functions
+		ValueExpression a = ToValue(lhs);
+		ValueExpression b = ToValue(rhs);
+
+		expression.m_Type = (node->type == ASTTypes::Add && IsStringType(lhs.m_Type) && IsStringType(rhs.m_Type)) ? ValueTypes::String : ValueTypes::Any;
+
+		switch (node->type)
+		{
+		case ASTTypes::Add:
+			expression.m_Value = [a, b]() { Value l = a(); Value r = b(); return Value::Add(l, r); };
+			break;
+		case ASTTypes::Subtract:
+			expression.m_Value = [a, b]() { Value l = a(); Value r = b(); return Value::Subtract(l, r); };
+			break;
+		case ASTTypes::Multiply:
+			expression.m_Value = [a, b]() { Value l = a(); Value r = b(); return Value::Multiply(l, r); };
+			break;
+		case ASTTypes::Divide:
+			expression.m_Value = [a, b]() { Value l = a(); Value r = b(); return Value::Divide(l, r); };
+			break;
+		default:
+			break;
+		}
+
+		return expression;
+	}
+
+	ClosureCompiler::Expression ClosureCompiler::CompileComparison(ASTNode* node)
+	{
+		Expression lhs = CompileExpression(node->left);
+		Expression rhs = CompileExpression(node->right);
+
+		Expression expression;
+		expression.m_Type = ValueTypes::Integer;
+
+		if (lhs.m_Type == ValueTypes::Integer && rhs.m_Type == ValueTypes::Integer)
+		{
+			expression.m_Int = MakeComparison<int>(node->type, lhs.m_Int, rhs.m_Int);
+			return expression;
+		}
+		if (lhs.m_Type == ValueTypes::Float && rhs.m_Type == ValueTypes::Float)
+		{
+			expression.m_Int = MakeComparison<double>(node->type, lhs.m_Float, rhs.m_Float);
+			return expression;
+		}
+
+		ValueExpression a = ToValue(lhs);
+		ValueExpression b = ToValue(rhs);
+		ASTTypes type = node->type;
+
+		expression.m_Int = [a, b, type]() { Value l = a(); return (int)Value::Compare(l, b(), type); };
+		return expression;
+	}
+
+	ClosureCompiler::Expression ClosureCompiler::CompileIncrement(ASTNode* node)
+	{
+		Expression expression;
+
+		ASTNode* variable = node->left;
+		if (variable->depth == -1)
+		{
+			MakeError("Variable '" + std::string(variable->stringValue) + "' has not been defined in this scope");
+			return expression;
+		}
+
+		VariableReference reference = GetReference(variable);
+		expression.m_Type = GetVariableType(reference);
+
+		ASTTypes type = node->type;
+
+		if (expression.m_Type == ValueTypes::Integer)
+		{
+			if (type == ASTTypes::PostIncrement)
+				expression.m_Int = [this, reference]() { return GetVariable(reference).GetInt()++; };
+			else if (type == ASTTypes::PreIncrement)
+				expression.m_Int = [this, reference]() { return ++GetVariable(reference).GetInt(); };
+			else if (type == ASTTypes::PostDecrement)
+				expression.m_Int = [this, reference]() { return GetVariable(reference).GetInt()--; };
+			else
+				expression.m_Int = [this, reference]() { return --GetVariable(reference).GetInt(); };
+
+			return expression;
+		}
+		if (expression.m_Type == ValueTypes::Float)
+		{
+			if (type == ASTTypes::PostIncrement)
+				expression.m_Float = [this, reference]() { double& value = GetVariable(reference).GetFloat(); double previous = value; value += 1.0; return previous; };
+			else if (type == ASTTypes::PreIncrement)
+				expression.m_Float = [this, reference]() { double& value = GetVariable(reference).GetFloat(); value += 1.0; return value; };
+			else if (type == ASTTypes::PostDecrement)
+				expression.m_Float = [this, reference]() { double& value = GetVariable(reference).GetFloat(); double previous = value; value -= 1.0; return previous; };
+			else
+				expression.m_Float = [this, reference]() { double& value = GetVariable(reference).GetFloat(); value -= 1.0; return value; };
+
+			return expression;
+		}
+
+		bool increment = type == ASTTypes::PostIncrement || type == ASTTypes::PreIncrement;
+		bool post = type == ASTTypes::PostIncrement || type == ASTTypes::PostDecrement;
+
+		expression.m_Value = [this, reference, increment, post]()
+		{
+			Value& value = GetVariable(reference);
+			Value previous = value;
+
+			value = increment ? Value::Increment(value) : Value::Decrement(value);
+
+			return post ? previous : value;
+		};
+
+		return expression;
+	}
+
+	ClosureCompiler::Expression ClosureCompiler::CompileFunctionCall(ASTNode* node)
+	{
+		std::string name(node->stringValue);
+
+		Expression expression;
+
+		// User defined function
+		Function* function = FindFunction(node->symbol);
+		if (function)
+		{
+			if (node->arguments.size() > function->m_ParameterTypes.size())
+			{
+				MakeError("Function '" + name + "' takes " + std::to_string(function->m_ParameterTypes.size()) + " arguments");
+				return expression;
+			}
+
+			std::vector<std::function<void(int)>> arguments;
+
+			for (int i = 0; i < function->m_ParameterTypes.size(); i++)
+			{
+				ValueTypes type = function->m_ParameterTypes[i];
+				int offset = function->m_ParameterOffsets[i];
+
+				// Parameters that aren't passed keep their default value
+				if (i >= node->arguments.size())
+				{
+					Value initialValue = DefaultValue(type);
+					arguments.push_back([this, offset, initialValue](int base) { m_Stack[base + offset] = initialValue; });
+					continue;
+				}
+
+				Expression argument = Convert(CompileExpression(node->arguments[i]), type);
+
+				if (type == ValueTypes::Integer)
+				{
+					IntExpression value = argument.m_Int;
+					arguments.push_back([this, offset, value](int base) { int result = value(); m_Stack[base + offset] = Value(result, ValueTypes::Integer); });
+				}
+				else if (type == ValueTypes::Float)
+				{
+					FloatExpression value = argument.m_Float;
+					arguments.push_back([this, offset, value](int base) { double result = value(); m_Stack[base + offset] = Value(result, ValueTypes::Float); });
+				}
+				else
+				{
+					ValueExpression value = ToValue(argument);
+					arguments.push_back([this, offset, value](int base) { Value result = value(); m_Stack[base + offset] = result; });
+				}
+			}
+
+			expression.m_Type = function->m_ReturnType;
+
+			if (expression.m_Type == ValueTypes::Integer)
+				expression.m_Int = [this, function, arguments]() { CallFunction(*function, arguments); return m_ReturnValue.GetInt(); };
+			else if (expression.m_Type == ValueTypes::Float)
+				expression.m_Float = [this, function, arguments]() { CallFunction(*function, arguments); return m_ReturnValue.GetFloat(); };
+			else
+				expression.m_Value = [this, function, arguments]() { CallFunction(*function, arguments); return m_ReturnValue; };
+
+			return expression;
+		}
+
+		// Native function
+		CallableFunction native = Functions::GetFunctionBySymbol(node->symbol);
+		if (!native)
+		{
+			MakeError("Function '" + name + "' doesn't exist");
+			return expression;
+		}
+
+		std::vector<ValueExpression> arguments;
+		for (ASTNode* argument : node->arguments)
+			arguments.push_back(ToValue(CompileExpression(argument)));
+
+		ValueExpression call = [this, native, arguments]()
+		{
+			ValueArray values;
+			values.reserve(arguments.size());
+
+			// A failed argument stops the call, so that it doesn't print or use a value that was never computed
+			for (const ValueExpression& argument : arguments)
+			{
+				values.push_back(argument());
+
+				if (m_HasError)
+					return Value(ValueTypes::Void);
+			}
+
+			return native(values);
+		};
+
+		expression.m_Type = GetNativeReturnType(name);
+
+		// A native function that fails has already made the error, and returns void
+		if (expression.m_Type == ValueTypes::Integer)
+		{
+			expression.m_Int = [call]()
+			{
+				Value result = call();
+				return result.GetType() == ValueTypes::Integer ? result.GetInt() : 0;
+			};
+		}
+		else if (expression.m_Type == ValueTypes::Float)
+		{
+			expression.m_Float = [call]()
+			{
+				Value result = call();
+				return result.GetType() == ValueTypes::Float ? result.GetFloat() : 0.0;
+			};
+		}
+		else
+			expression.m_Value = call;
+
+		return expression;
+	}
+
+	ClosureCompiler::Expression ClosureCompiler::Convert(const Expression& expression, ValueTypes type)
+	{
+		if (expression.m_Type == type)
+			return expression;
+
+		Expression converted;
+		converted.m_Type = type;
+
+		if (type == ValueTypes::Integer)
+		{
+			if (expression.m_Type == ValueTypes::Float)
+			{
+				FloatExpression value = expression.m_Float;
+				converted.m_Int = [value]() { return (int)value(); };
+				return converted;
+			}
+			if (expression.m_Type == ValueTypes::Any)
+			{
+				ValueExpression value = expression.m_Value;
+				converted.m_Int = [this, value]()
+				{
+					Value result = value();
+					if (result.GetType() == ValueTypes::Integer)
+						return result.GetInt();
+					if (result.GetType() == ValueTypes::Float)
+						return (int)result.GetFloat();
+
+					MakeError("Cannot convert " + ValueTypeToString(result.GetType()) + " to Integer");
+					return 0;
+				};
+				return converted;
+			}
+		}
+		else if (type == ValueTypes::Float)
+		{
+			if (expression.m_Type == ValueTypes::Integer)
+			{
+				IntExpression value = expression.m_Int;
+				converted.m_Float = [value]() { return (double)value(); };
+				return converted;
+			}
+			if (expression.m_Type == ValueTypes::Any)
+			{
+				ValueExpression value = expression.m_Value;
+				converted.m_Float = [this, value]()
+				{
+					Value result = value();
+					if (result.GetType() == ValueTypes::Float)
+						return result.GetFloat();
+					if (result.GetType() == ValueTypes::Integer)
+						return (double)result.GetInt();
+
+					MakeError("Cannot convert " + ValueTypeToString(result.GetType()) + " to Float");
+					return 0.0;
+				};
+				return converted;
+			}
+		}
+		else if (IsStringType(type))
+		{
+			if (IsStringType(expression.m_Type))
+				return expression;
+
+			if (expression.m_Type == ValueTypes::Any)
+			{
+				ValueExpression value = expression.m_Value;
+				converted.m_Value = [this, value]()
+				{
+					Value result = value();
+					if (!result.IsString())
+						MakeError("Cannot convert " + ValueTypeToString(result.GetType()) + " to String");
+
+					return result;
+				};
+				return converted;
+			}
+		}
+		else
+		{
+			// Variables without a known type take anything
+			return expression;
+		}
+
+		MakeError("Cannot convert " + ValueTypeToString(expression.m_Type) + " to " + ValueTypeToString(type));
+		return converted;
+	}
+
+	ClosureCompiler::ValueExpression ClosureCompiler::ToValue(const Expression& expression)
+	{
+		if (expression.m_Type == ValueTypes::Integer)
+		{
+			IntExpression value = expression.m_Int;
+			return [value]() { return Value(value(), ValueTypes::Integer); };
+		}
+		if (expression.m_Type == ValueTypes::Float)
+		{
+			FloatExpression value = expression.m_Float;
+			return [value]() { return Value(value(), ValueTypes::Float); };
+		}
+
+		return expression.m_Value;
+	}
+
+	ClosureCompiler::BoolExpression ClosureCompiler::ToBool(const Expression& expression)
+	{
+		if (expression.m_Type == ValueTypes::Integer)
+		{
+			IntExpression value = expression.m_Int;
+			return [value]() { return value() > 0; };
+		}
+		if (expression.m_Type == ValueTypes::Float)
+		{
+			FloatExpression value = expression.m_Float;
+			return [value]() { return value() > 0; };
+		}
+
+		ValueExpression value = expression.m_Value;
+		return [value]() { return value().IsTruthy(); };
+	}
+
+	ClosureCompiler::VariableReference ClosureCompiler::GetReference(ASTNode* variable)
+	{
+		VariableReference reference;
+
+		if (variable->depth == AST::GlobalDepth)
+		{
+			reference.m_IsGlobal = true;
+			reference.m_Index = variable->slot;
+			return reference;
+		}
+
+		FunctionContext& context = m_Contexts.back();
+
+		int scope = (int)context.m_ScopeOffsets.size() - 1 - variable->depth;
+		assert(scope >= 0);
+
+		reference.m_Index = context.m_ScopeOffsets[scope] + variable->slot;
+		return reference;
+	}
+
+	ValueTypes ClosureCompiler::GetVariableType(const VariableReference& reference)
+	{
+		if (reference.m_IsGlobal)
+			return m_GlobalTypes[reference.m_Index];
+
+		auto& types = m_Contexts.back().m_SlotTypes;
+
+		auto it = types.find(reference.m_Index);
+		if (it == types.end())
+			return ValueTypes::Any;
+
+		return it->second;
+	}
+
+	void ClosureCompiler::DeclareVariable(ASTNode* variable, ValueTypes type)
+	{
+		if (type == ValueTypes::Void)
+			type = ValueTypes::Any;
+
+		VariableReference reference = GetReference(variable);
+
+		if (reference.m_IsGlobal)
+			m_GlobalTypes[reference.m_Index] = type;
+		else
+			m_Contexts.back().m_SlotTypes[reference.m_Index] = type;
+	}
+
+	void ClosureCompiler::PushScope(int slotCount)
+	{
+		FunctionContext& context = m_Contexts.back();
+
+		context.m_ScopeOffsets.push_back(context.m_NextOffset);
+		context.m_NextOffset += slotCount;
+		context.m_FrameSize = std::max(context.m_FrameSize, context.m_NextOffset);
+	}
+
+	void ClosureCompiler::PopScope()
+	{
+		// Scopes after this one can reuse its slots
+		FunctionContext& context = m_Contexts.back();
+
+		context.m_NextOffset = context.m_ScopeOffsets.back();
+		context.m_ScopeOffsets.pop_back();
+	}
+
+	void ClosureCompiler::DeclareFunctions(ASTNode* scope)
+	{
+		for (ASTNode* node : scope->arguments)
+		{
+			if (node->type != ASTTypes::FunctionDefinition)
+				continue;
+
+			ASTNode* prototype = node->left;
+
+			Function& function = m_Functions.emplace_back();
+			function.m_Name = prototype->arguments[1]->stringValue;
+			function.m_Definition = node;
+			function.m_ReturnType = prototype->arguments[0]->VariableTypeToValueType();
+			function.m_DefaultReturnValue = DefaultValue(function.m_ReturnType);
+
+			for (int i = 2; i < prototype->arguments.size(); i++)
+			{
+				ASTNode* parameter = prototype->arguments[i];
+
+				ValueTypes type = parameter->left->VariableTypeToValueType();
+				function.m_ParameterTypes.push_back(type == ValueTypes::Void ? ValueTypes::Any : type);
+				function.m_ParameterOffsets.push_back(parameter->right->slot);
+			}
+
+			m_FunctionScopes.back()[prototype->arguments[1]->symbol] = &function;
+		}
+	}
+
+	ClosureCompiler::Function* ClosureCompiler::FindFunction(Symbol name)
+	{
+		for (int i = (int)m_FunctionScopes.size() - 1; i >= 0; i--)
+		{
+			auto it = m_FunctionScopes[i].find(name);
+			if (it != m_FunctionScopes[i].end())
+				return it->second;
+		}
+
+		return nullptr;
+	}
+
+	void ClosureCompiler::CallFunction(Function& function, const std::vector<std::function<void(int)>>& arguments)
+	{
+		// Nothing is called after an error, the expressions around the call return to the statement that stops
+		if (m_HasError)
+		{
+			m_ReturnValue = function.m_DefaultReturnValue;
+			return;
+		}
+
+		if (m_CallDepth >= MaxCallDepth)
+		{
+			MakeError("Too many nested function calls (more than " + std::to_string(MaxCallDepth) + ")");
+			m_ReturnValue = function.m_DefaultReturnValue;
+			return;
+		}
+
+		// Make room for the new frame before the arguments are evaluated, so that calls in the arguments end up above it
+		int base = m_StackTop;
+		m_StackTop += function.m_FrameSize;
+
+		if (m_StackTop > m_Stack.size())
+			m_Stack.resize(m_StackTop * 2);
+
+		for (const auto& argument : arguments)
+		{
+			argument(base);
+
+			if (m_HasError)
+				break;
+		}
+
+		int previousBase = m_FrameBase;
+		m_FrameBase = base;
+		m_CallDepth++;
+
+		m_ReturnValue = function.m_DefaultReturnValue;
+
+		if (!m_HasError)
+			function.m_Body();
+
+		m_CallDepth--;
+		m_FrameBase = previousBase;
+		m_StackTop = base;
+
+		// Only stop unwinding if it was because of a return
+		if (!m_HasError)
+			m_Unwind = false;
+	}
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "../../Parser.h"
+#include "../ValueTypes.h"
+#include "../Value.h"
+#include "../AST/Resolver.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+
+namespace Closure
+{
+
+constexpr int MaxCallDepth = 5000;
+
+// Compiles the AST once into a tree of C++ lambdas, which are then called to run the program.
+// The AST interpreter instead has to go through the big switch for every node, every time it is executed.
+// The language is statically typed, so most expressions know if they result in an int or a float when they are compiled and get lambdas that work on plain ints and doubles.
+// Variables are stored in one flat array per function call, at offsets that are worked out from the resolver's (depth, slot) pairs
+class ClosureCompiler
+{
+public:
+	using Statement = std::function<void()>;
+	using IntExpression = std::function<int()>;
+	using FloatExpression = std::function<double()>;
+	using ValueExpression = std::function<Value()>;
+	using BoolExpression = std::function<bool()>;
+
+	// Only the lambda that matches the type is set. Strings, void and values from native functions (ValueTypes::Any) use m_Value
+	struct Expression
+	{
+		ValueTypes m_Type = ValueTypes::Void;
+
+		IntExpression m_Int;
+		FloatExpression m_Float;
+		ValueExpression m_Value;
+	};
+
+	struct VariableReference
+	{
+		bool m_IsGlobal = false;
+		int m_Index = 0;
+	};
+
+	struct Function
+	{
+		std::string m_Name = "";
+		ASTNode* m_Definition = nullptr;
+
+		ValueTypes m_ReturnType = ValueTypes::Void;
+		std::vector<ValueTypes> m_ParameterTypes;
+		std::vector<int> m_ParameterOffsets;
+
+		int m_FrameSize = 0;
+		Statement m_Body;
+
+		// What the function returns if it ends without a return statement
+		Value m_DefaultReturnValue;
+	};
+
+public:
+	static ClosureCompiler& Get();
+
+	bool Compile(ASTNode* program);
+	Value Run();
+
+	void MakeError(const std::string& error);
+	Value MakeErrorValueReturn(const std::string& error);
+
+private:
+	ClosureCompiler() {};
+
+	// Where the variables of the function that is being compiled are put in its frame
+	struct FunctionContext
+	{
+		Function* m_Function = nullptr; // nullptr for the top level
+
+		std::vector<int> m_ScopeOffsets;
+		int m_NextOffset = 0;
+		int m_FrameSize = 0;
+
+		std::unordered_map<int, ValueTypes> m_SlotTypes;
+	};
+
+	Statement CompileStatement(ASTNode* node);
+	Statement CompileScope(ASTNode* node);
+	Statement CompileAssign(ASTNode* node);
+	Statement CompileDeclaration(ASTNode* declaration);
+	Statement CompileFunctionDefinition(ASTNode* node);
+
+	Expression CompileExpression(ASTNode* node);
+	Expression CompileVariable(ASTNode* node);
+	Expression CompileMath(ASTNode* node);
+	Expression CompileComparison(ASTNode* node);
+	Expression CompileIncrement(ASTNode* node);
+	Expression CompileFunctionCall(ASTNode* node);
+
+	// Converts an expression to the type of a variable, parameter or return value. Gives an error if it can't be done
+	Expression Convert(const Expression& expression, ValueTypes type);
+
+	ValueExpression ToValue(const Expression& expression);
+	BoolExpression ToBool(const Expression& expression);
+
+	VariableReference GetReference(ASTNode* variable);
+	ValueTypes GetVariableType(const VariableReference& reference);
+	void DeclareVariable(ASTNode* variable, ValueTypes type);
+
+	void PushScope(int slotCount);
+	void PopScope();
+	void DeclareFunctions(ASTNode* scope);
+	Function* FindFunction(Symbol name);
+
+	// The arguments are given the base of the new frame and put their value in the parameter's slot. The result is put in m_ReturnValue
+	void CallFunction(Function& function, const std::vector<std::function<void(int)>>& arguments);
+
+	inline Value& GetVariable(const VariableReference& reference)
+	{
+		if (reference.m_IsGlobal)
+			return m_Globals[reference.m_Index];
+
+		return m_Stack[m_FrameBase + reference.m_Index];
+	}
+
+private:
+	// Compiling
+	std::vector<FunctionContext> m_Contexts;
+	std::vector<std::unordered_map<Symbol, Function*>> m_FunctionScopes;
+	std::deque<Function> m_Functions;
+	std::vector<ValueTypes> m_GlobalTypes;
+
+	AST::Resolver m_Resolver;
+
+	Statement m_Program;
+	int m_ProgramFrameSize = 0;
+
+	// Running
+	std::vector<Value> m_Stack;
+	std::vector<Value> m_Globals;
+	int m_FrameBase = 0;
+	int m_StackTop = 0;
+	int m_CallDepth = 0;
+
+	Value m_ReturnValue;
+
+	// Set when returning from a function or when there's an error, so that the statements after it are skipped
+	bool m_Unwind = false;
+	bool m_HasError = false;
+
+public:
+	std::string m_Error = "";
+};
+
+}
@@ -1,6 +1,7 @@
 #include "Functions.h"
 
 #include <time.h>
+#include <chrono>
 #include <iostream>	
 
 #include "Bytecode/BytecodeInterpreter.h"
@@ -15,6 +16,7 @@ void Functions::InitializeDefaultFunctions(ExecutionMethods method)
 	NativeFunctions["rand"] = &_rand;
 	NativeFunctions["srand"] = &_srand;
 	NativeFunctions["time"] = &_time;
+	NativeFunctions["clock"] = &_clock;
 	NativeFunctions["rand_range"] = &rand_range;
 	//NativeFunctions["rand_range_float"] = &rand_range_float;
 
@@ -27,6 +29,8 @@ void Functions::InitializeDefaultFunctions(ExecutionMethods method)
 	NativeFunctions["to_int"] = &to_int;
 	NativeFunctions["to_float"] = &to_float;
 
+	NativeFunctions["length"] = &length;
+
 	NativeFunctions["abs_float"] = &abs_float;
 	
 	/*NativeFunctions["to_string"] = &to_string;
@@ -41,7 +45,6 @@ void Functions::InitializeDefaultFunctions(ExecutionMethods method)
 	NativeFunctions["to_char"] = &to_char;
 	NativeFunctions["to_ascii_code"] = &to_ascii_code;
 	NativeFunctions["format_string"] = &format_string;
-	NativeFunctions["length"] = &length;
 	NativeFunctions["at"] = &at;
 
 	NativeFunctions["time_now"] = &time_now;*/
@@ -82,15 +85,30 @@ void Functions::InitializeDefaultFunctions(ExecutionMethods method)
 
 	//NativeFunctions["get_key_down"] = &get_key_down;
 
+	// The parser gives function calls the symbol of the name, so they can be looked up without the string
+	NativeFunctionsBySymbol.clear();
+	for (auto& [name, function] : NativeFunctions)
+		NativeFunctionsBySymbol[StringInterner::Get().Intern(name)] = function;
+
 	srand(time(0));
 }
 
-CallableFunction Functions::GetFunctionByName(std::string name)
+CallableFunction Functions::GetFunctionByName(const std::string& name)
+{
+	auto it = NativeFunctions.find(name);
+	if (it == NativeFunctions.end())
+		return nullptr;
+
+	return it->second;
+}
+
+CallableFunction Functions::GetFunctionBySymbol(Symbol symbol)
 {
-	if (NativeFunctions.count(name) == 0)
+	auto it = NativeFunctionsBySymbol.find(symbol);
+	if (it == NativeFunctionsBySymbol.end())
 		return nullptr;
 
-	return (CallableFunction)NativeFunctions[name];
+	return it->second;
 }
 
 void Functions::ThrowException(std::string error)
@@ -144,7 +162,7 @@ Value Functions::_printf(ARGS)
 
 	// Cleanup
 	if (m_ExecutionMethod == ExecutionMethods::Bytecode)
-		Bytecode::BytecodeInterpreter::Get().m_Heap.DeleteObject(formatted.m_HeapEntryPointer);
+		Bytecode::BytecodeInterpreter::Get().m_Heap.DeleteObject(formatted.m_Handle);
 		 
 	return Value(ValueTypes::Void);
 }
@@ -160,7 +178,7 @@ Value Functions::format_string(ARGS)
 		if (m_ExecutionMethod == ExecutionMethods::Bytecode)
 			return Bytecode::BytecodeInterpreter::Get().m_Heap.CreateString(formatted);
 
-		if (m_ExecutionMethod == ExecutionMethods::AST)
+		if (m_ExecutionMethod == ExecutionMethods::AST || m_ExecutionMethod == ExecutionMethods::Closure)
 			return Value(formatted, ValueTypes::String);
 	}
 		
@@ -190,7 +208,7 @@ Value Functions::format_string(ARGS)
 	
 	if (m_ExecutionMethod == ExecutionMethods::Bytecode)
 		return Bytecode::BytecodeInterpreter::Get().m_Heap.CreateString(formatted);
-	if (m_ExecutionMethod == ExecutionMethods::AST)
+	if (m_ExecutionMethod == ExecutionMethods::AST || m_ExecutionMethod == ExecutionMethods::Closure)
 		return Value(formatted, ValueTypes::String);
 }
 
@@ -211,6 +229,15 @@ Value Functions::_time(ARGS)
 	return Value((int)time(0), ValueTypes::Integer);
 }
 
+// Milliseconds since clock() was first called, for timing code from inside a program
+Value Functions::_clock(ARGS)
+{
+	static auto start = std::chrono::steady_clock::now();
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	return Value(elapsed.count(), ValueTypes::Float);
+}
+
 Value Functions::rand_range(ARGS)
 {
 	int min = args[0].GetInt();
@@ -280,5 +307,16 @@ Value Functions::to_float(ARGS)
 	return Value((float)args[0].GetInt(), ValueTypes::Float);
 }
 
+Value Functions::length(ARGS)
+{
+	if (args.size() != 1)
+		return Value::MakeRuntimeError("Function 'length' expects 1 argument, got " + std::to_string(args.size()));
+	if (!args[0].IsString())
+		return Value::MakeRuntimeError("Function 'length' expects a string, got " + ValueTypeToString(args[0].GetType()));
+
+	return Value((int)args[0].GetStringView().size(), ValueTypes::Integer);
+}
+
 std::map<std::string, CallableFunction> Functions::NativeFunctions;
+std::unordered_map<Symbol, CallableFunction> Functions::NativeFunctionsBySymbol;
 ExecutionMethods Functions::m_ExecutionMethod;
\ No newline at end of file
@@ -7,8 +7,10 @@
 #include "../Utils.hpp"
 
 #include <map>
+#include <unordered_map>
 
 #include "Value.h"
+#include "../StringInterner.h"
 
 #define ARGS ValueArray args
 
@@ -17,11 +19,13 @@ typedef Value(*CallableFunction)(ARGS);
 namespace Functions
 {
 	extern std::map<std::string, CallableFunction> NativeFunctions;
+	extern std::unordered_map<Symbol, CallableFunction> NativeFunctionsBySymbol;
 
 	extern ExecutionMethods m_ExecutionMethod;
 
 	void InitializeDefaultFunctions(ExecutionMethods method);
-	CallableFunction GetFunctionByName(std::string name);
+	CallableFunction GetFunctionByName(const std::string& name);
+	CallableFunction GetFunctionBySymbol(Symbol symbol);
 
 	void ThrowException(std::string error);
 
@@ -33,6 +37,7 @@ namespace Functions
 	Value _rand(ARGS);
 	Value _srand(ARGS);
 	Value _time(ARGS);
+	Value _clock(ARGS);
 	Value rand_range(ARGS);
 	//Value rand_range_float(ARGS);
 
@@ -47,6 +52,8 @@ namespace Functions
 	Value to_int(ARGS);
 	Value to_float(ARGS);
 
+	Value length(ARGS);
+
 	//Value srand(ARGS);
 	//Value time(ARGS);
 	/*StackValue to_string(ARGS);
@@ -64,7 +71,6 @@ namespace Functions
 
 	/*StackValue time_now(ARGS);
 
-	StackValue length(ValueArray* args);
 	StackValue at(ValueArray* args);
 
 	StackValue sleep_for(ValueArray* args);*/
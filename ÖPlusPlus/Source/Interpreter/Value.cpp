@@ -5,6 +5,7 @@
 
 
 #include "AST/ASTInterpreter.h"
+#include "Closure/ClosureCompiler.h"
 #include "Bytecode/BytecodeInterpreter.h"
 
 #include "../Utils.hpp"
@@ -13,6 +14,8 @@ Value Value::MakeRuntimeError(std::string error)
 {
 	if (ExecutionMethods_Global::m_Method == ExecutionMethods::AST)
 		return AST::ASTInterpreter::Get().MakeErrorValueReturn(error);
+	if (ExecutionMethods_Global::m_Method == ExecutionMethods::Closure)
+		return Closure::ClosureCompiler::Get().MakeErrorValueReturn(error);
 	if (ExecutionMethods_Global::m_Method == ExecutionMethods::Bytecode)
 		return Bytecode::BytecodeInterpreter::Get().ThrowExceptionValue(error);
 	if (ExecutionMethods_Global::m_Method == ExecutionMethods::Assembly)
@@ -26,6 +29,8 @@ bool Value::MakeRuntimeErrorBool(std::string error)
 {
 	if (ExecutionMethods_Global::m_Method == ExecutionMethods::AST)
 		AST::ASTInterpreter::Get().MakeErrorValueReturn(error);
+	if (ExecutionMethods_Global::m_Method == ExecutionMethods::Closure)
+		Closure::ClosureCompiler::Get().MakeErrorValueReturn(error);
 	if (ExecutionMethods_Global::m_Method == ExecutionMethods::Bytecode)
 		Bytecode::BytecodeInterpreter::Get().ThrowExceptionValue(error);
 	
@@ -57,12 +62,18 @@ Value::Value(std::string value, ValueTypes type)
 	m_StringValue = value;
 }
 
-Value::Value(HeapEntry& value)
+Value::Value(HeapHandle handle)
 {
-	m_HeapEntryPointer = &value;
+	m_Handle = handle;
 
-	if (value.m_Type == 0)
+	HeapEntry* entry = Bytecode::BytecodeInterpreter::Get().m_Heap.Get(handle);
+	assert(entry != nullptr);
+
+	if (entry->m_Type == 0)
+	{
 		m_Type = ValueTypes::StringReference;
+		m_StringLength = entry->m_Length;
+	}
 	/*else if (value.m_Type == 1)
 		m_Type = Value::Array;
 	else if (value.m_Type == 2)
@@ -70,18 +81,31 @@ Value::Value(HeapEntry& value)
 }
 
 std::string Value::GetString()
+{
+	return std::string(GetStringView());
+}
+
+std::string_view Value::GetStringView()
 {
 	assert(IsString());
 
 	if (ExecutionMethods_Global::m_Method == ExecutionMethods::Bytecode)
 	{
+		if (m_Type == ValueTypes::StringReference)
+		{
+			HeapEntry* entry = Bytecode::BytecodeInterpreter::Get().m_Heap.Get(m_Handle);
+			assert(entry != nullptr);
+
+			return std::string_view((char*)entry->m_Data, m_StringLength);
+		}
+
 		if (m_HeapEntryPointer != nullptr)
 			return (char*)(m_HeapEntryPointer)->m_Data;
 
 		return m_StringValue;
 	}
 
-	if (ExecutionMethods_Global::m_Method == ExecutionMethods::AST)
+	if (ExecutionMethods_Global::m_Method == ExecutionMethods::AST || ExecutionMethods_Global::m_Method == ExecutionMethods::Closure)
 		return m_StringValue;
 
 	abort();
@@ -106,7 +130,7 @@ void Value::SetString(std::string value)
 {
 	assert(IsString());
 
-	if (ExecutionMethods_Global::m_Method == ExecutionMethods::AST)
+	if (ExecutionMethods_Global::m_Method == ExecutionMethods::AST || ExecutionMethods_Global::m_Method == ExecutionMethods::Closure)
 	{
 		// TODO: might cause problems
 		m_StringValue = value;
@@ -235,16 +259,8 @@ std::string Value::ToFormattedString(bool extraQuotes, int currentDepth)
 
 void Value::Delete()
 {
-	if (ExecutionMethods_Global::m_Method == ExecutionMethods::Bytecode)
-	{
-		if (IsString())
-		{
-			// Delete the string, because strings aren't stored as a reference to each other. Don't delete constants!!!
-			if (m_Type == ValueTypes::StringReference)
-				Bytecode::BytecodeInterpreter::Get().m_Heap.DeleteObject(m_HeapEntryPointer);
-		}
-	}
-	
+	// The strings on the heap can be in other values too, they are garbage collected
+	m_Handle = HeapHandle();
 	m_Type = ValueTypes::Void;
 }
 
@@ -484,7 +500,7 @@ Value Value::Decrement(Value& value)
 	{
 		return Value(value.GetFloat() - 1.0, ValueTypes::Float);
 	}
-	else if (ExecutionMethods_Global::m_Method == ExecutionMethods::AST)
+	else if (ExecutionMethods_Global::m_Method == ExecutionMethods::AST || ExecutionMethods_Global::m_Method == ExecutionMethods::Closure)
 	{
 		if (value.IsString())
 		{
@@ -500,6 +516,9 @@ Value Value::Decrement(Value& value)
 	return MakeRuntimeError("Unhandled decrement of type " + ValueTypeToString(value.m_Type));
 }
 
+// What std::string keeps inside itself
+static const size_t SmallStringLength = std::string().capacity();
+
 Value Value::Add(Value& lhs, Value& rhs)
 {
 	if (!Value::IsSamePrimitiveType(lhs, rhs))
@@ -515,16 +534,36 @@ Value Value::Add(Value& lhs, Value& rhs)
 	}
 	else if (lhs.IsString() || rhs.IsString())
 	{
+		if (ExecutionMethods_Global::m_Method == ExecutionMethods::Bytecode && lhs.IsString() && rhs.IsString())
+		{
+			Heap& heap = Bytecode::BytecodeInterpreter::Get().m_Heap;
+			std::string_view right = rhs.GetStringView();
+
+			// s = s + x appends to the data of s, as long as nothing else has been appended to it
+			if (lhs.m_Type == ValueTypes::StringReference)
+				return Value(heap.AppendString(lhs.m_Handle, lhs.m_StringLength, right));
+
+			// Short strings stay in the value, std::string keeps them without allocating and they don't have to be collected
+			std::string_view left = lhs.GetStringView();
+			if (left.size() + right.size() <= SmallStringLength)
+				return Value(std::string(left) + std::string(right), ValueTypes::String);
+		}
+
 		std::string appended;
 		if (lhs.IsString() && rhs.IsString())
-			appended = std::string(lhs.GetString()) + std::string(rhs.GetString());
+		{
+			appended = lhs.GetStringView();
+			appended += rhs.GetStringView();
+		}
 		/*else if (lhs.IsString() && rhs.IsChar())
 			appended = std::string(lhs.GetString()) + std::string(1, (char)rhs.m_Value);
 		else if (lhs.IsString() && rhs.IsChar())
 			appended = std::string(lhs.GetString()) + std::string(1, (char)rhs.m_Value);*/
 
-			// Allocate a new object in the heap that stores the string
-		//HeapEntry& newObject = BytecodeInterpreter::Get().m_Heap.CreateString(appended);
+		// Allocate a new object in the heap that stores the string
+		if (ExecutionMethods_Global::m_Method == ExecutionMethods::Bytecode)
+			return Value(Bytecode::BytecodeInterpreter::Get().m_Heap.CreateString(appended));
+
 		return Value(appended, ValueTypes::String);
 	}
 
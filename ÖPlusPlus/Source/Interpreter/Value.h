@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <map>
 
 #include "ValueTypes.h"
@@ -18,11 +19,14 @@ public:
 	Value(double value, ValueTypes type);
 	Value(std::string value, ValueTypes type);
 
-	Value(HeapEntry& value);
+	Value(HeapHandle handle);
 	Value(HeapEntry& value, ValueTypes type) : m_HeapEntryPointer(&value), m_Type(type) {};
 
 	std::string GetString();
 	int& GetInt();
+
+	// The string without copying it, it's only valid until the heap or the value changes
+	std::string_view GetStringView();
 	double& GetFloat();
 
 	void SetString(std::string value);
@@ -78,8 +82,12 @@ public:
 
 	Flags m_Flag = Flags::None;
 
-	// Bytecode
+	// Bytecode. The string constants aren't on the heap, they are pointed to directly
 	HeapEntry* m_HeapEntryPointer = nullptr;
+	HeapHandle m_Handle;
+
+	// The strings that were appended to share the data with the longer ones, so the length of this one is in the value
+	uint32_t m_StringLength = 0;
 
 	// ASM
 	std::string m_Name = "";
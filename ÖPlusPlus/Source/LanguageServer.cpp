@@ -0,0 +1,477 @@
+#include "LanguageServer.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+#include "LexerScanning.h"
+
+using json = nlohmann::json;
+
+// The JSON-RPC error codes
+static const int ParseErrorCode = -32700;
+static const int MethodNotFoundCode = -32601;
+static const int InvalidParamsCode = -32602;
+
+int LanguageServer::Run(std::istream& input, std::ostream& output)
+{
+	m_Output = &output;
+
+	std::string message;
+	while (!m_HasExited && ReadMessage(input, message))
+	{
+		json request = json::parse(message, nullptr, false);
+		if (request.is_discarded() || !request.is_object())
+		{
+			WriteMessage({ { "jsonrpc", "2.0" }, { "id", nullptr }, { "error", { { "code", ParseErrorCode }, { "message", "Couldn't parse the message" } } } });
+			continue;
+		}
+
+		bool isRequest = request.contains("id");
+		std::string method = request.value("method", "");
+
+		std::string error;
+		int errorCode = InvalidParamsCode;
+		json result;
+		std::string rawResult;
+
+		// The library throws when a field is missing or has the wrong type, that is the editor's mistake so it's returned as an error
+		try
+		{
+			result = HandleMessage(method, request.value("params", json::object()), error, rawResult);
+		}
+		catch (const json::exception& exception)
+		{
+			error = std::string("Invalid parameters: ") + exception.what();
+		}
+
+		if (error == "" && result.is_discarded())
+		{
+			errorCode = MethodNotFoundCode;
+			error = "Unknown method " + method;
+		}
+
+		if (!isRequest)
+			continue;
+
+		if (error == "" && rawResult != "")
+		{
+			WriteBody("{\"jsonrpc\":\"2.0\",\"id\":" + request["id"].dump() + ",\"result\":" + rawResult + "}");
+			continue;
+		}
+
+		json response = { { "jsonrpc", "2.0" }, { "id", request["id"] } };
+		if (error != "")
+			response["error"] = { { "code", errorCode }, { "message", error } };
+		else
+			response["result"] = result;
+
+		WriteMessage(response);
+	}
+
+	// Exiting without a shutdown request first is an error in the protocol
+	return m_IsShutDown ? 0 : 1;
+}
+
+// Adds the text as a JSON string. Bytes that aren't valid UTF-8 are replaced, like the JSON library does
+static void AppendJsonString(std::string& json, std::string_view text)
+{
+	json += '"';
+
+	for (int i = 0; i < text.length(); i++)
+	{
+		unsigned char c = text[i];
+
+		if (c == '"') json += "\\\"";
+		else if (c == '\\') json += "\\\\";
+		else if (c == '\n') json += "\\n";
+		else if (c == '\r') json += "\\r";
+		else if (c == '\t') json += "\\t";
+		else if (c == '\b') json += "\\b";
+		else if (c == '\f') json += "\\f";
+		else if (c < 0x20)
+		{
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			json += escaped;
+		}
+		else if (c < 0x80)
+			json += c;
+		else
+		{
+			int length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+			std::string_view character = text.substr(i, length);
+
+			if (character.length() == length && Scanning::FindInvalidUTF8(character, false) == length)
+			{
+				json.append(character);
+				i += length - 1;
+			}
+			else
+				json += "\xEF\xBF\xBD";
+		}
+	}
+
+	json += '"';
+}
+
+std::string LanguageServer::TokensToJson(std::vector<Token>& tokens, std::string_view source, int start, int end)
+{
+	// There can be hundreds of thousands of tokens, it's a lot faster to write the text than to build it with the JSON library
+	std::string json;
+	json.reserve(std::min((size_t)(end - start), tokens.size()) * 48);
+
+	json += '[';
+	for (int i = 0; i < tokens.size(); i++)
+	{
+		if (tokens[i].m_Offset < start || tokens[i].m_Offset >= end)
+			continue;
+
+		if (json.length() > 1)
+			json += ',';
+
+		json += "{\"index\":" + std::to_string(tokens[i].m_Offset) + ",\"type\":";
+		AppendJsonString(json, tokens[i].ToString());
+		json += ",\"value\":";
+		AppendJsonString(json, tokens[i].GetValue(source));
+		json += '}';
+	}
+	json += ']';
+
+	return json;
+}
+
+bool LanguageServer::ReadMessage(std::istream& input, std::string& message)
+{
+	// The headers end with an empty line, only Content-Length matters
+	int length = -1;
+	std::string header;
+	while (std::getline(input, header))
+	{
+		if (!header.empty() && header.back() == '\r')
+			header.pop_back();
+
+		if (header.empty())
+			break;
+
+		const char* name = "Content-Length:";
+		if (header.compare(0, strlen(name), name) == 0)
+			length = atoi(header.c_str() + strlen(name));
+	}
+
+	if (!input || length < 0)
+		return false;
+
+	message.resize(length);
+	input.read(message.data(), length);
+
+	return input.gcount() == length;
+}
+
+void LanguageServer::WriteMessage(const json& message)
+{
+	// The token values and the messages can have text that isn't UTF-8, like a file saved as Latin-1
+	WriteBody(message.dump(-1, ' ', false, json::error_handler_t::replace));
+}
+
+void LanguageServer::WriteBody(const std::string& body)
+{
+	*m_Output << "Content-Length: " << body.length() << "\r\n\r\n" << body;
+	m_Output->flush();
+}
+
+json LanguageServer::HandleMessage(const std::string& method, const json& params, std::string& error, std::string& rawResult)
+{
+	if (method == "initialize")
+	{
+		// Incremental changes, the diagnostics are both pushed after every change and can be requested
+		json capabilities = {
+			{ "textDocumentSync", { { "openClose", true }, { "change", 2 } } },
+			{ "diagnosticProvider", { { "interFileDependencies", false }, { "workspaceDiagnostics", false } } }
+		};
+
+		return { { "capabilities", capabilities }, { "serverInfo", { { "name", "oplusplus" } } } };
+	}
+	if (method == "initialized" || method == "$/setTrace" || method == "$/cancelRequest")
+		return nullptr;
+
+	if (method == "shutdown")
+	{
+		m_IsShutDown = true;
+		return nullptr;
+	}
+	if (method == "exit")
+	{
+		m_HasExited = true;
+		return nullptr;
+	}
+
+	if (method == "textDocument/didOpen")
+	{
+		const json& textDocument = params.at("textDocument");
+		std::string uri = textDocument.at("uri");
+
+		Document& document = m_Documents[uri];
+		document.m_Text = textDocument.at("text");
+		document.m_Version = textDocument.value("version", 0);
+		UpdateLineStarts(document);
+
+		Analyze(document);
+		PublishDiagnostics(uri, &document);
+		return nullptr;
+	}
+	if (method == "textDocument/didChange")
+	{
+		Document* document = FindDocument(params, error);
+		if (!document)
+			return nullptr;
+
+		for (const json& change : params.at("contentChanges"))
+			ApplyChange(*document, change);
+
+		document->m_Version = params.at("textDocument").value("version", document->m_Version);
+
+		PublishDiagnostics(params.at("textDocument").at("uri"), document);
+		return nullptr;
+	}
+	if (method == "textDocument/didClose")
+	{
+		std::string uri = params.at("textDocument").at("uri");
+		m_Documents.erase(uri);
+
+		// The editor keeps showing the last diagnostics unless they're cleared
+		PublishDiagnostics(uri, nullptr);
+		return nullptr;
+	}
+
+	if (method == "textDocument/diagnostic")
+	{
+		Document* document = FindDocument(params, error);
+		if (!document)
+			return nullptr;
+
+		return { { "kind", "full" }, { "items", DiagnosticsToJson(*document) } };
+	}
+	if (method == "oplusplus/tokens")
+	{
+		Document* document = FindDocument(params, error);
+		if (!document)
+			return nullptr;
+
+		// The editor can ask for only the lines that are visible
+		int start = 0;
+		int end = INT32_MAX;
+		if (params.contains("range"))
+		{
+			start = PositionToOffset(*document, params["range"].at("start"));
+			end = PositionToOffset(*document, params["range"].at("end"));
+		}
+
+		rawResult = TokensToJson(document->m_Lexer.m_Tokens, document->m_Text, start, end);
+		return nullptr;
+	}
+
+	return json(json::value_t::discarded);
+}
+
+LanguageServer::Document* LanguageServer::FindDocument(const json& params, std::string& error)
+{
+	std::string uri = params.at("textDocument").at("uri");
+
+	auto it = m_Documents.find(uri);
+	if (it == m_Documents.end())
+	{
+		error = "The document " + uri + " isn't open";
+		return nullptr;
+	}
+
+	return &it->second;
+}
+
+void LanguageServer::ApplyChange(Document& document, const json& change)
+{
+	std::string text = change.at("text");
+
+	// A change without a range replaces the whole text
+	int start = 0;
+	int end = (int)document.m_Text.length();
+
+	if (change.contains("range"))
+	{
+		start = PositionToOffset(document, change["range"].at("start"));
+		end = PositionToOffset(document, change["range"].at("end"));
+		if (end < start)
+			std::swap(start, end);
+	}
+
+	document.m_Text.replace(start, end - start, text);
+
+	// The next change in the same message has positions in the changed text, and the tokens are updated one change at a time
+	UpdateLineStarts(document);
+	AnalyzeChange(document, start, end - start, (int)text.length());
+}
+
+void LanguageServer::UpdateLineStarts(Document& document)
+{
+	document.m_LineStarts.clear();
+	document.m_LineStarts.push_back(0);
+	for (const char* c = document.m_Text.data(); (c = (const char*)memchr(c, '\n', document.m_Text.data() + document.m_Text.length() - c)); c++)
+		document.m_LineStarts.push_back((int)(c - document.m_Text.data()) + 1);
+}
+
+void LanguageServer::Analyze(Document& document)
+{
+	document.m_CodeTokens.clear();
+	document.m_Parser.reset();
+
+	// The tokens for the editor and the parser come from the same lexing, the parser just doesn't get the comments
+	std::string error = document.m_Lexer.CreateTokens(document.m_Text, true);
+
+	// Errors at the end of the source, like an unclosed scope, still give all the tokens. Then the tree is kept up to date too,
+	// so that it's there to be updated when the error is fixed
+	if (document.m_Lexer.m_IsComplete)
+	{
+		document.m_CodeTokens = RemoveCommentTokens(document.m_Lexer.m_Tokens);
+
+		document.m_Parser = std::make_unique<Parser>();
+		document.m_Parser->CreateEditableProgram(document.m_CodeTokens, document.m_Text);
+	}
+
+	UpdateDiagnostics(document, error);
+}
+
+void LanguageServer::AnalyzeChange(Document& document, int changeOffset, int removedLength, int insertedLength)
+{
+	Lexer& lexer = document.m_Lexer;
+	Parser* parser = document.m_Parser.get();
+
+	// The replaced lines stay in the arena, so the tree is made again once they take up more of it than the lines in use
+	if (!m_IsIncremental || !parser || parser->m_Arena.GetNodeCount() > parser->m_ProgramNodeCount * 2 + 4096)
+	{
+		Analyze(document);
+		return;
+	}
+
+	std::string error = lexer.UpdateTokens(document.m_Text, changeOffset, removedLength, insertedLength);
+	if (!lexer.m_IsComplete)
+	{
+		document.m_CodeTokens.clear();
+		document.m_Parser.reset();
+
+		UpdateDiagnostics(document, error);
+		return;
+	}
+
+	// The code tokens are replaced in the same part as the tokens, nothing is open at its ends so they are in order there
+	const Lexer::TokenUpdate& update = lexer.m_LastUpdate;
+	auto findOffset = [](std::vector<Token>& tokens, int offset) {
+		return (int)(std::partition_point(tokens.begin(), tokens.end(), [&](const Token& token) { return (int)token.m_Offset < offset; }) - tokens.begin());
+	};
+
+	std::vector<Token>& codeTokens = document.m_CodeTokens;
+	int begin = findOffset(codeTokens, update.m_Start);
+	int oldEnd = findOffset(codeTokens, update.m_OldEnd);
+
+	std::vector<Token> changedTokens = RemoveCommentTokens(lexer.m_Tokens, findOffset(lexer.m_Tokens, update.m_Start), findOffset(lexer.m_Tokens, update.m_NewEnd));
+
+	int shift = update.m_NewEnd - update.m_OldEnd;
+	for (int i = oldEnd; i < codeTokens.size(); i++)
+		codeTokens[i].m_Offset += shift;
+
+	ReplaceTokens(codeTokens, begin, oldEnd, changedTokens.data(), (int)changedTokens.size());
+
+	parser->UpdateProgram(codeTokens, document.m_Text, begin, oldEnd, begin + (int)changedTokens.size());
+
+	UpdateDiagnostics(document, error);
+}
+
+void LanguageServer::UpdateDiagnostics(Document& document, const std::string& lexerError)
+{
+	document.m_Diagnostics.clear();
+
+	// The parser errors are usually caused by the lexer error, so they're only shown without one
+	if (lexerError != "")
+	{
+		int offset = std::min(document.m_Lexer.m_Position, (int)document.m_Text.length());
+		document.m_Diagnostics.push_back({ offset, lexerError });
+	}
+	// The parser doesn't keep track of where its errors are
+	else if (document.m_Parser && document.m_Parser->m_Error != "")
+	{
+		document.m_Diagnostics.push_back({ 0, document.m_Parser->m_Error });
+	}
+}
+
+void LanguageServer::PublishDiagnostics(const std::string& uri, Document* document)
+{
+	json params = { { "uri", uri }, { "diagnostics", document ? DiagnosticsToJson(*document) : json::array() } };
+	if (document)
+		params["version"] = document->m_Version;
+
+	WriteMessage({ { "jsonrpc", "2.0" }, { "method", "textDocument/publishDiagnostics" }, { "params", params } });
+}
+
+json LanguageServer::DiagnosticsToJson(Document& document)
+{
+	json diagnostics = json::array();
+
+	for (Diagnostic& diagnostic : document.m_Diagnostics)
+	{
+		int end = std::min(diagnostic.m_Offset + 1, (int)document.m_Text.length());
+
+		json range = { { "start", OffsetToPosition(document, diagnostic.m_Offset) }, { "end", OffsetToPosition(document, end) } };
+		diagnostics.push_back({ { "range", range }, { "severity", 1 }, { "source", "oplusplus" }, { "message", diagnostic.m_Message } });
+	}
+
+	return diagnostics;
+}
+
+// The number of bytes in the UTF-8 character that starts with the byte, and how many UTF-16 characters it is
+static void UTF8CharacterSize(unsigned char first, int& bytes, int& units)
+{
+	bytes = first >= 0xF0 ? 4 : first >= 0xE0 ? 3 : first >= 0xC0 ? 2 : 1;
+	units = bytes == 4 ? 2 : 1;
+}
+
+int LanguageServer::PositionToOffset(Document& document, const json& position)
+{
+	int line = position.at("line");
+	int character = position.at("character");
+
+	if (line < 0)
+		return 0;
+	if (line >= document.m_LineStarts.size())
+		return (int)document.m_Text.length();
+
+	int offset = document.m_LineStarts[line];
+	int units = 0;
+
+	// Positions after the end of the line are at the end of it
+	while (units < character && offset < document.m_Text.length() && document.m_Text[offset] != '\n')
+	{
+		int bytes, characterUnits;
+		UTF8CharacterSize(document.m_Text[offset], bytes, characterUnits);
+
+		offset = std::min(offset + bytes, (int)document.m_Text.length());
+		units += characterUnits;
+	}
+
+	return offset;
+}
+
+json LanguageServer::OffsetToPosition(Document& document, int offset)
+{
+	int line = (int)(std::upper_bound(document.m_LineStarts.begin(), document.m_LineStarts.end(), offset) - document.m_LineStarts.begin()) - 1;
+
+	int units = 0;
+	for (int i = document.m_LineStarts[line]; i < offset;)
+	{
+		int bytes, characterUnits;
+		UTF8CharacterSize(document.m_Text[i], bytes, characterUnits);
+
+		i += bytes;
+		units += characterUnits;
+	}
+
+	return { { "line", line }, { "character", units } };
+}
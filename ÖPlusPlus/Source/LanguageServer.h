@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "json.hpp"
+
+#include "Lexer.h"
+#include "Parser.h"
+
+// Keeps the open documents in memory and answers the editor over JSON-RPC on stdin and stdout, so that the editor doesn't have to
+// start the program again with -tokens for every request. The messages are framed like in the Language Server Protocol,
+// with a Content-Length header before each one. A document is lexed and parsed once when it changes, the requests use the results
+class LanguageServer
+{
+public:
+	struct Diagnostic
+	{
+		// Where in the text the error is
+		int m_Offset = 0;
+		std::string m_Message;
+	};
+
+	struct Document
+	{
+		std::string m_Text;
+		int m_Version = 0;
+
+		// The offset of the start of each line, for converting between offsets and the line and character positions of the editor
+		std::vector<int> m_LineStarts;
+
+		// The tokens include the comments and new lines for highlighting, the parser gets the code tokens without them
+		Lexer m_Lexer;
+		std::vector<Token> m_CodeTokens;
+		std::unique_ptr<Parser> m_Parser;
+
+		std::vector<Diagnostic> m_Diagnostics;
+	};
+
+	// Handles messages until the editor sends exit or the input ends, and returns the exit code
+	int Run(std::istream& input, std::ostream& output);
+
+	// The JSON text of the tokens that start between the offsets, in the same format as the -tokens argument prints them
+	static std::string TokensToJson(std::vector<Token>& tokens, std::string_view source, int start = 0, int end = INT32_MAX);
+
+private:
+	bool ReadMessage(std::istream& input, std::string& message);
+	void WriteMessage(const nlohmann::json& message);
+	void WriteBody(const std::string& body);
+
+	// Returns the result of a request, notifications return null. Errors are returned as a string in error.
+	// Large results can be given as JSON text in rawResult instead, then the returned value isn't used
+	nlohmann::json HandleMessage(const std::string& method, const nlohmann::json& params, std::string& error, std::string& rawResult);
+
+	Document* FindDocument(const nlohmann::json& params, std::string& error);
+
+	void ApplyChange(Document& document, const nlohmann::json& change);
+	void UpdateLineStarts(Document& document);
+
+	// Lexes and parses the whole document
+	void Analyze(Document& document);
+
+	// After a part of the text was replaced, only lexes the tokens around it again and only parses the top-level lines that they are in
+	void AnalyzeChange(Document& document, int changeOffset, int removedLength, int insertedLength);
+
+	// The lexer error, or the parser error if there is none
+	void UpdateDiagnostics(Document& document, const std::string& lexerError);
+	void PublishDiagnostics(const std::string& uri, Document* document);
+
+	nlohmann::json DiagnosticsToJson(Document& document);
+
+	// The positions are lines and UTF-16 characters like in the protocol
+	int PositionToOffset(Document& document, const nlohmann::json& position);
+	nlohmann::json OffsetToPosition(Document& document, int offset);
+
+private:
+	std::ostream* m_Output = nullptr;
+
+	std::unordered_map<std::string, Document> m_Documents;
+
+	bool m_IsShutDown = false;
+	bool m_HasExited = false;
+
+public:
+	// If false, every change lexes and parses the whole document again. Only the edit benchmark turns it off
+	bool m_IsIncremental = true;
+};
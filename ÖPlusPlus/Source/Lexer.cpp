@@ -1,11 +1,13 @@
 #include "Lexer.h"
+#include "LexerScanning.h"
 
 #include <string>
 #include <sstream>
+#include <algorithm>
 
 std::string Token::ToString()
 {
-	std::string names[] = {
+	static const char* names[] = {
 		"Empty",
 		"VoidType",
 		"IntType",
@@ -75,16 +77,36 @@ std::string Token::ToString()
 		"Break",
 		"Continue",
 		"Return",
-		"Global"
+		"Global",
+		"Import",
+		"Export"
 	};
 
 	return names[(int)m_Type];
 }
 
+std::string_view Token::GetValue(std::string_view source) const
+{
+	if (m_Type == StringLiteral)
+		return StringInterner::Get().GetString(m_Symbol);
+
+	// true and false are integer literals, but the text is still the keyword
+	if (m_Type == IntLiteral && m_Length > 0 && (source[m_Offset] == 't' || source[m_Offset] == 'f'))
+		return source[m_Offset] == 't' ? "1" : "0";
+
+	return source.substr(m_Offset, m_Length);
+}
+
+// isdigit() and isalpha() can't be given the negative chars that UTF-8 characters are made of
+bool IsDigit(char ch)
+{
+	return ch >= '0' && ch <= '9';
+}
+
 bool IsValidNumberChar(char ch)
 {
 	if (ch == ' ') return false;
-	if (isdigit(ch) || ch == '.' || ch == '-')
+	if (IsDigit(ch) || ch == '.' || ch == '-')
 		return true;
 
 	return false;
@@ -92,16 +114,21 @@ bool IsValidNumberChar(char ch)
 bool IsValidVariableChar(char ch)
 {
 	if (ch == ' ') return false;
-	if (isalpha(ch) || ch == '_')
+
+	// Names can have any non-ASCII characters, the source is checked to be valid UTF-8
+	if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_' || (unsigned char)ch >= 0x80)
 		return true;
 	return false;
 }
-bool IsValidNumberPart(const std::string& string, int index, std::string& error)
+bool IsValidNumberPart(std::string_view string, int index, std::string& error)
 {
+	if (index >= string.length())
+		return false;
+
 	// 5....1;
 	char current = string[index];
 
-	if (isdigit(current))
+	if (IsDigit(current))
 		return true;
 
 	// At end or start
@@ -111,13 +138,13 @@ bool IsValidNumberPart(const std::string& string, int index, std::string& error)
 		{
 			if (current == '-')
 			{
-				if (isdigit(string[index + 1]))
+				if (string.length() > 1 && IsDigit(string[index + 1]))
 					return true;
 				return false;
 			}
 			if (current == '.')
 			{
-				if (isdigit(string[index + 1]))
+				if (string.length() > 1 && IsDigit(string[index + 1]))
 					return true;
 				error = "Expected number after decimal point";
 				return false;
@@ -136,13 +163,13 @@ bool IsValidNumberPart(const std::string& string, int index, std::string& error)
 				return false;
 			}
 
-			return isdigit(current);
+			return IsDigit(current);
 		}
 	}
 	else
 	{
 		// Walk backwards and check if this variable part is actually valid
-		if (isdigit(current))
+		if (IsDigit(current))
 			return true;
 
 		if (current == '.')
@@ -195,7 +222,7 @@ bool IsValidNumberPart(const std::string& string, int index, std::string& error)
 			}
 
 			// If previous is a digit, then that means a minus sign is inside a number, which is not allowed
-			if (isdigit(string[index - 1]))
+			if (IsDigit(string[index - 1]))
 				return false;
 
 			// If previous is a space or the previous is a variable
@@ -230,8 +257,11 @@ bool IsValidNumberPart(const std::string& string, int index, std::string& error)
 
 	return false;
 }
-bool IsValidVariablePart(std::string string, int index, std::string& error)
+bool IsValidVariablePart(std::string_view string, int index, std::string& error)
 {
+	if (index >= string.length())
+		return false;
+
 	char current = string[index];
 
 	// At end or start
@@ -243,7 +273,7 @@ bool IsValidVariablePart(std::string string, int index, std::string& error)
 		// Check if prev char exists, and if so if its a variable
 		if (index > 0)
 		{
-			if (isdigit(current) && IsValidVariablePart(string, index - 1, error))
+			if (IsDigit(current) && IsValidVariablePart(string, index - 1, error))
 				return true;
 		}
 	}
@@ -258,106 +288,117 @@ bool IsValidVariablePart(std::string string, int index, std::string& error)
 		if (!IsValidVariablePart(string, index - 1, error) && !IsValidVariableChar(string[index + 1]))
 			return false;
 
-		if (isdigit(current) && IsValidVariablePart(string, index - 1, error))
+		if (IsDigit(current) && IsValidVariablePart(string, index - 1, error))
 			return true;
 
-		if (isdigit(current))
+		if (IsDigit(current))
 			error = "Variable name cannot start with a number";
 	}
 
 	return false;
 }
 
-bool IsValidIncrement(const std::string& string, int index) 
+bool IsValidIncrement(std::string_view string, int index)
 {
 	if (index < string.length() - 1)
 		return (string[index] == '+' && string[index + 1] == '+');
 	return false;
 }
 
-bool IsValidDecrement(const std::string& string, int index)
+bool IsValidDecrement(std::string_view string, int index)
 {
 	if (index < string.length() - 1)
 		return (string[index] == '-' && string[index + 1] == '-');
 	return false;
 }
 
-std::vector<std::string> split(const std::string& txt, char ch)
+void ResolveTokenKeyword(Token& token, std::string_view value)
 {
-	std::vector<std::string> strs;
-	size_t pos = txt.find(ch);
-	size_t initialPos = 0;
-	strs.clear();
-
-	// Decompose statement
-	while (pos != std::string::npos) {
-		strs.push_back(txt.substr(initialPos, pos - initialPos));
-		initialPos = pos + 1;
+	if (token.m_Type != Token::Variable)
+		return;
 
-		pos = txt.find(ch, initialPos);
-	}
-
-	// Add the last one
-	strs.push_back(txt.substr(initialPos, std::min(pos, txt.size()) - initialPos + 1));
-
-	return strs;
-}
-
-Token ResolveTokenKeyword(Token tok)
-{
-	Token token = tok;
-	if (token.m_Value == "void")
+	if (value == "void")
 		token.m_Type = Token::VoidType;
-	if (token.m_Value == "int")
+	else if (value == "int")
 		token.m_Type = Token::IntType;
-	else if (token.m_Value == "float")
+	else if (value == "float")
 		token.m_Type = Token::FloatType;
-	else if (token.m_Value == "double")
+	else if (value == "double")
 		token.m_Type = Token::DoubleType;
-	else if (token.m_Value == "string")
+	else if (value == "string")
 		token.m_Type = Token::StringType;
-	else if (token.m_Value == "char")
+	else if (value == "char")
 		token.m_Type = Token::CharType;
 
-	else if (token.m_Value == "return")
+	else if (value == "return")
 		token.m_Type = Token::Return;
-	else if (token.m_Value == "if")
+	else if (value == "if")
 		token.m_Type = Token::If;
-	else if (token.m_Value == "else")
+	else if (value == "else")
 		token.m_Type = Token::Else;
-	else if (token.m_Value == "while")
+	else if (value == "while")
 		token.m_Type = Token::While;
-	else if (token.m_Value == "for")
+	else if (value == "for")
 		token.m_Type = Token::For;
-	else if (token.m_Value == "continue")
+	else if (value == "continue")
 		token.m_Type = Token::Continue;
-	else if (token.m_Value == "break")
+	else if (value == "break")
 		token.m_Type = Token::Break;
-	else if (token.m_Value == "global")
+	else if (value == "global")
 		token.m_Type = Token::Global;
-	else if (token.m_Value == "and")
+	else if (value == "import")
+		token.m_Type = Token::Import;
+	else if (value == "export")
+		token.m_Type = Token::Export;
+	else if (value == "and")
 		token.m_Type = Token::And;
-	else if (token.m_Value == "or")
+	else if (value == "or")
 		token.m_Type = Token::Or;
-	else if (token.m_Value == "not")
+	else if (value == "not")
 		token.m_Type = Token::Not;
-	else if (token.m_Value == "xor")
+	else if (value == "xor")
 		token.m_Type = Token::Xor;
-	else if (token.m_Value == "mod")
+	else if (value == "mod")
 		token.m_Type = Token::Modulus;
 
-	// Convert boolean tokens 'true' and 'false' to numbers
-	if (token.m_Type == Token::Variable && (token.m_Value == "true" || token.m_Value == "false"))
+	// Boolean tokens 'true' and 'false' are numbers, Token::GetValue() gives 1 or 0 for them
+	else if (value == "true" || value == "false")
+		token.m_Type = Token::IntLiteral;
+}
+
+// The contents of a string literal are only copied if they have escaped characters
+Symbol InternStringLiteral(std::string_view contents)
+{
+	if (contents.find('\\') == std::string_view::npos)
+		return StringInterner::Get().Intern(contents);
+
+	std::string string;
+	string.reserve(contents.length());
+
+	for (int i = 0; i < contents.length(); i++)
 	{
-		if (token.m_Value == "true")
-			token.m_Value = "1";
-		else
-			token.m_Value = "0";
+		if (contents[i] != '\\')
+		{
+			string += contents[i];
+			continue;
+		}
 
-		token.m_Type = Token::IntLiteral;
+		// Todo: add more escapes perhaps
+		char next = i + 1 < contents.length() ? contents[i + 1] : 0;
+		if (next == 'n')
+			string += '\n';
+		else if (next == 'r')
+			string += '\r';
+		else if (next == '\'')
+			string += '\'';
+		else if (next == '\"')
+			string += '\"';
+		else if (next == '\\')
+			string += '\\';
+		i++;
 	}
-	
-	return token;
+
+	return StringInterner::Get().Intern(string);
 }
 
 char Lexer::ConsumeNext()
@@ -401,6 +442,11 @@ int Lexer::TotalDepth()
 	return m_ParenthesisParsingDepth + m_ScopeParsingDepth;
 }
 
+static bool IsCommentToken(const Token& token)
+{
+	return token.m_Type == Token::SingleLineComment || token.m_Type == Token::MultiLineComment || token.m_Type == Token::NewLine;
+}
+
 Token Lexer::AddToken(Token token, int customDepth)
 {
 	if (token.m_Type == Token::Empty)
@@ -408,40 +454,365 @@ Token Lexer::AddToken(Token token, int customDepth)
 
 	token.m_Depth = customDepth == -1 ? TotalDepth() : customDepth;
 
+	// String literals are interned when they end, since the escapes have to be replaced
+	if (token.m_Type == Token::Variable || token.m_Type == Token::FunctionName)
+		token.m_Symbol = StringInterner::Get().Intern(token.GetValue(m_Source));
+
+	if (!IsCommentToken(token))
+		m_LastCodeToken = (int)m_Tokens.size();
+
 	m_Tokens.push_back(token);
-	return Token(/*Token::Empty, token.m_StartPosition + 1*/);
+	return Token(/*Token::Empty, token.m_Offset + 1*/);
+}
+
+Token* Lexer::LastCodeToken()
+{
+	return m_LastCodeToken == -1 ? nullptr : &m_Tokens[m_LastCodeToken];
+}
+
+void ReplaceTokens(std::vector<Token>& tokens, int begin, int end, const Token* newTokens, int newCount)
+{
+	int oldCount = end - begin;
+	int common = std::min(oldCount, newCount);
+
+	std::copy(newTokens, newTokens + common, tokens.begin() + begin);
+
+	if (newCount > oldCount)
+		tokens.insert(tokens.begin() + end, newTokens + common, newTokens + newCount);
+	else if (newCount < oldCount)
+		tokens.erase(tokens.begin() + begin + newCount, tokens.begin() + end);
+}
+
+std::vector<Token> RemoveCommentTokens(const std::vector<Token>& tokens)
+{
+	return RemoveCommentTokens(tokens, 0, (int)tokens.size());
+}
+
+std::vector<Token> RemoveCommentTokens(const std::vector<Token>& tokens, int begin, int end)
+{
+	std::vector<Token> codeTokens;
+	codeTokens.reserve(end - begin);
+
+	for (int i = begin; i < end; i++)
+	{
+		if (!IsCommentToken(tokens[i]))
+			codeTokens.push_back(tokens[i]);
+	}
+
+	return codeTokens;
 }
 
 std::string Lexer::MakeError(const std::string& message)
 {
-	int lineIndex = m_Position;
-	for (int i = 0; i < m_CurrentLine; i++)
+	// The line and column are only needed here, so they're counted from the position instead of while lexing
+	int line = 1;
+	int lineStart = 0;
+	for (int i = 0; i < m_Position && i < m_Source.length(); i++)
 	{
-		if (m_Lines[i].length() == 0)
-			lineIndex--;
-		else
-			lineIndex -= m_Lines[i].length() + 1;
+		if (m_Source[i] == '\n')
+		{
+			line++;
+			lineStart = i + 1;
+		}
+	}
+
+	return std::to_string(line) + ":" + std::to_string(m_Position - lineStart + 1) + " " + message;
+}
+
+std::string Lexer::CreateTokens(std::string_view source, bool createCommentTokens)
+{
+	m_Source = source;
+	m_CreateCommentTokens = createCommentTokens;
+
+	// The programs have a token every two to five characters, so the vector doesn't have to grow while lexing
+	m_Tokens.clear();
+	m_Tokens.reserve(source.length() / 2 + 16);
+	m_LastCodeToken = -1;
+
+	// Strings and comments can still have text in other encodings, the names are checked if this is false
+	m_IsValidUTF8 = Scanning::FindInvalidUTF8(source, m_UseVectorScanning) == source.length();
+
+	m_ParenthesisParsingDepth = 0;
+	m_ScopeParsingDepth = 0;
+	m_IsInSingleLineComment = false;
+	m_IsMultilineComment = false;
+	m_IsInString = false;
+
+	m_LastUpdate = TokenUpdate();
+
+	std::string error = Lex(0, nullptr);
+	if (error != "")
+		return error;
+
+	return CheckEndOfSource();
+}
+
+std::string Lexer::CreateChunkTokens(std::string_view source, int start, const std::vector<int>& stops, bool isValidUTF8)
+{
+	m_Source = source;
+	m_CreateCommentTokens = false;
+
+	int end = stops.empty() ? (int)source.length() : stops[0];
+
+	m_Tokens.clear();
+	m_Tokens.reserve((end - start) / 2 + 16);
+	m_LastCodeToken = -1;
+
+	m_IsValidUTF8 = isValidUTF8;
+
+	m_ParenthesisParsingDepth = 0;
+	m_ScopeParsingDepth = 0;
+	m_IsInSingleLineComment = false;
+	m_IsMultilineComment = false;
+	m_IsInString = false;
+
+	m_LastUpdate = TokenUpdate();
+
+	// The tokens after a semicolon are lexed differently than the first ones in the source, so the one that the chunk starts after is added first
+	if (start > 0)
+		AddToken(Token(Token::Semicolon, start - 1, source[start - 1] == ';' ? 1 : 0), 0);
+
+	std::string error = Lex(start, nullptr, &stops);
+
+	// The semicolon is in the chunk before
+	if (start > 0)
+	{
+		m_Tokens.erase(m_Tokens.begin());
+		m_LastCodeToken--;
 	}
 
-	return std::to_string(m_CurrentLine) + ":" + std::to_string(lineIndex + 1) + " " + message;
+	return error;
 }
 
-std::string Lexer::CreateTokens(const std::string& source, bool createCommentTokens)
+void Lexer::AppendChunk(const Lexer& chunk)
 {
-	m_Lines = split(source, '\n');
-	for (int i = 0; i < m_Lines.size(); i++)
+	// A chunk that has no code tokens of its own continues after the last one of this
+	if (chunk.m_LastCodeToken != -1)
+		m_LastCodeToken = (int)m_Tokens.size() + chunk.m_LastCodeToken;
+
+	m_Tokens.insert(m_Tokens.end(), chunk.m_Tokens.begin(), chunk.m_Tokens.end());
+
+	// The chunk counted the brackets from zero
+	m_ParenthesisParsingDepth += chunk.m_ParenthesisParsingDepth;
+	m_ScopeParsingDepth += chunk.m_ScopeParsingDepth;
+
+	m_Position = chunk.m_Position;
+	m_IsInSingleLineComment = chunk.m_IsInSingleLineComment;
+	m_IsMultilineComment = chunk.m_IsMultilineComment;
+	m_IsInString = chunk.m_IsInString;
+	m_IsComplete = chunk.m_IsComplete;
+}
+
+std::vector<int> Lexer::GuessChunkStarts(std::string_view source, int chunkCount)
+{
+	std::vector<int> starts = { 0 };
+
+	auto isNameStart = [](char c) {
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (unsigned char)c >= 0x80;
+	};
+
+	for (int i = 1; i < chunkCount; i++)
 	{
-		m_Lines[i] += '\n';
+		size_t target = source.length() * i / chunkCount;
+		if (target <= (size_t)starts.back())
+			continue;
+
+		// The lines in scopes are indented, so a line that starts with a name or a keyword is probably at the top level
+		size_t newLine = source.find('\n', target);
+		while (newLine != std::string_view::npos && newLine + 1 < source.length() && !isNameStart(source[newLine + 1]))
+			newLine = source.find('\n', newLine + 1);
+
+		if (newLine == std::string_view::npos || newLine + 1 >= source.length())
+			break;
+
+		// The line before ends with a semicolon, or one is added at the new line
+		starts.push_back(newLine > 0 && source[newLine - 1] == ';' ? (int)newLine : (int)newLine + 1);
+	}
+
+	return starts;
+}
+
+// The tokens before a point where no comment, string or other token is open all start before it, and the ones after it start at or after it.
+// Returns the index of the first token after the position if it's right after a semicolon at the top level that is lexed like the given one, or -1
+static int FindResyncIndex(const std::vector<Token>& tokens, int position, const Token& semicolon)
+{
+	int index = (int)(std::partition_point(tokens.begin(), tokens.end(), [&](const Token& token) { return (int)token.m_Offset < position; }) - tokens.begin());
+
+	int last = index - 1;
+	while (last >= 0 && IsCommentToken(tokens[last]))
+		last--;
+
+	if (last < 0)
+		return -1;
+
+	const Token& previous = tokens[last];
+	if (previous.m_Type != Token::Semicolon || previous.m_Depth != 0 || (int)previous.m_Offset != position - 1 || previous.m_Length != semicolon.m_Length)
+		return -1;
+
+	// A new line inside a string also adds a semicolon, but then the string is added after it
+	for (int i = index; i < tokens.size(); i++)
+	{
+		if (!IsCommentToken(tokens[i]))
+			return (int)tokens[i].m_Offset < position ? -1 : index;
+	}
+
+	return index;
+}
+
+std::string Lexer::UpdateTokens(std::string_view source, int changeOffset, int removedLength, int insertedLength)
+{
+	// Lexing stopped at an error the last time, so there is nothing after the change to continue from
+	if (!m_IsComplete)
+		return CreateTokens(source, m_CreateCommentTokens);
+
+	// The names are only checked when the source has invalid UTF-8, so the ones before the change could have errors now.
+	// Checking the whole source is still much faster than lexing it
+	bool isValidUTF8 = Scanning::FindInvalidUTF8(source, m_UseVectorScanning) == source.length();
+	if (m_IsValidUTF8 && !isValidUTF8)
+		return CreateTokens(source, m_CreateCommentTokens);
+
+	// Nothing that is lexed before a semicolon at the top level looks past it, and nothing is open after it.
+	// So lexing can start again after the last one before the change
+	int restart = -1;
+	int restartIndex = 0;
+	int changeIndex = (int)(std::partition_point(m_Tokens.begin(), m_Tokens.end(), [&](const Token& token) { return (int)token.m_Offset < changeOffset; }) - m_Tokens.begin());
+
+	for (int i = changeIndex - 1; i >= 0; i--)
+	{
+		Token& token = m_Tokens[i];
+		if (token.m_Type != Token::Semicolon || token.m_Depth != 0 || (int)token.m_Offset >= changeOffset)
+			continue;
+
+		restartIndex = FindResyncIndex(m_Tokens, token.m_Offset + 1, token);
+		if (restartIndex != -1)
+		{
+			restart = i;
+			break;
+		}
 	}
 
+	if (restart == -1)
+		return CreateTokens(source, m_CreateCommentTokens);
+
+	int start = m_Tokens[restart].m_Offset + 1;
+	int shift = insertedLength - removedLength;
+
+	// What the old tokens ended with, the tokens after the resync point are the same so they still end that way
+	int lastCodeToken = m_LastCodeToken;
+	int endPosition = m_Position;
+	int scopeDepth = m_ScopeParsingDepth;
+	int parenthesisDepth = m_ParenthesisParsingDepth;
+	bool isMultilineComment = m_IsMultilineComment;
+	bool isInString = m_IsInString;
+
+	// The new tokens are lexed into a vector of their own, after the semicolon that lexing starts after
+	ResyncPoint resync;
+	resync.m_OldTokens.swap(m_Tokens);
+	resync.m_After = changeOffset + insertedLength;
+	resync.m_Shift = shift;
+
+	m_Tokens.push_back(resync.m_OldTokens[restart]);
+	m_LastCodeToken = 0;
 	m_Source = source;
 
-	bool isInSingleLineComment = false;
-	bool isMultilineComment = false;
-	bool isInString = false;
+	m_IsValidUTF8 = isValidUTF8;
+
+	// The depths are counted from zero, and the brackets in the replaced tokens are subtracted from the old ones in the end
+	m_ParenthesisParsingDepth = 0;
+	m_ScopeParsingDepth = 0;
+	m_IsInSingleLineComment = false;
+	m_IsMultilineComment = false;
+	m_IsInString = false;
+
+	std::string error = Lex(start, &resync);
+
+	bool isResynced = error == "" && resync.m_OldIndex != -1;
+	int replacedEnd = isResynced ? resync.m_OldIndex : (int)resync.m_OldTokens.size();
+
+	std::vector<Token> lexedTokens;
+	lexedTokens.swap(m_Tokens);
+	m_Tokens.swap(resync.m_OldTokens);
+
+	for (int i = restartIndex; i < replacedEnd; i++)
+	{
+		Token::Types type = m_Tokens[i].m_Type;
+		if (type == Token::LeftCurlyBracket) scopeDepth--;
+		if (type == Token::RightCurlyBracket) scopeDepth++;
+		if (type == Token::LeftParentheses) parenthesisDepth--;
+		if (type == Token::RightParentheses) parenthesisDepth++;
+	}
+
+	for (int i = replacedEnd; i < m_Tokens.size(); i++)
+		m_Tokens[i].m_Offset += shift;
+
+	int lexedCount = (int)lexedTokens.size() - 1;
+	ReplaceTokens(m_Tokens, restartIndex, replacedEnd, lexedTokens.data() + 1, lexedCount);
+
+	// The last code token is one of the new ones, the one lexing started after, or one after the resync point that was moved
+	if (m_LastCodeToken == 0)
+		m_LastCodeToken = restart;
+	else
+		m_LastCodeToken += restartIndex - 1;
+
+	if (isResynced && lastCodeToken >= replacedEnd)
+		m_LastCodeToken = lastCodeToken - replacedEnd + restartIndex + lexedCount;
+
+	// The tokens stop at the error like when everything is lexed
+	if (error != "")
+	{
+		m_Tokens.resize(restartIndex + lexedCount);
+		return error;
+	}
+
+	m_ScopeParsingDepth += scopeDepth;
+	m_ParenthesisParsingDepth += parenthesisDepth;
+
+	m_LastUpdate.m_Start = start;
+	m_LastUpdate.m_OldEnd = INT32_MAX;
+	m_LastUpdate.m_NewEnd = INT32_MAX;
+
+	if (isResynced)
+	{
+		m_LastUpdate.m_OldEnd = m_Position - shift;
+		m_LastUpdate.m_NewEnd = m_Position;
+
+		m_IsMultilineComment = isMultilineComment;
+		m_IsInString = isInString;
+		m_Position = endPosition + shift;
+		m_IsComplete = true;
+	}
+
+	return CheckEndOfSource();
+}
+
+std::string Lexer::CheckEndOfSource()
+{
+	// Unclosed comment
+	if (m_IsMultilineComment)
+		return "Expected the comment to end";
+
+	// Check for unclosed strings
+	if (m_IsInString)
+		return "Expected the string to end";
+
+	// Check for unclosed scopes
+	if (m_ScopeParsingDepth != 0)
+		return "Expected closing curly bracket";
+
+	return "";
+}
+
+std::string Lexer::Lex(int start, ResyncPoint* resync, const std::vector<int>* stops)
+{
+	std::string_view source = m_Source;
+	bool createCommentTokens = m_CreateCommentTokens;
+
+	m_IsComplete = false;
+
+	bool& isInSingleLineComment = m_IsInSingleLineComment;
+	bool& isMultilineComment = m_IsMultilineComment;
+	bool& isInString = m_IsInString;
 
-	int functionParsingDepth = 0;
-	int parenthesisParsingDepth = 0;
 	int statementParsingDepth = 0;
 
 	auto isInComment = [&] {
@@ -449,26 +820,72 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 	};
 
 	auto shouldAddSemicolon = [&] {
-		return !m_Tokens.empty() && 
-			m_Tokens.back().m_Type != Token::Semicolon && 
-			m_Tokens.back().m_Type != Token::NewLine &&
-			m_Tokens.back().m_Type != Token::LeftCurlyBracket && 
-			m_Tokens.back().m_Type != Token::RightCurlyBracket &&
+		Token* last = LastCodeToken();
+		return last && 
+			last->m_Type != Token::Semicolon && 
+			last->m_Type != Token::LeftCurlyBracket && 
+			last->m_Type != Token::RightCurlyBracket &&
 			!isInComment();
 	};
 
 	Token token;
-	for (m_Position = 0; m_Position < source.length(); Skip())
+
+	// Nothing is open and the last token is a semicolon at the top level right before the position, so lexing could start here too
+	auto isAfterTopLevelLine = [&] {
+		if (token.m_Type != Token::Empty || isInString || isInComment())
+			return false;
+
+		Token* last = LastCodeToken();
+		return last && last->m_Type == Token::Semicolon && last->m_Depth == 0 && (int)last->m_Offset == m_Position - 1;
+	};
+
+	// The first stop that lexing hasn't gone past yet
+	int stopIndex = 0;
+	int nextStop = stops && !stops->empty() ? (*stops)[0] : INT32_MAX;
+
+	// Adds the comment that is being lexed, it ends at the given position
+	auto endComment = [&](int end) {
+		if (createCommentTokens)
+		{
+			token.m_Length = end - token.m_Offset;
+			AddToken(token);
+		}
+
+		token = Token();
+	};
+
+	for (m_Position = start; m_Position < source.length(); Skip())
 	{
-		if (Current() == '\n')
+		// After the change, stop at the first semicolon at the top level where the old tokens were lexed the same way
+		if (resync && m_Position > resync->m_After && isAfterTopLevelLine())
+		{
+			resync->m_OldIndex = FindResyncIndex(resync->m_OldTokens, m_Position - resync->m_Shift, *LastCodeToken());
+			if (resync->m_OldIndex != -1)
+				return "";
+		}
+
+		// A chunk ends at the first of its stops that turns out to be at the start of a line at the top level
+		if (m_Position >= nextStop)
 		{
-			m_CurrentLine++;
+			if (m_Position == nextStop && isAfterTopLevelLine())
+				return "";
 
-			if (isInSingleLineComment)
-				isInSingleLineComment = false;
+			while (stopIndex < stops->size() && (*stops)[stopIndex] <= m_Position)
+				stopIndex++;
+
+			nextStop = stopIndex < stops->size() ? (*stops)[stopIndex] : INT32_MAX;
+		}
+
+		if (Current() == '\n')
+		{
+			bool endsComment = isInSingleLineComment && !isMultilineComment;
+			isInSingleLineComment = false;
 
 			if (shouldAddSemicolon())
-				AddToken(Token(Token::Semicolon, m_Position, ";"));
+				AddToken(Token(Token::Semicolon, m_Position, 0));
+
+			if (endsComment)
+				endComment(m_Position);
 
 			if (createCommentTokens)
 				AddToken(Token(Token::NewLine, m_Position));
@@ -476,18 +893,13 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 			
 		std::string error;
 
-		// Skip spaces
-		if (!isInString && Current() == ' ')
+		// Skip spaces, tabs and carriage returns. The whole run is skipped at once, the loop steps past the last one
+		if (!isInString && Scanning::IsSpace(Current()))
 		{
-			if (isInComment())
-			{
-				if (createCommentTokens)
-					token.m_Value += Current();
-			}
-			else
-				// Check if current token is a variable, because it might be 'null', 'string' or 'number' but be considered a variable still
-				token = AddToken(ResolveTokenKeyword(token));
+			if (!isInComment())
+				token = AddToken(token);
 
+			m_Position = Scanning::SkipSpaces(source, m_Position + 1, m_UseVectorScanning) - 1;
 			continue;
 		}
 
@@ -497,7 +909,7 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 			if (isInComment())
 				continue;
 			isInString = true;
-			token.m_StartPosition = m_Position;
+			token.m_Offset = m_Position;
 			token.m_Type = Token::StringLiteral;
 		}
 		// Check for end of string
@@ -507,62 +919,49 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 				continue;
 
 			isInString = false;
+
+			token.m_Length = m_Position + 1 - token.m_Offset;
+			token.m_Symbol = InternStringLiteral(source.substr(token.m_Offset + 1, token.m_Length - 2));
 			token = AddToken(token);
 		}
 		// Otherwise to normal parsing. The 'else' is required, or else the first (") would be considered a part of the string 
 		else if (!isInString)
 		{
 			// Check for comments
-			if (Current() == '/')
+			if (Current() == '/' && IsNext() && (Next() == '*' || Next() == '/'))
 			{
-				if (IsNext())
+				// A comment inside another one is part of the first comment
+				if (!isInComment())
 				{
-					token = AddToken(token); // todo?
-					//token = Token();
-					token.m_StartPosition = m_Position;
+					token = AddToken(token);
+					token.m_Offset = m_Position;
 
-					if (Next() == '*')
-					{
-						isMultilineComment = true;
-						if (createCommentTokens) token.m_Type = Token::MultiLineComment;
-
-						Skip();
-						continue;
-					}
-					if (Next() == '/')
-					{
-						if (!isMultilineComment) isInSingleLineComment = true;
+					if (createCommentTokens)
+						token.m_Type = Next() == '*' ? Token::MultiLineComment : Token::SingleLineComment;
+				}
 
-						if (createCommentTokens) token.m_Type = Token::SingleLineComment;
+				if (Next() == '*')
+					isMultilineComment = true;
+				else if (!isMultilineComment)
+					isInSingleLineComment = true;
 
-						Skip();
-						continue;
-					}
-				}
-			} 
+				Skip();
+				continue;
+			}
 			if (isInComment())
 			{
-				if (isMultilineComment)
+				if (isMultilineComment && IsNext() && Current() == '*' && Next() == '/')
 				{
-					if (IsNext() && Current() == '*' && Next() == '/')
-					{
-						isMultilineComment = false;
-						if (createCommentTokens) AddToken(token);
-						token = Token();
-						Skip();
-						continue;
-					}
-				}
+					isMultilineComment = false;
+					if (!isInSingleLineComment)
+						endComment(m_Position + 2);
 
-				if (isInSingleLineComment && Current() == '\n')
-				{
-					isInSingleLineComment = false;
-					if (createCommentTokens) AddToken(token);
-					token = Token();
+					Skip();
 				}
-					
-				if (createCommentTokens)
-					token.m_Value += Current();
+
+				// Nothing else in a comment matters until a new line or something that can start or end a comment
+				if (isInComment())
+					m_Position = Scanning::FindFirstOf(source, m_Position + 1, '\n', '/', '*', '\n', m_UseVectorScanning) - 1;
 
 				continue;
 			}
@@ -570,30 +969,41 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 			// If parsing variable name (or a variable type, as long as it is a valid variable name)
 			else if (IsValidVariablePart(source, m_Position, error))
 			{
-				token.m_StartPosition = m_Position;
-				while (IsValidVariablePart(source, m_Position, error))
-				{
-					if (error != "") return MakeError(error);
-
-					token.m_Value += Current();
-					token.m_Type = Token::Variable;
-					Skip();
-				}
+				token.m_Offset = m_Position;
+				token.m_Type = Token::Variable;
 
 				if (error != "") return MakeError(error);
 
+				// After the first character every letter, digit and underscore is part of the name
+				m_Position = Scanning::SkipIdentifier(source, m_Position + 1, m_UseVectorScanning);
+
+				token.m_Length = m_Position - token.m_Offset;
+
+				std::string_view value = token.GetValue(source);
+
+				if (!m_IsValidUTF8)
+				{
+					int invalid = Scanning::FindInvalidUTF8(value, m_UseVectorScanning);
+					if (invalid != value.length())
+					{
+						m_Position = token.m_Offset + invalid;
+						return MakeError("Invalid UTF-8 character in a name");
+					}
+				}
+				ResolveTokenKeyword(token, value);
+
 				int depth = TotalDepth();
-				if (token.m_Value == "else")
+				if (value == "else")
 					depth++;
 
-				token = AddToken(ResolveTokenKeyword(token), depth);
-				token.m_StartPosition = m_Position;
+				token = AddToken(token, depth);
+				token.m_Offset = m_Position;
 			}
 
-			else if (!m_Tokens.empty() && m_Tokens.back().IsStatementKeyword())
+			else if (LastCodeToken() && LastCodeToken()->IsStatementKeyword())
 			{
 				//scopeParsingDepth++;
-				m_Tokens.back().m_Depth++;
+				LastCodeToken()->m_Depth++;
 
 				if (Current() == '(')
 					statementParsingDepth++;
@@ -602,24 +1012,19 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 			// Number
 			else if (IsValidNumberPart(source, m_Position, error))
 			{
-				token.m_StartPosition = m_Position;
+				token.m_Offset = m_Position;
 				while (IsValidNumberPart(source, m_Position, error))
 				{
 					if (error != "") return MakeError(error);
-
-					token.m_Value += Current();
-
-					if (token.m_Value.find('.') != std::string::npos)
-						token.m_Type = Token::DoubleLiteral;
-					else
-						token.m_Type = Token::IntLiteral;
-
 					Skip();
 				}
 				if (error != "") return MakeError(error);
 
+				token.m_Length = m_Position - token.m_Offset;
+				token.m_Type = token.GetValue(source).find('.') != std::string_view::npos ? Token::DoubleLiteral : Token::IntLiteral;
+
 				token = AddToken(token);
-				token.m_StartPosition = m_Position;
+				token.m_Offset = m_Position;
 			}
 
 			if (error != "") return MakeError(error);
@@ -628,25 +1033,25 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 			if (Current() == '{')
 			{
 				m_ScopeParsingDepth++;
-				AddToken(Token(Token::LeftCurlyBracket, m_Position, "{"));
+				AddToken(Token(Token::LeftCurlyBracket, m_Position));
 			}
 			else if (Current() == '}')
 			{
-				AddToken(Token(Token::RightCurlyBracket, m_Position, "}"));
+				AddToken(Token(Token::RightCurlyBracket, m_Position));
 				m_ScopeParsingDepth--;
 			}
 			// Check for parathesis
 			if (Current() == '(')
 			{
 				// The variable in the previous token is actually a function call
-				if (!m_Tokens.empty() && m_Tokens.back().m_Type == Token::Variable)
-					m_Tokens.back().m_Type = Token::FunctionName;
+				if (LastCodeToken() && LastCodeToken()->m_Type == Token::Variable)
+					LastCodeToken()->m_Type = Token::FunctionName;
 
 				m_ParenthesisParsingDepth++;
-				AddToken(Token(Token::LeftParentheses, m_Position, "("));
+				AddToken(Token(Token::LeftParentheses, m_Position));
 			} else if (Current() == ')')
 			{
-				AddToken(Token(Token::RightParentheses, m_Position, ")"));
+				AddToken(Token(Token::RightParentheses, m_Position));
 				m_ParenthesisParsingDepth--;
 			}
 
@@ -676,31 +1081,31 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 					// ==
 					if (Current() == '=' && Next() == '=')
 					{
-						AddToken(Token(Token::CompareEquals, m_Position, "=="));
+						AddToken(Token(Token::CompareEquals, m_Position, 2));
 						foundMatch = true;
 					}
 					// !=
 					if (Current() == '!' && Next() == '=')
 					{
-						AddToken(Token(Token::NotEquals, m_Position, "!="));
+						AddToken(Token(Token::NotEquals, m_Position, 2));
 						foundMatch = true;
 					}
 					// <=
 					if (Current() == '<' && Next() == '=')
 					{
-						AddToken(Token(Token::LessThanEqual, m_Position, "<="));
+						AddToken(Token(Token::LessThanEqual, m_Position, 2));
 						foundMatch = true;
 					}
 					// >=
 					if (Current() == '>' && Next() == '=')
 					{
-						AddToken(Token(Token::GreaterThanEqual, m_Position, ">="));
+						AddToken(Token(Token::GreaterThanEqual, m_Position, 2));
 						foundMatch = true;
 					}
 					// =>
 					if (Current() == '=' && Next() == '>')
 					{
-						AddToken(Token(Token::RightArrow, m_Position, "=>"));
+						AddToken(Token(Token::RightArrow, m_Position, 2));
 						foundMatch = true;
 					}
 				}
@@ -708,12 +1113,12 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 				// >
 				if (Current() == '>' && !foundMatch)
 				{
-					AddToken(Token(Token::GreaterThan, m_Position, ">"));
+					AddToken(Token(Token::GreaterThan, m_Position));
 					foundMatch = true;
 				}
 				if (Current() == '<' && !foundMatch)
 				{
-					AddToken(Token(Token::LessThan, m_Position, "<"));
+					AddToken(Token(Token::LessThan, m_Position));
 					foundMatch = true;
 				}
 
@@ -730,9 +1135,9 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 				if (Next() == '=' && (Current() == '+' || Current() == '-'))
 				{
 					if (Current() == '+')
-						AddToken(Token(Token::PlusEquals, m_Position, "+="));
+						AddToken(Token(Token::PlusEquals, m_Position, 2));
 					else if (Current() == '-')
-						AddToken(Token(Token::MinusEquals, m_Position, "-="));
+						AddToken(Token(Token::MinusEquals, m_Position, 2));
 
 					// Skip parsing the equals sign, or else there will be duplicates
 					Skip();
@@ -744,9 +1149,9 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 			if (IsValidIncrement(m_Source, m_Position) || IsValidDecrement(m_Source, m_Position))
 			{
 				if (IsValidIncrement(m_Source, m_Position))
-					AddToken(Token(Token::PostIncrement, m_Position, "++"));
+					AddToken(Token(Token::PostIncrement, m_Position, 2));
 				if (IsValidDecrement(m_Source, m_Position))
-					AddToken(Token(Token::PostDecrement, m_Position, "--"));
+					AddToken(Token(Token::PostDecrement, m_Position, 2));
 
 				Skip();
 				continue;
@@ -755,44 +1160,44 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 			// Logical and
 			if (IsNext() && (Current() == '&' && Next() == '&'))
 			{
-				token = AddToken(Token(Token::And, m_Position, "&&"));
+				token = AddToken(Token(Token::And, m_Position, 2));
 				Skip();
 				continue;
 			}
 			// Logical or
 			if (IsNext() && (Current() == '|' && Next() == '|'))
 			{
-				token = AddToken(Token(Token::Or, m_Position, "||"));
+				token = AddToken(Token(Token::Or, m_Position, 2));
 				Skip();
 				continue;
 			}
 
 			// Not
 			if (Current() == '!')
-				token = AddToken(Token(Token::Not, m_Position, "!"));
+				token = AddToken(Token(Token::Not, m_Position));
 			// Xor
 			if (Current() == '^')
-				token = AddToken(Token(Token::Xor, m_Position, "^"));
+				token = AddToken(Token(Token::Xor, m_Position));
 			// Modulus
 			if (Current() == '%')
-				token = AddToken(Token(Token::Modulus, m_Position, "%"));
+				token = AddToken(Token(Token::Modulus, m_Position));
 
 			// Plus
 			if (Current() == '+')
-				AddToken(Token(Token::Add, m_Position, "+"));
+				AddToken(Token(Token::Add, m_Position));
 			// Subtract
 			else if (Current() == '-')
-				AddToken(Token(Token::Subtract, m_Position, "-"));
+				AddToken(Token(Token::Subtract, m_Position));
 			// Multiply
 			else if (Current() == '*')
-				AddToken(Token(Token::Multiply, m_Position, "*"));
+				AddToken(Token(Token::Multiply, m_Position));
 			// Divide
 			else if (Current() == '/')
-				AddToken(Token(Token::Divide, m_Position, "/"));
+				AddToken(Token(Token::Divide, m_Position));
 
 			// Equals sign. Make sure the last token wasn't a PlusEquals or similar, or else there will be duplicates
 			else if (Current() == '=')// && (tokens.back().Type != Token::PlusEquals || tokens.back().Type != Token::MinusEquals))
-				AddToken(Token(Token::SetEquals, m_Position, "="));
+				AddToken(Token(Token::SetEquals, m_Position));
 
 			//if (string[i] == ':')
 			//{
@@ -804,20 +1209,18 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 			//}
 
 			if (Current() == ',')
-				AddToken(Token(Token::Comma, m_Position, ","));
+				AddToken(Token(Token::Comma, m_Position));
 
 			// Check for line ends
 			if (Current() == ';')
-				AddToken(Token(Token::Semicolon, m_Position, ";"));
+				AddToken(Token(Token::Semicolon, m_Position));
 
 			if (Current() == '\n')
 			{
-				m_CurrentLine++;
-
 				isInSingleLineComment = false;
 
 				if (shouldAddSemicolon())
-					AddToken(Token(Token::Semicolon, m_Position, ";"));
+					AddToken(Token(Token::Semicolon, m_Position, 0));
 
 				//if (createCommentTokens)
 				//	AddToken(Token(Token::NewLine, m_Position));
@@ -830,51 +1233,27 @@ std::string Lexer::CreateTokens(const std::string& source, bool createCommentTok
 			if (isInComment())
 				continue;
 
-			// Check for escaped characters
+			// An escaped character can't end the string, the contents are unescaped when it ends
 			if (Current() == '\\')
-			{
-				// If not the last
-				if (CharactersLeft() >= 1)
-				{
-					// Todo: add more escapes perhaps
-					if (Next() == 'n')
-						token.m_Value += '\n';
-					if (Next() == 'r')
-						token.m_Value += '\r';
-					else if (Next() == '\'')
-						token.m_Value += '\'';
-					else if (Next() == '\"')
-						token.m_Value += '\"';
-					else if (Next() == '\\')
-						token.m_Value += '\\';
-					Skip();
-				}
-			}
-			else
-			{
-				token.m_Value += Current();
-			}
+				Skip();
+
+			// Go to the next character that can end the string or escape the one after it. New lines are handled at the top of the loop
+			m_Position = Scanning::FindFirstOf(source, m_Position + 1, '\"', '\'', '\\', '\n', m_UseVectorScanning) - 1;
 		}
 	}
 
-	AddToken(token);
-
-	// Unclosed comment
-	if (isMultilineComment)
-		return "Expected the comment to end";
-
-	// Check for unclosed strings
-	if (isInString)
-		return "Expected the string to end";
+	// The last token runs to the end of the source
+	if (token.m_Type != Token::Empty && token.m_Length == 0)
+	{
+		token.m_Length = (uint32_t)source.length() - token.m_Offset;
 
-	// Check for unclosed scopes
-	if (m_ScopeParsingDepth != 0)
-		return "Expected closing curly bracket";
+		if (token.m_Type == Token::StringLiteral)
+			token.m_Symbol = InternStringLiteral(source.substr(token.m_Offset + 1));
+	}
 
-	if (parenthesisParsingDepth != 0)
-		return "Expected closing parenthesis";
+	AddToken(token);
 
-	
+	m_IsComplete = true;
 
 	// Check if current token is a variable, because it might be 'null', 'string' or 'number' but be considered a variable still
 	/*if (token.Type == Token::Variable)
@@ -1,7 +1,12 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <stdint.h>
+#include <limits.h>
+
+#include "StringInterner.h"
 
 struct Token
 {
@@ -75,14 +80,19 @@ struct Token
 		Break,
 		Continue,
 		Return,
-		Global
+		Global,
+		Import,
+		Export
 	};
 
 	Token() {};
-	Token(Types type, int position, std::string value = "", int depth = -1) : m_Type(type), m_StartPosition(position), m_Value(value), m_Depth(depth) {};
+	Token(Types type, uint32_t offset, uint32_t length = 1, int depth = -1) : m_Type(type), m_Offset(offset), m_Length(length), m_Depth(depth) {};
 
 	std::string ToString();
 
+	// The text of the token in the source it was lexed from. String literals give their contents, with the escapes replaced
+	std::string_view GetValue(std::string_view source) const;
+
 	/* 
 	string, int, double and also user-defined structs. Eg: Not an integer literal, but the explicit type
 	*/
@@ -108,19 +118,74 @@ struct Token
 	}
 
 	Types m_Type = Types::Empty;
-	std::string m_Value;
 
-	int m_StartPosition = 0;
+	// Where the token is in the source. String literals include the quotes, semicolons that are added at the end of a line are empty
+	uint32_t m_Offset = 0;
+	uint32_t m_Length = 0;
 
 	int m_Depth = -1;
+
+	// Set for identifiers and string literals
+	Symbol m_Symbol = NoSymbol;
 };
 
 typedef std::vector<Token> Tokens;
 
+// The tokens without the comments and new lines, like they are lexed when no comment tokens are created
+std::vector<Token> RemoveCommentTokens(const std::vector<Token>& tokens);
+std::vector<Token> RemoveCommentTokens(const std::vector<Token>& tokens, int begin, int end);
+
+// Replaces the tokens in [begin, end) with the new ones. The tokens after them are only moved if the number of tokens changes
+void ReplaceTokens(std::vector<Token>& tokens, int begin, int end, const Token* newTokens, int newCount);
+
+// The tokens point into the source instead of copying their text, so the source has to outlive them
 class Lexer
 {
 public:
-	std::string CreateTokens(const std::string& source, bool createCommentTokens = false);
+	// The part of the tokens that the last lexing replaced. The tokens that started between m_Start and m_OldEnd in the old source were replaced
+	// by the ones that start between m_Start and m_NewEnd, and the ones after them were moved by the difference of the ends
+	struct TokenUpdate
+	{
+		int m_Start = 0;
+		int m_OldEnd = INT32_MAX;
+		int m_NewEnd = INT32_MAX;
+	};
+
+	// Where UpdateTokens() can stop lexing and use the old tokens again
+	struct ResyncPoint
+	{
+		// The tokens from before the change
+		std::vector<Token> m_OldTokens;
+
+		// The end of the change in the new source, and how far the text after it moved
+		int m_After = 0;
+		int m_Shift = 0;
+
+		// Where in m_OldTokens the lexing could stop, or -1 if it went to the end
+		int m_OldIndex = -1;
+	};
+
+	std::string CreateTokens(std::string_view source, bool createCommentTokens = false);
+
+	// Lexes the source again after a part of the last one was replaced. It starts after the last semicolon at the top level
+	// before the change, and stops at the first one after it where the old tokens were lexed the same way, the rest are only moved.
+	// The tokens end up the same as if the whole source was lexed
+	std::string UpdateTokens(std::string_view source, int changeOffset, int removedLength, int insertedLength);
+
+	// For lexing a long source in chunks on different threads, see ParallelFrontEnd. A chunk is lexed from a position that is guessed to be
+	// right after a semicolon at the top level, as if it was. It ends at the first of the stops that is right after one, then m_IsComplete is false
+	// and m_Position is the stop, or at the end of the source. The next chunk is the one that starts at the stop, so a wrong guess is lexed past
+	std::string CreateChunkTokens(std::string_view source, int start, const std::vector<int>& stops, bool isValidUTF8);
+
+	// Adds the tokens of the chunk that starts where this stopped, and ends where it ends
+	void AppendChunk(const Lexer& chunk);
+
+	// Where the chunks could start, roughly evenly spaced. The first one starts at zero
+	static std::vector<int> GuessChunkStarts(std::string_view source, int chunkCount);
+
+	// Lexes from the position to the end of the source, or until the resync point or one of the stops is found
+	std::string Lex(int start, ResyncPoint* resync, const std::vector<int>* stops = nullptr);
+	std::string CheckEndOfSource();
 
 	char ConsumeNext();
 	char Next();
@@ -134,17 +199,38 @@ public:
 
 	Token AddToken(Token token, int customDepth = -1);
 
+	// The last token that isn't a comment or a new line. Those are only created for the editor, so they can't change how the rest is lexed
+	Token* LastCodeToken();
+
 	std::string MakeError(const std::string& message);
 
 public:
 	std::vector<Token> m_Tokens;
 
 	int m_Position = 0;
-	int m_CurrentLine = 0;
 
-	std::vector<std::string> m_Lines;
-	std::string m_Source = "";
+	std::string_view m_Source;
 
 	int m_ParenthesisParsingDepth = 0;
 	int m_ScopeParsingDepth = 0;
+
+	// If false, the runs of spaces, comments, strings and names are scanned one character at a time. Only the lexer benchmark turns it off
+	bool m_UseVectorScanning = true;
+
+	bool m_IsValidUTF8 = true;
+
+	bool m_CreateCommentTokens = false;
+
+	// What is open where the lexing ended, at the end of the source unless there was an error
+	bool m_IsInSingleLineComment = false;
+	bool m_IsMultilineComment = false;
+	bool m_IsInString = false;
+
+	// If the lexing got to the end of the source, UpdateTokens() needs all the old tokens
+	bool m_IsComplete = false;
+
+	TokenUpdate m_LastUpdate;
+
+	// The index of the token that LastCodeToken() gives, or -1
+	int m_LastCodeToken = -1;
 };
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include "LexerScanning.h"
+
+#include <algorithm>
+
+// SSE2 is always there on x64, and on x86 when the compiler is allowed to use it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCANNING_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace Scanning
+{
+	bool IsSpace(char ch)
+	{
+		return ch == ' ' || ch == '\t' || ch == '\r';
+	}
+
+	bool IsIdentifierCharacter(char ch)
+	{
+		unsigned char c = (unsigned char)ch;
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+	}
+
+#ifdef SCANNING_SSE2
+	static int FirstSetBit(unsigned int mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (int)index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	static __m128i Load(std::string_view source, int position)
+	{
+		return _mm_loadu_si128((const __m128i*)(source.data() + position));
+	}
+
+	// The masks have a bit set for each of the 16 characters where the scan should stop
+	static unsigned int StopAtNotSpace(__m128i chunk)
+	{
+		__m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t')));
+		spaces = _mm_or_si128(spaces, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')));
+
+		return ~_mm_movemask_epi8(spaces) & 0xFFFF;
+	}
+
+	static unsigned int StopAtNotIdentifier(__m128i chunk)
+	{
+		// The compares are signed, so bytes above 127 are negative and are only found by the sign bits at the end
+		__m128i lowercase = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+		__m128i letters = _mm_and_si128(_mm_cmpgt_epi8(lowercase, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lowercase, _mm_set1_epi8('z' + 1)));
+		__m128i digits = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1)));
+		__m128i underscores = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_'));
+
+		int identifier = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letters, digits), underscores)) | _mm_movemask_epi8(chunk);
+		return ~identifier & 0xFFFF;
+	}
+#endif
+
+	// Moves forward until stop() is true for a character. vectorStop() does the same for 16 characters at once
+	template<typename VectorStop, typename Stop>
+	static int ScanUntil(std::string_view source, int position, bool vectorized, VectorStop vectorStop, Stop stop)
+	{
+		int length = (int)source.length();
+		position = std::min(position, length);
+
+#ifdef SCANNING_SSE2
+		if (vectorized)
+		{
+			for (; position + 16 <= length; position += 16)
+			{
+				unsigned int mask = vectorStop(Load(source, position));
+				if (mask != 0)
+					return position + FirstSetBit(mask);
+			}
+		}
+#endif
+
+		while (position < length && !stop(source[position]))
+			position++;
+
+		return position;
+	}
+
+	int SkipSpaces(std::string_view source, int position, bool vectorized)
+	{
+#ifdef SCANNING_SSE2
+		return ScanUntil(source, position, vectorized, StopAtNotSpace, [](char ch) { return !IsSpace(ch); });
+#else
+		return ScanUntil(source, position, false, nullptr, [](char ch) { return !IsSpace(ch); });
+#endif
+	}
+
+	int SkipIdentifier(std::string_view source, int position, bool vectorized)
+	{
+#ifdef SCANNING_SSE2
+		return ScanUntil(source, position, vectorized, StopAtNotIdentifier, [](char ch) { return !IsIdentifierCharacter(ch); });
+#else
+		return ScanUntil(source, position, false, nullptr, [](char ch) { return !IsIdentifierCharacter(ch); });
+#endif
+	}
+
+	int FindFirstOf(std::string_view source, int position, char a, char b, char c, char d, bool vectorized)
+	{
+		auto stop = [=](char ch) { return ch == a || ch == b || ch == c || ch == d; };
+
+#ifdef SCANNING_SSE2
+		__m128i as = _mm_set1_epi8(a), bs = _mm_set1_epi8(b), cs = _mm_set1_epi8(c), ds = _mm_set1_epi8(d);
+
+		auto vectorStop = [=](__m128i chunk) {
+			__m128i found = _mm_or_si128(_mm_cmpeq_epi8(chunk, as), _mm_cmpeq_epi8(chunk, bs));
+			found = _mm_or_si128(found, _mm_or_si128(_mm_cmpeq_epi8(chunk, cs), _mm_cmpeq_epi8(chunk, ds)));
+			return (unsigned int)_mm_movemask_epi8(found);
+		};
+
+		return ScanUntil(source, position, vectorized, vectorStop, stop);
+#else
+		return ScanUntil(source, position, false, nullptr, stop);
+#endif
+	}
+
+	// The length of the UTF-8 character at the position, or 0 if it isn't valid.
+	// Overlong encodings, surrogates and characters above U+10FFFF are not valid
+	static int UTF8CharacterLength(std::string_view text, int position)
+	{
+		unsigned char first = text[position];
+
+		int length = 0;
+		unsigned char secondMin = 0x80, secondMax = 0xBF;
+
+		if (first >= 0xC2 && first <= 0xDF)
+			length = 2;
+		else if (first >= 0xE0 && first <= 0xEF)
+		{
+			length = 3;
+			if (first == 0xE0) secondMin = 0xA0;
+			if (first == 0xED) secondMax = 0x9F;
+		}
+		else if (first >= 0xF0 && first <= 0xF4)
+		{
+			length = 4;
+			if (first == 0xF0) secondMin = 0x90;
+			if (first == 0xF4) secondMax = 0x8F;
+		}
+		else
+			return 0;
+
+		if (position + length > (int)text.length())
+			return 0;
+
+		unsigned char second = text[position + 1];
+		if (second < secondMin || second > secondMax)
+			return 0;
+
+		for (int i = 2; i < length; i++)
+		{
+			if (((unsigned char)text[position + i] & 0xC0) != 0x80)
+				return 0;
+		}
+
+		return length;
+	}
+
+	int FindInvalidUTF8(std::string_view text, bool vectorized)
+	{
+		int length = (int)text.length();
+		int position = 0;
+
+		while (position < length)
+		{
+#ifdef SCANNING_SSE2
+			// Almost all of a program is ASCII, which is always valid, so that is skipped 16 bytes at a time
+			if (vectorized)
+			{
+				for (; position + 16 <= length; position += 16)
+				{
+					int mask = _mm_movemask_epi8(Load(text, position));
+					if (mask != 0)
+					{
+						position += FirstSetBit(mask);
+						break;
+					}
+				}
+
+				if (position >= length)
+					break;
+			}
+#endif
+
+			if ((unsigned char)text[position] < 0x80)
+			{
+				position++;
+				continue;
+			}
+
+			int characterLength = UTF8CharacterLength(text, position);
+			if (characterLength == 0)
+				return position;
+
+			position += characterLength;
+		}
+
+		return length;
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string_view>
+
+// Finds where the runs of characters that the lexer skips over end, like spaces, comments, strings and names.
+// With SSE2 16 characters are checked at once. The scalar versions give the same results, they're used for the
+// end of the source and when vectorized is false
+namespace Scanning
+{
+	bool IsSpace(char ch);
+
+	// Letters, digits, underscores and every byte of a UTF-8 character
+	bool IsIdentifierCharacter(char ch);
+
+	// These return the position of the first character that doesn't match, or the length of the source
+	int SkipSpaces(std::string_view source, int position, bool vectorized = true);
+	int SkipIdentifier(std::string_view source, int position, bool vectorized = true);
+
+	// The first position that has one of the characters, up to four can be given
+	int FindFirstOf(std::string_view source, int position, char a, char b, char c, char d, bool vectorized = true);
+
+	// Returns the offset of the first byte that isn't part of a valid UTF-8 character, or the length if all of it is valid
+	int FindInvalidUTF8(std::string_view text, bool vectorized = true);
+}
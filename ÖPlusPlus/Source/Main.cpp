@@ -12,6 +12,9 @@
 
 #include "Lexer.h"
 #include "Parser.h"
+#include "Inliner.h"
+#include "LanguageServer.h"
+#include "ParallelFrontEnd.h"
 
 #include "Utils.hpp"
 
@@ -28,9 +31,16 @@
 
 #include "Interpreter/Bytecode/BytecodeInterpreter.h"
 #include "Interpreter/AST/ASTInterpreter.h"
+#include "Interpreter/Closure/ClosureCompiler.h"
 #include "Compiler/AssemblyRunner.h"
 
 #include "Tester.h"
+#include "Benchmarks.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 double rand_range_float(double min, double max)  {
 	return ((max - min) * (double(rand()) / 32767.0)) + min;
@@ -74,6 +84,7 @@ std::string stringRaw(std::string s)
 	return s;
 }
 
+
 int main(int argc, const char* argv[])
 {
 	setlocale(LC_ALL, "");
@@ -81,12 +92,26 @@ int main(int argc, const char* argv[])
 	std::string error;
 
 	bool runTests = false;
+	bool runInterpreterTests = false;
 	bool onlyTokens = false;
 	bool quiet = false;
 	std::string filepath = "";// "Programs/hello_world.";
 	std::string fileContent = "";
 	std::string asmBuildDir = std::filesystem::current_path().generic_string() + "\\ASM Build files";
 	ExecutionMethods method = ExecutionMethods::Bytecode;
+	bool useStackEvaluator = false;
+	bool lexerBenchmark = false;
+	bool parserBenchmark = false;
+	bool editBenchmark = false;
+	bool frontEndBenchmark = false;
+	bool compileBenchmark = false;
+	bool heapBenchmark = false;
+	bool lazyFunctions = false;
+	bool parallelFrontEnd = false;
+	bool languageServer = false;
+	std::string moduleCacheDir = "";
+	bool incrementalGC = false;
+	double gcStepBudgetMs = 0.5;
 
 	// Iterate over arguments
 	for (int i = 1; i < argc; i++)
@@ -98,6 +123,12 @@ int main(int argc, const char* argv[])
 			runTests = true;
 		}
 
+		// Run the tests in Programs/InterpreterTests with every interpreter
+		if (arg == "-ti")
+		{
+			runInterpreterTests = true;
+		}
+
 		if (arg == "-q")
 		{
 			quiet = true;
@@ -111,10 +142,19 @@ int main(int argc, const char* argv[])
 		{
 			method = ExecutionMethods::AST;
 		}
+		if (arg == "-ast-stack")
+		{
+			method = ExecutionMethods::AST;
+			useStackEvaluator = true;
+		}
 		if (arg == "-bytecode")
 		{
 			method = ExecutionMethods::Bytecode;
 		}
+		if (arg == "-closure")
+		{
+			method = ExecutionMethods::Closure;
+		}
 
 		if (arg == "-buildDir")
 		{
@@ -153,6 +193,96 @@ int main(int argc, const char* argv[])
 		{
 			onlyTokens = true;
 		}
+
+		if (arg == "-lexbench")
+		{
+			lexerBenchmark = true;
+		}
+
+		if (arg == "-parsebench")
+		{
+			parserBenchmark = true;
+		}
+
+		if (arg == "-editbench")
+		{
+			editBenchmark = true;
+		}
+
+		if (arg == "-frontendbench")
+		{
+			frontEndBenchmark = true;
+		}
+
+		if (arg == "-compilebench")
+		{
+			compileBenchmark = true;
+		}
+
+		if (arg == "-heapbench")
+		{
+			heapBenchmark = true;
+		}
+
+		// Collect the bytecode heap in steps between the instructions, each one taking at most about the budget
+		if (arg == "-incrementalgc")
+		{
+			incrementalGC = true;
+		}
+
+		if (arg == "-gcbudget")
+		{
+			if (i >= argc - 1)
+			{
+				std::cout << "Expected the milliseconds of a step after -gcbudget argument\n";
+				abort();
+			}
+
+			gcStepBudgetMs = std::stod(argv[i + 1]);
+		}
+
+		// Compile the bytecode functions the first time they are called
+		if (arg == "-lazy")
+		{
+			lazyFunctions = true;
+		}
+
+		// Lex and parse the program in chunks on all the cores, and compile the bytecode functions on them
+		if (arg == "-parallel")
+		{
+			parallelFrontEnd = true;
+		}
+
+		if (arg == "-server")
+		{
+			languageServer = true;
+		}
+
+		// Save the compiled modules in a directory, so that the next run only compiles the imported files that changed
+		if (arg == "-modulecache")
+		{
+			if (i >= argc - 1)
+			{
+				std::cout << "Expected a directory after -modulecache argument\n";
+				abort();
+			}
+
+			moduleCacheDir = argv[i + 1];
+		}
+	}
+
+	// The editor keeps this running and sends requests on stdin, nothing is run so the functions aren't needed
+	if (languageServer)
+	{
+#ifdef _WIN32
+		// The message lengths are in bytes, so new lines can't be translated
+		_setmode(_fileno(stdin), _O_BINARY);
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		std::ios::sync_with_stdio(false);
+
+		LanguageServer server;
+		return server.Run(std::cin, std::cout);
 	}
 
 	ExecutionMethods_Global::m_Method = method;
@@ -169,16 +299,11 @@ int main(int argc, const char* argv[])
 			return 1;
 		}
 
-		Lexer lexerForParsing;
-		lexerForParsing.CreateTokens(fileContent, false);
+		std::vector<Token> codeTokens = RemoveCommentTokens(lexerForTokens.m_Tokens);
 
+		// Only parsed to report the syntax errors
 		Parser parser;
-
-		ASTNode tree;
-		tree.parent = new ASTNode(ASTTypes::ProgramBody);
-		tree.parent->left = &tree;
-
-		parser.CreateAST(lexerForParsing.m_Tokens, &tree, tree.parent);
+		parser.CreateProgram(codeTokens, lexerForTokens.m_Source);
 
 		if (parser.m_Error != "")
 		{
@@ -186,16 +311,38 @@ int main(int argc, const char* argv[])
 			return 1;
 		}
 
-		using json = nlohmann::json;
-		json tokens = json::array();
+		std::cout << LanguageServer::TokensToJson(lexerForTokens.m_Tokens, lexerForTokens.m_Source);
+		return 0;
+	}
 
-		for (int i = 0; i < lexerForTokens.m_Tokens.size(); i++)
-		{
-			Token& token = lexerForTokens.m_Tokens[i];
-			tokens.push_back({ {"type", token.ToString() }, { "value", token.m_Value }, { "index", token.m_StartPosition} });
-		}
+	if (parserBenchmark)
+	{
+		Benchmarks::RunParserBenchmark();
+		return 0;
+	}
 
-		std::cout << tokens;
+	if (editBenchmark)
+	{
+		Benchmarks::RunEditBenchmark(50000);
+		return 0;
+	}
+
+	if (frontEndBenchmark)
+	{
+		Benchmarks::RunFrontEndBenchmark(500000);
+		return 0;
+	}
+
+	if (compileBenchmark)
+	{
+		Benchmarks::RunCompileBenchmark(5000);
+		return 0;
+	}
+
+	if (heapBenchmark)
+	{
+		Benchmarks::RunHeapBenchmark(5000000);
+		Benchmarks::RunHeapThreadBenchmark(200000);
 		return 0;
 	}
 
@@ -213,6 +360,20 @@ int main(int argc, const char* argv[])
 		while (true) {};
 	}
 
+	if (runInterpreterTests)
+	{
+		Tester tester(asmBuildDir);
+
+		bool passedAllTests = tester.RunInterpreterTests(argv[0]);
+
+		if (passedAllTests)
+			std::cout << "Passed all the tests in all files!! :)\n";
+		else
+			std::cout << "Failed one of the test files :(\n";
+
+		return passedAllTests ? 0 : 1;
+	}
+
 	// Read file if filepath is specified
 	if (filepath != "")
 	{
@@ -226,6 +387,10 @@ int main(int argc, const char* argv[])
 			fileContent += line + "\n";
 		}
 	}
+	else if (lexerBenchmark && fileContent == "")
+	{
+		fileContent = Benchmarks::GenerateLexerBenchmarkSource(8 * 1024 * 1024);
+	}
 	else
 	{
 		if (fileContent == "")
@@ -235,9 +400,25 @@ int main(int argc, const char* argv[])
 		}
 	}
 
+	if (lexerBenchmark)
+	{
+		Benchmarks::RunLexerBenchmark(fileContent);
+		return 0;
+	}
+
 	if (method == ExecutionMethods::Bytecode)
 	{
-		Value v = Bytecode::BytecodeInterpreter::Get().CreateAndRunProgram(fileContent, error, !quiet);
+		Bytecode::BytecodeInterpreter::Get().m_Compiler.m_CompileFunctionsLazily = lazyFunctions;
+
+		// The imports are relative to the file
+		if (filepath != "")
+			Bytecode::BytecodeInterpreter::Get().m_Compiler.m_Directory = std::filesystem::path(filepath).parent_path().string();
+		Bytecode::BytecodeInterpreter::Get().m_Modules.m_Directory = moduleCacheDir;
+
+		Bytecode::BytecodeInterpreter::Get().m_Heap.m_Incremental = incrementalGC;
+		Bytecode::BytecodeInterpreter::Get().m_Heap.m_StepBudgetMs = gcStepBudgetMs;
+
+		Value v = Bytecode::BytecodeInterpreter::Get().CreateAndRunProgram(fileContent, error, !quiet, parallelFrontEnd);
 
 		if (error != "")
 		{
@@ -246,27 +427,37 @@ int main(int argc, const char* argv[])
 		}
 			
 	}
-	else if (method == ExecutionMethods::AST)
+	else if (method == ExecutionMethods::AST || method == ExecutionMethods::Closure)
 	{
 		Lexer lexer;
-		error = lexer.CreateTokens(fileContent);
+		Parser parser;
+		ASTNode* program = nullptr;
+
+		if (parallelFrontEnd)
+		{
+			ThreadPool pool;
+			ParallelFrontEnd frontEnd(pool);
+
+			error = frontEnd.CreateProgram(fileContent, lexer, parser);
+			program = parser.m_Program;
+		}
+		else
+		{
+			error = lexer.CreateTokens(fileContent);
+		}
+
 		if (error != "")
 			std::cout << error << "\n\n";
 
 		if (!quiet)
 		{
 			for (int i = 0; i < lexer.m_Tokens.size(); i++)
-				std::cout << lexer.m_Tokens[i].ToString() << ": " << lexer.m_Tokens[i].m_Value << " [" << lexer.m_Tokens[i].m_Depth << "]\n";
+				std::cout << lexer.m_Tokens[i].ToString() << ": " << lexer.m_Tokens[i].GetValue(lexer.m_Source) << " [" << lexer.m_Tokens[i].m_Depth << "]\n";
 			std::cout << "\n";
 		}
 
-		Parser parser;
-
-		ASTNode tree;
-		tree.parent = new ASTNode(ASTTypes::ProgramBody);
-		tree.parent->left = &tree;
-
-		parser.CreateAST(lexer.m_Tokens, &tree, tree.parent);
+		if (!parallelFrontEnd)
+			program = parser.CreateProgram(lexer.m_Tokens, lexer.m_Source);
 
 		if (parser.m_Error != "") 
 		{
@@ -274,15 +465,54 @@ int main(int argc, const char* argv[])
 			return 1;
 		}
 
-		if (!quiet) parser.PrintASTTree(tree.parent, 0);
+		Inliner inliner(parser.m_Arena);
+		inliner.Run(program);
+
+		if (!quiet) parser.PrintASTTree(program, 0);
+		if (!quiet) inliner.PrintReport();
+
+		if (method == ExecutionMethods::Closure)
+		{
+			auto& compiler = Closure::ClosureCompiler::Get();
+
+			auto compileStart = std::chrono::high_resolution_clock::now();
+
+			if (!compiler.Compile(program))
+			{
+				std::cout << "Closure compiler error: " << compiler.m_Error << "\n";
+				return 1;
+			}
+
+			auto compileStop = std::chrono::high_resolution_clock::now();
+			if (!quiet) std::cout << "Compilation took: " << std::chrono::duration_cast<std::chrono::milliseconds>(compileStop - compileStart).count() << "ms" << "\n";
+
+			if (!quiet) std::cout << "Console output:\n";
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			compiler.Run();
+			if (compiler.m_Error != "")
+			{
+				std::cout << "Closure compiler error: " << compiler.m_Error << "\n";
+				return 1;
+			}
+
+			auto stop = std::chrono::high_resolution_clock::now();
+			auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
+
+			if (!quiet) std::cout << "\nExecution took: " << (duration.count()) << "ms" << "\n";
+
+			return 0;
+		}
 
 		auto& interpreter = AST::ASTInterpreter::Get();
+		interpreter.m_UseStackEvaluator = useStackEvaluator;
 
 		auto start = std::chrono::high_resolution_clock::now();
 
 		if (!quiet) std::cout << "Console output:\n";
 
-		interpreter.Execute(tree.parent);
+		interpreter.Execute(program);
 		if (interpreter.m_Error != "")
 		{
 			std::cout << "AST Interpreter error: " << interpreter.m_Error << "\n";
@@ -293,6 +523,12 @@ int main(int argc, const char* argv[])
 		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
 
 		if (!quiet) std::cout << "\nExecution took: " << (duration.count()) << "ms" << "\n";
+
+		if (!quiet)
+		{
+			auto& stats = interpreter.m_SpecializationStats;
+			std::cout << "Specialized nodes: " << stats.m_Specialized << ", generic nodes: " << stats.m_Generic << ", fallbacks to generic: " << stats.m_Fallbacks << "\n";
+		}
 	}
 	else if (method == ExecutionMethods::Assembly)
 	{
@@ -0,0 +1,85 @@
+#include "ParallelFrontEnd.h"
+
+#include "LexerScanning.h"
+
+#include <algorithm>
+#include <assert.h>
+
+std::string ParallelFrontEnd::CreateProgram(std::string_view source, Lexer& lexer, Parser& parser, int chunkCount)
+{
+	if (chunkCount <= 0)
+		chunkCount = m_Pool.GetThreadCount() == 1 ? 1 : m_Pool.GetThreadCount() * 4;
+
+	chunkCount = std::max(1, std::min(chunkCount, (int)(source.length() / MinChunkSize)));
+
+	std::vector<int> starts = Lexer::GuessChunkStarts(source, chunkCount);
+	bool isValidUTF8 = Scanning::FindInvalidUTF8(source, true) == source.length();
+
+	ASTNode* program = parser.BeginProgram(source);
+
+	std::vector<Chunk> chunks(starts.size());
+	m_Pool.ForEach((int)chunks.size(), [&](int i) {
+		Chunk& chunk = chunks[i];
+
+		// A chunk can end at the start of any of the later ones
+		std::vector<int> stops(starts.begin() + i + 1, starts.end());
+		chunk.m_Error = chunk.m_Lexer.CreateChunkTokens(source, starts[i], stops, isValidUTF8);
+		chunk.m_Parser.ParseChunk(chunk.m_Lexer.m_Tokens, source, program);
+	});
+
+	// Each chunk continues where the one before it stopped, until one of them gets to the end or has an error
+	std::vector<int> used = { 0 };
+	size_t tokenCount = chunks[0].m_Lexer.m_Tokens.size();
+
+	for (int i = 0; chunks[i].m_Error == "" && !chunks[i].m_Lexer.m_IsComplete;)
+	{
+		int stop = chunks[i].m_Lexer.m_Position;
+		i = (int)(std::lower_bound(starts.begin(), starts.end(), stop) - starts.begin());
+		assert(i < starts.size() && starts[i] == stop);
+
+		used.push_back(i);
+		tokenCount += chunks[i].m_Lexer.m_Tokens.size();
+	}
+
+	// The nodes of each chunk are numbered for where they end up in the program's arena, on the threads since it touches every node
+	std::vector<uint32_t> firstNodes;
+	std::vector<uint32_t> firstChildren;
+	uint32_t firstNode = parser.m_Arena.GetAdoptIndex();
+	uint32_t firstChild = parser.m_Arena.GetChildCount();
+
+	for (int i : used)
+	{
+		firstNodes.push_back(firstNode);
+		firstChildren.push_back(firstChild);
+		firstNode += chunks[i].m_Parser.m_Arena.GetAdoptIndex();
+		firstChild += chunks[i].m_Parser.m_Arena.GetChildCount();
+	}
+
+	m_Pool.ForEach((int)used.size(), [&](int i) {
+		chunks[used[i]].m_Parser.m_Arena.Renumber(parser.m_Arena, firstNodes[i], firstChildren[i]);
+	});
+
+	lexer = std::move(chunks[0].m_Lexer);
+	lexer.m_Tokens.reserve(tokenCount);
+	parser.AppendChunk(chunks[0].m_Parser, 0);
+
+	for (int i = 1; i < used.size(); i++)
+	{
+		Chunk& chunk = chunks[used[i]];
+
+		int tokenOffset = (int)lexer.m_Tokens.size();
+		lexer.AppendChunk(chunk.m_Lexer);
+		parser.AppendChunk(chunk.m_Parser, tokenOffset);
+	}
+
+	parser.FinishProgram((int)lexer.m_Tokens.size());
+
+	m_ChunkCount = (int)chunks.size();
+	m_UsedChunkCount = (int)used.size();
+
+	std::string error = chunks[used.back()].m_Error;
+	if (error != "")
+		return error;
+
+	return lexer.CheckEndOfSource();
+}
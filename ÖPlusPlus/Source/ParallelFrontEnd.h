@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Lexer.h"
+#include "Parser.h"
+#include "ThreadPool.h"
+
+// Lexes and parses a long program on several threads. The source is split into chunks at lines that seem to start at the top level,
+// and each chunk is lexed and parsed on its own. Lexing a chunk checks that the next one really starts after a line at the top level,
+// if it doesn't the chunk is lexed past it to the start of a later one, and the chunks in between aren't used.
+// The tokens and the lines of the chunks are joined in order into one program body
+class ParallelFrontEnd
+{
+public:
+	ParallelFrontEnd(ThreadPool& pool) : m_Pool(pool) {};
+
+	// The lexer ends up like after lexer.CreateTokens(source), and the parser like after parser.CreateEditableProgram() with the tokens.
+	// Returns the lexer error. Zero chunks is four for each thread, if the source is long enough for them
+	std::string CreateProgram(std::string_view source, Lexer& lexer, Parser& parser, int chunkCount = 0);
+
+	// How many chunks the last program was split into, and how many of them were used
+	int m_ChunkCount = 0;
+	int m_UsedChunkCount = 0;
+
+private:
+	struct Chunk
+	{
+		Lexer m_Lexer;
+		Parser m_Parser;
+		std::string m_Error;
+	};
+
+	// Smaller chunks aren't worth a thread
+	static constexpr int MinChunkSize = 16 * 1024;
+
+	ThreadPool& m_Pool;
+};
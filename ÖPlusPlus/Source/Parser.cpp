@@ -4,6 +4,7 @@
 #include <sstream>
 #include <algorithm>
 #include <fstream>
+#include <cstring>
 
 #include "Memory.h"
 #include "Lexer.h"
@@ -77,7 +78,7 @@ std::string ASTNode::ToString(bool includeData)
 
 	if (includeData)
 	{
-		std::string val = "(\"" + stringValue + "\", " + std::to_string(numberValue) + ")";
+		std::string val = "(\"" + std::string(stringValue) + "\", " + std::to_string(numberValue) + ")";
 
 		return typeStr + " " + val;
 	}
@@ -119,108 +120,148 @@ void Parser::PrintASTTree(ASTNode* node, int depth)
 	}
 }
 
-bool IsInsideBrackets(std::vector<Token> tokens, int start)
+TokenRange TokenRange::Slice(int start, int end) const
 {
-	for (int i = start; i >= 0; i--) // Walk from here backwards
+	if (end == -1) end = Size();
+
+	return TokenRange(m_Begin + start, m_Begin + end, m_DepthShift);
+}
+
+static int ClosingBracketIndex(Token::Types type)
+{
+	if (type == Token::RightParentheses) return 0;
+	if (type == Token::RightCurlyBracket) return 1;
+	if (type == Token::RightSquareBracket) return 2;
+	return -1;
+}
+
+void TokenTables::Build(std::vector<Token>& tokens)
+{
+	m_Tokens = &tokens;
+	int count = (int)tokens.size();
+
+	for (auto& positions : m_Positions)
+		positions.clear();
+
+	for (int i = 0; i < count; i++)
+		m_Positions[tokens[i].m_Type].push_back(i);
+
+	// The depths can be negative when there are too many closing brackets, so they are indexed from the lowest one
+	int minDepth = 0;
+	int maxDepth = 0;
+	for (Token& token : tokens)
 	{
-		if (ElementExists(tokens, i - 1))
-		{
-			if (tokens[i - 1].m_Type == Token::LeftParentheses ||
-				tokens[i - 1].m_Type == Token::LeftSquareBracket) {
-				if (tokens[i].m_Depth == tokens[start].m_Depth)
-					return true;
-			}
-				
-		}
+		minDepth = std::min(minDepth, token.m_Depth);
+		maxDepth = std::max(maxDepth, token.m_Depth);
 	}
 
-	for (int i = start; i < tokens.size(); i++) // Walk from here forward
+	int depthCount = maxDepth - minDepth + 1;
+	auto depthOf = [&](int i) { return tokens[i].m_Depth - minDepth; };
+
+	// Forwards: the tokens that come right after an opening bracket, and the ifs before each else
+	std::vector<int> lastAfterOpen(depthCount, -1);
+	std::vector<int> lastIf(depthCount, -1);
+
+	m_AfterOpenBracket.resize(count);
+	m_IfBeforeElse.clear();
+	m_OuterIfBeforeElse.clear();
+
+	for (int i = 0; i < count; i++)
 	{
-		if (tokens[i].m_Type == Token::RightParentheses ||
-			tokens[i].m_Type == Token::RightSquareBracket)
+		Token::Types type = tokens[i].m_Type;
+		int depth = depthOf(i);
+
+		if (i > 0 && (tokens[i - 1].m_Type == Token::LeftParentheses || tokens[i - 1].m_Type == Token::LeftSquareBracket))
+			lastAfterOpen[depth] = i;
+		m_AfterOpenBracket[i] = lastAfterOpen[depth];
+
+		if (type == Token::Else)
 		{
-			assert(tokens[i].m_Depth != -1);
+			int outerIf = -1;
+			for (int d = 0; d < depth; d++)
+				outerIf = std::max(outerIf, lastIf[d]);
 
-			if (tokens[i].m_Depth == tokens[start].m_Depth)
-				return true;
+			m_IfBeforeElse.push_back(lastIf[depth]);
+			m_OuterIfBeforeElse.push_back(outerIf);
 		}
+		else if (type == Token::If)
+			lastIf[depth] = i;
 	}
 
-	return false;
-}
+	// Backwards: the closing brackets
+	std::vector<int> nextClose(depthCount, count);
+	std::vector<int> nextCloseOfType[3];
+	for (auto& next : nextCloseOfType)
+		next.assign(depthCount, -1);
 
-bool IsInsideNestedIfStatement(std::vector<Token> tokens, int start)
-{
-	if (start <= 0)
-		return false;
+	m_NextCloseBracket.resize(count);
+	m_MatchingBracket.assign(count, -1);
 
-	bool foundMatchingIf = false;
-	bool isHigherUpIf = false;
-	for (int i = start - 1; i >= 0; i--) // Walk from here backwards
+	for (int i = count - 1; i >= 0; i--)
 	{
-		if (tokens[i].m_Type == Token::If) {
-			if (tokens[i].m_Depth < tokens[start].m_Depth)
-				isHigherUpIf = true;
-
-			if (tokens[i].m_Depth == tokens[start].m_Depth)
-				foundMatchingIf = true;
-		}
+		Token::Types type = tokens[i].m_Type;
+		int depth = depthOf(i);
+
+		if (type == Token::LeftParentheses)
+			m_MatchingBracket[i] = nextCloseOfType[0][depth];
+		else if (type == Token::LeftCurlyBracket)
+			m_MatchingBracket[i] = nextCloseOfType[1][depth];
+		else if (type == Token::LeftSquareBracket)
+			m_MatchingBracket[i] = nextCloseOfType[2][depth];
+
+		int closing = ClosingBracketIndex(type);
+		if (closing != -1)
+			nextCloseOfType[closing][depth] = i;
+
+		if (type == Token::RightParentheses || type == Token::RightSquareBracket)
+			nextClose[depth] = i;
+		m_NextCloseBracket[i] = nextClose[depth];
 	}
+}
 
-	//for (int i = start; i < tokens.size(); i++) // Walk from here forwards
-	//{
-	//	if (ElementExists(tokens, i + 1))
-	//	{
-	//		if (tokens[i + 1].m_Type == Token::Else) {
-	//			if (tokens[i].m_Depth < tokens[start].m_Depth)
-	//				isHigherUpIf = true;
-
-	//			if (tokens[i].m_Depth == tokens[start].m_Depth)
-	//				foundMatchingIf = true;
-	//		}
-	//	}
-	//}
+Token& Parser::At(const TokenRange& tokens, int position)
+{
+	if (position < 0 || position >= tokens.Size())
+	{
+		m_EmptyToken = Token();
+		return m_EmptyToken;
+	}
 
-	if (foundMatchingIf && !isHigherUpIf)
-		return false;
+	return (*m_Tables->m_Tokens)[tokens.m_Begin + position];
+}
 
-	//for (int i = start; i < tokens.size(); i++) // Walk from here forward
-	//{
-	//	if (tokens[i].m_Type == Token::RightParentheses ||
-	//		tokens[i].m_Type == Token::RightSquareBracket)
-	//	{
-	//		assert(tokens[i].m_Depth != -1);
+// If there is a token right after a ( or [ before the token with the same depth, or a ) or ] after it with the same depth
+bool Parser::IsInsideBrackets(const TokenRange& tokens, int position)
+{
+	int index = tokens.m_Begin + position;
 
-	//		if (tokens[i].m_Depth == tokens[start].m_Depth)
-	//			return true;
-	//	}
-	//}
+	if (m_Tables->m_AfterOpenBracket[index] > tokens.m_Begin)
+		return true;
 
-	return true;
+	return m_Tables->m_NextCloseBracket[index] < tokens.m_End;
 }
 
-bool IsInsideScope(std::vector<Token> tokens, int start)
+// An else belongs to an if before it with the same depth, unless there is also an if with a lower depth before it
+bool Parser::IsInsideNestedIfStatement(const TokenRange& tokens, int elseIndex)
 {
-	for (int i = start; i >= 0; i--) // Walk from here backwards
-	{
-		if (ElementExists(tokens, i - 1))
-		{
-			if (tokens[i].m_Type == Token::LeftCurlyBracket)
-				return true;
-		}
-		if (tokens[i].m_Type == Token::RightCurlyBracket)
-		{
-			//assert(tokens[i].Depth >= 1);
-			return tokens[i].m_Depth > 1;
-		}
-	}
+	int position = m_Tables->m_Positions[Token::Else][elseIndex];
+	if (position <= tokens.m_Begin)
+		return false;
 
-	return false;
+	bool foundMatchingIf = m_Tables->m_IfBeforeElse[elseIndex] >= tokens.m_Begin;
+	bool isHigherUpIf = m_Tables->m_OuterIfBeforeElse[elseIndex] >= tokens.m_Begin;
+
+	if (foundMatchingIf && !isHigherUpIf)
+		return false;
+
+	return true;
 }
 
 // Find the matching bracket (, {, [ with the same depth
-int FindMatchingEndBracket(std::vector<Token>& tokens, Token& startToken)
+int Parser::FindMatchingEndBracket(const TokenRange& tokens, int startPosition)
 {
+	Token& startToken = At(tokens, startPosition);
+
 	Token::Types typeOfEnd = Token::Empty;
 	if (startToken.m_Type == Token::LeftParentheses)
 		typeOfEnd = Token::RightParentheses;
@@ -228,71 +269,93 @@ int FindMatchingEndBracket(std::vector<Token>& tokens, Token& startToken)
 		typeOfEnd = Token::RightCurlyBracket;
 	else if (startToken.m_Type == Token::LeftSquareBracket)
 		typeOfEnd = Token::RightSquareBracket;
+	else
+		return -1;
 
-	for (int i = 0; i < tokens.size(); i++)
+	// The search starts at the start of the range, there is only something to find before the bracket if the brackets are mismatched
+	for (int i = 0; i < startPosition; i++)
 	{
-		if (tokens[i].m_Depth == startToken.m_Depth && tokens[i].m_Type == typeOfEnd)
+		if (At(tokens, i).m_Depth == startToken.m_Depth && At(tokens, i).m_Type == typeOfEnd)
 			return i;
 	}
 
-	return -1;
+	int end = m_Tables->m_MatchingBracket[tokens.m_Begin + startPosition];
+	if (end == -1 || end >= tokens.m_End)
+		return -1;
+
+	return end - tokens.m_Begin;
 }
 
-void ReduceDepthOfBrackets(std::vector<Token>& tokens, Token::Types type)
+int Parser::FindOperator(const TokenRange& tokens, std::initializer_list<Token::Types> types)
 {
-	Token::Types typeOfEnd = Token::Empty;
-	if (type == Token::LeftParentheses)
-		typeOfEnd = Token::RightParentheses;
-	else if (type == Token::LeftCurlyBracket)
-		typeOfEnd = Token::RightCurlyBracket;
-	else if (type == Token::LeftSquareBracket)
-		typeOfEnd = Token::RightSquareBracket;
-
-	for (int i = 0; i < tokens.size(); i++)
+	// Most lines and arguments are short, then it's faster to look at the tokens than to search the position lists
+	if (tokens.Size() <= 16)
 	{
-		if (tokens[i].m_Depth == 0)
+		for (int i = 0; i < tokens.Size(); i++)
 		{
-			int a = 2;
+			Token::Types type = At(tokens, i).m_Type;
+			if (std::find(types.begin(), types.end(), type) != types.end() && !IsInsideBrackets(tokens, i))
+				return i;
 		}
-		assert(tokens[i].m_Depth != 0);
 
-		if (tokens[i].m_Type == type || tokens[i].m_Type == typeOfEnd)
-			tokens[i].m_Depth--;
+		return -1;
 	}
-}
 
+	// The positions of each type are walked at the same time, so the first operator of any of the types is found
+	struct Cursor
+	{
+		std::vector<int>::const_iterator m_Current;
+		std::vector<int>::const_iterator m_End;
+	};
 
-std::vector<std::vector<Token>> DepthSplit(std::vector<Token> tokens, Token::Types delimiter, int depth)
-{
-	std::vector<std::vector<Token>> splitted;
-	std::vector<Token> currentEntry;
+	Cursor cursors[8];
+	int cursorCount = 0;
 
-	for (int i = 0; i < tokens.size(); i++)
+	for (Token::Types type : types)
 	{
-		if (tokens[i].m_Type == delimiter && tokens[i].m_Depth == depth)
-		{
-			splitted.push_back(currentEntry);
-			currentEntry.clear();
-		}
-		else
+		const std::vector<int>& positions = m_Tables->m_Positions[type];
+		cursors[cursorCount++] = { std::lower_bound(positions.begin(), positions.end(), tokens.m_Begin), positions.end() };
+	}
+
+	while (true)
+	{
+		Cursor* first = nullptr;
+		for (int i = 0; i < cursorCount; i++)
 		{
-			currentEntry.push_back(tokens[i]);
+			if (cursors[i].m_Current != cursors[i].m_End && *cursors[i].m_Current < tokens.m_End && (!first || *cursors[i].m_Current < *first->m_Current))
+				first = &cursors[i];
 		}
-	}
 
-	if (!currentEntry.empty()) splitted.push_back(currentEntry);
+		if (!first)
+			return -1;
 
-	return splitted;
-}
+		int position = *first->m_Current - tokens.m_Begin;
+		if (!IsInsideBrackets(tokens, position))
+			return position;
 
+		first->m_Current++;
+	}
+}
 
-void ReduceDepthOfTokens(std::vector<Token>& tokens, int delta = -1)
+TokenRangeList Parser::DepthSplit(const TokenRange& tokens, Token::Types delimiter, int depth)
 {
-	for (int i = 0; i < tokens.size(); i++)
+	TokenRangeList splitted(m_RangeStack);
+	int entryStart = 0;
+
+	const std::vector<int>& positions = m_Tables->m_Positions[delimiter];
+	for (auto it = std::lower_bound(positions.begin(), positions.end(), tokens.m_Begin); it != positions.end() && *it < tokens.m_End; it++)
 	{
-		assert(tokens[i].m_Depth != 0);
-		tokens[i].m_Depth += delta;
+		int position = *it - tokens.m_Begin;
+		if (At(tokens, position).m_Depth != depth)
+			continue;
+
+		splitted.push_back(tokens.Slice(entryStart, position));
+		entryStart = position + 1;
 	}
+
+	if (entryStart < tokens.Size()) splitted.push_back(tokens.Slice(entryStart));
+
+	return splitted;
 }
 
 bool IsTokenValidPartOfExpression(Token token)
@@ -339,15 +402,13 @@ bool IsTokenValidPartOfExpression(Token token)
 //	return false;
 //}
 
-bool Parser::ParseMathExpression(Tokens& tokens, ASTNode* node)
+bool Parser::ParseMathExpression(const TokenRange& tokens, ASTNode* node)
 {
 	auto ParseMath = [&](int positionOfMathOperator) {
-		node->left = new ASTNode;
-		std::vector<Token> leftSide = SliceVector(tokens, 0, positionOfMathOperator);
-
-		//ReduceDepthOfBrackets(leftSide, Token::LeftParentheses);
+		node->left = m_Arena.Create();
+		TokenRange leftSide = tokens.Slice(0, positionOfMathOperator);
 
-		if (leftSide.size() == 0)
+		if (leftSide.Size() == 0)
 		{
 			// Assume that a '-' without a left means a multiplication by -1 
 			// TODO: Might not always work because of order of operations
@@ -366,10 +427,10 @@ bool Parser::ParseMathExpression(Tokens& tokens, ASTNode* node)
 		CreateAST(leftSide, node->left, node);
 		if (HasError()) return false;
 
-		node->right = new ASTNode;
-		std::vector<Token> rightSide = SliceVector(tokens, positionOfMathOperator + 1);
+		node->right = m_Arena.Create();
+		TokenRange rightSide = tokens.Slice(positionOfMathOperator + 1);
 
-		if (rightSide.size() == 0)
+		if (rightSide.Size() == 0)
 			return MakeError("Expected something to the right of math operator");
 
 		CreateAST(rightSide, node->right, node);
@@ -378,456 +439,555 @@ bool Parser::ParseMathExpression(Tokens& tokens, ASTNode* node)
 		return true;
 	};
 
-	// Add
-	for (int i = 0; i < tokens.size(); i++)
-	{
-		if (tokens[i].m_Type == Token::Add)
-		{
-			if (IsInsideBrackets(tokens, i))
-				continue;
-			node->type = ASTTypes::Add;
-			return ParseMath(i);
-		}
-	}
-	// Subtract
-	for (int i = 0; i < tokens.size(); i++)
-	{
-		if (tokens[i].m_Type == Token::Subtract)
-		{
-			if (IsInsideBrackets(tokens, i))
-				continue;
-			node->type = ASTTypes::Subtract;
-			return ParseMath(i);
-		}
-	}
-	// Multiply
-	for (int i = 0; i < tokens.size(); i++)
-	{
-		if (tokens[i].m_Type == Token::Multiply)
-		{
-			if (IsInsideBrackets(tokens, i))
-				continue;
-			node->type = ASTTypes::Multiply;
-			return ParseMath(i);
-		}
-	}
-	// Divide
-	for (int i = 0; i < tokens.size(); i++)
+	// The first operator of the first type that is found is split at, so + binds the loosest and / the tightest
+	const std::pair<Token::Types, ASTTypes> operators[] = {
+		{ Token::Add, ASTTypes::Add },
+		{ Token::Subtract, ASTTypes::Subtract },
+		{ Token::Multiply, ASTTypes::Multiply },
+		{ Token::Divide, ASTTypes::Divide }
+	};
+
+	for (auto& [tokenType, nodeType] : operators)
 	{
-		if (tokens[i].m_Type == Token::Divide)
+		int position = FindOperator(tokens, { tokenType });
+		if (position != -1)
 		{
-			if (IsInsideBrackets(tokens, i))
-				continue;
-			node->type = ASTTypes::Divide;
-			return ParseMath(i);
+			node->type = nodeType;
+			return ParseMath(position);
 		}
 	}
 
 	return false;
 }
 
-void ReduceDepth(std::vector<Token>& tokens, Token::Types toFind)
-{
-	for (int i = 0; i < tokens.size(); i++)
-	{
-		if (tokens[i].m_Type == toFind)
-			tokens[i].m_Depth--;
-	}
-}
-
-std::vector<Tokens> MakeScopeIntoLines(std::vector<Token> tokens, int start, int end, int startingDepth)
+// The lines are the parts of the scope between its semicolons and after its closing curly brackets, except when an else comes after them
+TokenRangeList Parser::MakeScopeIntoLines(const TokenRange& tokens, int start, int end, int startingDepth)
 {
-	std::vector<Tokens> lines;
-	std::vector<Token> currentLine;
-
-	int scopeDepth = startingDepth;// tokens[0].m_Depth;
-	bool isInsideParentheses = false;
-	bool isInsideDeeperScope = false;
+	TokenRangeList lines(m_RangeStack);
 
-	bool isInsideStatement = false;
+	TokenRange scope = tokens.Slice(start, end);
+	int lineStart = 0;
 
-	int currentCurlyBracketDepth = 0;
-	int curlyBracketDepth = 0;
-	int statementDepth = 0;
-	bool insideStatementArgs = false;
-
-	bool dontReduceDepth = tokens[0].m_Depth == 0;
-
-	auto ReduceTokenDepth = [dontReduceDepth](Token& token) {
-		//if (!dontReduceDepth)
-			//token.m_Depth--;
-	};
-
-	tokens = SliceVector(tokens, start, end);
-
-	for (int i = 0; i < tokens.size(); i++)
+	for (int i = 0; i < scope.Size(); i++)
 	{
-		Token token = tokens[i];
+		Token& token = At(scope, i);
 
-		isInsideDeeperScope = token.m_Depth > scopeDepth;
-		bool isInsideStatement = statementDepth > 0;
+		// Tokens in deeper scopes are always part of the current line
+		if (token.m_Depth > startingDepth)
+			continue;
 
-		if (token.IsStatementKeyword())
-		{
-			statementDepth++;
-			insideStatementArgs = true;
-			ReduceTokenDepth(token);
-			currentLine.push_back(token);
-		}
-		else if (token.m_Type == Token::LeftCurlyBracket)
+		if (token.m_Type == Token::RightCurlyBracket)
 		{
-			ReduceTokenDepth(token);
-
-			currentLine.push_back(token);
-
-			curlyBracketDepth++;
-		}
-		else if (token.m_Type == Token::RightCurlyBracket)
-		{
-			ReduceTokenDepth(token);
-
-			currentLine.push_back(token);
-
-			curlyBracketDepth--;
-			isInsideDeeperScope = token.m_Depth > scopeDepth;
-
-			// If the curly bracket belongs to this scope
-			if (!isInsideDeeperScope)
+			if (i < scope.Size() - 1 && At(scope, i + 1).m_Type != Token::Else)
 			{
-				// Then search for elses that are right after the scope, for example an if statement
-				/*if (i < tokens.size() - 1)
-				{
-					if (tokens[i + 1].m_Type == Token::Else)
-					{
-						currentLine.emplace_back(Token::Else, "", token.m_Depth - 1);
-						i++;
-					}
-				}*/
-
-				if (i < tokens.size() - 1)
-				{
-					if (tokens[i + 1].m_Type == Token::Else)
-					{
-
-					}
-					else {
-						lines.push_back(currentLine);
-						currentLine.clear();
-					}
-				}
-
-				// Reduce the scope depth
-				/*scopeDepth--;
-				isInsideDeeperScope = false;
-				curlyBracketDepth--;*/
+				lines.push_back(scope.Slice(lineStart, i + 1));
+				lineStart = i + 1;
 			}
 		}
-		else if (token.m_Type == Token::Else)
+		else if (token.m_Type == Token::Semicolon)
 		{
-			ReduceTokenDepth(token);
-			currentLine.push_back(token);
-		}
-		else if (token.m_Type == Token::LeftParentheses)
-		{
-			isInsideParentheses = true;
-
-			if (curlyBracketDepth > 0 || insideStatementArgs)
-				ReduceTokenDepth(token);
-
-			currentLine.push_back(token);
-		}
-		else if (token.m_Type == Token::RightParentheses)
-		{
-			isInsideParentheses = true;
-
-			if (curlyBracketDepth > 0 || insideStatementArgs)
-				ReduceTokenDepth(token);
-
-			if (statementDepth == token.m_Depth) insideStatementArgs = false;
-
-			currentLine.push_back(token);
-		}
-		/*else if (token.m_Type == Token::Else)
-		{
-			currentLine.emplace_back(Token::Else, "", token.m_Depth - 1);
-		}*/
-		else
-		{
-			if (token.m_Type != Token::Semicolon)
-			{
-				if (isInsideDeeperScope) {
-					if (curlyBracketDepth > 0 || insideStatementArgs)
-						ReduceTokenDepth(token);
-				}
+			if (i > lineStart)
+				lines.push_back(scope.Slice(lineStart, i));
 
-				currentLine.push_back(token);
-			}
-			else
-			{
-				if (!isInsideDeeperScope)
-				{
-					if (!currentLine.empty())
-					{
-						lines.push_back(currentLine);
-						currentLine.clear();
-					}
-				}
-				else
-				{
-					ReduceTokenDepth(token);
-					currentLine.push_back(token);
-				}
-			}
+			lineStart = i + 1;
 		}
 	}
-	if (!currentLine.empty()) lines.push_back(currentLine);
+
+	if (lineStart < scope.Size()) lines.push_back(scope.Slice(lineStart));
 
 	return lines;
 }
 
-bool Parser::IsValidElseStatement(Tokens tokens, int position)
+bool Parser::IsValidElseStatement(const TokenRange& tokens, int position)
 {
-	Tokens ifScope = SliceVector(tokens, 0, position);
-	Tokens elseScope = SliceVector(tokens, position + 1);
+	TokenRange ifScope = tokens.Slice(0, position);
 
-	if (ifScope.empty())
+	if (ifScope.Empty())
 		return MakeError("Expected if statement before else");
-	if (ifScope[0].m_Type != Token::If)
-		return MakeError("Expected if statement before else, not " + ifScope[0].ToString());
+	if (At(ifScope, 0).m_Type != Token::If)
+		return MakeError("Expected if statement before else, not " + At(ifScope, 0).ToString());
 
 	return true;
 }
 
-bool Parser::IsValidStatement(Tokens tokens)
+bool Parser::IsValidStatement(const TokenRange& tokens)
 {
-	if (!tokens[0].IsStatementKeyword()) return false;
+	if (!At(tokens, 0).IsStatementKeyword()) return false;
 
-	if (!ElementExists(tokens, 1) || tokens[1].m_Type != Token::LeftParentheses)
-		return MakeError("Expected a left parentheses after " + tokens[0].ToString() + " statement");
+	if (tokens.Size() < 2 || At(tokens, 1).m_Type != Token::LeftParentheses)
+		return MakeError("Expected a left parentheses after " + At(tokens, 0).ToString() + " statement");
 
 	// Collect the statement tokens
-	int endParanthesisPosition = FindMatchingEndBracket(tokens, tokens[1]);
+	int endParanthesisPosition = FindMatchingEndBracket(tokens, 1);
 	if (endParanthesisPosition == -1)
-		return MakeError("Found no closing parenthesis for " + tokens[0].ToString() + " statement");
-	std::vector<Token> argContent = SliceVector(tokens, 2, endParanthesisPosition);
+		return MakeError("Found no closing parenthesis for " + At(tokens, 0).ToString() + " statement");
+	TokenRange argContent = tokens.Slice(2, endParanthesisPosition);
 
-	if (argContent.empty())
-		return MakeError("Expected an expression inside the " + tokens[0].ToString() + " statement");
+	if (argContent.Empty())
+		return MakeError("Expected an expression inside the " + At(tokens, 0).ToString() + " statement");
 
-	if (argContent.front().m_Type == Token::Comma)
-		return MakeError("Expected something before the first comma in the " + tokens[0].ToString() + " statement");
-	if (argContent.back().m_Type == Token::Comma)
-		return MakeError("Expected something after the last comma in the " + tokens[0].ToString() + " statement");
+	if (At(argContent, 0).m_Type == Token::Comma)
+		return MakeError("Expected something before the first comma in the " + At(tokens, 0).ToString() + " statement");
+	if (At(argContent, argContent.Size() - 1).m_Type == Token::Comma)
+		return MakeError("Expected something after the last comma in the " + At(tokens, 0).ToString() + " statement");
 
-	std::vector<Tokens> argumentsForStatement = DepthSplit(argContent, Token::Comma, tokens[1].m_Depth);
+	TokenRangeList argumentsForStatement = DepthSplit(argContent, Token::Comma, At(tokens, 1).m_Depth);
 
 	if (argumentsForStatement.empty())
-		return MakeError("No arguments for " + tokens[0].ToString() + " statement");
+		return MakeError("No arguments for " + At(tokens, 0).ToString() + " statement");
 
 	int leftCurlyBracket = endParanthesisPosition + 1;
 
-	if (!ElementExists(tokens, leftCurlyBracket))
-		return MakeError("Expected a scope after the " + tokens[0].ToString() + " statement");
+	if (leftCurlyBracket >= tokens.Size())
+		return MakeError("Expected a scope after the " + At(tokens, 0).ToString() + " statement");
 
 	return true;
 }
 
 // {type} {variable} = {expression} 
 // {variable} = {expression} 
-bool Parser::IsValidAssignmentExpression(Tokens tokens, int equalsSignPosition)
+bool Parser::IsValidAssignmentExpression(const TokenRange& tokens, int equalsSignPosition)
 {
-	if (!ElementExists(tokens, equalsSignPosition - 1) || tokens[equalsSignPosition - 1].m_Type != Token::Variable)
-		return MakeError("Expected a variable on the left side of the equals sign, not a " + tokens[equalsSignPosition - 1].ToString());
+	if (equalsSignPosition - 1 < 0 || At(tokens, equalsSignPosition - 1).m_Type != Token::Variable)
+		return MakeError("Expected a variable on the left side of the equals sign, not a " + At(tokens, equalsSignPosition - 1).ToString());
 
-	if (ElementExists(tokens, equalsSignPosition - 2))
+	if (equalsSignPosition - 2 >= 0)
 	{
 		// For this to be valid the token i - 2 has to be a type decleration
-		if (!tokens[equalsSignPosition - 2].IsVariableType())// && tokens[equalsSignPosition - 2].m_Type != Token::PropertyAccess)
-			return MakeError("Expected variable type to the left of variable in assignment, not a " + tokens[equalsSignPosition - 2].ToString());
+		if (!At(tokens, equalsSignPosition - 2).IsVariableType())
+			return MakeError("Expected variable type to the left of variable in assignment, not a " + At(tokens, equalsSignPosition - 2).ToString());
 	}
 
-	if (!ElementExists(tokens, equalsSignPosition + 1))
+	if (equalsSignPosition + 1 >= tokens.Size())
 		return MakeError("Expected an expression on the right side of the equals sign");
 
-	//if (tokens[equalsSignPosition + 1].m_Type == Token::FunctionType)
-		//return true;
-
-	if (!IsTokenValidPartOfExpression(tokens[equalsSignPosition + 1]))
-		return MakeError("Expected an expression on the right side of the equals sign, not a " + tokens[equalsSignPosition + 1].ToString());
+	if (!IsTokenValidPartOfExpression(At(tokens, equalsSignPosition + 1)))
+		return MakeError("Expected an expression on the right side of the equals sign, not a " + At(tokens, equalsSignPosition + 1).ToString());
 
 	return true;
 }
 
-//// {variable}: {expression} 
-//bool Parser::IsValidPropertyAssignmentExpression(std::vector<Token> tokens)
-//{
-//	if (!ElementExists(tokens, 1) || tokens[0].m_Type != Token::Variable)
-//		return CreateError("Expected a variable on the left side of the equals sign, not a " + tokens[0].ToString());
-//
-//	if (!ElementExists(tokens, 2))
-//		return CreateError("Expected an expression on the right side of the equals sign");
-//
-//
-//	if (!IsTokenValidPartOfExpression(tokens[2]))
-//		return CreateError("Expected an expression on the right side of the equals sign, not a " + tokens[2].ToString());
-//
-//	return true;
-//}
-//
-
 // {variable} += {expression}
-bool Parser::IsValidCompoundAssignmentExpression(Tokens tokens, int operatorPosition)
+bool Parser::IsValidCompoundAssignmentExpression(const TokenRange& tokens, int operatorPosition)
 {
-	Token opToken = tokens[operatorPosition];
+	Token opToken = At(tokens, operatorPosition);
 
-	if (!ElementExists(tokens, operatorPosition - 1))
+	if (operatorPosition - 1 < 0)
 		return MakeError("Expected something before " + opToken.ToString());
 
-	Token varToken = tokens[operatorPosition - 1];
+	Token varToken = At(tokens, operatorPosition - 1);
 
 	if (varToken.m_Type != Token::Variable)
-		return MakeError("Expected a variable before " + opToken.ToString() + " but got a " + tokens[operatorPosition - 1].ToString());
+		return MakeError("Expected a variable before " + opToken.ToString() + " but got a " + varToken.ToString());
 
 	// If more things before variable
-	if (ElementExists(tokens, operatorPosition - 2))
-		return MakeError("Expected only a variable on the left side of " + opToken.ToString() + " but got" + tokens[operatorPosition - 2].ToString());
+	if (operatorPosition - 2 >= 0)
+		return MakeError("Expected only a variable on the left side of " + opToken.ToString() + " but got" + At(tokens, operatorPosition - 2).ToString());
 
-	if (!ElementExists(tokens, operatorPosition + 1))
+	if (operatorPosition + 1 >= tokens.Size())
 		return MakeError("Expected an expression after " + opToken.ToString());
 
 	return true;
 }
 
 // {something} && {something}
-bool Parser::IsValidLogicalAndOrExpression(Tokens tokens, int position)
+bool Parser::IsValidLogicalAndOrExpression(const TokenRange& tokens, int position)
 {
-	if (!ElementExists(tokens, position - 1))
-		return MakeError("Expected something to the left of " + tokens[position].ToString() + " operator");
-	if (!ElementExists(tokens, position + 1))
-		return MakeError("Expected something to the right of " + tokens[position].ToString() + " operator");
+	if (position - 1 < 0)
+		return MakeError("Expected something to the left of " + At(tokens, position).ToString() + " operator");
+	if (position + 1 >= tokens.Size())
+		return MakeError("Expected something to the right of " + At(tokens, position).ToString() + " operator");
 
 	return true;
 }
 
-bool Parser::IsValidComparisonExpression(Tokens tokens, int position)
+bool Parser::IsValidComparisonExpression(const TokenRange& tokens, int position)
 {
-	if (!ElementExists(tokens, position - 1))
-		return MakeError("Expected comething to the left of " + tokens[position].ToString() + " operator");
-	if (!ElementExists(tokens, position + 1))
-		return MakeError("Expected comething to the right of " + tokens[position].ToString() + " operator");
+	if (position - 1 < 0)
+		return MakeError("Expected comething to the left of " + At(tokens, position).ToString() + " operator");
+	if (position + 1 >= tokens.Size())
+		return MakeError("Expected comething to the right of " + At(tokens, position).ToString() + " operator");
 
 	return true;
 }
 
 // {variable}++
-bool Parser::IsValidPostIncDecExpression(Tokens tokens, int position)
+bool Parser::IsValidPostIncDecExpression(const TokenRange& tokens, int position)
 {
-	if (tokens[position].m_Type != Token::Variable)
+	if (At(tokens, position).m_Type != Token::Variable)
 		return MakeError("Expected variable to the left of Increment or decrement");
 
-	if (!ElementExists(tokens, position + 1))
+	if (position + 1 >= tokens.Size())
 		return MakeError("Expected ++ or -- to the right of variable");
 
-	if (tokens[position + 1].m_Type != Token::PostIncrement && tokens[position + 1].m_Type != Token::PostDecrement)
-		return MakeError("Expected ++ or -- to the right of variable, not " + tokens[position + 1].ToString());
+	if (At(tokens, position + 1).m_Type != Token::PostIncrement && At(tokens, position + 1).m_Type != Token::PostDecrement)
+		return MakeError("Expected ++ or -- to the right of variable, not " + At(tokens, position + 1).ToString());
 
-	if (tokens.size() > 2)
+	if (tokens.Size() > 2)
 		return MakeError("Too many things in increment or decrement expression");
 
 	return true;
 }
 
 // ++{variable}
-bool Parser::IsValidPreIncDecExpression(Tokens tokens, int position)
+bool Parser::IsValidPreIncDecExpression(const TokenRange& tokens, int position)
 {
-	if (tokens[position].m_Type != Token::PreIncrement && tokens[position].m_Type != Token::PreDecrement)
-		return MakeError("Expected ++ or -- to the left of variable, not " + tokens[position].ToString());
+	if (At(tokens, position).m_Type != Token::PreIncrement && At(tokens, position).m_Type != Token::PreDecrement)
+		return MakeError("Expected ++ or -- to the left of variable, not " + At(tokens, position).ToString());
 
-	if (!ElementExists(tokens, position + 1))
-		return MakeError("Expected variable to the right of " + tokens[position].ToString());
+	if (position + 1 >= tokens.Size())
+		return MakeError("Expected variable to the right of " + At(tokens, position).ToString());
 
-	if (tokens[position + 1].m_Type != Token::Variable)
-		return MakeError("Expected variable to the right of " + tokens[position].ToString());
+	if (At(tokens, position + 1).m_Type != Token::Variable)
+		return MakeError("Expected variable to the right of " + At(tokens, position).ToString());
 
-	if (tokens.size() > 2)
+	if (tokens.Size() > 2)
 		return MakeError("Too many things in increment or decrement expression");
 
 	return true;
 }
 
-bool Parser::IsValidFunctionCallExpression(Tokens tokens)
+bool Parser::IsValidFunctionCallExpression(const TokenRange& tokens)
 {
-	if (tokens[0].m_Type != Token::FunctionName)
+	if (At(tokens, 0).m_Type != Token::FunctionName)
 		return MakeError("Not a function call");
-	if (!ElementExists(tokens, 1) || tokens[1].m_Type != Token::LeftParentheses)
-		return MakeError("Expected a left parentheses after function call, but got " + tokens[1].ToString());
+	if (tokens.Size() < 2 || At(tokens, 1).m_Type != Token::LeftParentheses)
+		return MakeError("Expected a left parentheses after function call, but got " + At(tokens, 1).ToString());
 
-	int endParanthesisPosition = FindMatchingEndBracket(tokens, tokens[1]);
+	int endParanthesisPosition = FindMatchingEndBracket(tokens, 1);
 	if (endParanthesisPosition == -1)
 		return MakeError("Found no closing parenthesis for function call");
 
-	std::vector<Token> argContent = SliceVector(tokens, 2, endParanthesisPosition);
-	if (argContent.empty()) 
+	TokenRange argContent = tokens.Slice(2, endParanthesisPosition);
+	if (argContent.Empty()) 
 		return true;
-	if (argContent.front().m_Type == Token::Comma)
+	if (At(argContent, 0).m_Type == Token::Comma)
 		return MakeError("Expected an argument before the first comma in the function call");
-	if (argContent.back().m_Type == Token::Comma)
+	if (At(argContent, argContent.Size() - 1).m_Type == Token::Comma)
 		return MakeError("Expected an argument after the last comma in the function call");
 
 	return true;
 }
 
 // {type} {variable} or global {type} {variable}
-bool Parser::IsValidVariableDeclarationExpression(Tokens tokens)
+bool Parser::IsValidVariableDeclarationExpression(const TokenRange& tokens)
 {
-	if (tokens[0].m_Type == Token::Global)
+	if (At(tokens, 0).m_Type == Token::Global)
 	{
-		if (!tokens[1].IsVariableType())
+		if (!At(tokens, 1).IsVariableType())
 			return MakeError("Expected a type after 'global' keyword in variable declaration");
 
-		if (!ElementExists(tokens, 2) || tokens[2].m_Type != Token::Variable)
+		if (tokens.Size() < 3 || At(tokens, 2).m_Type != Token::Variable)
 			return MakeError("Expected a variable after variable type");
 	}
 	else
 	{
-		if (!tokens[0].IsVariableType())
+		if (!At(tokens, 0).IsVariableType())
 			return false;
 
-		if (!ElementExists(tokens, 1) || tokens[1].m_Type != Token::Variable)
+		if (tokens.Size() < 2 || At(tokens, 1).m_Type != Token::Variable)
 			return MakeError("Expected a variable after variable type");
 	}
 
 	return true;
 }
 
-void Parser::CreateAST(std::vector<Token>& tokens, ASTNode* node, ASTNode* parent)
+ASTNode* ASTArena::Create(ASTTypes type)
+{
+	if (m_NodeCount == m_Blocks.size() * BlockSize)
+		m_Blocks.emplace_back(new ASTNode[BlockSize]);
+
+	ASTNode* node = &m_Blocks.back()[m_NodeCount % BlockSize];
+	node->type = type;
+	node->index = m_FirstIndex + m_NodeCount++;
+	node->arguments.m_Arena = this;
+
+	return node;
+}
+
+std::string_view ASTArena::CopyString(std::string_view string)
+{
+	if (string.empty())
+		return std::string_view();
+
+	// A string that is longer than a block gets one of its own
+	if (m_StringBlocks.empty() || m_StringBlockUsed + string.size() > StringBlockSize)
+	{
+		m_StringBlocks.emplace_back(new char[std::max(string.size(), StringBlockSize)]);
+		m_StringBlockUsed = 0;
+	}
+
+	char* copy = m_StringBlocks.back().get() + m_StringBlockUsed;
+	memcpy(copy, string.data(), string.size());
+	m_StringBlockUsed += string.size();
+
+	return std::string_view(copy, string.size());
+}
+
+void ASTArena::Adopt(ASTArena& other)
+{
+	uint32_t first = GetAdoptIndex();
+	uint32_t firstChild = GetChildCount();
+
+	if (other.m_NodeCount != 0 && (other.m_FirstIndex != first || other.m_FirstChild != firstChild || other.m_ListArena != this))
+		other.Renumber(*this, first, firstChild);
+
+	for (auto& block : other.m_Blocks)
+		m_Blocks.push_back(std::move(block));
+
+	if (other.m_NodeCount != 0)
+		m_NodeCount = first - m_FirstIndex + other.m_NodeCount;
+
+	m_Children.insert(m_Children.end(), other.m_Children.begin(), other.m_Children.end());
+
+	// The strings don't need to be renumbered, the views point to the blocks
+	if (!other.m_StringBlocks.empty())
+	{
+		for (auto& block : other.m_StringBlocks)
+			m_StringBlocks.push_back(std::move(block));
+
+		m_StringBlockUsed = other.m_StringBlockUsed;
+	}
+
+	other.m_Blocks.clear();
+	other.m_NodeCount = 0;
+	other.m_FirstIndex = 0;
+	other.m_Children.clear();
+	other.m_FirstChild = 0;
+	other.m_ListArena = &other;
+	other.m_StringBlocks.clear();
+}
+
+void ASTArena::Renumber(ASTArena& target, uint32_t firstNode, uint32_t firstChild)
+{
+	for (uint32_t& child : m_Children)
+		child += firstNode - m_FirstIndex;
+
+	for (uint32_t i = 0; i < m_NodeCount; i++)
+	{
+		ASTNode& node = m_Blocks[i / BlockSize][i % BlockSize];
+		node.index = firstNode + i;
+		node.arguments.m_Arena = &target;
+		node.arguments.m_First += firstChild - m_FirstChild;
+	}
+
+	m_FirstIndex = firstNode;
+	m_FirstChild = firstChild;
+	m_ListArena = &target;
+}
+
+void ASTNodeList::push_back(ASTNode* node)
+{
+	std::vector<uint32_t>& children = m_Arena->m_Children;
+	assert(m_Arena->Get(node->index) == node);
+
+	if (m_Size == m_Capacity)
+	{
+		// The last list can grow where it is, the others are moved to the end
+		uint32_t capacity = m_Capacity == 0 ? 4 : m_Capacity * 2;
+		uint32_t first = m_First + m_Capacity == children.size() ? m_First : (uint32_t)children.size();
+
+		children.resize(first + capacity);
+		if (first != m_First)
+			std::copy(children.begin() + m_First, children.begin() + m_First + m_Size, children.begin() + first);
+
+		m_First = first;
+		m_Capacity = capacity;
+	}
+
+	children[m_First + m_Size++] = node->index;
+}
+
+ASTNode* Parser::CreateProgram(std::vector<Token>& tokens, std::string_view source)
+{
+	m_Source = source;
+
+	m_ProgramTables.Build(tokens);
+	m_Tables = &m_ProgramTables;
+
+	ASTNode* program = m_Arena.Create(ASTTypes::ProgramBody);
+	program->left = m_Arena.Create();
+
+	CreateAST(TokenRange(0, (int)tokens.size()), program->left, program);
+
+	return program;
+}
+
+ASTNode* Parser::CreateEditableProgram(std::vector<Token>& tokens, std::string_view source)
+{
+	m_Source = source;
+
+	m_ProgramTables.Build(tokens);
+	m_Tables = &m_ProgramTables;
+
+	m_Program = m_Arena.Create(ASTTypes::ProgramBody);
+	m_Program->left = m_Arena.Create(ASTTypes::Scope);
+
+	m_ProgramLines.clear();
+	ParseProgramLines(TokenRange(0, (int)tokens.size()), 0, m_ProgramLines);
+
+	FinishProgram((int)tokens.size());
+	return m_Program;
+}
+
+ASTNode* Parser::BeginProgram(std::string_view source)
+{
+	m_Source = source;
+
+	m_Program = m_Arena.Create(ASTTypes::ProgramBody);
+	m_Program->left = m_Arena.Create(ASTTypes::Scope);
+
+	m_ProgramLines.clear();
+	return m_Program;
+}
+
+void Parser::ParseChunk(std::vector<Token>& tokens, std::string_view source, ASTNode* program)
+{
+	m_Source = source;
+
+	m_ProgramTables.Build(tokens);
+	m_Tables = &m_ProgramTables;
+
+	// The lines get the scope of the program as their parent, it isn't changed until the chunks are appended
+	m_Program = program;
+	m_ProgramLines.clear();
+	ParseProgramLines(TokenRange(0, (int)tokens.size()), 0, m_ProgramLines);
+}
+
+void Parser::AppendChunk(Parser& chunk, int tokenOffset)
+{
+	for (ProgramLine& line : chunk.m_ProgramLines)
+	{
+		line.m_Tokens.m_Begin += tokenOffset;
+		line.m_Tokens.m_End += tokenOffset;
+		m_ProgramLines.push_back(std::move(line));
+	}
+
+	chunk.m_ProgramLines.clear();
+	m_Arena.Adopt(chunk.m_Arena);
+}
+
+ASTNode* Parser::UpdateProgram(std::vector<Token>& tokens, std::string_view source, int begin, int oldEnd, int newEnd)
+{
+	m_Source = source;
+
+	// The ends are line ends, so the lines before the replaced part end before it and the ones after it start after it
+	auto first = std::lower_bound(m_ProgramLines.begin(), m_ProgramLines.end(), begin, [](const ProgramLine& line, int position) { return line.m_Tokens.m_Begin < position; });
+	auto last = std::lower_bound(first, m_ProgramLines.end(), oldEnd, [](const ProgramLine& line, int position) { return line.m_Tokens.m_Begin < position; });
+
+	int shift = newEnd - oldEnd;
+	for (auto line = last; line != m_ProgramLines.end(); line++)
+	{
+		line->m_Tokens.m_Begin += shift;
+		line->m_Tokens.m_End += shift;
+	}
+
+	// The new tokens get tables of their own, they don't depend on anything outside of their lines
+	std::vector<Token> changedTokens(tokens.begin() + begin, tokens.begin() + newEnd);
+	TokenTables tables;
+	tables.Build(changedTokens);
+
+	TokenTables* previousTables = m_Tables;
+	m_Tables = &tables;
+
+	std::vector<ProgramLine> lines;
+	ParseProgramLines(TokenRange(0, (int)changedTokens.size()), begin, lines);
+
+	m_Tables = previousTables;
+
+	int firstIndex = (int)(first - m_ProgramLines.begin());
+	m_ProgramLines.erase(first, last);
+	m_ProgramLines.insert(m_ProgramLines.begin() + firstIndex, std::make_move_iterator(lines.begin()), std::make_move_iterator(lines.end()));
+
+	FinishProgram((int)tokens.size());
+	return m_Program;
+}
+
+void Parser::ParseProgramLines(const TokenRange& tokens, int offset, std::vector<ProgramLine>& lines)
+{
+	TokenRangeList ranges = MakeScopeIntoLines(tokens, 0, tokens.Size(), 0);
+
+	for (int i = 0; i < ranges.size(); i++)
+	{
+		TokenRange range = ranges[i];
+
+		ProgramLine line;
+		line.m_Tokens = TokenRange(range.m_Begin + offset, range.m_End + offset);
+
+		// Every line starts without an error, the first one that gets one has the error of the whole program
+		m_Error = "";
+
+		uint32_t nodeCount = m_Arena.GetNodeCount();
+		line.m_Node = m_Arena.Create();
+		CreateAST(range, line.m_Node, m_Program->left);
+
+		line.m_Error = m_Error;
+		line.m_NodeCount = m_Arena.GetNodeCount() - nodeCount;
+		lines.push_back(std::move(line));
+	}
+}
+
+void Parser::FinishProgram(int tokenCount)
+{
+	ASTNode* scope = m_Program->left;
+	scope->parent = m_Program;
+
+	// CreateAST() leaves the node empty when there are no tokens at all
+	scope->type = tokenCount == 0 ? ASTTypes::Empty : ASTTypes::Scope;
+	scope->arguments.clear();
+
+	m_Error = "";
+	m_ProgramNodeCount = 2;
+
+	for (ProgramLine& line : m_ProgramLines)
+	{
+		m_ProgramNodeCount += line.m_NodeCount;
+
+		if (m_Error != "")
+			continue;
+
+		if (line.m_Error != "")
+			m_Error = line.m_Error;
+		else
+			scope->arguments.push_back(line.m_Node);
+	}
+}
+
+void Parser::CreateASTFromCopy(std::vector<Token>& tokens, int depthShift, ASTNode* node, ASTNode* parent)
+{
+	TokenTables tables;
+	tables.Build(tokens);
+
+	TokenTables* previousTables = m_Tables;
+	m_Tables = &tables;
+
+	CreateAST(TokenRange(0, (int)tokens.size(), depthShift), node, parent);
+
+	m_Tables = previousTables;
+}
+
+void Parser::CreateAST(const TokenRange& tokens, ASTNode* node, ASTNode* parent)
 {
 	node->parent = parent;
 
 	if (HasError()) return;
 
-	if (tokens.empty()) return;
+	if (tokens.Empty()) return;
 
 	// Check for scopes
-	if (tokens[0].m_Type == Token::LeftCurlyBracket || parent->type == ASTTypes::ProgramBody)
+	if (At(tokens, 0).m_Type == Token::LeftCurlyBracket || parent->type == ASTTypes::ProgramBody)
 	{
 		node->type = ASTTypes::Scope;
 
-		std::vector<std::vector<Token>> lines;
-
 		// There are no first and last brackets to exlude if it's the root program, so iterate all tokens
-		if (parent->type == ASTTypes::ProgramBody)
-			lines = MakeScopeIntoLines(tokens, 0, tokens.size(), 0);
-		else
-			lines = MakeScopeIntoLines(tokens, 1, tokens.size() - 1, tokens[0].m_Depth);
-
-		// Evaluate each of the lines, and make the result a child of a line node
-		ASTNode* lineNode = new ASTNode;
+		TokenRangeList lines = parent->type == ASTTypes::ProgramBody ?
+			MakeScopeIntoLines(tokens, 0, tokens.Size(), 0) :
+			MakeScopeIntoLines(tokens, 1, tokens.Size() - 1, At(tokens, 0).m_Depth);
 
 		// Finally, evaluate all lines
 		for (int i = 0; i < lines.size(); i++)
 		{
-			ASTNode* line = new ASTNode;
+			ASTNode* line = m_Arena.Create();
 
 			CreateAST(lines[i], line, node);
 			if (HasError()) return;
@@ -838,6 +998,30 @@ void Parser::CreateAST(std::vector<Token>& tokens, ASTNode* node, ASTNode* paren
 		return;
 	}
 
+	// import "file"
+	if (At(tokens, 0).m_Type == Token::Import)
+	{
+		if (tokens.Size() != 2 || At(tokens, 1).m_Type != Token::StringLiteral)
+			return MakeErrorVoid("Expected the path of a file in a string after import");
+
+		node->type = ASTTypes::Import;
+		node->stringValue = m_Arena.CopyString(At(tokens, 1).GetValue(m_Source));
+		return;
+	}
+
+	// export and a variable or function declaration
+	if (At(tokens, 0).m_Type == Token::Export)
+	{
+		if (tokens.Size() == 1)
+			return MakeErrorVoid("Expected a declaration after export");
+
+		node->type = ASTTypes::Export;
+		node->left = m_Arena.Create();
+
+		CreateAST(tokens.Slice(1), node->left, node);
+		return;
+	}
+
 	if (!ParseElseStatement(tokens, node))
 	{
 		if (HasError())
@@ -860,13 +1044,13 @@ void Parser::CreateAST(std::vector<Token>& tokens, ASTNode* node, ASTNode* paren
 	else return;
 
 	// parse return 
-	if (tokens[0].m_Type == Token::Return)
+	if (At(tokens, 0).m_Type == Token::Return)
 	{
-		node->left = new ASTNode;
+		node->left = m_Arena.Create();
 		node->type = ASTTypes::Return;
 
 		// Parse the expression after the return
-		std::vector<Token> returnValue = SliceVector(tokens, 1);
+		TokenRange returnValue = tokens.Slice(1);
 
 		CreateAST(returnValue, node->left, node);
 
@@ -906,12 +1090,12 @@ void Parser::CreateAST(std::vector<Token>& tokens, ASTNode* node, ASTNode* paren
 	}
 	else return;
 
-	if (tokens[0].m_Type == Token::Else)
+	if (At(tokens, 0).m_Type == Token::Else)
 	{
-		node->left = new ASTNode;
+		node->left = m_Arena.Create();
 		node->type = ASTTypes::Else;
 
-		std::vector<Token> scope = SliceVector(tokens, 1);
+		TokenRange scope = tokens.Slice(1);
 		CreateAST(scope, node->left, node);
 
 		return;
@@ -952,28 +1136,30 @@ void Parser::CreateAST(std::vector<Token>& tokens, ASTNode* node, ASTNode* paren
 	else return;
 
 	// Single token nodes
-	if (tokens.size() == 1)
+	if (tokens.Size() == 1)
 	{
-		Token& token = tokens[0];
+		Token& token = At(tokens, 0);
 		if (token.m_Type == Token::Variable)
 		{
 			node->type = ASTTypes::Variable;
-			node->stringValue = token.m_Value;
+			node->stringValue = m_Arena.CopyString(token.GetValue(m_Source));
+			node->symbol = token.m_Symbol;
 		}
 		if (token.m_Type == Token::IntLiteral)
 		{
 			node->type = ASTTypes::IntLiteral;
-			node->numberValue = std::stoi(token.m_Value);
+			node->numberValue = std::stoi(std::string(token.GetValue(m_Source)));
 		}
 		if (token.m_Type == Token::DoubleLiteral)
 		{
 			node->type = ASTTypes::DoubleLiteral;
-			node->numberValue = StringToDouble(token.m_Value);
+			node->numberValue = StringToDouble(std::string(token.GetValue(m_Source)));
 		}
 		if (token.m_Type == Token::StringLiteral)
 		{
 			node->type = ASTTypes::StringLiteral;
-			node->stringValue = token.m_Value;
+			node->stringValue = m_Arena.CopyString(token.GetValue(m_Source));
+			node->symbol = token.m_Symbol;
 		}
 
 		return;
@@ -983,34 +1169,37 @@ void Parser::CreateAST(std::vector<Token>& tokens, ASTNode* node, ASTNode* paren
 }
 
 
-bool Parser::ParseElseStatement(Tokens& tokens, ASTNode* node)
+bool Parser::ParseElseStatement(const TokenRange& tokens, ASTNode* node)
 {
 	bool hasFoundElse = false;
+
 	// Check for else
-	for (int i = 0; i < tokens.size(); i++)
+	const std::vector<int>& elses = m_Tables->m_Positions[Token::Else];
+	int first = (int)(std::lower_bound(elses.begin(), elses.end(), tokens.m_Begin) - elses.begin());
+
+	for (int elseIndex = first; elseIndex < elses.size() && elses[elseIndex] < tokens.m_End; elseIndex++)
 	{
-		if (tokens[i].m_Type == Token::Else)
-		{
-			if (hasFoundElse)
-				return MakeError("Cannot have multiple else statements after the same if statement");
+		int i = elses[elseIndex] - tokens.m_Begin;
+
+		if (hasFoundElse)
+			return MakeError("Cannot have multiple else statements after the same if statement");
 
-			if (IsInsideNestedIfStatement(tokens, i))
-				continue;
-			if (!IsValidElseStatement(tokens, i))
-				return false;
+		if (IsInsideNestedIfStatement(tokens, elseIndex))
+			continue;
+		if (!IsValidElseStatement(tokens, i))
+			return false;
 
-			Tokens ifScope = SliceVector(tokens, 0, i);
-			Tokens elseScope = SliceVector(tokens, i + 1);
+		TokenRange ifScope = tokens.Slice(0, i);
+		TokenRange elseScope = tokens.Slice(i + 1);
 
-			node->type = ASTTypes::Else;
-			node->left = new ASTNode;
-			node->right = new ASTNode;
+		node->type = ASTTypes::Else;
+		node->left = m_Arena.Create();
+		node->right = m_Arena.Create();
 
-			CreateAST(ifScope, node->left, node);
-			CreateAST(elseScope, node->right, node);
+		CreateAST(ifScope, node->left, node);
+		CreateAST(elseScope, node->right, node);
 
-			hasFoundElse = true;
-		}
+		hasFoundElse = true;
 	}
 
 	if (hasFoundElse) 
@@ -1019,30 +1208,25 @@ bool Parser::ParseElseStatement(Tokens& tokens, ASTNode* node)
 	return false;
 }
 
-bool Parser::ParseStatement(Tokens& tokens, ASTNode* node)
+bool Parser::ParseStatement(const TokenRange& tokens, ASTNode* node)
 {
-	if (!tokens[0].IsStatementKeyword()) return false;
+	if (!At(tokens, 0).IsStatementKeyword()) return false;
 
 	if (!IsValidStatement(tokens)) return false;
 
 	// Collect the statement tokens
-	int endParanthesisPosition = FindMatchingEndBracket(tokens, tokens[1]);
-	std::vector<Token> argContent = SliceVector(tokens, 2, endParanthesisPosition);
+	int endParanthesisPosition = FindMatchingEndBracket(tokens, 1);
+	TokenRange argContent = tokens.Slice(2, endParanthesisPosition);
 
-	std::vector<Tokens> argumentsForStatement = DepthSplit(argContent, Token::Comma, tokens[1].m_Depth);
+	TokenRangeList argumentsForStatement = DepthSplit(argContent, Token::Comma, At(tokens, 1).m_Depth);
 
-	if (tokens[0].m_Type == Token::If)
+	if (At(tokens, 0).m_Type == Token::If)
 		node->type = ASTTypes::IfStatement;
-	else if (tokens[0].m_Type == Token::While)
+	else if (At(tokens, 0).m_Type == Token::While)
 		node->type = ASTTypes::WhileStatement;
-	else if (tokens[0].m_Type == Token::For)
+	else if (At(tokens, 0).m_Type == Token::For)
 		node->type = ASTTypes::ForStatement;
 
-	/*for (int i = 0; i < argumentsForStatement.size(); i++)
-	{
-		ReduceDepthOfTokens(argumentsForStatement[i]);
-	}*/
-
 	// Specifics for a 'for' statement
 	if (node->type == ASTTypes::ForStatement)
 	{
@@ -1050,17 +1234,17 @@ bool Parser::ParseStatement(Tokens& tokens, ASTNode* node)
 			return MakeError("Expected 3 parts inside the for statement");
 
 		// 1. Initialization, run once
-		ASTNode* n1 = new ASTNode();
+		ASTNode* n1 = m_Arena.Create();
 		CreateAST(argumentsForStatement[0], n1, node);
 		node->arguments.push_back(n1);
 
 		// 2. Condition
-		ASTNode* n2 = new ASTNode();
+		ASTNode* n2 = m_Arena.Create();
 		CreateAST(argumentsForStatement[1], n2, node);
 		node->arguments.push_back(n2);
 
 		// 3. Increment, run at end
-		ASTNode* n3 = new ASTNode();
+		ASTNode* n3 = m_Arena.Create();
 		CreateAST(argumentsForStatement[2], n3, node);
 		node->arguments.push_back(n3);
 
@@ -1068,108 +1252,102 @@ bool Parser::ParseStatement(Tokens& tokens, ASTNode* node)
 	}
 	else
 	{
-		node->left = new ASTNode();
+		node->left = m_Arena.Create();
 		CreateAST(argumentsForStatement[0], node->left, node);
 	}
 
 	int leftCurlyBracket = endParanthesisPosition + 1;
-	int rightCurlyBracket = FindMatchingEndBracket(tokens, tokens[endParanthesisPosition + 1]);
+	int rightCurlyBracket = FindMatchingEndBracket(tokens, leftCurlyBracket);
 
-	node->right = new ASTNode;
-	std::vector<Token> scope = SliceVector(tokens, leftCurlyBracket, rightCurlyBracket + 1);
+	node->right = m_Arena.Create();
+	TokenRange scope = tokens.Slice(leftCurlyBracket, rightCurlyBracket + 1);
 	CreateAST(scope, node->right, node);
 	if (HasError()) return false;
 
 	return true;
 }
 
-bool Parser::ParseFunctionDeclaration(Tokens& tokens, ASTNode* node)
+bool Parser::ParseFunctionDeclaration(const TokenRange& tokens, ASTNode* node)
 {
-	for (int i = 0; i < tokens.size(); i++)
-	{
-		if (tokens[i].m_Type == Token::RightArrow)
-		{
-			if (tokens[i].m_Depth != 0)
-				return MakeError("Function declaration has to be at the global scope");
-				
-			//if (!IsValidAssignmentExpression(tokens, i))
-				//return false;
+	const std::vector<int>& arrows = m_Tables->m_Positions[Token::RightArrow];
+	auto arrow = std::lower_bound(arrows.begin(), arrows.end(), tokens.m_Begin);
 
-			node->type = ASTTypes::FunctionDefinition;
+	if (arrow == arrows.end() || *arrow >= tokens.m_End)
+		return false;
 
-			node->left = new ASTNode(ASTTypes::FunctionPrototype);
-			node->right = new ASTNode;
+	int i = *arrow - tokens.m_Begin;
 
-			Tokens functionPrototype = SliceVector(tokens, 0, i);
+	if (At(tokens, i).m_Depth + tokens.m_DepthShift != 0)
+		return MakeError("Function declaration has to be at the global scope");
 
-			if (!ParseFunctionPrototype(functionPrototype, node->left))
-				return false;
+	node->type = ASTTypes::FunctionDefinition;
 
-			Tokens functionBody = SliceVector(tokens, i + 1);
-			for (int j = 0; j < functionBody.size(); j++)
-			{
-				//functionBody[j].m_Depth++;
-			}
+	node->left = m_Arena.Create(ASTTypes::FunctionPrototype);
+	node->right = m_Arena.Create();
 
-			CreateAST(functionBody, node->right, node);
-			if (HasError()) return false;
+	TokenRange functionPrototype = tokens.Slice(0, i);
 
-			auto& bodyLines = node->right->arguments;
-			if (bodyLines.empty() || bodyLines[bodyLines.size() - 1]->type != ASTTypes::Return)
-			{
-				// TODO: A void-function should require to have a return
-				return MakeError("Missing return at end of function");
-			}
+	if (!ParseFunctionPrototype(functionPrototype, node->left))
+		return false;
 
-			return true;
-		}
+	TokenRange functionBody = tokens.Slice(i + 1);
+
+	CreateAST(functionBody, node->right, node);
+	if (HasError()) return false;
+
+	auto& bodyLines = node->right->arguments;
+	if (bodyLines.empty() || bodyLines[bodyLines.size() - 1]->type != ASTTypes::Return)
+	{
+		// TODO: A void-function should require to have a return
+		return MakeError("Missing return at end of function");
 	}
 
-	return false;
+	return true;
 }
 
 // {returnType} {name} (...args)
-bool Parser::ParseFunctionPrototype(Tokens& tokens, ASTNode* node)
+bool Parser::ParseFunctionPrototype(const TokenRange& tokens, ASTNode* node)
 {
-	if (!ElementExists(tokens, 0) || !tokens[0].IsVariableType())
+	if (tokens.Size() < 1 || !At(tokens, 0).IsVariableType())
 		return MakeError("Expected return type of the function at the start of the function prototype");
 
-	if (!ElementExists(tokens, 1) || tokens[1].m_Type != Token::FunctionName)
+	if (tokens.Size() < 2 || At(tokens, 1).m_Type != Token::FunctionName)
 		return MakeError("Expected function name after the function return type");
 
-	if (!ElementExists(tokens, 2) || tokens[2].m_Type != Token::LeftParentheses)
+	if (tokens.Size() < 3 || At(tokens, 2).m_Type != Token::LeftParentheses)
 		return MakeError("Expected left parentheses after function name in prototype");
 
 	// Return type
-	ASTNode* returnType = new ASTNode(ASTTypes::VariableType);
-	returnType->stringValue = tokens[0].m_Value;
+	ASTNode* returnType = m_Arena.Create(ASTTypes::VariableType);
+	returnType->stringValue = m_Arena.CopyString(At(tokens, 0).GetValue(m_Source));
  	node->arguments.push_back(returnType);
 
 	// Function name
-	ASTNode* functionName = new ASTNode(ASTTypes::Variable);
-	functionName->stringValue = tokens[1].m_Value;
+	ASTNode* functionName = m_Arena.Create(ASTTypes::Variable);
+	functionName->stringValue = m_Arena.CopyString(At(tokens, 1).GetValue(m_Source));
+	functionName->symbol = At(tokens, 1).m_Symbol;
 	node->arguments.push_back(functionName);
 
-	int endParanthesisPosition = FindMatchingEndBracket(tokens, tokens[2]);
-	std::vector<Token> argContent = SliceVector(tokens, 3, endParanthesisPosition);
+	int endParanthesisPosition = FindMatchingEndBracket(tokens, 2);
+	TokenRange argContent = tokens.Slice(3, endParanthesisPosition);
 
-	if (!ElementExists(tokens, endParanthesisPosition) || !tokens[endParanthesisPosition].m_Type == Token::RightParentheses)
+	if (endParanthesisPosition < 0 || endParanthesisPosition >= tokens.Size())
 		return MakeError("Expected right parentheses after parameters in function prototype");
 
 	// No parameters
-	if (argContent.empty())
+	if (argContent.Empty())
 		return true;
 
-	std::vector<Tokens> parameters = DepthSplit(argContent, Token::Comma, tokens[2].m_Depth);
+	TokenRangeList parameters = DepthSplit(argContent, Token::Comma, At(tokens, 2).m_Depth);
 
 	// Resolve the arguments
 	for (int i = 0; i < parameters.size(); i++)
 	{
 		// If an argument has no tokens, then there was nothing after the comma
-		if (parameters[i].empty())
+		if (parameters[i].Empty())
 			return MakeError("Expected a parameter after the comma in the function prototype");
 
-		ASTNode* argNode = new ASTNode;
+		ASTNode* argNode = m_Arena.Create();
 		CreateAST(parameters[i], argNode, node);
 
 		node->arguments.push_back(argNode);
@@ -1178,196 +1356,172 @@ bool Parser::ParseFunctionPrototype(Tokens& tokens, ASTNode* node)
 	return true;
 }
 
-bool Parser::ParseAssignment(Tokens& tokens, ASTNode* node)
+bool Parser::ParseAssignment(const TokenRange& tokens, ASTNode* node)
 {
-	for (int i = 0; i < tokens.size(); i++)
-	{
-		if (tokens[i].m_Type == Token::SetEquals)
-		{
-			if (IsInsideBrackets(tokens, i))
-				continue;
+	int i = FindOperator(tokens, { Token::SetEquals });
+	if (i == -1)
+		return false;
 
-			if (!IsValidAssignmentExpression(tokens, i))
-				return false;
+	if (!IsValidAssignmentExpression(tokens, i))
+		return false;
 
-			node->type = ASTTypes::Assign;
+	node->type = ASTTypes::Assign;
 
-			std::vector<Token> lhs = SliceVector(tokens, 0, i);
-			std::vector<Token> rhs = SliceVector(tokens, i + 1);
+	TokenRange lhs = tokens.Slice(0, i);
+	TokenRange rhs = tokens.Slice(i + 1);
 
-			node->left = new ASTNode;
-			node->right = new ASTNode;
+	node->left = m_Arena.Create();
+	node->right = m_Arena.Create();
 
-			CreateAST(lhs, node->left, node);
-			CreateAST(rhs, node->right, node);
+	CreateAST(lhs, node->left, node);
+	CreateAST(rhs, node->right, node);
 
-			return true;
-		}
-	}
-
-	return false;
+	return true;
 }
 
-bool Parser::ParseLogicalAndOr(Tokens& tokens, ASTNode* node)
+bool Parser::ParseLogicalAndOr(const TokenRange& tokens, ASTNode* node)
 {
-	for (int i = 0; i < tokens.size(); i++)
-	{
-		if (tokens[i].m_Type == Token::And || tokens[i].m_Type == Token::Or)
-		{
-			if (IsInsideBrackets(tokens, i))
-				continue;
-
-			if (!IsValidLogicalAndOrExpression(tokens, i))
-				return false;
+	int i = FindOperator(tokens, { Token::And, Token::Or });
+	if (i == -1)
+		return false;
 
-			if (tokens[i].m_Type == Token::And)
-				node->type = ASTTypes::And;
-			if (tokens[i].m_Type == Token::Or)
-				node->type = ASTTypes::Or;
+	if (!IsValidLogicalAndOrExpression(tokens, i))
+		return false;
 
-			node->left = new ASTNode;
-			Tokens leftTokens = SliceVector(tokens, 0, i);
-			CreateAST(leftTokens, node->left, node);
-			if (HasError()) return false;
+	if (At(tokens, i).m_Type == Token::And)
+		node->type = ASTTypes::And;
+	if (At(tokens, i).m_Type == Token::Or)
+		node->type = ASTTypes::Or;
 
-			node->right = new ASTNode;
-			Tokens rightTokens = SliceVector(tokens, i + 1);
-			CreateAST(rightTokens, node->right, node);
-			if (HasError()) return false;
+	node->left = m_Arena.Create();
+	TokenRange leftTokens = tokens.Slice(0, i);
+	CreateAST(leftTokens, node->left, node);
+	if (HasError()) return false;
 
-			return true;
-		}
-	}
+	node->right = m_Arena.Create();
+	TokenRange rightTokens = tokens.Slice(i + 1);
+	CreateAST(rightTokens, node->right, node);
+	if (HasError()) return false;
 
-	return false;
+	return true;
 }
 
-bool Parser::ParseComparisonOperators(Tokens& tokens, ASTNode* node)
+bool Parser::ParseComparisonOperators(const TokenRange& tokens, ASTNode* node)
 {
-	for (int i = 0; i < tokens.size(); i++)
-	{
-		if (tokens[i].IsComparisonOperator())
-		{
-			if (IsInsideBrackets(tokens, i))
-				continue;
-
-			if (!IsValidComparisonExpression(tokens, i))
-				return false;
-
-			if (tokens[i].m_Type == Token::CompareEquals)
-				node->type = ASTTypes::CompareEquals;
-			else if (tokens[i].m_Type == Token::NotEquals)
-				node->type = ASTTypes::CompareNotEquals;
-			else if (tokens[i].m_Type == Token::LessThan)
-				node->type = ASTTypes::CompareLessThan;
-			else if (tokens[i].m_Type == Token::GreaterThan)
-				node->type = ASTTypes::CompareGreaterThan;
-			else if (tokens[i].m_Type == Token::LessThanEqual)
-				node->type = ASTTypes::CompareLessThanEqual;
-			else if (tokens[i].m_Type == Token::GreaterThanEqual)
-				node->type = ASTTypes::CompareGreaterThanEqual;
-
-			node->left = new ASTNode;
-			node->right = new ASTNode;
-
-			std::vector<Token> lhs = SliceVector(tokens, 0, i);
-			std::vector<Token> rhs = SliceVector(tokens, i + 1);
-
-			CreateAST(lhs, node->left, node);
-			CreateAST(rhs, node->right, node);
-
-			return true;
-		}
-	}
+	int i = FindOperator(tokens, { Token::CompareEquals, Token::NotEquals, Token::LessThan, Token::GreaterThan, Token::LessThanEqual, Token::GreaterThanEqual });
+	if (i == -1)
+		return false;
 
-	return false;
+	if (!IsValidComparisonExpression(tokens, i))
+		return false;
+
+	Token::Types type = At(tokens, i).m_Type;
+	if (type == Token::CompareEquals)
+		node->type = ASTTypes::CompareEquals;
+	else if (type == Token::NotEquals)
+		node->type = ASTTypes::CompareNotEquals;
+	else if (type == Token::LessThan)
+		node->type = ASTTypes::CompareLessThan;
+	else if (type == Token::GreaterThan)
+		node->type = ASTTypes::CompareGreaterThan;
+	else if (type == Token::LessThanEqual)
+		node->type = ASTTypes::CompareLessThanEqual;
+	else if (type == Token::GreaterThanEqual)
+		node->type = ASTTypes::CompareGreaterThanEqual;
+
+	node->left = m_Arena.Create();
+	node->right = m_Arena.Create();
+
+	TokenRange lhs = tokens.Slice(0, i);
+	TokenRange rhs = tokens.Slice(i + 1);
+
+	CreateAST(lhs, node->left, node);
+	CreateAST(rhs, node->right, node);
+
+	return true;
 }
 
-bool Parser::ParseCompoundAssignment(Tokens& tokens, ASTNode* node)
+bool Parser::ParseCompoundAssignment(const TokenRange& tokens, ASTNode* node)
 {
 	// Plus/Minus Equals. left += right
-	for (int i = 0; i < tokens.size(); i++)
-	{
-		if (tokens[i].m_Type == Token::PlusEquals || tokens[i].m_Type == Token::MinusEquals)
-		{
-			if (IsInsideBrackets(tokens, i))
-				continue;
-
-			if (!IsValidCompoundAssignmentExpression(tokens, i))
-				return false;
+	int i = FindOperator(tokens, { Token::PlusEquals, Token::MinusEquals });
+	if (i == -1)
+		return false;
 
-			node->type = ASTTypes::Assign;
+	if (!IsValidCompoundAssignmentExpression(tokens, i))
+		return false;
 
-			node->left = new ASTNode;
-			Tokens newTokens = SliceVector(tokens, 0, i);
-			CreateAST(newTokens, node->left, node);
-			if (HasError()) return false;
+	node->type = ASTTypes::Assign;
 
-			node->right = new ASTNode;
-			node->right->left = new ASTNode;
+	node->left = m_Arena.Create();
+	TokenRange newTokens = tokens.Slice(0, i);
+	CreateAST(newTokens, node->left, node);
+	if (HasError()) return false;
 
-			if (tokens[i].m_Type == Token::PlusEquals)
-				node->right->type = ASTTypes::Add;
-			else if (tokens[i].m_Type == Token::MinusEquals)
-				node->right->type = ASTTypes::Subtract;
+	node->right = m_Arena.Create();
+	node->right->left = m_Arena.Create();
 
-			node->right->left->type = ASTTypes::Variable;
-			node->right->left->stringValue = tokens[i - 1].m_Value;
+	if (At(tokens, i).m_Type == Token::PlusEquals)
+		node->right->type = ASTTypes::Add;
+	else if (At(tokens, i).m_Type == Token::MinusEquals)
+		node->right->type = ASTTypes::Subtract;
 
-			node->right->right = new ASTNode;
-			newTokens = SliceVector(tokens, i + 1);
+	node->right->left->type = ASTTypes::Variable;
+	node->right->left->stringValue = m_Arena.CopyString(At(tokens, i - 1).GetValue(m_Source));
+	node->right->left->symbol = At(tokens, i - 1).m_Symbol;
 
-			if (newTokens.size() == 0)
-				return MakeError("Expected something after " + tokens[i].ToString() + "sign");
+	node->right->right = m_Arena.Create();
+	newTokens = tokens.Slice(i + 1);
 
-			CreateAST(newTokens, node->right->right, node->right);
-			if (HasError()) return false;
+	if (newTokens.Size() == 0)
+		return MakeError("Expected something after " + At(tokens, i).ToString() + "sign");
 
-			return true;
-		}
-	}
+	CreateAST(newTokens, node->right->right, node->right);
+	if (HasError()) return false;
 
-	return false;
+	return true;
 }
 
-bool Parser::ParseVariableDeclaration(Tokens& tokens, ASTNode* node)
+bool Parser::ParseVariableDeclaration(const TokenRange& tokens, ASTNode* node)
 {
 	if (!IsValidVariableDeclarationExpression(tokens))
 		return false;
 	
 	// Variable type
-	node->left = new ASTNode;
+	node->left = m_Arena.Create();
 	node->left->type = ASTTypes::VariableType;
 
 	// Variabe name
-	node->right = new ASTNode;
+	node->right = m_Arena.Create();
 	node->right->type = ASTTypes::Variable;
 
 	// Global variable
-	if (tokens[0].m_Type == Token::Global)
+	if (At(tokens, 0).m_Type == Token::Global)
 	{
 		node->type = ASTTypes::GlobalVariableDeclaration;
-		node->left->stringValue = tokens[1].m_Value;
-		node->right->stringValue = tokens[2].m_Value;
+		node->left->stringValue = m_Arena.CopyString(At(tokens, 1).GetValue(m_Source));
+		node->right->stringValue = m_Arena.CopyString(At(tokens, 2).GetValue(m_Source));
+		node->right->symbol = At(tokens, 2).m_Symbol;
 	}
 	else
 	{
 		node->type = ASTTypes::VariableDeclaration;
-		node->left->stringValue = tokens[0].m_Value;
-		node->right->stringValue = tokens[1].m_Value;
+		node->left->stringValue = m_Arena.CopyString(At(tokens, 0).GetValue(m_Source));
+		node->right->stringValue = m_Arena.CopyString(At(tokens, 1).GetValue(m_Source));
+		node->right->symbol = At(tokens, 1).m_Symbol;
 	}
 
 	return true;
 }
 
-bool Parser::ParseParentheses(Tokens& tokens, ASTNode* node)
+bool Parser::ParseParentheses(const TokenRange& tokens, ASTNode* node)
 {
 	// Paranthesis
-	if (tokens[0].m_Type != Token::LeftParentheses)
+	if (At(tokens, 0).m_Type != Token::LeftParentheses)
 		return false;
 
 	// Slice until next parenthesis
-	int end = FindMatchingEndBracket(tokens, tokens[0]);
+	int end = FindMatchingEndBracket(tokens, 0);
 	if (end == -1)
 	{
 		MakeError("Found no matching right parenthesis");
@@ -1376,31 +1530,30 @@ bool Parser::ParseParentheses(Tokens& tokens, ASTNode* node)
 
 	if (end == 2) // Theres only on item in the brackets
 	{
-		std::vector<Token> newTokens = tokens;
-
 		// Remove the brackets and act as normal
-		newTokens.erase(newTokens.begin() + end);
-		newTokens.erase(newTokens.begin() + 0);
+		if (tokens.Size() == 3)
+		{
+			CreateAST(tokens.Slice(1, 2), node, node->parent);
+		}
+		else
+		{
+			// The tokens after the brackets are kept, so they aren't next to the item anymore and have to be copied
+			std::vector<Token> newTokens;
+			newTokens.push_back(At(tokens, 1));
+			for (int i = 3; i < tokens.Size(); i++)
+				newTokens.push_back(At(tokens, i));
+
+			CreateASTFromCopy(newTokens, tokens.m_DepthShift, node, node->parent);
+		}
 
-		CreateAST(newTokens, node, node->parent);
 		if (HasError()) return false;
 	}
 	else
 	{
-		/*if (end + 1 < tokens.size())
-		{
-			std::vector<Token> newTokens = SliceVector(tokens, end + 1);
-			node->left = new ASTNode;
-			error = CreateAST(newTokens, node->left, node);
-			if (error != "") return error;
-		}
-		else*/
-		{
-			std::vector<Token> newTokens = SliceVector(tokens, 1, end);
-			ReduceDepthOfTokens(newTokens);
+		TokenRange newTokens = tokens.Slice(1, end);
+		newTokens.m_DepthShift--;
 
-			CreateAST(newTokens, node, node->parent);
-		}
+		CreateAST(newTokens, node, node->parent);
 
 		if (HasError()) return false;
 	}
@@ -1408,9 +1561,9 @@ bool Parser::ParseParentheses(Tokens& tokens, ASTNode* node)
 	return true;
 }
 
-bool Parser::ParseFunctionCall(Tokens& tokens, ASTNode* node)
+bool Parser::ParseFunctionCall(const TokenRange& tokens, ASTNode* node)
 {
-	if (tokens[0].m_Type != Token::FunctionName)
+	if (At(tokens, 0).m_Type != Token::FunctionName)
 		return false;
 
 	if (IsInsideBrackets(tokens, 0))
@@ -1420,28 +1573,26 @@ bool Parser::ParseFunctionCall(Tokens& tokens, ASTNode* node)
 		return false;
 
 	node->type = ASTTypes::FunctionCall;
-	node->stringValue = tokens[0].m_Value; // Function Name
+	node->stringValue = m_Arena.CopyString(At(tokens, 0).GetValue(m_Source)); // Function Name
+	node->symbol = At(tokens, 0).m_Symbol;
 
-	int endParanthesisPosition = FindMatchingEndBracket(tokens, tokens[1]);
-	std::vector<Token> argContent = SliceVector(tokens, 2, endParanthesisPosition);
+	int endParanthesisPosition = FindMatchingEndBracket(tokens, 1);
+	TokenRange argContent = tokens.Slice(2, endParanthesisPosition);
 
 	// No arguments (print());
-	if (argContent.empty())
+	if (argContent.Empty())
 		return true;
 
-	std::vector<Tokens> arguments = DepthSplit(argContent, Token::Comma, tokens[1].m_Depth);
+	TokenRangeList arguments = DepthSplit(argContent, Token::Comma, At(tokens, 1).m_Depth);
 
 	// Resolve the arguments
 	for (int i = 0; i < arguments.size(); i++)
 	{
 		// If an argument has no tokens, then there was nothing after the comma
-		if (arguments[i].empty())
+		if (arguments[i].Empty())
 			return MakeError("Expected an argument after the comma in the function call");
 
-		//ReduceDepthOfBrackets(arguments[i], Token::LeftParentheses);
-		//ReduceDepth(arguments[i], Token::Comma);
-
-		ASTNode* argNode = new ASTNode;
+		ASTNode* argNode = m_Arena.Create();
 		CreateAST(arguments[i], argNode, node);
 
 		node->arguments.push_back(argNode);
@@ -1450,41 +1601,34 @@ bool Parser::ParseFunctionCall(Tokens& tokens, ASTNode* node)
 	return true;
 }
 
-bool Parser::ParseIncrementDecrement(Tokens& tokens, ASTNode* node)
+bool Parser::ParseIncrementDecrement(const TokenRange& tokens, ASTNode* node)
 {
-	for (int i = 0; i < tokens.size(); i++)
-	{
-		if ((tokens[i].m_Type == Token::PostIncrement || tokens[i].m_Type == Token::PostDecrement))
-		{
-			// Check if these tokens are inside a function argument
-			if (IsInsideBrackets(tokens, i))
-				continue;
-
-			if (!IsValidPostIncDecExpression(tokens, i - 1))
-				return false;
+	// Operators inside a function argument are skipped
+	int i = FindOperator(tokens, { Token::PostIncrement, Token::PostDecrement });
+	if (i == -1)
+		return false;
 
-			if (tokens[i].m_Type == Token::PostIncrement)
-				node->type = ASTTypes::PostIncrement;
-			else if (tokens[i].m_Type == Token::PostDecrement)
-				node->type = ASTTypes::PostDecrement;
+	if (!IsValidPostIncDecExpression(tokens, i - 1))
+		return false;
 
-			// The left side should be a variable
-			node->left = new ASTNode;
-			std::vector<Token> newTokens = SliceVector(tokens, 0, i);
+	if (At(tokens, i).m_Type == Token::PostIncrement)
+		node->type = ASTTypes::PostIncrement;
+	else if (At(tokens, i).m_Type == Token::PostDecrement)
+		node->type = ASTTypes::PostDecrement;
 
-			CreateAST(newTokens, node->left, node);
-			if (HasError()) return false;
+	// The left side should be a variable
+	node->left = m_Arena.Create();
+	TokenRange newTokens = tokens.Slice(0, i);
 
-			// Parse the right side
-			node->right = new ASTNode;
-			newTokens = SliceVector(tokens, i + 1);
+	CreateAST(newTokens, node->left, node);
+	if (HasError()) return false;
 
-			CreateAST(newTokens, node->right, node);
-			if (HasError()) return false;
+	// Parse the right side
+	node->right = m_Arena.Create();
+	newTokens = tokens.Slice(i + 1);
 
-			return true;
-		}
-	}
+	CreateAST(newTokens, node->right, node);
+	if (HasError()) return false;
 
-	return false;
+	return true;
 }
@@ -1,12 +1,18 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <string_view>
+#include <initializer_list>
+#include <stdint.h>
 #include <assert.h>
 
 #include "Lexer.h"
 #include "Interpreter/ValueTypes.h"
+#include "Interpreter/AST/Specialization.h"
 
 struct ASTNode;
+class ASTArena;
 
 enum class ASTTypes
 {
@@ -69,18 +75,74 @@ enum class ASTTypes
 	Modifier
 };
 
+// The children of a node that can have any number of them. The list only has the indices of the nodes, they are stored
+// next to each other in the arena of the node, so it doesn't allocate anything of its own.
+// When it grows past its capacity it is moved to the end of the arena, and the space it used is left unused
+class ASTNodeList
+{
+public:
+	class Iterator
+	{
+	public:
+		Iterator(const ASTNodeList* list, uint32_t i) : m_List(list), m_Index(i) {};
+
+		// The node is looked up every time, since the loop can add to other lists, and the arena's indices move when it grows
+		ASTNode* operator*() const { return (*m_List)[m_Index]; }
+		Iterator& operator++() { m_Index++; return *this; }
+		bool operator!=(const Iterator& other) const { return m_Index != other.m_Index; }
+
+	private:
+		const ASTNodeList* m_List;
+		uint32_t m_Index;
+	};
+
+	inline ASTNode* operator[](size_t i) const;
+	ASTNode* back() const { return (*this)[m_Size - 1]; }
+
+	size_t size() const { return m_Size; }
+	bool empty() const { return m_Size == 0; }
+
+	void push_back(ASTNode* node);
+	void clear() { m_Size = 0; }
+
+	Iterator begin() const { return Iterator(this, 0); }
+	Iterator end() const { return Iterator(this, m_Size); }
+
+private:
+	friend class ASTArena;
+
+	ASTArena* m_Arena = nullptr;
+	uint32_t m_First = 0;
+	uint32_t m_Size = 0;
+	uint32_t m_Capacity = 0;
+};
+
 struct ASTNode
 {
 	ASTNode* parent = nullptr;
 	ASTNode* left = nullptr;
 	ASTNode* right = nullptr;
-	std::vector<ASTNode*> arguments;
+
+	// Copying a node shares the list, so it's only done to move one node into another
+	ASTNodeList arguments;
 
 	ASTTypes type = ASTTypes::Empty;
 
 	// optional
 	float numberValue = 0.0f;
-	std::string stringValue = "";
+	std::string_view stringValue; // Stored in the arena of the node, see ASTArena::CopyString()
+	Symbol symbol = NoSymbol; // The interned stringValue, for variables, functions and string literals
+
+	// Set by the AST interpreter's resolver (see Interpreter/AST/Resolver.h)
+	int depth = -1;
+	int slot = -1;
+	int slotCount = 0;
+
+	// Type feedback for the AST interpreter's math and compare nodes
+	AST::TypeFeedback feedback;
+
+	// Where the node is in the arena that created it
+	uint32_t index = 0;
 
 	std::string ToString(bool includeData = true);
 
@@ -112,6 +174,150 @@ struct ASTNode
 	}
 };
 
+// Owns the nodes of a tree, with the lists of their children and their strings. They are allocated in blocks in the order they are created,
+// instead of one at a time, and they are all freed at once when the arena is. Nodes never move, so pointers to them stay valid.
+// The nodes' lists point to the arena, so it can't be moved either
+class ASTArena
+{
+public:
+	ASTArena() {};
+	ASTArena(const ASTArena&) = delete;
+	ASTArena& operator=(const ASTArena&) = delete;
+
+	ASTNode* Create(ASTTypes type = ASTTypes::Empty);
+	inline ASTNode* Get(uint32_t index);
+
+	// The string stays valid as long as the arena, or the one that adopts it
+	std::string_view CopyString(std::string_view string);
+
+	uint32_t GetNodeCount() { return m_NodeCount; }
+	uint32_t GetChildCount() { return (uint32_t)m_Children.size(); }
+
+	// Moves the nodes of another arena to the end of this one and gives them the indices they end up at, unless they already have them.
+	// The rest of the last block of this arena is left unused, it's counted as nodes
+	void Adopt(ASTArena& other);
+
+	// The index that the first node of the next arena that is adopted gets
+	uint32_t GetAdoptIndex() { return m_FirstIndex + (uint32_t)m_Blocks.size() * BlockSize; }
+
+	// Gives the nodes the indices, and their lists the places, they would get if they were adopted by the target at the indices,
+	// so that the arenas of different threads can be numbered at the same time before they are adopted.
+	// The nodes' lists can't be used until the arena is adopted
+	void Renumber(ASTArena& target, uint32_t firstNode, uint32_t firstChild);
+
+private:
+	friend class ASTNodeList;
+
+	static constexpr uint32_t BlockSize = 256;
+	static constexpr size_t StringBlockSize = 4096;
+
+	std::vector<std::unique_ptr<ASTNode[]>> m_Blocks;
+	uint32_t m_NodeCount = 0;
+	uint32_t m_FirstIndex = 0; // Of the first node, it changes when the arena is renumbered
+
+	// The indices of the children of all the lists
+	std::vector<uint32_t> m_Children;
+	uint32_t m_FirstChild = 0;
+	ASTArena* m_ListArena = this;
+
+	std::vector<std::unique_ptr<char[]>> m_StringBlocks;
+	size_t m_StringBlockUsed = 0;
+};
+
+inline ASTNode* ASTArena::Get(uint32_t index)
+{
+	uint32_t i = index - m_FirstIndex;
+	assert(i < m_NodeCount);
+
+	return &m_Blocks[i / BlockSize][i % BlockSize];
+}
+
+inline ASTNode* ASTNodeList::operator[](size_t i) const
+{
+	assert(i < m_Size);
+
+	return m_Arena->Get(m_Arena->m_Children[m_First + i]);
+}
+
+// A part of the token array that is being parsed. The parser passes these around instead of copies of the tokens,
+// and the indices that the parse functions use are relative to the start of the range
+struct TokenRange
+{
+	TokenRange() {};
+	TokenRange(int begin, int end, int depthShift = 0) : m_Begin(begin), m_End(end < begin ? begin : end), m_DepthShift(depthShift) {};
+
+	int Size() const { return m_End - m_Begin; }
+	bool Empty() const { return m_End == m_Begin; }
+
+	// Like SliceVector, an end of -1 is the end of the range
+	TokenRange Slice(int start, int end = -1) const;
+
+	int m_Begin = 0;
+	int m_End = 0;
+
+	// The contents of parentheses are parsed as if their depth was one lower, only the depth of function declarations depends on that
+	int m_DepthShift = 0;
+};
+
+// The ranges that DepthSplit() and MakeScopeIntoLines() split a range into. They are pushed onto a stack that the parser reuses,
+// instead of a vector of their own, and popped when the list is destroyed. The lists are nested like the calls that make them.
+// The stack grows while the ranges are parsed, so they are returned as copies
+class TokenRangeList
+{
+public:
+	TokenRangeList(std::vector<TokenRange>& stack) : m_Stack(&stack), m_First(stack.size()) {};
+	TokenRangeList(TokenRangeList&& other) : m_Stack(other.m_Stack), m_First(other.m_First) { other.m_Stack = nullptr; };
+	TokenRangeList(const TokenRangeList&) = delete;
+	~TokenRangeList() { if (m_Stack) m_Stack->resize(m_First); }
+
+	TokenRange operator[](size_t i) const { return (*m_Stack)[m_First + i]; }
+
+	size_t size() const { return m_Stack->size() - m_First; }
+	bool empty() const { return size() == 0; }
+
+	void push_back(const TokenRange& range) { m_Stack->push_back(range); }
+
+private:
+	std::vector<TokenRange>* m_Stack;
+	size_t m_First;
+};
+
+// Lookups that are computed once for the whole token array, so that the parser doesn't have to search through the tokens again at every level
+struct TokenTables
+{
+	void Build(std::vector<Token>& tokens);
+
+	std::vector<Token>* m_Tokens = nullptr;
+
+	// The positions of the tokens of each type, in order
+	std::vector<int> m_Positions[Token::Export + 1];
+
+	// The first closing bracket after an opening bracket with the same depth, or -1
+	std::vector<int> m_MatchingBracket;
+
+	// For IsInsideBrackets(). The last token at or before each token that has the same depth and comes right after a ( or [,
+	// and the first ) or ] at or after each token with the same depth
+	std::vector<int> m_AfterOpenBracket;
+	std::vector<int> m_NextCloseBracket;
+
+	// For each else in m_Positions[Token::Else], the last if before it with the same depth and the last one with a lower depth, or -1
+	std::vector<int> m_IfBeforeElse;
+	std::vector<int> m_OuterIfBeforeElse;
+};
+
+// A top-level line of a program that is kept while it's being edited, so that it can be parsed again on its own
+struct ProgramLine
+{
+	// Where the line is in the token array
+	TokenRange m_Tokens;
+
+	ASTNode* m_Node = nullptr;
+	std::string m_Error;
+
+	// How many nodes parsing the line created
+	uint32_t m_NodeCount = 0;
+};
+
 class Parser
 {
 public:
@@ -122,36 +328,96 @@ public:
 
 	void PrintASTTree(ASTNode* node, int depth);
 
-	bool IsValidElseStatement(Tokens tokens, int position);
-	bool IsValidStatement(Tokens tokens);
-	bool IsValidAssignmentExpression(Tokens tokens, int equalsSignPosition);
-	bool IsValidCompoundAssignmentExpression(Tokens tokens, int position);
-	bool IsValidComparisonExpression(Tokens tokens, int position);
-	bool IsValidLogicalAndOrExpression(Tokens tokens, int position);
-	//bool IsValidPropertyAssignmentExpression(Tokens tokens);
-	bool IsValidPostIncDecExpression(Tokens tokens, int position);
-	bool IsValidPreIncDecExpression(Tokens tokens, int position);
-	bool IsValidFunctionCallExpression(Tokens tokens);
-	bool IsValidVariableDeclarationExpression(Tokens tokens);
-
-	void CreateAST(std::vector<Token>& tokens, ASTNode* node, ASTNode* parent = nullptr);
-
-	bool ParseElseStatement(Tokens& tokens, ASTNode* node);
-	bool ParseStatement(Tokens& tokens, ASTNode* node);
-	bool ParseFunctionDeclaration(Tokens& tokens, ASTNode* node);
-	bool ParseFunctionPrototype(Tokens& tokens, ASTNode* node);
-	bool ParseAssignment(Tokens& tokens, ASTNode* node);
-	bool ParseLogicalAndOr(Tokens& tokens, ASTNode* node);
-	bool ParseComparisonOperators(Tokens& tokens, ASTNode* node);
-	bool ParseCompoundAssignment(Tokens& tokens, ASTNode* node);
-	bool ParseMathExpression(Tokens& tokens, ASTNode* node);
-	bool ParseVariableDeclaration(Tokens& tokens, ASTNode* node);
-	bool ParseParentheses(Tokens& tokens, ASTNode* node);
-	bool ParseFunctionCall(Tokens& tokens, ASTNode* node);
-	bool ParseIncrementDecrement(Tokens& tokens, ASTNode* node);
+	bool IsValidElseStatement(const TokenRange& tokens, int position);
+	bool IsValidStatement(const TokenRange& tokens);
+	bool IsValidAssignmentExpression(const TokenRange& tokens, int equalsSignPosition);
+	bool IsValidCompoundAssignmentExpression(const TokenRange& tokens, int position);
+	bool IsValidComparisonExpression(const TokenRange& tokens, int position);
+	bool IsValidLogicalAndOrExpression(const TokenRange& tokens, int position);
+	bool IsValidPostIncDecExpression(const TokenRange& tokens, int position);
+	bool IsValidPreIncDecExpression(const TokenRange& tokens, int position);
+	bool IsValidFunctionCallExpression(const TokenRange& tokens);
+	bool IsValidVariableDeclarationExpression(const TokenRange& tokens);
+
+	// Creates the program body and parses the tokens into it. The source is what the tokens were lexed from
+	ASTNode* CreateProgram(std::vector<Token>& tokens, std::string_view source);
+
+	// Like CreateProgram(), but every top-level line is parsed and kept, also the ones after an error,
+	// so that UpdateProgram() can parse only the changed ones again
+	ASTNode* CreateEditableProgram(std::vector<Token>& tokens, std::string_view source);
+
+	// For parsing a long program in chunks on different threads, see ParallelFrontEnd. BeginProgram() creates the program body, and every chunk
+	// is parsed into it by a parser of its own with ParseChunk(). The chunks start after a semicolon at the top level, AppendChunk() adds the lines
+	// and nodes of the chunk that starts at the token offset, and FinishProgram() with the number of tokens makes the tree like CreateEditableProgram()
+	ASTNode* BeginProgram(std::string_view source);
+	void ParseChunk(std::vector<Token>& tokens, std::string_view source, ASTNode* program);
+	void AppendChunk(Parser& chunk, int tokenOffset);
+
+	// Makes the lines before the first error the lines of the program, and its error the program's error
+	void FinishProgram(int tokenCount);
+
+	// The tokens in [begin, oldEnd) were replaced by the ones in [begin, newEnd), and the ones after them moved. Both ends have to be
+	// at an end of the tokens or right after a semicolon at the top level, like the part that Lexer::UpdateTokens() lexes again.
+	// The tree and the error end up the same as CreateProgram() would give, but the tables for the whole program aren't built again
+	ASTNode* UpdateProgram(std::vector<Token>& tokens, std::string_view source, int begin, int oldEnd, int newEnd);
+	void CreateAST(const TokenRange& tokens, ASTNode* node, ASTNode* parent = nullptr);
+
+	bool ParseElseStatement(const TokenRange& tokens, ASTNode* node);
+	bool ParseStatement(const TokenRange& tokens, ASTNode* node);
+	bool ParseFunctionDeclaration(const TokenRange& tokens, ASTNode* node);
+	bool ParseFunctionPrototype(const TokenRange& tokens, ASTNode* node);
+	bool ParseAssignment(const TokenRange& tokens, ASTNode* node);
+	bool ParseLogicalAndOr(const TokenRange& tokens, ASTNode* node);
+	bool ParseComparisonOperators(const TokenRange& tokens, ASTNode* node);
+	bool ParseCompoundAssignment(const TokenRange& tokens, ASTNode* node);
+	bool ParseMathExpression(const TokenRange& tokens, ASTNode* node);
+	bool ParseVariableDeclaration(const TokenRange& tokens, ASTNode* node);
+	bool ParseParentheses(const TokenRange& tokens, ASTNode* node);
+	bool ParseFunctionCall(const TokenRange& tokens, ASTNode* node);
+	bool ParseIncrementDecrement(const TokenRange& tokens, ASTNode* node);
+
+private:
+	// The token at a position in the range. Positions outside of it give an empty token
+	Token& At(const TokenRange& tokens, int position);
+
+	bool IsInsideBrackets(const TokenRange& tokens, int position);
+	bool IsInsideNestedIfStatement(const TokenRange& tokens, int elseIndex);
+	int FindMatchingEndBracket(const TokenRange& tokens, int startPosition);
+
+	// The first token with one of the types that isn't inside brackets, or -1
+	int FindOperator(const TokenRange& tokens, std::initializer_list<Token::Types> types);
+
+	TokenRangeList DepthSplit(const TokenRange& tokens, Token::Types delimiter, int depth);
+	TokenRangeList MakeScopeIntoLines(const TokenRange& tokens, int start, int end, int startingDepth);
+
+	// Parses tokens that aren't a part of the token array, with tables of their own
+	void CreateASTFromCopy(std::vector<Token>& tokens, int depthShift, ASTNode* node, ASTNode* parent);
+
+	// Parses each top-level line on its own. The token ranges of the lines are moved by the offset, when the tokens are a copy of a part of the program
+	void ParseProgramLines(const TokenRange& tokens, int offset, std::vector<ProgramLine>& lines);
 
 public:
 	std::string m_Error = "";
 
-	ASTNode root;
+	// All the nodes of the tree, they live as long as the parser
+	ASTArena m_Arena;
+
+	std::string_view m_Source;
+
+	// Set by CreateEditableProgram()
+	ASTNode* m_Program = nullptr;
+	std::vector<ProgramLine> m_ProgramLines;
+
+	// The nodes that the program uses, the rest of the arena is lines that were replaced
+	uint32_t m_ProgramNodeCount = 0;
+
+private:
+	TokenTables m_ProgramTables;
+	TokenTables* m_Tables = &m_ProgramTables;
+
+	// What At() gives outside of the range. It's reset every time, since the callers can change it
+	Token m_EmptyToken;
+
+	// Where the TokenRangeLists are
+	std::vector<TokenRange> m_RangeStack;
 };
\ No newline at end of file
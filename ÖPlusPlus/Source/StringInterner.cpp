@@ -0,0 +1,65 @@
+#include "StringInterner.h"
+
+#include <assert.h>
+
+StringInterner& StringInterner::Get()
+{
+	static StringInterner instance;
+	return instance;
+}
+
+StringInterner::StringInterner()
+{
+	// The empty string is the first string of the first shard, so that it's NoSymbol
+	m_Shards[0].m_Strings.emplace_back();
+}
+
+StringInterner::Shard& StringInterner::ShardOf(std::string_view string)
+{
+	return m_Shards[std::hash<std::string_view>()(string) % ShardCount];
+}
+
+Symbol StringInterner::Intern(std::string_view string)
+{
+	if (string.empty())
+		return NoSymbol;
+
+	Shard& shard = ShardOf(string);
+	std::lock_guard<std::mutex> lock(shard.m_Mutex);
+
+	auto it = shard.m_Symbols.find(string);
+	if (it != shard.m_Symbols.end())
+		return it->second;
+
+	Symbol symbol = (Symbol)(shard.m_Strings.size() * ShardCount + (&shard - m_Shards));
+	shard.m_Strings.emplace_back(string);
+	shard.m_Symbols[shard.m_Strings.back()] = symbol;
+
+	return symbol;
+}
+
+const std::string& StringInterner::GetString(Symbol symbol)
+{
+	Shard& shard = m_Shards[symbol % ShardCount];
+	std::lock_guard<std::mutex> lock(shard.m_Mutex);
+
+	assert(symbol / ShardCount < shard.m_Strings.size());
+
+	// The strings never move, so the reference stays valid after the lock is released
+	return shard.m_Strings[symbol / ShardCount];
+}
+
+Symbol StringInterner::Find(std::string_view string)
+{
+	if (string.empty())
+		return NoSymbol;
+
+	Shard& shard = ShardOf(string);
+	std::lock_guard<std::mutex> lock(shard.m_Mutex);
+
+	auto it = shard.m_Symbols.find(string);
+	if (it != shard.m_Symbols.end())
+		return it->second;
+
+	return NoSymbol;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <stdint.h>
+
+// Identifies an interned string. Two strings have the same symbol only if they are equal
+typedef uint32_t Symbol;
+
+// The symbol of the empty string, used for tokens and nodes that don't have a name
+constexpr Symbol NoSymbol = 0;
+
+// Gives every identifier and string literal a symbol when it is lexed, so that the later stages can use
+// the symbol as a key instead of hashing and copying the string again.
+// The parts of a long program can be lexed on different threads, so the strings are split into shards by their hash,
+// each with a lock of its own, and the threads only wait for each other when they intern strings in the same shard
+class StringInterner
+{
+public:
+	static StringInterner& Get();
+
+	Symbol Intern(std::string_view string);
+	const std::string& GetString(Symbol symbol);
+
+	// Returns NoSymbol if the string has never been interned
+	Symbol Find(std::string_view string);
+
+private:
+	StringInterner();
+
+	// The low bits of a symbol are its shard, and the rest is where it is in the shard
+	static constexpr uint32_t ShardCount = 16;
+
+	struct Shard
+	{
+		std::mutex m_Mutex;
+
+		// A deque so that the strings don't move, the map points to them
+		std::deque<std::string> m_Strings;
+		std::unordered_map<std::string_view, Symbol> m_Symbols;
+	};
+
+	Shard& ShardOf(std::string_view string);
+
+private:
+	Shard m_Shards[ShardCount];
+};
@@ -1,8 +1,11 @@
 #include "Tester.h"
 
+#include <array>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 
 static std::vector<std::string> SplitString(const std::string& txt, char ch, bool includeLast = true)
 {
@@ -29,6 +32,7 @@ static std::vector<std::string> SplitString(const std::string& txt, char ch, boo
 Tester::Tester(const std::string& buildDir)
 {
 	m_FolderPath = "Programs\\Tests";
+	m_InterpreterFolderPath = "Programs/InterpreterTests";
 	m_BuildDir = buildDir;
 }
 
@@ -132,6 +136,77 @@ bool Tester::RunTests()
 	return passedAllTests;
 }
 
+// Runs the program with one of the interpreters and returns what it printed
+static std::string RunInterpreter(const std::string& executable, const std::string& engine, const std::string& path)
+{
+	std::string command = "\"" + executable + "\" -q -" + engine + " -f \"" + path + "\"";
+#ifdef _WIN32
+	// cmd removes the first and the last quote of the command when there are more than two
+	command = "\"" + command + "\"";
+#endif
+
+	std::array<char, 128> buffer;
+	std::string result;
+	std::unique_ptr<FILE, decltype(&_pclose)> pipe(_popen(command.c_str(), "r"), _pclose);
+	if (!pipe)
+		return "";
+
+	while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr)
+		result += buffer.data();
+
+	return result;
+}
+
+bool Tester::RunInterpreterTests(const std::string& executable)
+{
+	bool passedAllTests = true;
+
+	namespace fs = std::filesystem;
+
+	for (const auto& entry : fs::directory_iterator(m_InterpreterFolderPath))
+	{
+		// Every program has the output it should print next to it
+		if (entry.path().extension() != ".result")
+			continue;
+
+		std::string testPath = entry.path().parent_path().string() + "/" + entry.path().stem().string();
+
+		std::ifstream resultFile(entry.path());
+		std::string expectedResult = "";
+		for (std::string line; std::getline(resultFile, line);)
+		{
+			if (line != "")
+				expectedResult += line + "\n";
+		}
+
+		std::cout << "Testing file " << testPath << ":\n\n";
+
+		for (const std::string engine : { "ast", "ast-stack", "closure", "bytecode" })
+		{
+			std::string result = RunInterpreter(executable, engine, testPath);
+
+			auto resultLines = SplitString(result, '\n', false);
+			auto expectedResultLines = SplitString(expectedResult, '\n', false);
+
+			if (resultLines == expectedResultLines)
+			{
+				std::cout << engine << ": Passed\n";
+			}
+			else
+			{
+				std::cout << engine << ": Failed\n";
+				std::cout << "Program output:\n" << result;
+				std::cout << "\nExpected:\n" << expectedResult << "\n";
+				passedAllTests = false;
+			}
+		}
+
+		std::cout << "\n";
+	}
+
+	return passedAllTests;
+}
+
 Tester::~Tester()
 {
 }
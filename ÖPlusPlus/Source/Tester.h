@@ -11,10 +11,15 @@ public:
 
 	bool RunTests();
 
+	// Runs the programs that need more than the ASM backend supports with the interpreters,
+	// by starting the executable once for each of them
+	bool RunInterpreterTests(const std::string& executable);
+
 	~Tester();
 private:
 	std::vector<ASM::AssemblyRunner> testInstances;
 
 	std::string m_FolderPath;
+	std::string m_InterpreterFolderPath;
 	std::string m_BuildDir;
 };
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threadCount)
+{
+	if (threadCount <= 0)
+		threadCount = (int)std::thread::hardware_concurrency();
+
+	for (int i = 1; i < threadCount; i++)
+		m_Threads.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_IsStopping = true;
+	}
+
+	m_BatchStarted.notify_all();
+
+	for (std::thread& thread : m_Threads)
+		thread.join();
+}
+
+void ThreadPool::ForEach(int count, const std::function<void(int)>& function)
+{
+	if (m_Threads.empty() || count <= 1)
+	{
+		for (int i = 0; i < count; i++)
+			function(i);
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Function = &function;
+		m_Count = count;
+		m_NextIndex = 0;
+		m_BusyWorkers = (int)m_Threads.size();
+		m_Batch++;
+	}
+
+	m_BatchStarted.notify_all();
+
+	RunBatch();
+
+	// The function has to outlive the workers' calls to it
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_BatchDone.wait(lock, [&] { return m_BusyWorkers == 0; });
+	m_Function = nullptr;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	uint64_t lastBatch = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_BatchStarted.wait(lock, [&] { return m_IsStopping || m_Batch != lastBatch; });
+
+			if (m_IsStopping)
+				return;
+
+			lastBatch = m_Batch;
+		}
+
+		RunBatch();
+
+		bool isLast = false;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			isLast = --m_BusyWorkers == 0;
+		}
+
+		if (isLast)
+			m_BatchDone.notify_one();
+	}
+}
+
+void ThreadPool::RunBatch()
+{
+	for (int i = m_NextIndex++; i < m_Count; i = m_NextIndex++)
+		(*m_Function)(i);
+}
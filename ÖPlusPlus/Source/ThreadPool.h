@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// Threads that are started once and then used for one batch of work at a time. The calling thread works on the batch too,
+// so a pool with one thread doesn't start any and runs everything on the caller
+class ThreadPool
+{
+public:
+	// Zero threads is one for each core
+	ThreadPool(int threadCount = 0);
+	~ThreadPool();
+
+	int GetThreadCount() { return (int)m_Threads.size() + 1; }
+
+	// Calls the function with every index from 0 to count, on all the threads. The indices are taken in order, so the
+	// largest work should have the lowest ones. Returns when all the calls have returned
+	void ForEach(int count, const std::function<void(int)>& function);
+
+private:
+	void WorkerLoop();
+	void RunBatch();
+
+private:
+	std::vector<std::thread> m_Threads;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_BatchStarted;
+	std::condition_variable m_BatchDone;
+
+	// Changes for every batch, so that a worker doesn't run the same one twice
+	uint64_t m_Batch = 0;
+	bool m_IsStopping = false;
+
+	const std::function<void(int)>* m_Function = nullptr;
+	int m_Count = 0;
+	std::atomic<int> m_NextIndex{ 0 };
+
+	// The workers that haven't finished the current batch yet
+	int m_BusyWorkers = 0;
+};
@@ -7,7 +7,8 @@
 enum class ExecutionMethods {
 	Assembly,
 	AST,
-	Bytecode
+	Bytecode,
+	Closure
 };
 
 namespace ExecutionMethods_Global 